@@ -10,7 +10,7 @@ uint64_t rnd (uint64_t m)
      return r % m;
    }
 
-uint64_t check (hybridBV B)
+uint64_t check (hybridNode B)
 
    { uint64_t l,r,s;
      if (B->type == tDynamic) {
@@ -22,7 +22,16 @@ uint64_t check (hybridBV B)
 	   }
         return l+r;
 	}
-     return hybridLeaves(B);
+     if ((B->type == tLeaf) || (B->type == tRLE) || (B->type == tArray)) 
+	return 1;
+     if (B->type == tWide) return B->bv.wide->leaves;
+     if (B->type == tUniform) 
+	return (B->bv.uni/2+leafNewSize()*w-1)/(leafNewSize()*w);
+     if (B->type == tRRR) 
+	return (rrrLength(B->bv.rrr)+leafNewSize()*w-1)/(leafNewSize()*w);
+     if (B->type == tEF) 
+	return (efLength(B->bv.ef)+leafNewSize()*w-1)/(leafNewSize()*w);
+     return (staticLength(B->bv.stat)+leafNewSize()*w-1)/(leafNewSize()*w);
    }
 
 void main (int argc, char **argv)
@@ -58,7 +67,7 @@ void main (int argc, char **argv)
 
      times(&t1);
 
-     B = hybridCreateFrom(data,n);
+     B = hybridCreateFrom(data,n,NULL);
 
      for (i=0;i<m;i++)
 	{ if (rnd(1000000000) < alphaUpd * 1000000000)
@@ -79,7 +88,7 @@ void main (int argc, char **argv)
 	     u,m,alphaUpd,
 	     (t2.tms_utime-t1.tms_utime)/(float)sysconf(_SC_CLK_TCK)*1000000/(float)m);
 */
-   //  printf("   %li hojas\n",check (B));
+   //  printf("   %li hojas\n",check (B->root));
 
      hybridDestroy(B);
      exit(0);
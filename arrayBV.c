@@ -0,0 +1,362 @@
+
+/*
+
+HybridBV -- an implementation of adaptive dynamic bitvectors. 
+Copyright (C) 2024-current_year Gonzalo Navarro
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+Author's contact: Gonzalo Navarro, Dept. of Computer Science, University of
+Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
+
+*/
+
+#include "arrayBV.h"
+
+static const uint ClassLine = 64; // capacities grow by this many bytes
+static const float ClassGrowth = 1.25; // capacity ratio of consecutive classes
+static const float ShrinkFill = 0.75; // shrink when fits in this fraction 
+				      // of the previous class
+
+        // trick for lowest 1 in a 64-bit word, as in staticBV.c
+static int decodeLow[64] = {
+       0, 1,56, 2,57,49,28, 3,61,58,42,50,38,29,17, 4,
+      62,47,59,36,45,43,51,22,53,39,33,30,24,18,12, 5,
+      63,55,48,27,60,41,37,16,46,35,44,21,52,32,23,11,
+      54,26,40,15,34,20,31,10,25,14,19, 9,13, 8, 7, 6 };
+
+static inline uint lowest (uint64_t x)
+
+   { return decodeLow[(0x03f79d71b4ca8b09 * (x & -x))>>58];
+   }
+
+	// number of 1s of B before position i, by binary search
+
+static inline uint find (arrayBV B, uint i)
+
+   { uint l,r,m;
+     l = 0; r = B->ones;
+     while (l < r)
+	{ m = (l+r)/2;
+	  if (B->pos[m] < i) l = m+1; else r = m;
+	}
+     return l;
+   }
+
+	// gives the number of 1s of the n bits of data, or a number over
+	// max if there are more than max
+
+uint arrayCountOnes (uint64_t *data, uint n, uint max)
+
+   { uint k,nw,ones;
+     nw = n/w;
+     ones = 0;
+     for (k=0;k<nw;k++)
+	{ if (data[k]) ones += popcount(data[k]);
+	  if (ones > max) return ones;
+	}
+     if (n % w) ones += popcount(data[nw] & ((((uint64_t)1) << (n%w))-1));
+     return ones;
+   }
+
+	// creates empty pools for arrays
+
+arrayPools arrayPoolsCreate (void)
+
+   { arrayPools P = (arrayPools)myalloc(sizeof(struct s_arrayPools));
+     uint lines,next,cap;
+     P->nclasses = 0;
+     lines = 1;
+     do { cap = (lines*ClassLine - sizeof(struct s_arrayBV)) / sizeof(uint16_t);
+	  if ((cap >= MaxPositions) || (P->nclasses == MaxArrayClasses-1))
+	     cap = MaxPositions;
+	  P->cap[P->nclasses] = cap;
+	  P->blocks[P->nclasses] = NULL; // created on its first array
+	  P->nclasses++;
+	  next = lines * ClassGrowth;
+	  lines = max(lines+1,next);
+	}
+     while (cap < MaxPositions);
+     return P;
+   }
+
+	// destroys P, releasing at once all the arrays taken from it
+
+void arrayPoolsDestroy (arrayPools P)
+
+   { uint c;
+     for (c=0;c<P->nclasses;c++) 
+	if (P->blocks[c] != NULL) poolDestroy(P->blocks[c]);
+     myfree(P);
+   }
+
+	// releases the slabs of P that became free, as poolTrim
+
+void arrayPoolsTrim (arrayPools P)
+
+   { uint c;
+     for (c=0;c<P->nclasses;c++) 
+	if (P->blocks[c] != NULL) poolTrim(P->blocks[c]);
+   }
+
+	// releases the slabs of P that hold no array in use
+
+void arrayPoolsCompact (arrayPools P)
+
+   { uint c;
+     for (c=0;c<P->nclasses;c++) 
+	if (P->blocks[c] != NULL) poolCompact(P->blocks[c]);
+   }
+
+	// gives space allocated by P, in w-bit words
+
+uint64_t arrayPoolsSpace (arrayPools P)
+
+   { uint64_t s = (sizeof(struct s_arrayPools)*8+w-1)/w;
+     uint c;
+     for (c=0;c<P->nclasses;c++) 
+	if (P->blocks[c] != NULL) s += poolSpace(P->blocks[c]);
+     return s;
+   }
+
+	// gives space allocated by P and not in use, in w-bit words
+
+uint64_t arrayPoolsOverhead (arrayPools P)
+
+   { uint64_t s = (sizeof(struct s_arrayPools)*8+w-1)/w;
+     uint c;
+     for (c=0;c<P->nclasses;c++) 
+	if (P->blocks[c] != NULL) s += poolOverhead(P->blocks[c]);
+     return s;
+   }
+
+	// takes from P an array of class c
+
+static arrayBV newArray (arrayPools P, uint c)
+
+   { arrayBV B;
+     if (P->blocks[c] == NULL)
+	P->blocks[c] = poolCreate(sizeof(struct s_arrayBV) + 
+				  P->cap[c] * sizeof(uint16_t));
+     B = (arrayBV)poolAlloc(P->blocks[c]);
+     B->cap = P->cap[c];
+     B->cls = c;
+     return B;
+   }
+
+	// smallest class of P where ones 1s fit
+
+static uint fitClass (arrayPools P, uint ones)
+
+   { uint c = 0;
+     while (ones > P->cap[c]) c++;
+     return c;
+   }
+
+	// converts a bit array of at most MaxPositions 1s into an arrayBV 
+	// of n bits, taken from P. data is not freed
+
+arrayBV arrayCreateFrom (uint64_t *data, uint n, arrayPools P)
+
+   { arrayBV B = newArray(P,fitClass(P,arrayCountOnes(data,n,MaxPositions)));
+     uint64_t x;
+     uint k;
+     B->size = n;
+     B->ones = 0;
+     for (k=0;k<(n+w-1)/w;k++)
+	{ x = data[k];
+	  if ((k+1)*w > n) x &= (((uint64_t)1) << (n%w))-1;
+	  while (x)
+	     { B->pos[B->ones++] = k*w + lowest(x);
+	       x &= x-1;
+	     }
+	}
+     return B;
+   }
+
+	// destroys B, returning it to P
+
+void arrayDestroy (arrayBV B, arrayPools P)
+
+   { poolFree(P->blocks[B->cls],B);
+   }
+
+	// gives an array with the content of B and room for ones 1s,
+	// arrayOnes(B) <= ones <= MaxPositions. B is moved to a larger class
+	// if they do not fit, or to a smaller one if they use little of its
+	// class. B should not be used anymore, only the returned array
+
+arrayBV arrayResize (arrayBV B, uint ones, arrayPools P)
+
+   { arrayBV NB;
+     uint c;
+     if (ones > B->cap) c = fitClass(P,ones);
+     else if ((B->cls > 0) && (ones <= P->cap[B->cls-1]*ShrinkFill))
+	c = fitClass(P,ones);
+     else return B;
+     NB = newArray(P,c);
+     NB->size = B->size;
+     NB->ones = B->ones;
+     memcpy(NB->pos,B->pos,B->ones*sizeof(uint16_t));
+     poolFree(P->blocks[B->cls],B);
+     return NB;
+   }
+
+	// gives space of B in w-bit words
+
+uint arraySpace (arrayBV B)
+
+   { return (sizeof(struct s_arrayBV) + B->cap*sizeof(uint16_t) + 
+	     sizeof(uint64_t)-1) / sizeof(uint64_t);
+   }
+
+	// gives bit length
+
+extern inline uint arrayLength (arrayBV B)
+
+   { return B->size;
+   }
+
+	// gives number of 1s
+
+extern inline uint arrayOnes (arrayBV B)
+
+   { return B->ones;
+   }
+
+       // sets value for B[i]= (v != 0), assumes i is right and that B 
+	// has room for another 1 if v != 0. returns difference in 1s
+
+int arrayWrite (arrayBV B, uint i, uint v)
+
+   { uint k = find(B,i);
+     uint b = (k < B->ones) && (B->pos[k] == i);
+     v = (v != 0);
+     if (b == v) return 0;
+     if (v)
+	{ memmove(B->pos+k+1,B->pos+k,(B->ones-k)*sizeof(uint16_t));
+	  B->pos[k] = i;
+	  B->ones++;
+	  return 1;
+	}
+     memmove(B->pos+k,B->pos+k+1,(B->ones-k-1)*sizeof(uint16_t));
+     B->ones--;
+     return -1;
+   }
+
+        // inserts v at B[i], assumes i is right and that B has room for
+	// another 1 if v != 0
+
+void arrayInsert (arrayBV B, uint i, uint v)
+
+   { uint k,j;
+     k = find(B,i);
+     for (j=k;j<B->ones;j++) B->pos[j]++;
+     B->size++;
+     if (v)
+	{ memmove(B->pos+k+1,B->pos+k,(B->ones-k)*sizeof(uint16_t));
+	  B->pos[k] = i;
+	  B->ones++;
+	}
+   }
+
+        // deletes B[i], assumes i is right
+        // returns difference in 1s
+
+int arrayDelete (arrayBV B, uint i)
+
+   { uint k,j,v;
+     k = find(B,i);
+     v = (k < B->ones) && (B->pos[k] == i);
+     if (v) 
+	{ memmove(B->pos+k,B->pos+k+1,(B->ones-k-1)*sizeof(uint16_t));
+	  B->ones--;
+	}
+     for (j=k;j<B->ones;j++) B->pos[j]--;
+     B->size--;
+     return - (int)v;
+   }
+
+	// access B[i], assumes i is right
+
+uint arrayAccess (arrayBV B, uint i)
+
+   { uint k = find(B,i);
+     return (k < B->ones) && (B->pos[k] == i);
+   }
+
+        // read bits [i..i+l-1], onto D[j...]
+
+void arrayRead (arrayBV B, uint i, uint l, uint64_t *D, uint64_t j)
+
+   { uint64_t zeros[16];
+     uint k,d,len;
+     if (l == 0) return;
+     memset(zeros,0,sizeof(zeros));
+     for (d=0;d<l;d+=len) // clears the target first
+	{ len = min(l-d,16*w);
+	  copyBits(D,j+d,zeros,0,len);
+	}
+     for (k=find(B,i);(k < B->ones) && (B->pos[k] < i+l);k++)
+	D[(j+B->pos[k]-i)/w] |= ((uint64_t)1) << ((j+B->pos[k]-i)%w);
+   }
+
+	// computes rank(B,i), zero-based, assumes i is right
+
+uint arrayRank (arrayBV B, uint i)
+
+   { return find(B,i+1);
+   }
+
+	// computes select_1(B,j), zero-based, assumes j is right
+
+uint arraySelect (arrayBV B, uint j)
+
+   { return B->pos[j-1];
+   }
+
+	// computes select_0(B,j), zero-based, assumes j is right
+
+uint arraySelect0 (arrayBV B, uint j)
+
+   { uint l,r,m;
+     l = 0; r = B->ones; // the 0 is before the 1 number l
+     while (l < r)
+	{ m = (l+r)/2;
+	  if (B->pos[m]-m < j) l = m+1; else r = m;
+	}
+     return j-1+l;
+   }
+
+        // computes next_1(B,i), zero-based and including i
+        // returns -1 if no answer
+
+int arrayNext (arrayBV B, uint i)
+
+   { uint k = find(B,i);
+     if (k == B->ones) return -1;
+     return B->pos[k];
+   }
+
+        // computes next_0(B,i), zero-based and including i
+        // returns -1 if no answer
+
+int arrayNext0 (arrayBV B, uint i)
+
+   { uint k = find(B,i);
+     while ((k < B->ones) && (B->pos[k] == i)) { k++; i++; }
+     if (i >= B->size) return -1;
+     return i;
+   }
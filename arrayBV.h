@@ -0,0 +1,141 @@
+
+/*
+
+HybridBV -- an implementation of adaptive dynamic bitvectors. 
+Copyright (C) 2024-current_year Gonzalo Navarro
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+Author's contact: Gonzalo Navarro, Dept. of Computer Science, University of
+Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
+
+*/
+
+#ifndef INCLUDEDarrayBV
+#define INCLUDEDarrayBV
+
+	// supports leaf bitvectors of size up to 2^16 with few 1s, stored
+	// as the sorted array of their positions
+
+#include "basics.h"
+#include "pool.h"
+
+#define ArrayRatio 16 // a leaf with one 1 per ArrayRatio bits or more must
+		      // be stored as plain bits, which then take less space
+#define MaxPositions 4096 // max 1s of a leaf, 2^16/ArrayRatio
+#define MaxArrayClasses 32 // max number of array capacities
+
+	// 16-bit positions suffice because leaves hold at most 
+	// leafMaxSize()*w <= 2^16 bits. the counters and the positions share
+	// a single block, whose capacity is one of a few size classes growing
+	// geometrically up to MaxPositions, as for leafBVs
+typedef struct s_arrayBV
+   { uint size; // bits represented
+     uint ones; // # 1s
+     uint cap; // positions it has room for
+     uint cls; // size class
+     uint16_t pos[]; // positions of the 1s, increasing
+   } *arrayBV;
+
+	// pools the arrays of a structure are taken from, one per size class
+typedef struct s_arrayPools
+   { uint nclasses;
+     uint cap[MaxArrayClasses]; // positions of each class, increasing
+     pool blocks[MaxArrayClasses]; // s_arrayBV with their positions, NULL
+				   // until used
+   } *arrayPools;
+
+	// creates empty pools for arrays
+arrayPools arrayPoolsCreate (void);
+
+	// destroys P, releasing at once all the arrays taken from it
+void arrayPoolsDestroy (arrayPools P);
+
+	// releases the slabs of P that became free, as poolTrim
+void arrayPoolsTrim (arrayPools P);
+
+	// releases the slabs of P that hold no array in use
+void arrayPoolsCompact (arrayPools P);
+
+	// gives space allocated by P, in w-bit words
+uint64_t arrayPoolsSpace (arrayPools P);
+
+	// gives space allocated by P and not in use, in w-bit words
+uint64_t arrayPoolsOverhead (arrayPools P);
+
+	// gives the number of 1s of the n bits of data, or a number over
+	// max if there are more than max
+uint arrayCountOnes (uint64_t *data, uint n, uint max);
+
+	// converts a bit array of at most MaxPositions 1s into an arrayBV 
+	// of n bits, taken from P. data is not freed
+arrayBV arrayCreateFrom (uint64_t *data, uint n, arrayPools P);
+
+	// destroys B, returning it to P
+void arrayDestroy (arrayBV B, arrayPools P);
+
+	// gives an array with the content of B and room for ones 1s,
+	// arrayOnes(B) <= ones <= MaxPositions. B is moved to a larger class
+	// if they do not fit, or to a smaller one if they use little of its
+	// class. B should not be used anymore, only the returned array
+arrayBV arrayResize (arrayBV B, uint ones, arrayPools P);
+
+	// gives space of B in w-bit words
+uint arraySpace (arrayBV B);
+
+	// gives bit length
+extern inline uint arrayLength (arrayBV B);
+
+	// gives number of 1s
+extern inline uint arrayOnes (arrayBV B);
+
+       // sets value for B[i]= (v != 0), assumes i is right and that B 
+	// has room for another 1 if v != 0. returns difference in 1s
+int arrayWrite (arrayBV B, uint i, uint v);
+
+        // inserts v at B[i], assumes i is right and that B has room for
+	// another 1 if v != 0
+void arrayInsert (arrayBV B, uint i, uint v);
+
+        // deletes B[i], assumes i is right
+        // returns difference in 1s
+int arrayDelete (arrayBV B, uint i);
+
+	// access B[i], assumes i is right
+uint arrayAccess (arrayBV B, uint i);
+
+        // read bits [i..i+l-1], onto D[j...]
+void arrayRead (arrayBV B, uint i, uint l, uint64_t *D, uint64_t j);
+
+	// computes rank_1(B,i), zero-based, assumes i is right
+uint arrayRank (arrayBV B, uint i);
+
+	// computes select_1(B,j), zero-based, assumes j is right
+uint arraySelect (arrayBV B, uint j);
+
+	// computes select_0(B,j), zero-based, assumes j is right
+uint arraySelect0 (arrayBV B, uint j);
+
+        // computes next_1(B,i), zero-based and including i
+        // returns -1 if no answer
+
+int arrayNext (arrayBV B, uint i);
+
+        // computes next_0(B,i), zero-based and including i
+        // returns -1 if no answer
+
+int arrayNext0 (arrayBV B, uint i);
+
+#endif
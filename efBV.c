@@ -0,0 +1,353 @@
+
+/*
+
+HybridBV -- an implementation of adaptive dynamic bitvectors. 
+Copyright (C) 2024-current_year Gonzalo Navarro
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+Author's contact: Gonzalo Navarro, Dept. of Computer Science, University of
+Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
+
+*/
+
+#include "efBV.h"
+
+#define SS 256 // 1s or 0s of high between samples
+
+        // trick for lowest 1 in a 64-bit word, as in staticBV.c
+static int decodeLow[64] = {
+       0, 1,56, 2,57,49,28, 3,61,58,42,50,38,29,17, 4,
+      62,47,59,36,45,43,51,22,53,39,33,30,24,18,12, 5,
+      63,55,48,27,60,41,37,16,46,35,44,21,52,32,23,11,
+      54,26,40,15,34,20,31,10,25,14,19, 9,13, 8, 7, 6 };
+
+static inline uint lowest (uint64_t x)
+
+    { return decodeLow[(0x03f79d71b4ca8b09 * (x & -x))>>58];
+    }
+
+	// position of the jth 1 of x, j >= 1, skipping bytes first
+
+static inline uint selectWord (uint64_t x, uint j)
+
+    { uint p = 0;
+      uint c;
+      while ((c = popcount(x & 0xff)) < j)
+	 { j -= c; x >>= 8; p += 8; }
+      while (--j) x &= x-1;
+      return p + lowest(x);
+    }
+
+	// reads the l < w low bits of the kth 1 of B
+
+static inline uint64_t getLow (efBV B, uint64_t k)
+
+    { uint64_t p = k*B->lbits;
+      uint64_t x;
+      if (B->lbits == 0) return 0;
+      x = B->low[p/w] >> (p%w);
+      if ((p%w)+B->lbits > w) x |= B->low[p/w+1] << (w-(p%w));
+      return x & ((((uint64_t)1) << B->lbits) - 1);
+    }
+
+	// position in high of its kth 1, zero-based
+
+static inline uint64_t highSelect1 (efBV B, uint64_t k)
+
+    { uint64_t p = B->sel1[k/SS];
+      uint64_t j = k%SS + 1;
+      uint64_t x = B->high[p/w] & ((~(uint64_t)0) << (p%w));
+      uint c;
+      p /= w;
+      while ((c = popcount(x)) < j)
+	 { j -= c; x = B->high[++p]; }
+      return p*w + selectWord(x,j);
+    }
+
+	// position in high of its kth 0, zero-based
+
+static inline uint64_t highSelect0 (efBV B, uint64_t k)
+
+    { uint64_t p = B->sel0[k/SS];
+      uint64_t j = k%SS + 1;
+      uint64_t x = ~B->high[p/w] & ((~(uint64_t)0) << (p%w));
+      uint c;
+      p /= w;
+      while ((c = popcount(x)) < j)
+	 { j -= c; x = ~B->high[++p]; }
+      return p*w + selectWord(x,j);
+    }
+
+	// position of the next 1 of high from p, which must exist
+
+static inline uint64_t highNext (efBV B, uint64_t p)
+
+    { uint64_t x = B->high[p/w] & ((~(uint64_t)0) << (p%w));
+      p /= w;
+      while (!x) x = B->high[++p];
+      return p*w + lowest(x);
+    }
+
+	// position of the kth 1 of B, zero-based, being p its position in high
+
+static inline uint64_t position (efBV B, uint64_t k, uint64_t p)
+
+    { return ((p-k) << B->lbits) | getLow(B,k);
+    }
+
+	// low bits for n bits with the given ones
+
+static uint lowBits (uint64_t n, uint64_t ones)
+
+    { uint l = 0;
+      while ((l < w-1) && (ones << (l+1) <= n) && (ones << (l+1) >> (l+1) == ones))
+	 l++;
+      return l;
+    }
+
+	// finds the first 1 of B at position >= i, giving its index k and
+	// its position p in high. k = ones if there is none
+
+static inline void locate (efBV B, uint64_t i, uint64_t *k, uint64_t *p)
+
+    { uint64_t x = i >> B->lbits;
+      uint64_t lo = i & ((((uint64_t)1) << B->lbits) - 1);
+      *p = x ? highSelect0(B,x-1)+1 : 0; // start of bucket x
+      *k = *p - x;
+      while ((*k < B->ones) && ((B->high[*p/w] >> (*p%w)) & 1) &&
+	     (getLow(B,*k) < lo))
+	  { (*k)++; (*p)++; }
+      if ((*k < B->ones) && !((B->high[*p/w] >> (*p%w)) & 1))
+	 *p = highNext(B,*p); // the first 1 after bucket x
+    }
+
+	// allocates an Elias-Fano bitvector of n bits with the given ones,
+	// to be filled with put and finished with sample0
+
+static efBV alloc (uint64_t n, uint64_t ones)
+
+    { efBV B = (efBV)myalloc(sizeof(struct s_efBV));
+      B->size = n;
+      B->ones = ones;
+      B->lbits = lowBits(n,ones);
+      B->hsize = ones + (n >> B->lbits) + 1;
+      B->low = (uint64_t*)mycalloc((ones*B->lbits)/w+2,sizeof(uint64_t));
+      B->high = (uint64_t*)mycalloc(B->hsize/w+2,sizeof(uint64_t));
+      B->sel1 = (uint64_t*)myalloc((ones/SS+1)*sizeof(uint64_t));
+      B->sel0 = (uint64_t*)myalloc(((B->hsize-ones)/SS+1)*sizeof(uint64_t));
+      B->sel1[0] = 0;
+      return B;
+    }
+
+	// sets p as the position of the kth 1 of B, in increasing order of k
+
+static inline void put (efBV B, uint64_t k, uint64_t p)
+
+    { if (B->lbits) 
+	 { B->low[(k*B->lbits)/w] |= 
+	      (p & ((((uint64_t)1) << B->lbits) - 1)) << ((k*B->lbits)%w);
+	   if (((k*B->lbits)%w)+B->lbits > w)
+	      B->low[(k*B->lbits)/w+1] |= 
+		 (p & ((((uint64_t)1) << B->lbits) - 1)) >> 
+		 (w-((k*B->lbits)%w));
+	 }
+      p = (p >> B->lbits) + k;
+      B->high[p/w] |= ((uint64_t)1) << (p%w);
+      if (k % SS == 0) B->sel1[k/SS] = p;
+    }
+
+	// samples the 0s of high once all the 1s are put
+
+static void sample0 (efBV B)
+
+    { uint64_t p,z;
+      z = 0;
+      for (p=0;p<B->hsize;p++)
+	  if (!((B->high[p/w] >> (p%w)) & 1))
+	     { if (z % SS == 0) B->sel0[z/SS] = p;
+	       z++;
+	     }
+    }
+
+	// converts a bit array into an Elias-Fano bitvector of n bits
+	// data is not freed
+
+efBV efCreateFrom (uint64_t *data, uint64_t n)
+
+    { efBV B;
+      uint64_t i,k,x,ones;
+      ones = 0;
+      for (i=0;i<n/w;i++) if (data[i]) ones += popcount(data[i]);
+      if (n % w) ones += popcount(data[n/w] & ((((uint64_t)1) << (n%w)) - 1));
+      B = alloc(n,ones);
+      k = 0;
+      for (i=0;i<(n+w-1)/w;i++)
+	  { x = data[i];
+	    if ((i == n/w) && (n % w)) x &= (((uint64_t)1) << (n%w)) - 1;
+	    while (x)
+	       { put(B,k++,i*w + lowest(x));
+		 x &= x-1;
+	       }
+	  }
+      sample0(B);
+      return B;
+    }
+
+	// creates an Elias-Fano bitvector of n bits whose 1s are at the
+	// ones increasing positions pos[k]-off, all in [0..n-1]. pos is 
+	// not freed
+
+efBV efCreateFromPositions (uint64_t *pos, uint64_t ones, uint64_t n,
+			    uint64_t off)
+
+    { efBV B = alloc(n,ones);
+      uint64_t k;
+      for (k=0;k<ones;k++) put(B,k,pos[k]-off);
+      sample0(B);
+      return B;
+    }
+
+	// gives the space in w-bit words that an Elias-Fano bitvector of n 
+	// bits with the given ones uses
+
+uint64_t efEstimate (uint64_t n, uint64_t ones)
+
+    { uint l = lowBits(n,ones);
+      uint64_t hsize = ones + (n >> l) + 1;
+      return sizeof(struct s_efBV)*8/w + (ones*l)/w+2 + hsize/w+2 +
+	     ones/SS+1 + (hsize-ones)/SS+1;
+    }
+
+	// destroys B
+
+void efDestroy (efBV B)
+
+    { if (B != NULL) 
+         { myfree(B->low); myfree(B->high);
+	   myfree(B->sel1); myfree(B->sel0);
+      	   myfree(B);
+	 }
+    }
+
+	// efBV size in w-bit words
+
+uint64_t efSpace (efBV B)
+
+    { if (B == NULL) return 0;
+      return efEstimate(B->size,B->ones);
+    }
+
+        // gives bit length
+
+extern inline uint64_t efLength (efBV B)
+
+    { return B->size;
+    }
+
+        // gives number of ones
+
+extern inline uint64_t efOnes (efBV B)
+
+    { return B->ones;
+    }
+
+	// access B[i], assumes i is right
+
+uint efAccess (efBV B, uint64_t i)
+
+    { uint64_t k,p;
+      locate(B,i,&k,&p);
+      return (k < B->ones) && (position(B,k,p) == i);
+    }
+
+        // read bits [i..i+l-1] onto D[j..], assumes it is right
+        
+void efRead (efBV B, uint64_t i, uint64_t l, uint64_t *D, uint64_t j)
+
+    { uint64_t zeros[16];
+      uint64_t k,p,pos,len,d;
+      if (l == 0) return;
+      memset(zeros,0,sizeof(zeros));
+      for (d=0;d<l;d+=len) // clears the target first
+	  { len = min(l-d,16*w);
+	    copyBits(D,j+d,zeros,0,len);
+	  }
+      locate(B,i,&k,&p);
+      while (k < B->ones)
+	 { pos = position(B,k,p);
+	   if (pos >= i+l) break;
+	   D[(j+pos-i)/w] |= ((uint64_t)1) << ((j+pos-i)%w);
+	   k++;
+	   if (k < B->ones) p = highNext(B,p+1);
+	 }
+    }
+
+	// computes rank(B,i), zero-based, assumes i is right
+
+uint64_t efRank (efBV B, uint64_t i)
+
+    { uint64_t k,p;
+      locate(B,i,&k,&p);
+      if ((k < B->ones) && (position(B,k,p) == i)) return k+1;
+      return k;
+    }
+
+        // computes select_1(B,j), zero-based, assumes j is right
+
+uint64_t efSelect (efBV B, uint64_t j)
+
+    { return position(B,j-1,highSelect1(B,j-1));
+    }
+
+        // computes select_0(B,j), zero-based, assumes j is right
+
+uint64_t efSelect0 (efBV B, uint64_t j)
+
+    { uint64_t s,d,m;
+	// binary search for the first 1 with >= j 0s before it
+      s = 0; d = B->ones;
+      while (s < d)
+	 { m = (s+d)/2;
+	   if (efSelect(B,m+1) - m < j) s = m+1; else d = m;
+	 }
+      return j-1 + s; // s 1s before it
+    }
+
+        // computes next_1(B,i), zero-based and including i
+        // returns -1 if no answer
+
+int64_t efNext (efBV B, uint64_t i)
+
+    { uint64_t k,p;
+      locate(B,i,&k,&p);
+      if (k == B->ones) return -1;
+      return position(B,k,p);
+    }
+
+        // computes next_0(B,i), zero-based and including i
+        // returns -1 if no answer
+
+int64_t efNext0 (efBV B, uint64_t i)
+
+    { uint64_t k,p;
+      locate(B,i,&k,&p);
+      while ((k < B->ones) && (position(B,k,p) == i))
+	 { i++; k++; // a run of 1s
+	   if (k < B->ones) p = highNext(B,p+1);
+	 }
+      if (i >= B->size) return -1;
+      return i;
+    }
@@ -0,0 +1,94 @@
+
+/*
+
+HybridBV -- an implementation of adaptive dynamic bitvectors. 
+Copyright (C) 2024-current_year Gonzalo Navarro
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+Author's contact: Gonzalo Navarro, Dept. of Computer Science, University of
+Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
+
+*/
+
+#ifndef INCLUDEDefBV
+#define INCLUDEDefBV
+
+	// supports static bitvectors of size up to 2^64-1 with few 1s, 
+	// Elias-Fano encoded: the positions of the 1s are cut into their
+	// lowest bits, stored in an array, and their highest bits, stored 
+	// in unary in a bitvector with samples to select on it
+
+#include "basics.h"
+
+typedef struct s_efBV {
+    uint64_t size; // number of bits
+    uint64_t ones; // number of 1s
+    uint lbits; // low bits of each position
+    uint64_t *low; // low bits of the positions of the 1s
+    uint64_t *high; // a 1 per 1 and a 0 per bucket of 2^lbits positions
+    uint64_t hsize; // bits in high
+    uint64_t *sel1; // position in high of each SS-th 1
+    uint64_t *sel0; // position in high of each SS-th 0
+    } *efBV;
+
+	// converts a bit array into an Elias-Fano bitvector of n bits
+	// data is not freed
+efBV efCreateFrom (uint64_t *data, uint64_t n);
+
+	// creates an Elias-Fano bitvector of n bits whose 1s are at the
+	// ones increasing positions pos[k]-off, all in [0..n-1]. pos is 
+	// not freed
+efBV efCreateFromPositions (uint64_t *pos, uint64_t ones, uint64_t n,
+			    uint64_t off);
+
+	// gives the space in w-bit words that an Elias-Fano bitvector of n 
+	// bits with the given ones uses
+uint64_t efEstimate (uint64_t n, uint64_t ones);
+
+	// destroys B
+void efDestroy (efBV B);
+
+	// gives space of bitvector in w-bit words
+uint64_t efSpace (efBV B);
+
+	// gives bit length
+extern inline uint64_t efLength (efBV B);
+
+	// gives number of ones
+extern inline uint64_t efOnes (efBV B);
+
+	// access B[i], assumes i is right
+uint efAccess (efBV B, uint64_t i);
+
+        // read bits [i..i+l-1], writes onto D[j..]
+void efRead (efBV B, uint64_t i, uint64_t l, uint64_t *D, uint64_t j);
+
+	// computes rank_1(B,i), zero-based, assumes i is right
+uint64_t efRank (efBV B, uint64_t i);
+
+	// computes select_1(B,j), zero-based, assumes j is right
+uint64_t efSelect (efBV B, uint64_t j);
+
+	// computes select_0(B,j), zero-based, assumes j is right
+uint64_t efSelect0 (efBV B, uint64_t j);
+
+	// computes next_1(B,i), zero-based, assumes i is right
+int64_t efNext (efBV B, uint64_t i);
+
+	// computes next_0(B,i), zero-based, assumes i is right
+int64_t efNext0 (efBV B, uint64_t i);
+
+#endif
@@ -29,8 +29,12 @@ Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
 
 extern float Theta = 0.01; // Theta * length reads => rebuild as static
 
+	// defaults of hybridConfig
+
 static const float Epsilon = 0.1; // do not flatten leaves of size over Epsilon * n
 
+static const uint Fanout = 2; // max children of internal nodes, over 2 uses wideBVs
+
 static const float Alpha = 0.65; // balance factor 3/5 < . < 1
 
 static const float TrfFactor = 0.125; // TrfFactor * MaxLeafSize to justify transferLeft/Right
@@ -40,67 +44,610 @@ static const int MinLeavesToBalance = 5; // min number of leaves to balance the
 static const float MinFillFactor = 0.3; // less than this involves rebuild. 
 				// Must be <= Gamma/2
 
+static const uint64_t DecayPeriod = 0; // operations after which node access
+				// counts are halved, 0 to never decay them
+
+static const uint Sample = 1; // only 1 in Sample queries, chosen at random,
+				// count accesses, each as Sample of them
+
+static const uint LeafGap = 0; // dynamic leaves keep a gap at their last
+				// update, 0 for not
+
+#define MaxDepth 128 // deepest leaf that repairLeaf looks after
+
+static const float MinWideFill = 0.25; // wide children with less than this
+				// fraction of fanout children are merged if possible
+
+static const uint RatioWindow = 65536; // ops after which the counts that 
+				// drive the adaptive theta are halved
+
+static const float CapSlack = 0.9; // under a memory cap, flatten until 
+				// using this fraction of it
+
+static const float CompressRatio = 0.5; // long static parts are compressed,
+				// with RRR or Elias-Fano, if that takes less 
+				// than this fraction of their plain bits
+
+static const uint64_t BuildBits = ((uint64_t)1) << 24; // long bitvectors
+				// built from positions or by chunks are made
+				// of statics of about this many bits
+
+static const uint64_t ReadWords = ((uint64_t)1) << 16; // words read at a
+				// time by hybridCreateFromFile
+
+#define maxChildren(H) (min((H)->conf.fanout,MaxFanout))
+
 	// internal, to study behavior
 extern uint64_t flattenMax = 0;
 extern uint64_t flattenAccess = 0;
 extern uint64_t flattenBalance = 0;
+extern uint64_t balanceRotations = 0;
 extern uint64_t flattenFill = 0;
+extern uint64_t flattenMemory = 0;
+
+	// theta used by H
+
+static inline float theta (hybridBV H)
+
+   { return H->adaptive ? H->theta : H->conf.theta;
+   }
+
+	// whether the current query counts accesses, and the state of the 
+	// xorshift generator that samples them, both per thread
+
+static __thread uint sampled = 1;
+static __thread uint64_t sampleSeed = 88172645463325252ull;
+
+	// decides whether the query starting on H counts accesses
+
+static inline void sampleQuery (hybridBV H)
+
+   { uint64_t x;
+     if (H->conf.sample <= 1) { sampled = 1; return; }
+     x = sampleSeed;
+     x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+     sampleSeed = x;
+     sampled = (x % H->conf.sample == 0);
+   }
+
+	// counts a query on dynamic or wide B, if sampled, as conf.sample 
+	// queries. first halves its count for each period of conf.decay 
+	// operations since its last query
+
+static inline void countAccess (hybridBV H, hybridNode B)
+
+   { uint64_t *accesses,*epoch;
+     uint64_t e;
+     if (!sampled) return;
+     if (B->type == tWide)
+	{ accesses = &B->bv.wide->accesses; epoch = &B->bv.wide->epoch; }
+     else { accesses = &B->bv.dyn->accesses; epoch = &B->bv.dyn->epoch; }
+     if (H->conf.decay)
+	{ e = H->ops / H->conf.decay;
+	  if (e != *epoch)
+	     { *accesses = (e - *epoch >= 64) ? 0 : *accesses >> (e - *epoch);
+	       *epoch = e;
+	     }
+	}
+     *accesses += max(H->conf.sample,1);
+   }
 
-static inline mustFlatten(hybridBV B, uint64_t n)
-  { return ((B->bv.dyn->size <= Epsilon * n) && (B->bv.dyn->accesses >= Theta * B->bv.dyn->size));
-    // return (B->bv.dyn->accesses >= Theta * B->bv.dyn->size);
+static inline int mustFlatten(hybridBV H, hybridNode B, uint64_t n)
+  { uint64_t size,accesses;
+    if (B->type == tWide)
+       { size = B->bv.wide->csize[B->bv.wide->nchildren-1];
+         accesses = B->bv.wide->accesses;
+       }
+    else
+       { size = B->bv.dyn->size;
+         accesses = B->bv.dyn->accesses;
+       }
+    return ((size <= H->conf.epsilon * n) && (accesses >= theta(H) * size));
+    // return (accesses >= H->conf.theta * size);
   }
 
-	// creates an empty hybridBV
+	// length and bit of uniform B
+
+static inline uint64_t uniLength (hybridNode B)
+
+   { return B->bv.uni >> 1;
+   }
+
+static inline uint uniBit (hybridNode B)
+
+   { return B->bv.uni & 1;
+   }
+
+	// B holds no dynamic structure, so updates must split it first
+
+static inline int isStatic (hybridNode B)
+
+   { return (B->type == tStatic) || (B->type == tUniform) || 
+	    (B->type == tRRR) || (B->type == tEF);
+   }
+
+	// B is a leaf of any kind, which mergeLeaves accepts
+
+static inline int isLeaf (hybridNode B)
+
+   { return (B->type == tLeaf) || (B->type == tRLE) || (B->type == tArray);
+   }
+
+	// makes B a uniform node of n bits v
+
+static inline void setUniform (hybridNode B, uint64_t n, uint v)
+
+   { B->type = tUniform;
+     B->bv.uni = (n << 1) | v;
+   }
+
+	// gives bit length
+
+static inline uint64_t nodeLength (hybridNode B)
+
+   { if (B->type == tLeaf) return leafLength(B->bv.leaf);
+     if (B->type == tRLE) return rleLength(B->bv.rle);
+     if (B->type == tArray) return arrayLength(B->bv.arr);
+     if (B->type == tStatic) return staticLength(B->bv.stat);
+     if (B->type == tUniform) return uniLength(B);
+     if (B->type == tRRR) return rrrLength(B->bv.rrr);
+     if (B->type == tEF) return efLength(B->bv.ef);
+     if (B->type == tWide) return B->bv.wide->csize[B->bv.wide->nchildren-1] +
+				 (B->bv.wide->buf ? B->bv.wide->buf->length : 0);
+     return B->bv.dyn->size + (B->bv.dyn->buf ? B->bv.dyn->buf->length : 0);
+   }
+
+	// gives number of ones
+
+static inline uint64_t nodeOnes (hybridNode B)
+
+   { if (B->type == tLeaf) return leafOnes(B->bv.leaf);
+     if (B->type == tRLE) return rleOnes(B->bv.rle);
+     if (B->type == tArray) return arrayOnes(B->bv.arr);
+     if (B->type == tStatic) return staticOnes(B->bv.stat);
+     if (B->type == tUniform) return uniBit(B) ? uniLength(B) : 0;
+     if (B->type == tRRR) return rrrOnes(B->bv.rrr);
+     if (B->type == tEF) return efOnes(B->bv.ef);
+     if (B->type == tWide) return B->bv.wide->cones[B->bv.wide->nchildren-1] +
+				 (B->bv.wide->buf ? B->bv.wide->buf->ones : 0);
+     return B->bv.dyn->ones + (B->bv.dyn->buf ? B->bv.dyn->buf->ones : 0);
+   }
+
+	// gives the updates buffered in B, NULL if none or not internal
+
+static inline hybridBuf nodeBuf (hybridNode B)
+
+   { if (B->type == tWide) return B->bv.wide->buf;
+     if (B->type == tDynamic) return B->bv.dyn->buf;
+     return NULL;
+   }
+
+	// creates a hybridBV configured by C with empty pools and an
+	// uninitialized root
+	// the root is not taken from the pools, so they can be released
+
+static hybridBV create (hybridConfig *C)
+
+   { hybridBV H = (hybridBV)myalloc(sizeof(struct s_hybridBV));
+     if (C) H->conf = *C; else hybridDefaultConfig(&H->conf);
+     H->root = (hybridNode)myalloc(sizeof(struct s_hybridNode));
+     H->nodes = poolCreate(sizeof(struct s_hybridNode));
+     H->dyns = poolCreate(sizeof(struct s_dynamicBV));
+     H->wides = poolCreate(sizeof(struct s_wideBV));
+     H->leaves = leafPoolsCreate();
+     H->runs = poolCreate(sizeof(struct s_rleBV));
+     H->arrays = arrayPoolsCreate();
+     H->statics = 0;
+     H->clock = 0;
+     H->ops = 0;
+     H->underflow = 0;
+     H->cap = 0;
+     H->capFloor = 0;
+     H->adaptive = 0;
+     H->tail = NULL;
+     H->head = H->headOnes = 0;
+     H->front = NULL;
+     H->frontStart = H->frontEnd = 0;
+     H->bufs = NULL;
+     H->cbuffer = 0;
+     H->pending = 0;
+     return H;
+   }
+
+	// creates a static of n bits from data, accounting for its space in H
+
+static staticBV newStatic (hybridBV H, uint64_t *data, uint64_t n)
+
+   { staticBV SB = staticCreateFrom(data,n);
+     H->statics += staticSpace(SB);
+     return SB;
+   }
+
+	// same, reusing the counts of the nparts statics parts[k] copied at
+	// offs[k] of data
+
+static staticBV newStaticFromParts (hybridBV H, uint64_t *data, uint64_t n,
+				    staticBV *parts, uint64_t *offs, uint nparts)
+
+   { staticBV SB = staticCreateFromParts(data,n,parts,offs,nparts);
+     H->statics += staticSpace(SB);
+     return SB;
+   }
+
+	// creates a static with bits [off..off+n-1] of SB, sharing its buffer,
+	// accounting for its space in H
+
+static staticBV newView (hybridBV H, staticBV SB, uint64_t off, uint64_t n)
+
+   { staticBV V = staticView(SB,off,n);
+     H->statics += staticSpace(V);
+     return V;
+   }
+
+	// destroys static SB of H. the statics that share its buffer get
+	// their own bits if they use less than half of it
+
+static void freeStatic (hybridBV H, staticBV SB)
+
+   { H->statics -= staticSpace(SB);
+     H->statics += staticRelease(SB);
+   }
+
+	// the kind of static, tStatic, tRRR or tEF, that best represents n
+	// bits with the given ones
+
+static nodeType staticType (uint64_t n, uint64_t ones)
+
+   { uint64_t r = rrrEstimate(n,ones);
+     uint64_t e = efEstimate(n,ones);
+     float plain = CompressRatio * ((n+w-1)/w);
+     if ((e <= r) && (e < plain)) return tEF;
+     if (r < plain) return tRRR;
+     return tStatic;
+   }
+
+	// makes B a compressed static of the given type with n bits from 
+	// data, accounting for its space in H. data is not freed
+
+static void newCompressed (hybridBV H, hybridNode B, nodeType type,
+			   uint64_t *data, uint64_t n)
+
+   { B->type = type;
+     if (type == tRRR) 
+	{ B->bv.rrr = rrrCreateFrom(data,n);
+	  H->statics += rrrSpace(B->bv.rrr);
+	}
+     else 
+	{ B->bv.ef = efCreateFrom(data,n);
+	  H->statics += efSpace(B->bv.ef);
+	}
+   }
+
+	// destroys the compressed static of B, of H
+
+static void freeCompressed (hybridBV H, hybridNode B)
+
+   { if (B->type == tRRR) 
+	{ H->statics -= rrrSpace(B->bv.rrr);
+	  rrrDestroy(B->bv.rrr);
+	}
+     else 
+	{ H->statics -= efSpace(B->bv.ef);
+	  efDestroy(B->bv.ef);
+	}
+   }
+
+	// makes HB a leaf with the n bits of data, as the positions of its
+	// 1s if they take at most half the bits, or run-length encoded if 
+	// they have few runs. data is not freed
+
+static void makeLeaf (hybridBV H, hybridNode HB, uint64_t *data, uint64_t n)
+
+   { if (arrayCountOnes(data,n,n/(2*ArrayRatio)) <= n/(2*ArrayRatio))
+	{ HB->type = tArray;
+	  HB->bv.arr = arrayCreateFrom(data,n,H->arrays);
+	}
+     else if (rleCountRuns(data,n,MaxRuns/2) <= MaxRuns/2)
+	{ HB->type = tRLE;
+	  HB->bv.rle = rleCreateFrom(data,n,H->runs);
+	}
+     else
+	{ HB->type = tLeaf;
+	  HB->bv.leaf = leafCreateFrom(data,n,0,H->leaves);
+	}
+   }
+
+	// turns run-length encoded or array leaf B into a plain one
 
-hybridBV hybridCreate (void)
+static void plainLeaf (hybridBV H, hybridNode B)
 
-   { hybridBV B = myalloc(sizeof(struct s_hybridBV));
+   { uint64_t n = nodeLength(B);
+     uint64_t *D = (uint64_t*)myalloc(((n+w-1)/w+1)*sizeof(uint64_t));
+     if (B->type == tRLE)
+	{ rleRead(B->bv.rle,0,n,D,0);
+	  rleDestroy(B->bv.rle,H->runs);
+	}
+     else
+	{ arrayRead(B->bv.arr,0,n,D,0);
+	  arrayDestroy(B->bv.arr,H->arrays);
+	}
      B->type = tLeaf;
-     B->bv.leaf = leafCreate();
-     return B;
+     B->bv.leaf = leafCreateFrom(D,n,1,H->leaves);
    }
 
-	// converts a bit array into a hybridBV of n bits
-	// data is pointed to and will be freed 
+	// tells whether the bits of leaf L around position i, L[i-1] and
+	// L[j], are both v or missing. after writing v at L[i] (j = i+1) or
+	// deleting a bit other than v from L[i] (j = i), this is the only
+	// case where the runs of L decrease
+
+static inline int joinsRuns (leafBV L, uint i, uint j, uint v)
+
+   { return ((i == 0) || (leafAccess(L,i-1) == v)) &&
+	    ((j >= leafLength(L)) || (leafAccess(L,j) == v));
+   }
+
+	// turns plain leaf B into a run-length encoded one if it has at most
+	// MaxRuns/2 runs. since it becomes plain again only over MaxRuns
+	// runs, a leaf does not switch back and forth around one limit
+
+static void runsLeaf (hybridBV H, hybridNode B)
+
+   { leafBV L = B->bv.leaf;
+     if (leafRuns(L,MaxRuns/2) > MaxRuns/2) return;
+     leafCloseGap(L);
+     B->type = tRLE;
+     B->bv.rle = rleCreateFrom(L->data,leafLength(L),H->runs);
+     leafDestroy(L,H->leaves);
+   }
+
+	// fills C with the default configuration
+
+void hybridDefaultConfig (hybridConfig *C)
+
+   { C->theta = Theta;
+     C->epsilon = Epsilon;
+     C->alpha = Alpha;
+     C->fanout = Fanout;
+     C->trfFactor = TrfFactor;
+     C->minLeavesToBalance = MinLeavesToBalance;
+     C->minFillFactor = MinFillFactor;
+     C->decay = DecayPeriod;
+     C->sample = Sample;
+     C->gap = LeafGap;
+   }
+
+	// creates an empty hybridBV configured by C, NULL for the default
+
+hybridBV hybridCreate (hybridConfig *C)
+
+   { hybridBV H = create(C);
+     H->root->type = tLeaf;
+     H->root->bv.leaf = leafCreate(H->leaves);
+     return H;
+   }
 
-hybridBV hybridCreateFrom (uint64_t *data, uint64_t n)
+	// tells whether the n > 0 bits of data are all 0s (0) or all 1s (1),
+	// or neither (-1). stops at the first word that shows it is neither
 
-   { hybridBV B = myalloc(sizeof(struct s_hybridBV));
-     if (n > leafNewSize()*w)
+static int uniformBits (uint64_t *data, uint64_t n)
+
+   { uint64_t i,fill,mask;
+     fill = (data[0] & 1) ? ~(uint64_t)0 : 0;
+     for (i=0;i<n/w;i++) if (data[i] != fill) return -1;
+     if (n % w) 
+	{ mask = (((uint64_t)1) << (n % w)) - 1;
+	  if ((data[i] & mask) != (fill & mask)) return -1;
+	}
+     return fill & 1;
+   }
+
+	// counts in *ones the 1s of the n bits of data, and tells whether 
+	// they can be compressed. stops at the first word that shows that
+	// neither the 1s nor the 0s are few enough
+
+static int sparseBits (uint64_t *data, uint64_t n, uint64_t *ones)
+
+   { uint64_t i,s,d,m;
+	// binary search for the most 1s (or 0s) that compress
+     s = 0; d = n/2+1;
+     while (s+1 < d)
+	{ m = (s+d)/2;
+	  if (staticType(n,m) != tStatic) s = m; else d = m;
+	}
+     *ones = 0;
+     for (i=0;i<n/w;i++) 
+	{ if (data[i]) *ones += popcount(data[i]); // mostly 0s if sparse
+	  if ((*ones > s) && ((i+1)*w - *ones > s)) return 0;
+	}
+     if (n % w) *ones += popcount(data[i] & ((((uint64_t)1) << (n % w)) - 1));
+     return staticType(n,*ones) != tStatic;
+   }
+
+	// makes B a node of the n bits of data: uniform, compressed, or 
+	// static if they are long, else a leaf. data is pointed to and 
+	// will be freed
+
+static void bitsNode (hybridBV H, hybridNode B, uint64_t *data, uint64_t n)
+
+   { uint64_t ones;
+     int v;
+     if ((n > leafNewSize()*w) && ((v = uniformBits(data,n)) != -1))
+	{ setUniform(B,n,v);
+	  myfree(data);
+	}
+     else if ((n > leafNewSize()*w) && sparseBits(data,n,&ones))
+	{ newCompressed(H,B,staticType(n,ones),data,n);
+	  myfree(data);
+	}
+     else if (n > leafNewSize()*w)
 	{ B->type = tStatic;
-          B->bv.stat = staticCreateFrom(data,n);
+          B->bv.stat = newStatic(H,data,n);
 	}
      else
-	{ B->type = tLeaf;
-          B->bv.leaf = leafCreateFrom(data,n,1);
+	{ makeLeaf(H,B,data,n);
+	  myfree(data);
 	}
-     return B;
    }
 
-	// destroys B, frees data 
+	// converts a bit array into a hybridBV of n bits
+	// data is pointed to and will be freed. configured by C, NULL for the
+	// default
+
+hybridBV hybridCreateFrom (uint64_t *data, uint64_t n, hybridConfig *C)
+
+   { hybridBV H = create(C);
+     bitsNode(H,H->root,data,n);
+     return H;
+   }
+
+	// frees the static data below B, the rest goes with the pools
+
+static void destroyStatics (hybridNode B)
+
+   { uint k;
+     if (B->type == tStatic) staticDestroy(B->bv.stat);
+     else if (B->type == tRRR) rrrDestroy(B->bv.rrr);
+     else if (B->type == tEF) efDestroy(B->bv.ef);
+     else if (B->type == tWide)
+	  { for (k=0;k<B->bv.wide->nchildren;k++) 
+		destroyStatics(B->bv.wide->child[k]);
+	  }
+     else if (B->type == tDynamic)
+	  { destroyStatics(B->bv.dyn->left);
+            destroyStatics(B->bv.dyn->right);
+	  }
+   }
+
+	// destroys H, frees data. nodes and leaves are released in bulk
+
+void hybridDestroy (hybridBV H)
+
+   { destroyStatics(H->root);
+     myfree(H->root);
+     poolDestroy(H->nodes);
+     poolDestroy(H->dyns);
+     poolDestroy(H->wides);
+     leafPoolsDestroy(H->leaves);
+     poolDestroy(H->runs);
+     arrayPoolsDestroy(H->arrays);
+     myfree(H->front);
+     if (H->bufs) poolDestroy(H->bufs);
+     myfree(H);
+   }
+
+	// returns the buffer *F of an internal node to the pool of H
 
-void hybridDestroy (hybridBV B)
+static void bufDestroy (hybridBV H, hybridBuf *F)
 
-   { if (B->type == tLeaf) leafDestroy(B->bv.leaf);
-     else if (B->type == tStatic) staticDestroy(B->bv.stat);
-     else { hybridDestroy(B->bv.dyn->left);
-            hybridDestroy(B->bv.dyn->right);
-	    myfree(B->bv.dyn);
+   { if (*F == NULL) return;
+     H->pending -= (*F)->n;
+     poolFree(H->bufs,*F);
+     *F = NULL;
+   }
+
+	// destroys B, returns its nodes and leaves to the pools of H
+
+static void nodeDestroy (hybridBV H, hybridNode B)
+
+   { uint k;
+     if (B->type == tLeaf) leafDestroy(B->bv.leaf,H->leaves);
+     else if (B->type == tRLE) rleDestroy(B->bv.rle,H->runs);
+     else if (B->type == tArray) arrayDestroy(B->bv.arr,H->arrays);
+     else if (B->type == tStatic) freeStatic(H,B->bv.stat);
+     else if ((B->type == tRRR) || (B->type == tEF)) freeCompressed(H,B);
+     else if (B->type == tWide)
+	  { for (k=0;k<B->bv.wide->nchildren;k++) 
+		nodeDestroy(H,B->bv.wide->child[k]);
+	    bufDestroy(H,&B->bv.wide->buf);
+	    poolFree(H->wides,B->bv.wide);
 	  }
-     myfree(B);
+     else if (B->type == tDynamic)
+	  { nodeDestroy(H,B->bv.dyn->left);
+            nodeDestroy(H,B->bv.dyn->right);
+	    bufDestroy(H,&B->bv.dyn->buf);
+	    poolFree(H->dyns,B->bv.dyn);
+	  }
+     poolFree(H->nodes,B);
+   }
+
+	// child of W holding position i (the last one if i = size)
+	// branchless count over the cumulative sizes, so it vectorizes
+
+static inline uint wideFind (wideBV W, uint64_t i)
+
+   { uint k,c = 0;
+     for (k=0;k<W->nchildren;k++) c += (W->csize[k] <= i);
+     return c < W->nchildren ? c : W->nchildren-1;
+   }
+
+	// child of W holding the jth 1
+
+static inline uint wideFindOnes (wideBV W, uint64_t j)
+
+   { uint k,c = 0;
+     for (k=0;k<W->nchildren;k++) c += (W->cones[k] < j);
+     return c;
+   }
+
+	// child of W holding the jth 0
+
+static inline uint wideFindZeros (wideBV W, uint64_t j)
+
+   { uint k,c = 0;
+     for (k=0;k<W->nchildren;k++) c += (W->csize[k] - W->cones[k] < j);
+     return c;
+   }
+
+	// bits and 1s in the children of W before the kth
+
+static inline uint64_t wideSizeBefore (wideBV W, uint k)
+
+   { return k ? W->csize[k-1] : 0;
+   }
+
+static inline uint64_t wideOnesBefore (wideBV W, uint k)
+
+   { return k ? W->cones[k-1] : 0;
    }
 
-	// creates a static version of B, rewriting it but not its address
+	// writes l bits v onto D[j...]
+
+static void fillBits (uint64_t *D, uint64_t j, uint64_t l, uint v)
+
+   { uint64_t fill[16];
+     uint64_t len;
+     memset(fill,v ? 0xff : 0,sizeof(fill));
+     while (l)
+	{ len = min(l,16*w);
+	  copyBits(D,j,fill,0,len);
+	  j += len; l -= len;
+	}
+   }
 
 	// version of hybridRead that does not count accesses, for internal use
 
-static void myread (hybridBV B, uint64_t i, uint64_t l, uint64_t *D, uint64_t j)
+static void myread (hybridNode B, uint64_t i, uint64_t l, uint64_t *D, uint64_t j)
 
-   { uint64_t lsize;
+   { uint64_t lsize,off,len;
+     uint k;
      if (B->type == tLeaf) { leafRead(B->bv.leaf,i,l,D,j); return; }
+     if (B->type == tRLE) { rleRead(B->bv.rle,i,l,D,j); return; }
+     if (B->type == tArray) { arrayRead(B->bv.arr,i,l,D,j); return; }
+     if (B->type == tUniform) { fillBits(D,j,l,uniBit(B)); return; }
+     if (B->type == tRRR) { rrrRead(B->bv.rrr,i,l,D,j); return; }
+     if (B->type == tEF) { efRead(B->bv.ef,i,l,D,j); return; }
+     if (B->type == tWide)
+        { k = wideFind(B->bv.wide,i);
+          while (l)
+	     { off = wideSizeBefore(B->bv.wide,k);
+	       len = min(l,B->bv.wide->csize[k]-i);
+	       myread(B->bv.wide->child[k],i-off,len,D,j);
+	       i += len; j += len; l -= len; k++;
+	     }
+	  return;
+	}
      if (B->type == tDynamic)
-        { lsize = hybridLength(B->bv.dyn->left);
+        { lsize = nodeLength(B->bv.dyn->left);
      	  if (i+l < lsize) myread(B->bv.dyn->left,i,l,D,j);
 	  else if (i >= lsize) myread(B->bv.dyn->right,i-lsize,l,D,j);
 	  else { myread(B->bv.dyn->left,i,lsize-i,D,j);
@@ -111,105 +658,606 @@ static void myread (hybridBV B, uint64_t i, uint64_t l, uint64_t *D, uint64_t j)
      staticRead(B->bv.stat,i,l,D,j);
    }
 
+	// destroys the bv.dyn or bv.wide of B and all below it
+
+static void destroyBelow (hybridBV H, hybridNode B)
+
+   { uint k;
+     if (B->type == tWide)
+	{ for (k=0;k<B->bv.wide->nchildren;k++) 
+	      nodeDestroy(H,B->bv.wide->child[k]);
+	  bufDestroy(H,&B->bv.wide->buf);
+	  poolFree(H->wides,B->bv.wide);
+	  return;
+	}
+     nodeDestroy(H,B->bv.dyn->left);
+     nodeDestroy(H,B->bv.dyn->right);
+     bufDestroy(H,&B->bv.dyn->buf);
+     poolFree(H->dyns,B->bv.dyn);
+   }
+
 	// collects all the descending bits into an array, destroys bv.dyn
+	// or bv.wide
 
-static uint64_t* collect (hybridBV B, uint64_t len)
+static uint64_t* collect (hybridBV H, hybridNode B, uint64_t len)
 
    { uint64_t *D;
      D = (uint64_t*)myalloc(((len+w-1)/w)*sizeof(uint64_t));
      myread (B,0,len,D,0);
-     hybridDestroy(B->bv.dyn->left);
-     hybridDestroy(B->bv.dyn->right);
-     myfree(B->bv.dyn);
+     destroyBelow(H,B);
      return D;
    }
 
+	// collects in parts/offs the static nodes below B, in order, and
+	// their offsets, B starting at off. returns how many they are
+
+static uint staticParts (hybridNode B, uint64_t off, staticBV *parts, 
+			 uint64_t *offs)
+
+   { uint k,np;
+     if (B->type == tStatic) 
+	{ parts[0] = B->bv.stat;
+	  offs[0] = off;
+	  return 1;
+	}
+     if ((B->type != tWide) && (B->type != tDynamic)) return 0;
+     np = 0;
+     if (B->type == tWide)
+	{ for (k=0;k<B->bv.wide->nchildren;k++)
+	      np += staticParts(B->bv.wide->child[k],
+				off+wideSizeBefore(B->bv.wide,k),
+				parts+np,offs+np);
+	  return np;
+	}
+     np = staticParts(B->bv.dyn->left,off,parts,offs);
+     return np + staticParts(B->bv.dyn->right,
+			     off+nodeLength(B->bv.dyn->left),parts+np,offs+np);
+   }
+
 	// gives number of leaves
 
-inline uint64_t hybridLeaves (hybridBV B)
+static inline uint64_t nodeLeaves (hybridNode B)
 
-   { if (B->type == tLeaf) return 1;
-     if (B->type == tStatic) return (staticLength(B->bv.stat)+leafNewSize()*w-1)
-					/ (leafNewSize()*w);
+   { if ((B->type == tLeaf) || (B->type == tRLE) || (B->type == tArray)) 
+	return 1;
+     if (isStatic(B)) 
+	return (nodeLength(B)+leafNewSize()*w-1) / (leafNewSize()*w);
+     if (B->type == tWide) return B->bv.wide->leaves;
      return B->bv.dyn->leaves;
    }
 
-	// converts into a leaf if it's short or into a static otherwise
-	// delta gives the difference in leaves (new - old)
+	// in write-optimized mode (H->cbuffer > 0) the updates that reach an
+	// internal node are kept in its buffer, and the whole buffer is sent
+	// to the children when it fills, as in a B^epsilon-tree. the counters
+	// of a node do not include its own buffer, nodeLength and nodeOnes do
 
-static void flatten (hybridBV B, int64_t *delta)
+static void insert (hybridBV H, hybridNode B, uint64_t i, uint v, uint *recalc);
+static int delete (hybridBV H, hybridNode B, uint64_t i, uint old, uint *recalc);
+static int nodeWrite (hybridBV H, hybridNode B, uint64_t i, uint v, uint old);
+static void flushNode (hybridBV H, hybridNode B);
 
-   { uint64_t len;
-     uint64_t *D;
-     if (B->type != tDynamic) return;
-     len = hybridLength(B);
+	// recounts the leaves of B from its children, if it is internal
+
+static void recountLeaves (hybridNode B)
+
+   { uint k;
+     if (B->type == tWide)
+	{ B->bv.wide->leaves = 0;
+	  for (k=0;k<B->bv.wide->nchildren;k++)
+	      B->bv.wide->leaves += nodeLeaves(B->bv.wide->child[k]);
+	}
+     else if (B->type == tDynamic)
+	B->bv.dyn->leaves = nodeLeaves(B->bv.dyn->left) +
+			    nodeLeaves(B->bv.dyn->right);
+   }
+
+	// adds an update op of B[i] with bit v, replacing bit old, to the 
+	// buffer of internal B, and sends the buffer down if it fills
+	// returns the difference in 1s
+
+static int bufferMsg (hybridBV H, hybridNode B, msgType op, uint64_t i, 
+		      uint v, uint old)
+
+   { hybridBuf *F = (B->type == tWide) ? &B->bv.wide->buf : &B->bv.dyn->buf;
+     hybridMsg *M;
+     int dif;
+     if (*F == NULL)
+	{ *F = (hybridBuf)poolAlloc(H->bufs);
+	  (*F)->n = 0;
+	  (*F)->length = (*F)->ones = 0;
+	}
+     M = (*F)->msg + (*F)->n++;
+     M->pos = i; M->op = op; M->bit = v; M->old = old;
+     H->pending++;
+     if (op == mInsert) { (*F)->length++; dif = v; }
+     else if (op == mDelete) { (*F)->length--; dif = -(int)old; }
+     else dif = (int)v - (int)old;
+     (*F)->ones += dif;
+     if (B->type == tWide) 
+	{ B->bv.wide->accesses = 0; // reset
+	  B->bv.wide->updated = H->clock;
+	}
+     else
+	{ B->bv.dyn->accesses = 0; // reset
+	  B->bv.dyn->updated = H->clock;
+	}
+     if ((*F)->n == H->cbuffer) flushNode(H,B);
+     return dif;
+   }
+
+	// sends an update op of B[i] with bit v, replacing bit old, to the
+	// child B, which buffers it if it is internal and H buffers updates,
+	// or applies it otherwise. returns the difference in 1s
+
+static inline int send (hybridBV H, hybridNode B, msgType op, uint64_t i,
+			uint v, uint old, uint *recalc)
+
+   { if (H->cbuffer && ((B->type == tWide) || (B->type == tDynamic)))
+	return bufferMsg(H,B,op,i,v,old);
+     if (op == mInsert) { insert(H,B,i,v,recalc); return v; }
+     if (op == mDelete) return delete(H,B,i,old,recalc);
+     return nodeWrite(H,B,i,v,old);
+   }
+
+	// sends down the updates buffered in B, in order. they are applied
+	// on B, which changes as inserts and deletes make it, and so go on
+	// to the buffers of its internal children or to its other children.
+	// if B becomes one of its children, its buffer is sent down too
+
+static void flushNode (hybridBV H, hybridNode B)
+
+   { hybridBuf F;
+     hybridMsg *M;
+     uint k,recalc;
+     while ((F = nodeBuf(B)) != NULL)
+	{ if (B->type == tWide) B->bv.wide->buf = NULL;
+	  else B->bv.dyn->buf = NULL;
+	  H->pending -= F->n;
+	  for (k=0;k<F->n;k++)
+	      { M = F->msg + k;
+		if (nodeBuf(B)) // B became a child with its own buffer
+		   bufferMsg(H,B,M->op,M->pos,M->bit,M->old);
+		else if (M->op == mInsert) insert(H,B,M->pos,M->bit,&recalc);
+		else if (M->op == mDelete) delete(H,B,M->pos,M->old,&recalc);
+		else nodeWrite(H,B,M->pos,M->bit,M->old);
+		recountLeaves(B); // they may have changed below
+	      }
+	  poolFree(H->bufs,F);
+	}
+   }
+
+	// sends down all the updates buffered in B and below it
+
+static void drain (hybridBV H, hybridNode B)
+
+   { uint k;
+     if (H->pending == 0) return;
+     flushNode(H,B);
+     if (B->type == tWide)
+	{ for (k=0;k<B->bv.wide->nchildren;k++) 
+	      drain(H,B->bv.wide->child[k]);
+	}
+     else if (B->type == tDynamic)
+	{ drain(H,B->bv.dyn->left);
+	  drain(H,B->bv.dyn->right);
+	}
+     recountLeaves(B);
+   }
+
+	// sends down the updates buffered in the nodes of B that hold bits 
+	// [i..i+l-1], l > 0, so that none remains on the way to them
+
+static void unbuffer (hybridBV H, hybridNode B, uint64_t i, uint64_t l)
+
+   { uint64_t lsize,off,len;
+     uint k;
+     if (H->pending == 0) return;
+     flushNode(H,B);
+     if (B->type == tWide)
+        { k = wideFind(B->bv.wide,i);
+          while (l)
+	     { off = wideSizeBefore(B->bv.wide,k);
+	       len = min(l,B->bv.wide->csize[k]-i);
+	       unbuffer(H,B->bv.wide->child[k],i-off,len);
+	       i += len; l -= len; k++;
+	     }
+	}
+     else if (B->type == tDynamic)
+        { lsize = nodeLength(B->bv.dyn->left);
+     	  if (i+l <= lsize) unbuffer(H,B->bv.dyn->left,i,l);
+	  else if (i >= lsize) unbuffer(H,B->bv.dyn->right,i-lsize,l);
+	  else { unbuffer(H,B->bv.dyn->left,i,lsize-i);
+		 unbuffer(H,B->bv.dyn->right,0,l-(lsize-i));
+	       }
+	}
+     recountLeaves(B);
+   }
+
+	// sends down the updates buffered in the nodes of B on the way to
+	// its jth 1, or its jth 0 if v is 0, so that none remains there
+
+static void unbufferSelect (hybridBV H, hybridNode B, uint64_t j, uint v)
+
+   { uint64_t before;
+     uint k;
+     if (H->pending == 0) return;
+     flushNode(H,B);
+     if (B->type == tWide)
+	{ k = v ? wideFindOnes(B->bv.wide,j) : wideFindZeros(B->bv.wide,j);
+	  before = wideOnesBefore(B->bv.wide,k);
+	  if (!v) before = wideSizeBefore(B->bv.wide,k) - before;
+	  unbufferSelect(H,B->bv.wide->child[k],j-before,v);
+	}
+     else if (B->type == tDynamic)
+	{ before = nodeOnes(B->bv.dyn->left);
+	  if (!v) before = nodeLength(B->bv.dyn->left) - before;
+	  if (j <= before) unbufferSelect(H,B->bv.dyn->left,j,v);
+	  else unbufferSelect(H,B->bv.dyn->right,j-before,v);
+	}
+     recountLeaves(B);
+   }
+
+	// translates position *i of a node to the position it had before
+	// the updates buffered in F. returns 1 and the bit in *v instead if
+	// the bit at *i was inserted or written by them
+
+static uint bufferFind (hybridBuf F, uint64_t *i, uint *v)
+
+   { hybridMsg *M;
+     uint k = F->n;
+     while (k--)
+	{ M = F->msg + k;
+	  if (M->op == mInsert)
+	     { if (*i == M->pos) { *v = M->bit; return 1; }
+	       if (*i > M->pos) (*i)--;
+	     }
+	  else if (M->op == mDelete) 
+	     { if (*i >= M->pos) (*i)++;
+	     }
+	  else if (*i == M->pos) { *v = M->bit; return 1; }
+	}
+     return 0;
+   }
+
+	// translates the number i of first bits of a node to the number 
+	// they had before the updates buffered in F, adding to *ones the
+	// 1s that the updates added among them
+
+static uint64_t bufferRank (hybridBuf F, uint64_t i, int64_t *ones)
+
+   { hybridMsg *M;
+     uint k = F->n;
+     while (k--)
+	{ M = F->msg + k;
+	  if (M->pos >= i) continue;
+	  if (M->op == mInsert) { i--; *ones += M->bit; }
+	  else if (M->op == mDelete) { i++; *ones -= M->old; }
+	  else *ones += (int)M->bit - (int)M->old;
+	}
+     return i;
+   }
+
+	// converts into a leaf if it's short, into a uniform node if it's
+	// all 0s or all 1s, into a compressed static if it's sparse enough,
+	// or into a static otherwise
+	// delta gives the difference in leaves (new - old)
+
+static void flatten (hybridBV H, hybridNode B, int64_t *delta)
+
+   { uint64_t len,ones,nparts;
+     uint64_t *D,*offs;
+     staticBV SB,*parts;
+     nodeType type;
+     if ((B->type != tDynamic) && (B->type != tWide)) return;
+     *delta = - nodeLeaves(B);
+     drain(H,B); // the buffered updates below are applied first
+     if ((B->type != tDynamic) && (B->type != tWide))
+	{ *delta += nodeLeaves(B);
+	  return;
+	}
+     len = nodeLength(B);
+     ones = nodeOnes(B);
      flattenAccess += len;
      if (len > flattenMax) flattenMax = len;
-     *delta = - hybridLeaves(B);
-     D = collect(B,len);
-     if (len > leafNewSize()*w) // creates a static
-        { B->type = tStatic;
-          B->bv.stat = staticCreateFrom(D,len);
+     if ((len > leafNewSize()*w) && ((ones == 0) || (ones == len)))
+	{ destroyBelow(H,B); // no need to read the bits
+	  setUniform(B,len,ones != 0);
+	}
+     else if ((len > leafNewSize()*w) && 
+	      ((type = staticType(len,ones)) != tStatic))
+        { D = (uint64_t*)myalloc(((len+w-1)/w)*sizeof(uint64_t));
+	  myread(B,0,len,D,0);
+	  destroyBelow(H,B);
+	  newCompressed(H,B,type,D,len);
+	  myfree(D);
+	}
+     else if (len > leafNewSize()*w) // creates a static, with the counts of 
+        { nparts = nodeLeaves(B); // the statics below, at most one per leaf
+	  parts = (staticBV*)myalloc(nparts*sizeof(staticBV));
+	  offs = (uint64_t*)myalloc(nparts*sizeof(uint64_t));
+	  nparts = staticParts(B,0,parts,offs);
+	  D = (uint64_t*)myalloc(((len+w-1)/w)*sizeof(uint64_t));
+	  myread(B,0,len,D,0);
+	  SB = newStaticFromParts(H,D,len,parts,offs,nparts);
+	  myfree(parts); myfree(offs);
+	  destroyBelow(H,B);
+	  B->type = tStatic;
+          B->bv.stat = SB;
 	}
      else
-        { B->type = tLeaf;
-          B->bv.leaf = leafCreateFrom(D,len,1);
+        { D = collect(H,B,len);
+          makeLeaf(H,B,D,len);
+	  myfree(D);
 	}
-     *delta += hybridLeaves(B);
+     poolTrim(H->nodes); // gives back the slabs the flattening emptied
+     poolTrim(H->dyns);
+     poolTrim(H->wides);
+     poolTrim(H->runs);
+     arrayPoolsTrim(H->arrays);
+     leafPoolsTrim(H->leaves);
+     if (H->bufs) poolTrim(H->bufs);
+     *delta += nodeLeaves(B);
+   }
+
+	// splits a full leaf into two hybridNode leaves, which are run-length
+	// encoded if they have few runs, destroys B
+
+static void halveLeaf (hybridBV H, leafBV B, hybridNode *HB1, hybridNode *HB2)
+
+   { uint bsize; 
+
+     leafCloseGap(B);
+     bsize = (B->size/2+7)/8; // byte size of new left leaf
+     *HB1 = (hybridNode)poolAlloc(H->nodes);
+     makeLeaf(H,*HB1,B->data,bsize*8);
+     *HB2 = (hybridNode)poolAlloc(H->nodes);
+     makeLeaf(H,*HB2,(uint64_t*)(((byte*)B->data)+bsize),B->size-bsize*8);
+     leafDestroy(B,H->leaves);
    }
 
 	// splits a full leaf into two
 	// returns a dynamicBV and destroys B
 
-static dynamicBV splitLeaf (leafBV B)
+static dynamicBV splitLeaf (hybridBV H, leafBV B)
 
-   { hybridBV HB1,HB2;
-     dynamicBV DB;
-     leafBV LB;
-     uint bsize; 
+   { dynamicBV DB;
 
-     bsize = (B->size/2+7)/8; // byte size of new left leaf
-     LB = leafCreateFrom(B->data,bsize*8,0);
-     HB1 = (hybridBV)myalloc(sizeof(struct s_hybridBV));
-     HB1->type = tLeaf;
-     HB1->bv.leaf = LB;
-     LB = leafCreateFrom((uint64_t*)(((byte*)B->data)+bsize),B->size-bsize*8,0);
-     HB2 = (hybridBV)myalloc(sizeof(struct s_hybridBV));
-     HB2->type = tLeaf;
-     HB2->bv.leaf = LB;
-     DB = (dynamicBV)myalloc(sizeof(struct s_dynamicBV));
+     DB = (dynamicBV)poolAlloc(H->dyns);
      DB->size = B->size;
      DB->ones = B->ones;
      DB->leaves = 2;
      DB->accesses = 0;
-     DB->left = HB1;
-     DB->right = HB2;
-     leafDestroy(B);
+     DB->updated = H->clock;
+     DB->epoch = 0;
+     DB->buf = NULL;
+     halveLeaf(H,B,&DB->left,&DB->right);
      return DB;
    }
 
+	// recomputes the cumulative counters of W from its children
+
+static void wideRecount (wideBV W)
+
+   { uint k;
+     uint64_t size,ones,leaves;
+     size = ones = leaves = 0;
+     for (k=0;k<W->nchildren;k++)
+	{ size += nodeLength(W->child[k]);
+	  ones += nodeOnes(W->child[k]);
+	  leaves += nodeLeaves(W->child[k]);
+	  W->csize[k] = size;
+	  W->cones[k] = ones;
+	}
+     W->leaves = leaves;
+   }
+
+	// creates a wide node without children
+
+static wideBV wideCreate (hybridBV H)
+
+   { wideBV W = (wideBV)poolAlloc(H->wides);
+     W->nchildren = 0;
+     W->leaves = 0;
+     W->accesses = 0;
+     W->updated = H->clock;
+     W->epoch = 0;
+     W->buf = NULL;
+     return W;
+   }
+
+	// inserts HB as the kth child of W, does not recount
+
+static void wideAddChild (wideBV W, uint k, hybridNode HB)
+
+   { memmove(W->child+k+1,W->child+k,(W->nchildren-k)*sizeof(hybridNode));
+     W->child[k] = HB;
+     W->nchildren++;
+   }
+
+	// removes the kth child of W, does not destroy it nor recount
+
+static void wideRemoveChild (wideBV W, uint k)
+
+   { W->nchildren--;
+     memmove(W->child+k,W->child+k+1,(W->nchildren-k)*sizeof(hybridNode));
+   }
+
+	// moves the second half of the children of W to a new wide hybridNode
+
+static hybridNode wideSplit (hybridBV H, wideBV W)
+
+   { hybridNode HB;
+     uint half = W->nchildren/2;
+     HB = (hybridNode)poolAlloc(H->nodes);
+     HB->type = tWide;
+     HB->bv.wide = wideCreate(H);
+     memcpy(HB->bv.wide->child,W->child+half,
+	    (W->nchildren-half)*sizeof(hybridNode));
+     HB->bv.wide->nchildren = W->nchildren-half;
+     W->nchildren = half;
+     wideRecount(W);
+     wideRecount(HB->bv.wide);
+     return HB;
+   }
+
+	// B is a full wide node with no parent to absorb a split, so it
+	// becomes a wide node with the two halves as children
+
+static void wideGrow (hybridBV H, hybridNode B)
+
+   { hybridNode HB;
+     wideBV W = wideCreate(H);
+     HB = (hybridNode)poolAlloc(H->nodes);
+     HB->type = tWide;
+     HB->bv.wide = B->bv.wide;
+     W->buf = HB->bv.wide->buf; // B keeps its buffered updates
+     HB->bv.wide->buf = NULL;
+     W->child[1] = wideSplit(H,HB->bv.wide);
+     W->child[0] = HB;
+     W->nchildren = 2;
+     wideRecount(W);
+     B->bv.wide = W;
+   }
+
+	// splits the full leaf child k of W into two children
+
+static void wideSplitLeaf (hybridBV H, wideBV W, uint k)
+
+   { hybridNode HB = W->child[k];
+     hybridNode HB1,HB2;
+     halveLeaf(H,HB->bv.leaf,&HB1,&HB2);
+     poolFree(H->nodes,HB);
+     W->child[k] = HB1;
+     wideAddChild(W,k+1,HB2);
+     wideRecount(W);
+   }
+
+	// moves the children of the wide child k+1 of W to the wide child k.
+	// their buffered updates go down first, and they are not merged if
+	// they no longer fit together after that
+
+static void wideMergeChildren (hybridBV H, wideBV W, uint k)
+
+   { wideBV W1,W2;
+     flushNode(H,W->child[k]);
+     flushNode(H,W->child[k+1]);
+     if ((W->child[k]->type != tWide) || (W->child[k+1]->type != tWide) ||
+	 (W->child[k]->bv.wide->nchildren + W->child[k+1]->bv.wide->nchildren
+						> maxChildren(H)))
+	{ wideRecount(W);
+	  return;
+	}
+     W1 = W->child[k]->bv.wide;
+     W2 = W->child[k+1]->bv.wide;
+     memcpy(W1->child+W1->nchildren,W2->child,W2->nchildren*sizeof(hybridNode));
+     W1->nchildren += W2->nchildren;
+     W1->accesses = 0;
+     W1->updated = H->clock;
+     W1->epoch = 0;
+     poolFree(H->wides,W2);
+     poolFree(H->nodes,W->child[k+1]);
+     wideRemoveChild(W,k+1);
+     wideRecount(W1);
+     wideRecount(W);
+   }
+
+	// makes HB a node with bits [off..off+len-1] of data: a static if
+	// it is long, sharing the buffer of static SB if data lies inside 
+	// it, and compressed if it is not shared and sparse enough, or a 
+	// leaf otherwise. if data is NULL the bits are all v, and the node
+	// is uniform if it is long. off is a multiple of w
+
+static void makePart (hybridBV H, hybridNode HB, staticBV SB, uint64_t *data,
+		      uint64_t off, uint64_t len, uint v)
+
+   { uint64_t *segment;
+     uint64_t k,ones;
+     nodeType type;
+     if ((len > leafNewSize() * w) && (data == NULL))
+	setUniform(HB,len,v);
+     else if ((len > leafNewSize() * w) && (SB != NULL)) // share SB's bits
+	{ HB->type = tStatic;
+	  HB->bv.stat = newView(H,SB,(data-staticBits(SB))*w+off,len);
+	}
+     else if (len > leafNewSize() * w) // create a static
+	{ segment = (uint64_t*)myalloc(((len+w-1)/w)*sizeof(uint64_t));
+	  memcpy(segment,data+off/w,((len+w-1)/w)*sizeof(uint64_t));
+	  if (len % w) segment[len/w] &= (((uint64_t)1) << (len % w)) - 1;
+	  ones = 0;
+	  for (k=0;k<(len+w-1)/w;k++) ones += popcount(segment[k]);
+	  type = staticType(len,ones);
+	  if (type != tStatic)
+	     { newCompressed(H,HB,type,segment,len);
+	       myfree(segment);
+	     }
+	  else
+	     { HB->type = tStatic;
+	       HB->bv.stat = newStatic(H,segment,len);
+	     }
+	}
+     else if (data == NULL) // create a leaf of bits v
+	{ segment = (uint64_t*)myalloc(((len+w-1)/w)*sizeof(uint64_t));
+	  fillBits(segment,0,len,v);
+	  makeLeaf(H,HB,segment,len);
+	  myfree(segment);
+	}
+     else makeLeaf(H,HB,data+off/w,len); // create a leaf
+   }
+
+	// distributes bits [off..off+n-1] of a static bitmap into a wide 
+	// node, leaving a leaf covering i. returns a wideBV and does not 
+	// free data. if data lies inside static SB, the statics created 
+	// share SB's buffer. if data is NULL the bits are all v
+
+static wideBV wideSplitFrom (hybridBV H, staticBV SB, uint64_t *data, 
+			     uint64_t off, uint64_t n, uint64_t i, uint v)
+
+   { wideBV W;
+     hybridNode HB;
+     uint64_t blen; // bit size of blocks to create
+     uint64_t nblock,parts,p,from,to,len;
+
+     W = wideCreate(H);
+     blen = leafNewSize() * w;
+     nblock = (n+blen-1)/blen; // total blocks 
+     parts = min(nblock,max(2,maxChildren(H)/2)); // leave room to grow
+     for (p=0;p<parts;p++)
+	{ from = (nblock*p/parts)*blen;
+	  to = min(n,(nblock*(p+1)/parts)*blen);
+	  len = to-from;
+	  HB = (hybridNode)poolAlloc(H->nodes);
+	  if ((i >= from) && ((i < to) || (p == parts-1)) && (len > blen))
+	     { HB->type = tWide; // continue on the part holding i
+	       HB->bv.wide = wideSplitFrom(H,SB,data,off+from,len,i-from,v);
+	     }
+	  else makePart(H,HB,SB,data,off+from,len,v);
+	  W->child[p] = HB;
+	}
+     W->nchildren = parts;
+     wideRecount(W);
+     return W;
+   }
+
 	// halves a static bitmap into leaves, leaving a leaf covering i
-	// returns a dynamicBV and destroys B
+	// returns a dynamicBV and does not free data. if data lies inside
+	// static SB, the statics created share SB's buffer. if data is NULL
+	// the bits are all v
 
-static dynamicBV splitFrom (uint64_t *data, uint64_t n, uint64_t ones,
-			    uint64_t i)
+static dynamicBV splitFrom (hybridBV H, staticBV SB, uint64_t *data, 
+			    uint64_t n, uint64_t ones, uint64_t i, uint v)
 
-   { hybridBV HB;
+   { hybridNode HB;
      dynamicBV DB,finalDB;
-     uint bsize; // byte size of blocks to create
      uint blen; // bit size of block to create
-     uint64_t *segment;
-     uint64_t nblock;
-     byte *start,*mid,*end;
+     uint64_t nblock,half;
+     uint64_t off; // where the current part starts in data
 
      HB = NULL;
      blen = leafNewSize() * w;
-     bsize = (blen+7)/8; // +7 not really needed as 8 | w
      nblock = (n+blen-1)/blen; // total blocks 
-     start = (byte*)data;
-     end = start + (n+7)/8;
+     off = 0;
      while (nblock >= 2) {
-        DB = (dynamicBV)myalloc(sizeof(struct s_dynamicBV));
+        DB = (dynamicBV)poolAlloc(H->dyns);
 	if (HB == NULL) finalDB = DB;
 	else { 
            HB->type = tDynamic;
@@ -219,121 +1267,251 @@ static dynamicBV splitFrom (uint64_t *data, uint64_t n, uint64_t ones,
 	DB->ones = ones;
         DB->leaves = nblock;
         DB->accesses = 0;
-	mid = start+(nblock/2)*bsize;
-     	if (i < (nblock/2)*blen) { // split the left half
+        DB->updated = H->clock;
+        DB->epoch = 0;
+        DB->buf = NULL;
+	half = (nblock/2)*blen;
+     	if (i < half) { // split the left half
 		// create right half
-           DB->right = HB = (hybridBV)myalloc(sizeof(struct s_hybridBV));
-	   if (n - (nblock/2)*blen > leafNewSize() * w) { // create a static
-	      segment = (uint64_t*)myalloc(end-mid);
-	      memcpy(segment,mid,end-mid);
-	      HB->type = tStatic;
-	      HB->bv.stat = staticCreateFrom(segment,n-(nblock/2)*blen);
-	      }
-	   else { // create a leaf
-	      HB->type = tLeaf;
-	      HB->bv.leaf =leafCreateFrom((uint64_t*)mid,n-(nblock/2)*blen,0);
-	      }
+           DB->right = HB = (hybridNode)poolAlloc(H->nodes);
+	   makePart(H,HB,SB,data,off+half,n-half,v);
 		// continue on left half
-	   end = mid;
 	   nblock = nblock/2;
-	   n = nblock * blen;
-	   ones -= hybridOnes(HB);
-           DB->left = HB = (hybridBV)myalloc(sizeof(struct s_hybridBV));
+	   n = half;
+	   ones -= nodeOnes(HB);
+           DB->left = HB = (hybridNode)poolAlloc(H->nodes);
 	   }
 	else { // split the right half
 		// create left half
-           DB->left = HB = (hybridBV)myalloc(sizeof(struct s_hybridBV));
-	   if ((nblock/2)*blen > leafNewSize() * w) { // create a static
-	      segment = (uint64_t*)myalloc(mid-start);
-	      memcpy(segment,start,mid-start);
-	      HB->type = tStatic;
-	      HB->bv.stat = staticCreateFrom(segment,(nblock/2)*blen);
-	      }
-	   else { // create a leaf
-	      HB->type = tLeaf;
-	      HB->bv.leaf =leafCreateFrom((uint64_t*)start,(nblock/2)*blen,0);
-	      }
+           DB->left = HB = (hybridNode)poolAlloc(H->nodes);
+	   makePart(H,HB,SB,data,off,half,v);
 		// continue for right half
-	   start = mid;
-	   n = n-(nblock/2)*blen;
-	   i = i-(nblock/2)*blen;
-	   ones -= hybridOnes(HB);
+	   off += half;
+	   n = n-half;
+	   i = i-half;
+	   ones -= nodeOnes(HB);
 	   nblock = nblock - nblock/2;
-           DB->right = HB = (hybridBV)myalloc(sizeof(struct s_hybridBV));
+           DB->right = HB = (hybridNode)poolAlloc(H->nodes);
 	   }
 	}
 	// finally, the leaf where i lies
-     HB->type = tLeaf;
-     HB->bv.leaf =leafCreateFrom((uint64_t*)start,n,0);
+     makePart(H,HB,SB,data,off,n,v);
      return finalDB;
    }
 
-static dynamicBV split (staticBV B, uint64_t i)
+	// turns static, uniform or compressed B into a dynamic subtree, 
+	// leaving a leaf covering i. the static parts keep using B's buffer
+	// and the uniform ones stay uniform, so only the leaves are written.
+	// compressed B is decompressed and its long parts are compressed 
+	// again if they are sparse. does not change #leaves!
 
-   { dynamicBV DB;
-     DB = splitFrom(B->data,staticLength(B),staticOnes(B),i);
-     staticDestroy(B);
-     return DB;
+static void split (hybridBV H, hybridNode B, uint64_t i)
+
+   { staticBV SB = NULL;
+     struct s_hybridNode old = *B;
+     uint64_t *data = NULL;
+     uint64_t n = nodeLength(B);
+     uint64_t ones = nodeOnes(B);
+     uint v = 0;
+     if (B->type == tStatic) 
+	{ SB = B->bv.stat;
+	  data = staticBits(SB);
+	}
+     else if (B->type == tUniform) v = uniBit(B);
+     else // decompress
+	{ data = (uint64_t*)myalloc(((n+w-1)/w+1)*sizeof(uint64_t));
+	  myread(B,0,n,data,0);
+	}
+     if (H->conf.fanout > 2)
+	{ B->type = tWide;
+	  B->bv.wide = wideSplitFrom(H,SB,data,0,n,i,v);
+	}
+     else 
+	{ B->type = tDynamic;
+	  B->bv.dyn = splitFrom(H,SB,data,n,ones,i,v);
+	}
+     if (SB != NULL) freeStatic(H,SB);
+     if ((old.type == tRRR) || (old.type == tEF)) 
+	{ freeCompressed(H,&old); 
+	  myfree(data); 
+	}
    }
 
 	// balance by rebuilding: flattening + splitting
 	// assumes B is dynamic
 
-static inline int canBalance (uint64_t n, int dleft, int dright)
+static inline int canBalance (hybridBV H, uint64_t n, int dleft, int dright)
 
    { uint b = leafNewSize() * w; // bit size of leaves to create in split
      uint64_t left = (((n+b-1)/b)/2)*b; // bit size of left part 
      uint64_t right = n-left; // bit size of right part 
 //     if (left+dleft < (1-Alpha)*(n+dleft+dright)) return 0;
 //     if (right+dright < (1-Alpha)*(n+dleft+dright)) return 0;
-     if (left+dleft > Alpha*(n+dleft+dright)) return 0;
-     if (right+dright > Alpha*(n+dleft+dright)) return 0;
+     if (left+dleft > H->conf.alpha*(n+dleft+dright)) return 0;
+     if (right+dright > H->conf.alpha*(n+dleft+dright)) return 0;
+     return 1;
+   }
+
+	// whether sizes a and b of two siblings are within the balance 
+	// factor even after deleting or inserting one element, or too
+	// small to matter
+
+static inline int balanced (hybridBV H, uint64_t a, uint64_t b)
+
+   { if (a+b < H->conf.minLeavesToBalance*leafMaxSize()*w) return 1;
+     return (max(a,b)+1 <= H->conf.alpha*(a+b-1));
+   }
+
+	// recomputes the counters of dynamic D from its children
+
+static inline void dynRecount (hybridBV H, dynamicBV D)
+
+   { D->size = nodeLength(D->left) + nodeLength(D->right);
+     D->ones = nodeOnes(D->left) + nodeOnes(D->right);
+     D->leaves = nodeLeaves(D->left) + nodeLeaves(D->right);
+     D->accesses = 0;
+     D->updated = H->clock;
+   }
+
+	// child of D on side s (0 = left, 1 = right)
+
+static inline hybridNode *side (dynamicBV D, uint s)
+
+   { return s ? &D->right : &D->left;
+   }
+
+	// rebalances dynamic B with a single or a double rotation towards 
+	// its lighter side, if that leaves it balanced. returns whether it 
+	// did. the leaves and the size of B do not change
+
+static int rotate (hybridBV H, hybridNode B)
+
+   { dynamicBV D = B->bv.dyn;
+     uint h = (nodeLength(D->left) < nodeLength(D->right)); // heavy side
+     uint o = 1-h;
+     hybridNode X = *side(D,h);
+     hybridNode O = *side(D,o);
+     hybridNode Xh,Xo,Y,Yh,Yo;
+     dynamicBV DX,DY;
+     if (X->type != tDynamic) return 0;
+     if (nodeBuf(X)) // X changes, its buffered updates go down first
+	{ flushNode(H,X);
+	  recountLeaves(B);
+	  if (X->type != tDynamic) return 0;
+	}
+     DX = X->bv.dyn;
+     Xh = *side(DX,h); Xo = *side(DX,o);
+	// single: X goes to side o, with Xo and O as its children
+     if (balanced(H,nodeLength(Xh),nodeLength(Xo)+nodeLength(O)) &&
+	 balanced(H,nodeLength(Xo),nodeLength(O)))
+	{ *side(DX,h) = Xo; *side(DX,o) = O;
+	  dynRecount(H,DX);
+	  *side(D,h) = Xh; *side(D,o) = X;
+	  balanceRotations++;
+	  return 1;
+	}
+	// double: Xo = (Yh,Yo) is split between X = (Xh,Yh) and Y = (Yo,O)
+     if (Xo->type != tDynamic) return 0;
+     Y = Xo;
+     if (nodeBuf(Y)) // so does Y
+	{ flushNode(H,Y);
+	  recountLeaves(X);
+	  recountLeaves(B);
+	  if (Y->type != tDynamic) return 0;
+	}
+     DY = Y->bv.dyn;
+     Yh = *side(DY,h); Yo = *side(DY,o);
+     if (!(balanced(H,nodeLength(Xh)+nodeLength(Yh),
+		      nodeLength(Yo)+nodeLength(O)) &&
+	   balanced(H,nodeLength(Xh),nodeLength(Yh)) &&
+	   balanced(H,nodeLength(Yo),nodeLength(O)))) return 0;
+     *side(DX,o) = Yh;
+     dynRecount(H,DX);
+     *side(DY,h) = Yo; *side(DY,o) = O;
+     dynRecount(H,DY);
+     *side(D,o) = Y;
+     balanceRotations += 2;
      return 1;
    }
 
-static void balance (hybridBV B, uint64_t i, int64_t *delta)
+	// rebuilds B unless a rotation suffices
 
-   { uint64_t len = hybridLength(B);
-     uint64_t ones = hybridOnes(B);
+static void balance (hybridBV H, hybridNode B, uint64_t i, int64_t *delta)
+
+   { uint64_t len = nodeLength(B);
+     uint64_t ones = nodeOnes(B);
      uint64_t *D;
+     if (rotate(H,B)) return;
      flattenBalance += len;
-     *delta = - hybridLeaves(B);
-     D = collect(B,len);
-     B->bv.dyn = splitFrom(D,len,ones,i);
-     *delta += hybridLeaves(B);
+     *delta = - nodeLeaves(B);
+     drain(H,B); // the buffered updates below are applied first
+     if (B->type != tDynamic)
+	{ *delta += nodeLeaves(B);
+	  return;
+	}
+     D = collect(H,B,len);
+     B->bv.dyn = splitFrom(H,NULL,D,len,ones,i,0);
+     *delta += nodeLeaves(B);
      myfree(D);
    }
 
-	// merge the two leaf children of B into a leaf
-	// returns a leafBV and destroys B
+	// appends the leaf of B2 to the leaf of B1, destroys the leaf of B2
+	// the result is a plain leaf
 
-static leafBV mergeLeaves (dynamicBV B)
+static void mergeLeaves (hybridBV H, hybridNode B1, hybridNode B2)
 
    { leafBV LB1,LB2;
-
-     LB1 = B->left->bv.leaf;
-     LB2 = B->right->bv.leaf;
+     if (B1->type != tLeaf) plainLeaf(H,B1);
+     if (B2->type != tLeaf) plainLeaf(H,B2);
+     LB2 = B2->bv.leaf;
+     LB1 = B1->bv.leaf = leafResize(B1->bv.leaf,B1->bv.leaf->size+LB2->size,
+				    H->leaves);
+     leafCloseGap(LB1);
+     leafCloseGap(LB2);
      copyBits(LB1->data,LB1->size,LB2->data,0,LB2->size);
      LB1->size += LB2->size;
      LB1->ones += LB2->ones;
-     leafDestroy(LB2);
-     myfree(B);
+     leafDestroy(LB2,H->leaves);
+   }
+
+	// merge the two leaf children of B into a leaf
+	// returns a leafBV and destroys B
+
+static leafBV mergeChildren (hybridBV H, dynamicBV B)
+
+   { leafBV LB1;
+     mergeLeaves(H,B->left,B->right);
+     LB1 = B->left->bv.leaf;
+     poolFree(H->nodes,B->left); poolFree(H->nodes,B->right);
+     poolFree(H->dyns,B);
      return LB1;
    }
 
-	// transfers bits from the right to the left leaves children of B
+	// merges the leaf children k and k+1 of W 
+
+static void wideMergeLeaves (hybridBV H, wideBV W, uint k)
+
+   { mergeLeaves(H,W->child[k],W->child[k+1]);
+     poolFree(H->nodes,W->child[k+1]);
+     wideRemoveChild(W,k+1);
+     wideRecount(W);
+   }
+
+	// transfers bits from the right leaf of B2 to the left leaf of B1
 	// tells if it transfered something
 
-static int transferLeft (dynamicBV B)
+static int transferLeft (hybridBV H, hybridNode B1, hybridNode B2)
 
-   { leafBV LB1,LB2;
-     uint i,trf,ones,words;
+   { uint i,trf,ones,words;
      uint64_t *segment;
+     leafBV LB1 = B1->bv.leaf;
+     leafBV LB2 = B2->bv.leaf;
 
-     LB1 = B->left->bv.leaf;
-     LB2 = B->right->bv.leaf;
      trf = (LB2->size-LB1->size+1)/2;
-     if (trf < leafMaxSize() * w * TrfFactor) return 0;
+     if (trf < leafMaxSize() * w * H->conf.trfFactor) return 0;
+     LB1 = B1->bv.leaf = leafResize(LB1,LB1->size+trf,H->leaves);
+     leafCloseGap(LB1);
+     leafCloseGap(LB2);
      copyBits(LB1->data,LB1->size,LB2->data,0,trf);
      LB1->size += trf;
      LB2->size -= trf;
@@ -348,323 +1526,1313 @@ static int transferLeft (dynamicBV B)
      LB2->ones -= ones;
      memcpy(LB2->data,segment,(LB2->size+7)/8);
      myfree(segment);
+     B2->bv.leaf = leafResize(LB2,LB2->size,H->leaves);
      return 1;
    }
 
-	// transfers bits from the left to the right leaves children of B
+	// transfers bits from the left leaf of B1 to the right leaf of B2
 	// tells if it transfered something
 
-static int transferRight (dynamicBV B)
+static int transferRight (hybridBV H, hybridNode B1, hybridNode B2)
+
+   { uint i,trf,ones,words;
+     uint64_t *segment;
+     leafBV LB1 = B1->bv.leaf;
+     leafBV LB2 = B2->bv.leaf;
+
+     trf = (LB1->size-LB2->size+1)/2;
+     if (trf < leafMaxSize() * w * H->conf.trfFactor) return 0;
+     LB2 = B2->bv.leaf = leafResize(LB2,LB2->size+trf,H->leaves);
+     leafCloseGap(LB1);
+     leafCloseGap(LB2);
+     segment = (uint64_t*)myalloc(leafMaxSize()*sizeof(uint64_t));
+     memcpy(segment,LB2->data,(LB2->size+7)/8);
+     copyBits(LB2->data,0,LB1->data,LB1->size-trf,trf);
+     words = trf / w;
+     ones = 0;
+     for (i=0;i<words;i++) ones += popcount(LB2->data[i]);
+     if (trf % w) ones += popcount(LB2->data[words] & 
+				   (((uint64_t)1) << (trf % w)) - 1);
+     LB1->ones -= ones;
+     LB2->ones += ones;
+     copyBits(LB2->data,trf,segment,0,LB2->size);
+     LB1->size -= trf;
+     LB2->size += trf;
+     myfree(segment);
+     B1->bv.leaf = leafResize(LB1,LB1->size,H->leaves);
+     return 1;
+   }
+
+	// makes HB a node of the len > leafNewSize()*w bits whose m 1s are
+	// at positions pos[k]-off: uniform, Elias-Fano built from the 
+	// positions, or else RRR or static built from the bits
+
+static void positionsPart (hybridBV H, hybridNode HB, uint64_t *pos, 
+			   uint64_t m, uint64_t off, uint64_t len)
+
+   { uint64_t *data;
+     uint64_t k;
+     nodeType type;
+     if ((m == 0) || (m == len)) setUniform(HB,len,m != 0);
+     else if ((type = staticType(len,m)) == tEF)
+	{ HB->type = tEF;
+	  HB->bv.ef = efCreateFromPositions(pos,m,len,off);
+	  H->statics += efSpace(HB->bv.ef);
+	}
+     else 
+	{ data = (uint64_t*)mycalloc((len+w-1)/w,sizeof(uint64_t));
+	  for (k=0;k<m;k++) 
+	      data[(pos[k]-off)/w] |= ((uint64_t)1) << ((pos[k]-off)%w);
+	  if (type == tRRR)
+	     { newCompressed(H,HB,type,data,len);
+	       myfree(data);
+	     }
+	  else
+	     { HB->type = tStatic;
+	       HB->bv.stat = newStatic(H,data,len);
+	     }
+	}
+   }
+
+	// makes B a balanced tree, binary or wide as the fanout of H says,
+	// whose leaves are the k >= 2 nodes parts[0..k-1]
+
+static void assemble (hybridBV H, hybridNode B, hybridNode *parts, uint64_t k)
+
+   { hybridNode HB;
+     dynamicBV D;
+     wideBV W;
+     uint64_t c,from,to,nch;
+     if (H->conf.fanout > 2)
+	{ W = wideCreate(H);
+	  nch = min(k,max(2,maxChildren(H)/2)); // leave room to grow
+	  for (c=0;c<nch;c++)
+	      { from = k*c/nch; to = k*(c+1)/nch;
+		if (to-from == 1) HB = parts[from];
+		else 
+		   { HB = (hybridNode)poolAlloc(H->nodes);
+		     assemble(H,HB,parts+from,to-from);
+		   }
+		W->child[c] = HB;
+	      }
+	  W->nchildren = nch;
+	  wideRecount(W);
+	  B->type = tWide;
+	  B->bv.wide = W;
+	}
+     else
+	{ D = (dynamicBV)poolAlloc(H->dyns);
+	  if (k/2 == 1) D->left = parts[0];
+	  else 
+	     { D->left = (hybridNode)poolAlloc(H->nodes);
+	       assemble(H,D->left,parts,k/2);
+	     }
+	  if (k-k/2 == 1) D->right = parts[k/2];
+	  else 
+	     { D->right = (hybridNode)poolAlloc(H->nodes);
+	       assemble(H,D->right,parts+k/2,k-k/2);
+	     }
+	  dynRecount(H,D);
+	  D->epoch = 0;
+	  D->buf = NULL;
+	  B->type = tDynamic;
+	  B->bv.dyn = D;
+	}
+   }
+
+	// creates a hybridBV of n bits whose 1s are at the count increasing
+	// positions pos[0..count-1], without building the n bits. long 
+	// bitvectors become a balanced tree of statics of about BuildBits 
+	// bits. pos is not freed. configured by C, NULL for the default
+
+hybridBV hybridCreateFromPositions (uint64_t *pos, uint64_t count, 
+				    uint64_t n, hybridConfig *C)
+
+   { hybridBV H;
+     hybridNode *parts;
+     uint64_t *data;
+     uint64_t k,j,p,nparts,from,to;
+     if (n <= leafNewSize()*w)
+	{ data = (uint64_t*)mycalloc((n+w-1)/w+1,sizeof(uint64_t));
+	  for (k=0;k<count;k++) data[pos[k]/w] |= ((uint64_t)1) << (pos[k]%w);
+	  return hybridCreateFrom(data,n,C);
+	}
+     H = create(C);
+     nparts = (n+BuildBits-1)/BuildBits;
+     if (nparts == 1)
+	{ positionsPart(H,H->root,pos,count,0,n);
+	  return H;
+	}
+     parts = (hybridNode*)myalloc(nparts*sizeof(hybridNode));
+     j = 0;
+     for (p=0;p<nparts;p++)
+	{ from = ((n/w)*p/nparts)*w;
+	  to = (p == nparts-1) ? n : ((n/w)*(p+1)/nparts)*w;
+	  k = j;
+	  while ((j < count) && (pos[j] < to)) j++;
+	  parts[p] = (hybridNode)poolAlloc(H->nodes);
+	  positionsPart(H,parts[p],pos+k,j-k,from,to-from);
+	}
+     assemble(H,H->root,parts,nparts);
+     myfree(parts);
+     return H;
+   }
+
+	// starts building a hybridBV configured by C, NULL for the default,
+	// whose bits will be given by chunks
+
+hybridBuilder hybridBuilderCreate (hybridConfig *C)
+
+   { hybridBuilder Bd = (hybridBuilder)myalloc(sizeof(struct s_hybridBuilder));
+     Bd->H = create(C);
+     Bd->cparts = 16;
+     Bd->parts = (hybridNode*)myalloc(Bd->cparts*sizeof(hybridNode));
+     Bd->nparts = 0;
+     Bd->data = (uint64_t*)myalloc((2*BuildBits/w+1)*sizeof(uint64_t));
+     Bd->len = 0;
+     return Bd;
+   }
+
+	// adds to Bd a part with the len bits of its buffer from the 
+	// w-aligned position from
+
+static void builderPart (hybridBuilder Bd, uint64_t from, uint64_t len)
+
+   { uint64_t *data;
+     hybridNode HB;
+     data = (uint64_t*)myalloc(((len+w-1)/w+1)*sizeof(uint64_t));
+     memcpy(data,Bd->data+from/w,((len+w-1)/w)*sizeof(uint64_t));
+     HB = (hybridNode)poolAlloc(Bd->H->nodes);
+     bitsNode(Bd->H,HB,data,len);
+     if (Bd->nparts == Bd->cparts)
+	{ Bd->cparts *= 2;
+	  Bd->parts = (hybridNode*)myrealloc(Bd->parts,
+					     Bd->cparts*sizeof(hybridNode));
+	}
+     Bd->parts[Bd->nparts++] = HB;
+   }
+
+	// appends the n bits of data to the hybridBV being built. the buffer
+	// keeps up to 2*BuildBits bits, and the first BuildBits become a 
+	// part when it fills, so the last parts are not too short
+
+void hybridBuilderAdd (hybridBuilder Bd, uint64_t *data, uint64_t n)
+
+   { uint64_t done,take;
+     done = 0;
+     while (done < n)
+	{ take = min(n-done,2*BuildBits-Bd->len);
+	  copyBits(Bd->data,Bd->len,data,done,take);
+	  Bd->len += take;
+	  done += take;
+	  if (Bd->len == 2*BuildBits)
+	     { builderPart(Bd,0,BuildBits);
+	       memcpy(Bd->data,Bd->data+BuildBits/w,
+		      (BuildBits/w)*sizeof(uint64_t));
+	       Bd->len = BuildBits;
+	     }
+	}
+   }
+
+	// finishes the hybridBV being built as a balanced tree of its parts,
+	// the buffer making one or two more, and destroys Bd
+
+hybridBV hybridBuilderFinish (hybridBuilder Bd)
+
+   { hybridBV H = Bd->H;
+     uint64_t half;
+     if (Bd->nparts == 0) // a single node
+	{ Bd->data = (uint64_t*)myrealloc(Bd->data,
+				((Bd->len+w-1)/w+1)*sizeof(uint64_t));
+	  bitsNode(H,H->root,Bd->data,Bd->len);
+	}
+     else 
+	{ if (Bd->len > BuildBits)
+	     { half = (Bd->len/w/2)*w;
+	       builderPart(Bd,0,half);
+	       builderPart(Bd,half,Bd->len-half);
+	     }
+	  else builderPart(Bd,0,Bd->len);
+	  myfree(Bd->data);
+	  assemble(H,H->root,Bd->parts,Bd->nparts);
+	}
+     myfree(Bd->parts);
+     myfree(Bd);
+     return H;
+   }
+
+	// creates a hybridBV of n bits read from file, opened for reading,
+	// as the (n+w-1)/w words of the array given to hybridCreateFrom.
+	// reads ReadWords words at a time. configured by C, NULL for the 
+	// default
+
+hybridBV hybridCreateFromFile (FILE *file, uint64_t n, hybridConfig *C)
+
+   { hybridBuilder Bd = hybridBuilderCreate(C);
+     uint64_t *chunk;
+     uint64_t done,len;
+     chunk = (uint64_t*)myalloc(ReadWords*sizeof(uint64_t));
+     for (done=0;done<n;done+=len)
+	{ len = min(n-done,ReadWords*w);
+	  myfread(chunk,sizeof(uint64_t),(len+w-1)/w,file);
+	  hybridBuilderAdd(Bd,chunk,len);
+	}
+     myfree(chunk);
+     return hybridBuilderFinish(Bd);
+   }
+
+	// writes the bits of uniform or compressed B to file, as staticSave,
+	// decoding them by chunks
+
+static void chunkSave (hybridNode B, FILE *file)
+
+   { uint64_t chunk[16];
+     uint64_t n = nodeLength(B);
+     uint64_t i,len;
+     for (i=0;i<n;i+=len)
+	{ len = min(n-i,16*w);
+	  myread(B,i,len,chunk,0);
+	  if (len % w) chunk[len/w] &= (((uint64_t)1) << (len % w)) - 1;
+	  myfwrite (chunk,sizeof(uint64_t),(len+w-1)/w,file);
+	}
+   }
+
+	// writes H to file, which must be opened for writing
+
+static void flushTail (hybridBV H);
+static void dropHead (hybridBV H);
+static int bufferUpdate (hybridBV H, msgType op, uint64_t i, uint v);
+
+void hybridSave (hybridBV H, FILE *file)
+
+   { int64_t delta;
+     uint64_t size;
+     hybridNode B = H->root;
+     flushTail(H);
+     flatten(H,B,&delta);
+     dropHead(H);
+     size = nodeLength(B);
+     myfwrite (&size,sizeof(uint64_t),1,file);
+     if (B->type == tStatic) staticSave(B->bv.stat,file);
+     else if (B->type != tLeaf) chunkSave(B,file);
+     else leafSave(B->bv.leaf,file);
+   }
+
+	// loads hybridBV from file, which must be opened for reading
+	// configured by C, NULL for the default
+
+hybridBV hybridLoad (FILE *file, hybridConfig *C)
+
+   { uint64_t size,ones;
+     uint64_t *D;
+     int v;
+     staticBV SB;
+     hybridBV H = create(C);
+     hybridNode B = H->root;
+     myfread (&size,sizeof(uint64_t),1,file);
+     if (size > leafNewSize()*w)
+        { B->type = tStatic;
+          B->bv.stat = SB = staticLoad(file,size);
+	  H->statics = staticSpace(SB);
+	  if ((v = uniformBits(staticBits(SB),size)) != -1)
+	     { freeStatic(H,SB);
+	       setUniform(B,size,v);
+	     }
+	  else if (sparseBits(staticBits(SB),size,&ones))
+	     { newCompressed(H,B,staticType(size,ones),staticBits(SB),size);
+	       freeStatic(H,SB);
+	     }
+	}
+     else
+        { D = (uint64_t*)myalloc(((size+w-1)/w+1)*sizeof(uint64_t));
+	  myfread (D,sizeof(uint64_t),(size+w-1)/w,file);
+	  makeLeaf(H,B,D,size);
+	  myfree(D);
+	}
+     return H;
+   }
+
+	// gives space of the nodes and leaves of B in w-bit words, without
+	// their statics, which can share buffers
+
+static uint64_t nodeSpace (hybridNode B)
+
+   { uint64_t s;
+     uint k;
+     s = (sizeof(struct s_hybridNode)*8+w-1)/w;
+     if (B->type == tLeaf) return s+leafSpace(B->bv.leaf);
+     if (B->type == tRLE) return s+rleSpace(B->bv.rle);
+     if (B->type == tArray) return s+arraySpace(B->bv.arr);
+     else if (isStatic(B)) return s;
+     else if (B->type == tWide)
+	{ s += (sizeof(struct s_wideBV)*8+w-1)/w;
+	  for (k=0;k<B->bv.wide->nchildren;k++) 
+	      s += nodeSpace(B->bv.wide->child[k]);
+	  return s;
+	}
+     return s+(sizeof(struct s_dynamicBV)*8+w-1)/w+
+	    nodeSpace(B->bv.dyn->left)+nodeSpace(B->bv.dyn->right);
+   }
+
+	// gives space of hybridBV in w-bit words, including the space the
+	// pools hold but is not in use
+
+uint64_t hybridSpace (hybridBV H)
+
+   { return (sizeof(struct s_hybridBV)*8+w-1)/w + nodeSpace(H->root) +
+	    H->statics + poolOverhead(H->nodes) + poolOverhead(H->dyns) + 
+	    poolOverhead(H->wides) + leafPoolsOverhead(H->leaves) +
+	    poolOverhead(H->runs) + arrayPoolsOverhead(H->arrays) + 
+	    (H->tail ? leafSpace(H->tail) : 0) + 
+	    (H->front ? leafNewSize()+1 : 0) + 
+	    (H->bufs ? poolSpace(H->bufs) : 0);
+   }
+
+	// gives the same as hybridSpace in O(1) time, from what the pools
+	// and the statics of H hold
+
+static uint64_t curSpace (hybridBV H)
+
+   { return (sizeof(struct s_hybridBV)*8+w-1)/w + 
+	    (sizeof(struct s_hybridNode)*8+w-1)/w + H->statics +
+	    poolSpace(H->nodes) + poolSpace(H->dyns) + poolSpace(H->wides) +
+	    leafPoolsSpace(H->leaves) + poolSpace(H->runs) +
+	    arrayPoolsSpace(H->arrays) + (H->front ? leafNewSize()+1 : 0) +
+	    (H->bufs ? poolSpace(H->bufs) : 0);
+   }
+
+	// flattens the maximal dynamic subtrees below B last updated at
+	// time <= old, and recounts the leaves above them
+
+static void flattenCold (hybridBV H, hybridNode B, uint64_t old)
+
+   { int64_t delta;
+     uint k;
+     if (B->type == tWide)
+	{ if (B->bv.wide->updated <= old) 
+	     { flattenMemory += nodeLength(B);
+	       flattenAccess -= nodeLength(B);
+	       flatten(H,B,&delta);
+	       return;
+	     }
+	  B->bv.wide->leaves = 0;
+	  for (k=0;k<B->bv.wide->nchildren;k++)
+	      { flattenCold(H,B->bv.wide->child[k],old);
+	        B->bv.wide->leaves += nodeLeaves(B->bv.wide->child[k]);
+	      }
+	}
+     else if (B->type == tDynamic)
+	{ if (B->bv.dyn->updated <= old) 
+	     { flattenMemory += nodeLength(B);
+	       flattenAccess -= nodeLength(B);
+	       flatten(H,B,&delta);
+	       return;
+	     }
+	  flattenCold(H,B->bv.dyn->left,old);
+	  flattenCold(H,B->bv.dyn->right,old);
+	  B->bv.dyn->leaves = nodeLeaves(B->bv.dyn->left) +
+			      nodeLeaves(B->bv.dyn->right);
+	}
+   }
+
+	// gives the oldest update time of a dynamic node below B
+
+static uint64_t oldestUpdate (hybridNode B)
+
+   { uint64_t old,t;
+     uint k;
+     if (B->type == tWide)
+	{ old = B->bv.wide->updated;
+	  for (k=0;k<B->bv.wide->nchildren;k++)
+	      { t = oldestUpdate(B->bv.wide->child[k]);
+		if (t < old) old = t;
+	      }
+	  return old;
+	}
+     if (B->type == tDynamic)
+	{ old = B->bv.dyn->updated;
+	  t = oldestUpdate(B->bv.dyn->left);
+	  if (t < old) old = t;
+	  t = oldestUpdate(B->bv.dyn->right);
+	  if (t < old) old = t;
+	  return old;
+	}
+     return ~(uint64_t)0;
+   }
+
+	// if H exceeds its cap, flattens the subtrees not updated since 
+	// the oldest update, then doubling that period each time, until 
+	// it uses at most CapSlack times its cap or it is all static. in 
+	// the latter case the cap is too close to the static size, and
+	// later calls wait until the space exceeds that floor by the slack
+	// of the cap, (1-CapSlack) times it, and then flatten only until
+	// half of that slack is recovered, instead of everything each time.
+	// flattening part of the views of a shared static buffer copies
+	// them, but frees it only when the views left use less than 
+	// MinShared of it, so a step that does not reduce the space is
+	// followed by flattening everything
+
+static void enforceCap (hybridBV H)
+
+   { uint64_t old,period,slack,target,space;
+     if (H->cap == 0) return;
+     slack = H->cap * (1-CapSlack);
+     target = H->cap - slack;
+     if (H->capFloor)
+	{ if (curSpace(H) <= max(H->cap,H->capFloor+slack)) return;
+	  target = max(target,H->capFloor+slack/2);
+	}
+     else if (curSpace(H) <= H->cap) return;
+     old = oldestUpdate(H->root);
+     period = 1;
+     space = curSpace(H);
+     while (old <= H->clock)
+	{ flattenCold(H,H->root,old);
+	  poolCompact(H->nodes);
+	  poolCompact(H->dyns);
+	  poolCompact(H->wides);
+	  poolCompact(H->runs);
+	  arrayPoolsCompact(H->arrays);
+	  leafPoolsCompact(H->leaves);
+	  if (curSpace(H) <= target) return;
+	  if (old == H->clock) break;
+	  if (curSpace(H) >= space) old = H->clock; // no gain, flatten all
+	  else { space = curSpace(H);
+		 old = min(H->clock,old+period);
+		 period *= 2;
+	       }
+	}
+     H->capFloor = curSpace(H); // all static now
+   }
+
+	// chooses theta for the fraction of updates q1 among the recent
+	// operations on H and its length n, as recommended in the README
+
+static void retune (hybridBV H)
+
+   { float q1 = H->updates / (float)(H->updates + H->queries);
+     if (q1 >= 0.1) H->theta = 0.1;
+     else if (q1 <= 0.0001) H->theta = 0.01;
+     else if (nodeLength(H->root) <= (((uint64_t)1) << 22)) H->theta = 0.01;
+     else H->theta = 0.001;
+   }
+
+	// counts an update (upd) or query on H. if adaptive, retunes its
+	// theta and halves the counts once per window so old operations fade out
+
+static inline void countOp (hybridBV H, uint upd)
+
+   { if (H->conf.decay) H->ops++;
+     if (!upd) sampleQuery(H);
+     if (!H->adaptive) return;
+     if (upd) H->updates++; else H->queries++;
+     if (H->updates + H->queries >= RatioWindow)
+	{ retune(H);
+	  H->updates /= 2; H->queries /= 2;
+	}
+   }
+
+	// makes H choose its own theta, or use the configured one
+
+void hybridSetAdaptiveTheta (hybridBV H, uint adaptive)
+
+   { H->adaptive = adaptive;
+     H->theta = H->conf.theta;
+     H->updates = H->queries = 0;
+   }
+
+	// sets the max space of H in w-bit words, 0 for no limit
 
-   { leafBV LB1,LB2;
-     uint i,trf,ones,words;
-     uint64_t *segment;
+void hybridSetMemoryCap (hybridBV H, uint64_t cap)
 
-     LB1 = B->left->bv.leaf;
-     LB2 = B->right->bv.leaf;
-     trf = (LB1->size-LB2->size+1)/2;
-     if (trf < leafMaxSize() * w * TrfFactor) return 0;
-     segment = (uint64_t*)myalloc(leafMaxSize()*sizeof(uint64_t));
-     memcpy(segment,LB2->data,(LB2->size+7)/8);
-     copyBits(LB2->data,0,LB1->data,LB1->size-trf,trf);
-     words = trf / w;
-     ones = 0;
-     for (i=0;i<words;i++) ones += popcount(LB2->data[i]);
-     if (trf % w) ones += popcount(LB2->data[words] & 
-				   (((uint64_t)1) << (trf % w)) - 1);
-     LB1->ones -= ones;
-     LB2->ones += ones;
-     copyBits(LB2->data,trf,segment,0,LB2->size);
-     LB1->size -= trf;
-     LB2->size += trf;
-     myfree(segment);
-     return 1;
+   { H->cap = cap;
+     H->capFloor = 0;
+     enforceCap(H);
    }
 
-	// writes B to file, which must be opened for writing
+	// appends leaf HB after the last leaf of B, merging them if they fit
+	// in a new leaf. full wide nodes are split on the way down and 
+	// dynamic ones rebalanced on the way up, as insert does
 
-void hybridSave (hybridBV B, FILE *file)
+static void appendNode (hybridBV H, hybridNode B, hybridNode HB)
 
-   { int64_t delta;
-     flatten(B,&delta);
-     if (B->type == tStatic) 
-	{ myfwrite (&B->bv.stat->size,sizeof(uint64_t),1,file);
-	  staticSave(B->bv.stat,file);
+   { hybridNode C;
+     dynamicBV D;
+     wideBV W;
+     uint64_t lsize,rsize;
+     int64_t delta;
+     if (B->type == tWide)
+	{ if (B->bv.wide->nchildren >= maxChildren(H)) wideGrow(H,B); // no room
+	  W = B->bv.wide;
+	  C = W->child[W->nchildren-1];
+	  if ((C->type == tWide) && (C->bv.wide->nchildren >= maxChildren(H)))
+	     flushNode(H,C); // C splits, its buffered updates go down first
+	  if ((C->type == tWide) && (C->bv.wide->nchildren >= maxChildren(H)))
+	     { wideAddChild(W,W->nchildren,wideSplit(H,C->bv.wide));
+	       C = W->child[W->nchildren-1];
+	     }
+	  if ((C->type == tWide) || (C->type == tDynamic) || 
+	      (isLeaf(C) && (nodeLength(C)+nodeLength(HB) <= leafNewSize()*w)))
+	     appendNode(H,C,HB);
+	  else wideAddChild(W,W->nchildren,HB);
+	  wideRecount(W);
+	  W->accesses = 0; // reset
+	  W->updated = H->clock;
 	}
-     else 
-	{ myfwrite (&B->bv.leaf->size,sizeof(uint64_t),1,file);
-	  leafSave(B->bv.leaf,file);
+     else if (B->type == tDynamic)
+	{ D = B->bv.dyn;
+	  appendNode(H,D->right,HB);
+	  dynRecount(H,D);
+	  lsize = nodeLength(D->left);
+	  rsize = nodeLength(D->right);
+	  if ((rsize > H->conf.alpha*(lsize+rsize))
+	      && (lsize+rsize >= H->conf.minLeavesToBalance*leafMaxSize()*w) 
+	      && canBalance(H,lsize+rsize,0,0)) // too biased
+	     { delta = 0;
+	       balance(H,B,lsize+rsize-1,&delta);
+	     }
+	}
+     else if (nodeLength(B) == 0) // an empty root
+	{ C = (hybridNode)poolAlloc(H->nodes);
+	  *C = *B;
+	  nodeDestroy(H,C);
+	  *B = *HB;
+	  poolFree(H->nodes,HB);
+	}
+     else if (isLeaf(B) && (nodeLength(B)+nodeLength(HB) <= leafNewSize()*w))
+	{ mergeLeaves(H,B,HB);
+	  poolFree(H->nodes,HB);
+	}
+     else // B becomes the parent of its old contents and HB
+	{ C = (hybridNode)poolAlloc(H->nodes);
+	  *C = *B;
+	  if (H->conf.fanout > 2)
+	     { W = wideCreate(H);
+	       W->child[0] = C;
+	       W->child[1] = HB;
+	       W->nchildren = 2;
+	       wideRecount(W);
+	       B->type = tWide;
+	       B->bv.wide = W;
+	     }
+	  else
+	     { D = (dynamicBV)poolAlloc(H->dyns);
+	       D->left = C;
+	       D->right = HB;
+	       dynRecount(H,D);
+	       D->epoch = 0;
+	       D->buf = NULL;
+	       B->type = tDynamic;
+	       B->bv.dyn = D;
+	     }
 	}
    }
 
-	// loads hybridBV from file, which must be opened for reading
+	// number of bits appended to H and not yet in the tree
 
-hybridBV hybridLoad (FILE *file)
+static inline uint64_t tailLength (hybridBV H)
 
-   { uint64_t size;
-     hybridBV B = myalloc(sizeof(struct s_hybridBV));
-     myfread (&size,sizeof(uint64_t),1,file);
-     if (size > leafNewSize()*w)
-        { B->type = tStatic;
-          B->bv.stat = staticLoad(file,size);
-	}
-     else
-        { B->type = tLeaf;
-          B->bv.leaf = leafLoad(file,size);
-	}
-     return B;
+   { return H->tail ? leafLength(H->tail) : 0;
    }
 
-	// gives space of hybridBV in w-bit words
+	// moves the bits appended to H from its tail to the end of the tree
 
-uint64_t hybridSpace (hybridBV B)
+static void flushTail (hybridBV H)
 
-   { uint64_t s;
-     s = (sizeof(struct s_hybridBV)*8+w-1)/w;
-     if (B->type == tLeaf) return s+leafSpace(B->bv.leaf);
-     else if (B->type == tStatic) return s+staticSpace(B->bv.stat);
-     return s+(sizeof(struct s_dynamicBV)*8+w-1)/w+
-	    hybridSpace(B->bv.dyn->left)+hybridSpace(B->bv.dyn->right);
+   { hybridNode HB;
+     if (tailLength(H) == 0) return;
+     H->clock++;
+     HB = (hybridNode)poolAlloc(H->nodes);
+     leafCloseGap(H->tail);
+     makeLeaf(H,HB,H->tail->data,leafLength(H->tail));
+     leafDestroy(H->tail,H->leaves);
+     H->tail = NULL;
+     appendNode(H,H->root,HB);
+     enforceCap(H);
+   }
+
+	// gives B[i] seeing the buffered updates, without counting accesses
+
+static uint peek (hybridNode B, uint64_t i)
+
+   { uint64_t D[1];
+     uint64_t lsize;
+     hybridBuf F;
+     uint k,v;
+     while ((B->type == tWide) || (B->type == tDynamic))
+	{ F = nodeBuf(B);
+	  if (F && bufferFind(F,&i,&v)) return v;
+	  if (B->type == tWide)
+	     { k = wideFind(B->bv.wide,i);
+	       i -= wideSizeBefore(B->bv.wide,k);
+	       B = B->bv.wide->child[k];
+	     }
+	  else
+	     { lsize = nodeLength(B->bv.dyn->left);
+	       if (i < lsize) B = B->bv.dyn->left;
+	       else { i -= lsize; B = B->bv.dyn->right; }
+	     }
+	}
+     myread(B,i,1,D,0);
+     return D[0] & 1;
    }
 
 	// gives bit length
 
-inline uint64_t hybridLength (hybridBV B)
+inline uint64_t hybridLength (hybridBV H)
 
-   { if (B->type == tLeaf) return leafLength(B->bv.leaf);
-     if (B->type == tStatic) return staticLength(B->bv.stat);
-     return B->bv.dyn->size;
+   { return nodeLength(H->root) - H->head + tailLength(H);
+   }
+
+	// gives number of leaves
+
+inline uint64_t hybridLeaves (hybridBV H)
+
+   { return nodeLeaves(H->root);
    }
 
 	// gives number of ones
 
-inline uint64_t hybridOnes (hybridBV B)
+inline uint64_t hybridOnes (hybridBV H)
 
-   { if (B->type == tLeaf) return leafOnes(B->bv.leaf);
-     if (B->type == tStatic) return staticOnes(B->bv.stat);
-     return B->bv.dyn->ones;
+   { return nodeOnes(H->root) - H->headOnes + 
+	    (H->tail ? leafOnes(H->tail) : 0);
    }
 
-	// sets value for B[i]= (v != 0), assumes i is right
-	// returns the difference in 1s
+	// sets value for B[i]= (v != 0), assumes i is right. old is B[i]
+	// if updates are buffered. returns the difference in 1s
 
-int hybridWrite (hybridBV B, uint64_t i, uint v)
+static int nodeWrite (hybridBV H, hybridNode B, uint64_t i, uint v, uint old)
 
    { uint64_t lsize;
      int dif;
-     if (B->type == tStatic) { 
-	B->type = tDynamic;
-	B->bv.dyn = split(B->bv.stat,i); // does not change #leaves!
+     wideBV W;
+     uint k;
+     if ((B->type == tUniform) && (uniBit(B) == (v != 0))) return 0;
+     if (isStatic(B)) { 
+	split(H,B,i); // does not change #leaves!
+	}
+     if (B->type == tArray)
+	{ if (!v || ((arrayOnes(B->bv.arr)+1)*ArrayRatio < 
+		     arrayLength(B->bv.arr)))
+	     { B->bv.arr = arrayResize(B->bv.arr,arrayOnes(B->bv.arr)+(v != 0),
+				       H->arrays);
+	       dif = arrayWrite(B->bv.arr,i,v);
+	       if (dif < 0) 
+		  B->bv.arr = arrayResize(B->bv.arr,arrayOnes(B->bv.arr),
+					  H->arrays);
+	       return dif;
+	     }
+	  plainLeaf(H,B); // too many 1s, write it as a plain leaf
 	}
      if (B->type == tLeaf) 
-	return leafWrite(B->bv.leaf,i,v);
+	{ dif = leafWrite(B->bv.leaf,i,v);
+	  if (dif && joinsRuns(B->bv.leaf,i,i+1,v != 0)) runsLeaf(H,B);
+	  return dif;
+	}
+     if (B->type == tRLE)
+	{ dif = rleWrite(B->bv.rle,i,v);
+	  if (rleRuns(B->bv.rle) > MaxRuns) plainLeaf(H,B);
+	  return dif;
+	}
+     if (B->type == tWide)
+	{ W = B->bv.wide;
+	  W->accesses = 0; // reset
+	  W->updated = H->clock;
+	  k = wideFind(W,i);
+	  dif = send(H,W->child[k],mWrite,i-wideSizeBefore(W,k),v,old,NULL);
+	  for (;k<W->nchildren;k++) W->cones[k] += dif;
+	  return dif;
+	}
      B->bv.dyn->accesses = 0; // reset
-     lsize = hybridLength(B->bv.dyn->left);
-     if (i < lsize) dif = hybridWrite(B->bv.dyn->left,i,v);
-     else dif = hybridWrite(B->bv.dyn->right,i-lsize,v);
+     B->bv.dyn->updated = H->clock;
+     lsize = nodeLength(B->bv.dyn->left);
+     if (i < lsize) dif = send(H,B->bv.dyn->left,mWrite,i,v,old,NULL);
+     else dif = send(H,B->bv.dyn->right,mWrite,i-lsize,v,old,NULL);
      B->bv.dyn->ones += dif;
      return dif;
    }
 
+static int doWrite (hybridBV H, uint64_t i, uint v)
+
+   { int dif;
+     uint64_t size = nodeLength(H->root) - H->head; // bits before the tail
+     H->clock++;
+     if (i >= size) return leafWrite(H->tail,i-size,v);
+     i += H->head;
+     if (i < H->frontEnd) H->frontEnd = 0; // the copy is no longer valid
+     dif = nodeWrite(H,H->root,i,v,H->cbuffer ? peek(H->root,i) : 0);
+     enforceCap(H);
+     return dif;
+   }
+
+int hybridWrite (hybridBV H, uint64_t i, uint v)
+
+   { countOp(H,1);
+     if (H->cbuffer) return bufferUpdate(H,mWrite,i,v != 0);
+     return doWrite(H,i,v);
+   }
+
 	// changing leaves is uncommon and only then we need to recompute
 	// leaves. we do our best to avoid this overhead in typical operations
 
-static void irecompute (hybridBV B, uint64_t i)
+static void irecompute (hybridNode B, uint64_t i)
 
    { uint64_t lsize;
+     uint k;
+     if (B->type == tWide) {
+	k = wideFind(B->bv.wide,i);
+	irecompute(B->bv.wide->child[k],i-wideSizeBefore(B->bv.wide,k));
+	B->bv.wide->leaves = 0;
+	for (k=0;k<B->bv.wide->nchildren;k++)
+	    B->bv.wide->leaves += nodeLeaves(B->bv.wide->child[k]);
+	}
      if (B->type == tDynamic) {
-        lsize = hybridLength(B->bv.dyn->left);
+        lsize = nodeLength(B->bv.dyn->left);
         if (i < lsize) irecompute(B->bv.dyn->left,i);
         else irecompute(B->bv.dyn->right,i-lsize);
-        B->bv.dyn->leaves = hybridLeaves(B->bv.dyn->left) +
-			    hybridLeaves(B->bv.dyn->right);
+        B->bv.dyn->leaves = nodeLeaves(B->bv.dyn->left) +
+			    nodeLeaves(B->bv.dyn->right);
 	}
    }
 
-static void rrecompute (hybridBV B, uint64_t i, uint64_t l)
-
-   { uint64_t lsize;
+static void rrecompute (hybridNode B, uint64_t i, uint64_t l)
+
+   { uint64_t lsize,off,len;
+     uint k;
+     if (B->type == tWide) {
+	k = wideFind(B->bv.wide,i);
+	while (l) {
+	   off = wideSizeBefore(B->bv.wide,k);
+	   len = min(l,B->bv.wide->csize[k]-i);
+	   rrecompute(B->bv.wide->child[k],i-off,len);
+	   i += len; l -= len; k++;
+	   }
+	B->bv.wide->leaves = 0;
+	for (k=0;k<B->bv.wide->nchildren;k++)
+	    B->bv.wide->leaves += nodeLeaves(B->bv.wide->child[k]);
+	}
      if (B->type == tDynamic) {
-	lsize = hybridLength(B->bv.dyn->left);
+	lsize = nodeLength(B->bv.dyn->left);
      	if (i+l < lsize) rrecompute(B->bv.dyn->left,i,l);
 	else if (i >= lsize) rrecompute(B->bv.dyn->right,i-lsize,l);
 	else { rrecompute(B->bv.dyn->left,i,lsize-i);
 	       rrecompute(B->bv.dyn->right,0,l-(lsize-i));
 	     }
-        B->bv.dyn->leaves = hybridLeaves(B->bv.dyn->left) +
-			    hybridLeaves(B->bv.dyn->right);
+        B->bv.dyn->leaves = nodeLeaves(B->bv.dyn->left) +
+			    nodeLeaves(B->bv.dyn->right);
+	}
+   }
+
+	// inserts v at B[i] for a wide B, as in a B+-tree: full children are
+	// split before descending, so there is always room for them in B
+
+static void wideInsert (hybridBV H, hybridNode B, uint64_t i, uint v, uint *recalc)
+
+   { wideBV W;
+     hybridNode C;
+     uint k;
+     if (B->bv.wide->nchildren >= maxChildren(H)) wideGrow(H,B); // no room
+     W = B->bv.wide;
+     W->accesses = 0; // reset
+     W->updated = H->clock;
+     k = wideFind(W,i);
+     C = W->child[k];
+     if ((C->type == tWide) && (C->bv.wide->nchildren >= maxChildren(H)))
+	flushNode(H,C); // C splits, its buffered updates go down first
+     if (((C->type == tRLE) || (C->type == tArray)) && 
+	 (nodeLength(C) == leafMaxSize()*w))
+	plainLeaf(H,C); // full, split it as a plain leaf
+     if ((C->type == tWide) && (C->bv.wide->nchildren >= maxChildren(H)))
+	{ wideAddChild(W,k+1,wideSplit(H,C->bv.wide));
+	  wideRecount(W);
+	  k = wideFind(W,i);
+	}
+     else if ((C->type == tLeaf) && (leafLength(C->bv.leaf) == leafMaxSize()*w))
+	{ if (!(((k+1 < W->nchildren) && (W->child[k+1]->type == tLeaf) 
+		&& transferRight(H,C,W->child[k+1]))
+	       || ((k > 0) && (W->child[k-1]->type == tLeaf) 
+		&& transferLeft(H,W->child[k-1],C))))
+	     { wideSplitLeaf(H,W,k); // could not avoid it
+	       *recalc = 1; // leaf added
+	     }
+	  else wideRecount(W);
+	  k = wideFind(W,i);
 	}
+     send(H,W->child[k],mInsert,i-wideSizeBefore(W,k),v,0,recalc);
+     for (;k<W->nchildren;k++) 
+	 { W->csize[k]++;
+	   W->cones[k] += v;
+	 }
    }
 
 	// inserts v at B[i], assumes i is right
 
-static void insert (hybridBV B, uint64_t i, uint v, uint *recalc)
+static void insert (hybridBV H, hybridNode B, uint64_t i, uint v, uint *recalc)
 
    { uint64_t lsize,rsize;
      int64_t delta;
-     if (B->type == tStatic) { 
-	B->type = tDynamic;
-	B->bv.dyn = split(B->bv.stat,i); // does not change #leaves!
+     hybridNode HB1,HB2;
+     if ((B->type == tUniform) && (uniBit(B) == v)) { // just grows
+	lsize = nodeLeaves(B);
+	setUniform(B,uniLength(B)+1,v);
+	if (nodeLeaves(B) != lsize) *recalc = 1;
+	return;
+	}
+     if (isStatic(B)) { 
+	split(H,B,i); // does not change #leaves!
+	}
+     if (B->type == tRLE) {
+	if (rleLength(B->bv.rle) < leafMaxSize() * w)
+	   { rleInsert(B->bv.rle,i,v);
+	     if (rleRuns(B->bv.rle) > MaxRuns) plainLeaf(H,B);
+	     return;
+	   }
+	plainLeaf(H,B); // full, split it as a plain leaf
+	}
+     if (B->type == tArray) {
+	if ((arrayLength(B->bv.arr) < leafMaxSize() * w) &&
+	    ((arrayOnes(B->bv.arr)+(v != 0))*ArrayRatio < 
+	     arrayLength(B->bv.arr)+1))
+	   { B->bv.arr = arrayResize(B->bv.arr,arrayOnes(B->bv.arr)+(v != 0),
+				     H->arrays);
+	     arrayInsert(B->bv.arr,i,v);
+	     return;
+	   }
+	plainLeaf(H,B); // full or too many 1s, insert it as a plain leaf
 	}
      if (B->type == tLeaf) {
 	if (leafLength(B->bv.leaf) == leafMaxSize() * w) // split
-	   { B->type = tDynamic;
-	     B->bv.dyn = splitLeaf(B->bv.leaf);
+	   { if (H->conf.fanout > 2)
+		{ halveLeaf(H,B->bv.leaf,&HB1,&HB2);
+		  B->type = tWide;
+		  B->bv.wide = wideCreate(H);
+		  B->bv.wide->child[0] = HB1;
+		  B->bv.wide->child[1] = HB2;
+		  B->bv.wide->nchildren = 2;
+		  wideRecount(B->bv.wide);
+		}
+	     else 
+		{ B->type = tDynamic;
+	          B->bv.dyn = splitLeaf(H,B->bv.leaf);
+		}
 	     *recalc = 1; // leaf added
 	   }
 	else 
-	   { leafInsert(B->bv.leaf,i,v);
+	   { B->bv.leaf = leafResize(B->bv.leaf,leafLength(B->bv.leaf)+1,
+				     H->leaves);
+	     leafInsert(B->bv.leaf,i,v,H->conf.gap);
 	     return;
 	   }
 	}
+     if (B->type == tWide) {
+	wideInsert(H,B,i,v,recalc);
+	return;
+	}
      B->bv.dyn->accesses = 0; // reset
-     lsize = hybridLength(B->bv.dyn->left);
-     rsize = hybridLength(B->bv.dyn->right);
+     B->bv.dyn->updated = H->clock;
+     lsize = nodeLength(B->bv.dyn->left);
+     rsize = nodeLength(B->bv.dyn->right);
      if (i < lsize) {  // insert on left child
         if ((lsize == leafMaxSize() * w)     // will overflow if leaf
 	     && (rsize < leafMaxSize() * w)  // can avoid if leaf
 	     && (B->bv.dyn->left->type == tLeaf) // both are leaves
 	     && (B->bv.dyn->right->type == tLeaf) 
-	     && transferRight(B->bv.dyn)) { // avoided, transferred to right
-	   insert(B,i,v,recalc); // now could be to the right!
+	     && transferRight(H,B->bv.dyn->left,B->bv.dyn->right)) {
+				// avoided, transferred to right
+	   insert(H,B,i,v,recalc); // now could be to the right!
 	   return;
 	   }
-	if ((lsize+1 > Alpha*(lsize+rsize+1))
-	    && (lsize+rsize >= MinLeavesToBalance*leafMaxSize()*w) 
-	    && canBalance(lsize+rsize,1,0)) { // too biased
+	if ((lsize+1 > H->conf.alpha*(lsize+rsize+1))
+	    && (lsize+rsize >= H->conf.minLeavesToBalance*leafMaxSize()*w) 
+	    && canBalance(H,lsize+rsize,1,0)) { // too biased
 	   delta = 0;
-	   balance(B,i,&delta);
+	   balance(H,B,i,&delta);
 	   if (delta) *recalc = 1;
-	   insert(B,i,v,recalc); 
+	   insert(H,B,i,v,recalc); 
 	   return;
 	   }
-	insert(B->bv.dyn->left,i,v,recalc); // normal recursive call 
+	send(H,B->bv.dyn->left,mInsert,i,v,0,recalc); // normal recursive call 
 	}
      else { // insert on right child
 	if ((rsize == leafMaxSize() * w)    // will overflow if leaf
 	     && (lsize < leafMaxSize() * w) // can avoid if leaf
 	     && (B->bv.dyn->left->type == tLeaf) // both are leaves
 	     && (B->bv.dyn->right->type == tLeaf) 
-	     && transferLeft(B->bv.dyn)) { // avoided, transferred to right
-	   insert(B,i,v,recalc); // now could be to the left!
+	     && transferLeft(H,B->bv.dyn->left,B->bv.dyn->right)) {
+				// avoided, transferred to left
+	   insert(H,B,i,v,recalc); // now could be to the left!
 	   return;
 	   }
-	if ((rsize+1 > Alpha*(lsize+rsize+1))
-	    && (lsize+rsize >= MinLeavesToBalance*leafMaxSize()*w) 
-	    && canBalance(lsize+rsize,0,1)) { // too biased
+	if ((rsize+1 > H->conf.alpha*(lsize+rsize+1))
+	    && (lsize+rsize >= H->conf.minLeavesToBalance*leafMaxSize()*w) 
+	    && canBalance(H,lsize+rsize,0,1)) { // too biased
 	   delta = 0;
-	   balance(B,i,&delta);
+	   balance(H,B,i,&delta);
 	   if (delta) *recalc = 1;
-	   insert(B,i,v,recalc);
+	   insert(H,B,i,v,recalc);
 	   return;
 	   }
-        insert(B->bv.dyn->right,i-lsize,v,recalc); // normal rec call
+        send(H,B->bv.dyn->right,mInsert,i-lsize,v,0,recalc); // normal rec call
 	}
      B->bv.dyn->size++;
      B->bv.dyn->ones += v;
    }
 
-void hybridInsert (hybridBV B, uint64_t i, uint v)
+static void doInsert (hybridBV H, uint64_t i, uint v)
 
-   { uint recalc = 0;
-     insert(B,i,v,&recalc);
+   { hybridNode B = H->root;
+     uint recalc = 0;
+     uint64_t size = nodeLength(B) - H->head; // bits before the tail
+     H->clock++;
+     if ((i >= size) && (tailLength(H) == leafNewSize()*w))
+	{ flushTail(H); // no room in the tail
+	  size = nodeLength(B) - H->head;
+	}
+     if (i >= size)
+	{ if (H->tail == NULL) H->tail = leafCreate(H->leaves);
+	  H->tail = leafResize(H->tail,leafLength(H->tail)+1,H->leaves);
+	  leafInsert(H->tail,i-size,v,H->conf.gap);
+	  return;
+	}
+     i += H->head;
+     if (i < H->frontEnd) H->frontEnd = 0; // the copy is no longer valid
+     insert(H,B,i,v,&recalc);
      if (recalc) irecompute(B,i); // we went to the leaf now holding i
+     enforceCap(H);
+   }
+
+void hybridInsert (hybridBV H, uint64_t i, uint v)
+
+   { countOp(H,1);
+     if (H->cbuffer) bufferUpdate(H,mInsert,i,v);
+     else doInsert(H,i,v);
+   }
+
+	// deletes B[i] for a wide B. underfull children are merged with
+	// a neighbor as in a B+-tree, while flattening works as usual
+
+static int wideDelete (hybridBV H, hybridNode B, uint64_t i, uint old,
+		       uint *recalc)
+
+   { wideBV W = B->bv.wide;
+     hybridNode C;
+     uint k,j;
+     int dif;
+     int64_t delta;
+     uint64_t size;
+     W->accesses = 0; // reset
+     W->updated = H->clock;
+     k = wideFind(W,i);
+     dif = send(H,W->child[k],mDelete,i-wideSizeBefore(W,k),0,old,recalc);
+     for (j=k;j<W->nchildren;j++)
+	 { W->csize[j]--;
+	   W->cones[j] += dif;
+	 }
+     C = W->child[k];
+     if (nodeLength(C) == 0) // empty child, remove
+	{ nodeDestroy(H,C);
+	  wideRemoveChild(W,k);
+	  wideRecount(W);
+	  *recalc = 1;
+	}
+     else if (C->type == tLeaf)
+	{ if ((k+1 < W->nchildren) && (W->child[k+1]->type == tLeaf) &&
+	      (nodeLength(C)+nodeLength(W->child[k+1]) <= leafNewSize()*w))
+	     { wideMergeLeaves(H,W,k);
+	       *recalc = 1;
+	     }
+	  else if ((k > 0) && (W->child[k-1]->type == tLeaf) &&
+	      (nodeLength(C)+nodeLength(W->child[k-1]) <= leafNewSize()*w))
+	     { wideMergeLeaves(H,W,k-1);
+	       *recalc = 1;
+	     }
+	}
+     else if ((C->type == tWide) && 
+	      (C->bv.wide->nchildren < maxChildren(H) * MinWideFill))
+	{ if ((k+1 < W->nchildren) && (W->child[k+1]->type == tWide) &&
+	      (C->bv.wide->nchildren + W->child[k+1]->bv.wide->nchildren 
+						<= maxChildren(H)))
+	     wideMergeChildren(H,W,k);
+	  else if ((k > 0) && (W->child[k-1]->type == tWide) &&
+	      (C->bv.wide->nchildren + W->child[k-1]->bv.wide->nchildren 
+						<= maxChildren(H)))
+	     wideMergeChildren(H,W,k-1);
+	}
+     if (W->nchildren == 1) // a single child, replaces B
+	{ C = W->child[0];
+	  *B = *C;
+	  poolFree(H->nodes,C);
+	  poolFree(H->wides,W);
+	  *recalc = 1;
+	  return dif;
+	}
+     size = W->csize[W->nchildren-1];
+     if (size <= leafNewSize() * w) { // becomes a leaf
+	delta = 0;
+	flatten(H,B,&delta);
+	*recalc = 1;
+	}
+     else if (size < W->leaves * leafNewSize() * w * H->conf.minFillFactor) {
+	delta = 0;
+	flattenFill += size;
+	flattenAccess -= size;
+	flatten(H,B,&delta);
+	if (delta) *recalc = 1;
+	}
+     return dif;
    }
 
-	// deletes B[i], assumes i is right
-	// returns difference in 1s
+	// deletes B[i], assumes i is right. old is B[i] if updates are
+	// buffered. returns difference in 1s
 
-static int delete (hybridBV B, uint64_t i, uint *recalc)
+static int delete (hybridBV H, hybridNode B, uint64_t i, uint old, uint *recalc)
 
    { uint64_t lsize,rsize;
-     hybridBV B2;
+     hybridNode B2;
      int dif;
      int64_t delta;
-     if (B->type == tStatic) { 
-	B->type = tDynamic;
-	B->bv.dyn = split(B->bv.stat,i); // does not change #leaves!
+     if (B->type == tUniform) { // just shrinks, or becomes a leaf
+	lsize = nodeLeaves(B);
+	dif = - uniBit(B);
+	if (uniLength(B)-1 > leafNewSize() * w) 
+	   setUniform(B,uniLength(B)-1,uniBit(B));
+	else makePart(H,B,NULL,NULL,0,uniLength(B)-1,uniBit(B));
+	if (nodeLeaves(B) != lsize) *recalc = 1;
+	H->underflow = 0;
+	return dif;
+	}
+     if (isStatic(B)) { 
+	split(H,B,i); // does not change #leaves!
+	}
+     if (B->type == tRLE) // becomes plain if it must be repaired
+	{ dif = rleDelete(B->bv.rle,i);
+	  H->underflow = (rleLength(B->bv.rle) < leafNewSize()*w/2);
+	  if (H->underflow || (rleRuns(B->bv.rle) > MaxRuns)) plainLeaf(H,B);
+	  return dif;
+	}
+     if (B->type == tArray) // becomes plain if it must be repaired
+	{ dif = arrayDelete(B->bv.arr,i);
+	  H->underflow = (arrayLength(B->bv.arr) < leafNewSize()*w/2);
+	  if (H->underflow || 
+	      (arrayOnes(B->bv.arr)*ArrayRatio >= arrayLength(B->bv.arr)))
+	     plainLeaf(H,B); // or if too many 1s for its length
+	  else if (dif < 0)
+	     B->bv.arr = arrayResize(B->bv.arr,arrayOnes(B->bv.arr),H->arrays);
+	  return dif;
 	}
      if (B->type == tLeaf) 
-	return leafDelete(B->bv.leaf,i);
+	{ dif = leafDelete(B->bv.leaf,i,H->conf.gap);
+	  B->bv.leaf = leafResize(B->bv.leaf,leafLength(B->bv.leaf),H->leaves);
+	  H->underflow = (leafLength(B->bv.leaf) < leafNewSize()*w/2);
+	  if (!H->underflow && joinsRuns(B->bv.leaf,i,i,1+dif)) 
+	     runsLeaf(H,B);
+	  return dif;
+	}
+     if (B->type == tWide)
+	return wideDelete(H,B,i,old,recalc);
      B->bv.dyn->accesses = 0; // reset
-     lsize = hybridLength(B->bv.dyn->left);
-     rsize = hybridLength(B->bv.dyn->right);
+     B->bv.dyn->updated = H->clock;
+     lsize = nodeLength(B->bv.dyn->left);
+     rsize = nodeLength(B->bv.dyn->right);
      if (i < lsize) { 
-        if ((rsize > Alpha*(lsize+rsize-1))
-	    && (lsize+rsize >= MinLeavesToBalance*leafMaxSize()*w) 
-	    && canBalance(lsize+rsize,-1,0)) { // too biased
+        if ((rsize > H->conf.alpha*(lsize+rsize-1))
+	    && (lsize+rsize >= H->conf.minLeavesToBalance*leafMaxSize()*w) 
+	    && canBalance(H,lsize+rsize,-1,0)) { // too biased
 	   delta = 0;
-	   balance(B,i,&delta); 
+	   balance(H,B,i,&delta); 
 	   if (delta) *recalc = 1;
-	   return delete(B,i,recalc); // now could enter in the right child!
+	   return delete(H,B,i,old,recalc); // now could enter the right child!
 	   }
-	dif = delete(B->bv.dyn->left,i,recalc); // normal recursive call otherw
+	dif = send(H,B->bv.dyn->left,mDelete,i,0,old,recalc); // normal call
         if (lsize == 1) { // left child is now of size zero, remove
-           hybridDestroy(B->bv.dyn->left);
+           nodeDestroy(H,B->bv.dyn->left);
            B2 = B->bv.dyn->right;
-           myfree(B->bv.dyn);
+           poolFree(H->dyns,B->bv.dyn);
            *B = *B2;
+           poolFree(H->nodes,B2);
 	   *recalc = 1; 
            return dif;
            } 
 	}
      else {
-        if ((lsize > Alpha*(lsize+rsize-1))
-	    && (lsize+rsize >= MinLeavesToBalance*leafMaxSize()*w) 
-	    && canBalance(lsize+rsize,0,-1)) { // too biased
+        if ((lsize > H->conf.alpha*(lsize+rsize-1))
+	    && (lsize+rsize >= H->conf.minLeavesToBalance*leafMaxSize()*w) 
+	    && canBalance(H,lsize+rsize,0,-1)) { // too biased
 	   delta = 0;
-	   balance(B,i,&delta);
+	   balance(H,B,i,&delta);
 	   if (delta) *recalc = 1; 
-	   return delete(B,i,recalc); // now could enter in the left child!
+	   return delete(H,B,i,old,recalc); // now could enter the left child!
 	   }
-        dif = delete(B->bv.dyn->right,i-lsize,recalc); // normal recursive call
+        dif = send(H,B->bv.dyn->right,mDelete,i-lsize,0,old,recalc); // normal call
         if (rsize == 1) { // right child now size zero, remove
-           hybridDestroy(B->bv.dyn->right);
+           nodeDestroy(H,B->bv.dyn->right);
            B2 = B->bv.dyn->left;
-           myfree(B->bv.dyn);
+           poolFree(H->dyns,B->bv.dyn);
            *B = *B2;
+           poolFree(H->nodes,B2);
 	   *recalc = 1; 
            return dif;
            }
 	}
      B->bv.dyn->size--;
      B->bv.dyn->ones += dif;
-     if (B->bv.dyn->size <= leafNewSize() * w) { // merge, must be leaves
-	B->bv.leaf = mergeLeaves(B->bv.dyn);
+     if ((B->bv.dyn->size <= leafNewSize() * w) && // merge, must be leaves
+	 isLeaf(B->bv.dyn->left) && isLeaf(B->bv.dyn->right)) {
+	B->bv.leaf = mergeChildren(H,B->bv.dyn);
 	B->type = tLeaf;
 	*recalc = 1; 
 	}
+     else if (B->bv.dyn->size <= leafNewSize() * w) { // buffered below
+	delta = 0;
+	flatten(H,B,&delta);
+	*recalc = 1;
+	}
      else if (B->bv.dyn->size < 
-	      B->bv.dyn->leaves * leafNewSize() * w * MinFillFactor) {
+	      B->bv.dyn->leaves * leafNewSize() * w * H->conf.minFillFactor) {
 	delta = 0;
 	flattenFill += B->bv.dyn->size;
 	flattenAccess -= B->bv.dyn->size;
-	flatten(B,&delta); 
+	flatten(H,B,&delta); 
 	if (delta) *recalc = 1;
 	}
      return dif;
    }
 
-int hybridDelete (hybridBV B, uint64_t i)
+	// collects in P[0..] the nodes from the root of H down to the leaf
+	// holding position i, and in *start the position where the leaf 
+	// starts. returns the depth of the leaf, or -1 if the path goes 
+	// through wide or static nodes or is deeper than MaxDepth
+
+static int leafPath (hybridBV H, uint64_t i, hybridNode *P, uint64_t *start)
+
+   { hybridNode B = H->root;
+     uint64_t lsize;
+     int d = 0;
+     *start = 0;
+     while (B->type == tDynamic)
+	{ if (d == MaxDepth-1) return -1;
+	  P[d++] = B;
+	  lsize = nodeLength(B->bv.dyn->left);
+	  if (i < lsize) B = B->bv.dyn->left;
+	  else { B = B->bv.dyn->right; i -= lsize; *start += lsize; }
+	}
+     if (B->type != tLeaf) return -1;
+     P[d] = B;
+     return d;
+   }
+
+	// recomputes the counters of the dynamic nodes P[0..d-1], bottom-up
+
+static void pathRecount (hybridBV H, hybridNode *P, int d)
+
+   { while (d--) dynRecount(H,P[d]->bv.dyn);
+   }
+
+	// if the leaf holding position i is less than half full, merges it
+	// with the next (or previous) leaf or borrows from it, even if they
+	// hang from different nodes. it gives up on wide and static nodes
+
+static void repairLeaf (hybridBV H, uint64_t i)
+
+   { hybridNode P1[MaxDepth],P2[MaxDepth];
+     hybridNode *PL,*PR; // paths to the left and the right leaf
+     int d1,d2,dl,dr,k;
+     uint64_t s1,s2,len;
+     hybridNode Par,Sib;
+     dynamicBV D;
+     d1 = leafPath(H,i,P1,&s1);
+     if (d1 <= 0) return; // also if the root is a leaf
+     len = leafLength(P1[d1]->bv.leaf);
+     if (len >= leafNewSize()*w/2) return;
+     if (s1+len < nodeLength(H->root))
+	{ d2 = leafPath(H,s1+len,P2,&s2);
+	  PL = P1; dl = d1; PR = P2; dr = d2;
+	}
+     else
+	{ d2 = leafPath(H,s1-1,P2,&s2);
+	  PL = P2; dl = d2; PR = P1; dr = d1;
+	}
+     if (d2 < 0) return;
+     if (len + leafLength(P2[d2]->bv.leaf) <= leafNewSize()*w)
+	{ mergeLeaves(H,PL[dl],PR[dr]);
+		// the parent of the right leaf is replaced by its sibling
+	  Par = PR[dr-1]; D = Par->bv.dyn;
+	  Sib = (D->left == PR[dr]) ? D->right : D->left;
+	  *Par = *Sib;
+	  poolFree(H->nodes,Sib); poolFree(H->nodes,PR[dr]);
+	  poolFree(H->dyns,D);
+	  if ((dl >= dr) && (PL[dr-1] == Par)) // Sib was on the left path
+	     { for (k=dr;k<dl;k++) PL[k] = PL[k+1];
+	       dl--;
+	     }
+	  dr--; // the right path now ends at the ancestors of Par
+	}
+     else if (PL == P1) 
+	{ if (!transferLeft(H,PL[dl],PR[dr])) return;
+	}
+     else if (!transferRight(H,PL[dl],PR[dr])) return;
+     pathRecount(H,PL,dl);
+     pathRecount(H,PR,dr);
+   }
+
+static int doDelete (hybridBV H, uint64_t i)
 
-   { uint recalc = 0;
-     int dif = delete(B,i,&recalc);
+   { hybridNode B = H->root;
+     uint recalc = 0;
+     int dif;
+     uint64_t size = nodeLength(B) - H->head; // bits before the tail
+     H->clock++;
+     if (i >= size)
+	{ dif = leafDelete(H->tail,i-size,H->conf.gap);
+	  H->tail = leafResize(H->tail,leafLength(H->tail),H->leaves);
+	  return dif;
+	}
+     i += H->head;
+     if (i < H->frontEnd) H->frontEnd = 0; // the copy is no longer valid
+     dif = delete(H,B,i,H->cbuffer ? peek(B,i) : 0,&recalc);
      if (recalc) { // the node is now at i-1 or at i, hard to know
         irecompute(B,i-1);
         irecompute(B,i); 
 	}
+     if (H->underflow && !H->pending) // it moves bits below buffers
+	{ if (i > 0) repairLeaf(H,i-1);
+	  if (i < nodeLength(H->root)) repairLeaf(H,i);
+	}
+     enforceCap(H);
      return dif;
    }
 
+int hybridDelete (hybridBV H, uint64_t i)
+
+   { countOp(H,1);
+     if (H->cbuffer) return bufferUpdate(H,mDelete,i,0);
+     return doDelete(H,i);
+   }
+
 	// flattening is uncommon and only then we need to recompute
-	// leaves. we do our best to avoid this overhead in typical queries
+	// leaves. we do our best to avoid this overhead in typical queries.
+	// i goes through the buffered updates as in rank, which is also the
+	// way access went if it went below them
 
-static void recompute (hybridBV B, uint64_t i, int64_t delta)
+static void recompute (hybridNode B, uint64_t i, int64_t delta)
 
    { uint64_t lsize;
-     if (B->type == tDynamic) {
-        B->bv.dyn->leaves += delta;
-        lsize = hybridLength(B->bv.dyn->left);
+     int64_t ones = 0;
+     uint k;
+     if ((B->type != tWide) && (B->type != tDynamic)) return;
+     if (B->type == tWide) B->bv.wide->leaves += delta;
+     else B->bv.dyn->leaves += delta;
+     if (nodeBuf(B))
+	{ i = bufferRank(nodeBuf(B),i+1,&ones);
+	  if (i-- == 0) return;
+	}
+     if (B->type == tWide) {
+	k = wideFind(B->bv.wide,i);
+	recompute(B->bv.wide->child[k],i-wideSizeBefore(B->bv.wide,k),delta);
+	}
+     else {
+        lsize = nodeLength(B->bv.dyn->left);
         if (i < lsize) recompute(B->bv.dyn->left,i,delta);
         else recompute(B->bv.dyn->right,i-lsize,delta);
 	}
@@ -672,240 +2840,695 @@ static void recompute (hybridBV B, uint64_t i, int64_t delta)
 
 	// access B[i], assumes i is right
 
-static uint access (hybridBV B, uint64_t i, int64_t *delta, uint64_t n)
+static uint access (hybridBV H, hybridNode B, uint64_t i, int64_t *delta, uint64_t n)
 
    { uint64_t lsize;
+     uint k,v;
+     if (B->type == tWide)
+        { countAccess(H,B);
+	  if (mustFlatten(H,B,n))
+ 	     flatten(H,B,delta); 
+          else 
+	     { if (B->bv.wide->buf && bufferFind(B->bv.wide->buf,&i,&v)) 
+		  return v;
+	       k = wideFind(B->bv.wide,i);
+	       return access(H,B->bv.wide->child[k],
+			     i-wideSizeBefore(B->bv.wide,k),delta,n);
+	     }
+        }
      if (B->type == tDynamic) 
-        { B->bv.dyn->accesses++;
-	  if (mustFlatten(B,n))
- 	     flatten(B,delta); 
+        { countAccess(H,B);
+	  if (mustFlatten(H,B,n))
+ 	     flatten(H,B,delta); 
           else 
-	     { lsize = hybridLength(B->bv.dyn->left);
-               if (i < lsize) return access(B->bv.dyn->left,i,delta,n);
-               else return access(B->bv.dyn->right,i-lsize,delta,n);
+	     { if (B->bv.dyn->buf && bufferFind(B->bv.dyn->buf,&i,&v)) 
+		  return v;
+	       lsize = nodeLength(B->bv.dyn->left);
+               if (i < lsize) return access(H,B->bv.dyn->left,i,delta,n);
+               else return access(H,B->bv.dyn->right,i-lsize,delta,n);
 	     }
         }
      if (B->type == tLeaf) return leafAccess(B->bv.leaf,i);
+     if (B->type == tRLE) return rleAccess(B->bv.rle,i);
+     if (B->type == tArray) return arrayAccess(B->bv.arr,i);
+     if (B->type == tUniform) return uniBit(B);
+     if (B->type == tRRR) return rrrAccess(B->bv.rrr,i);
+     if (B->type == tEF) return efAccess(B->bv.ef,i);
      return staticAccess(B->bv.stat,i);
    }
 
-uint hybridAccess (hybridBV B, uint64_t i)
+uint hybridAccess (hybridBV H, uint64_t i)
 
-   { int64_t delta = 0;
+   { hybridNode B = H->root;
+     int64_t delta = 0;
      uint64_t n = 0;
-     if (B->type == tDynamic) n = B->bv.dyn->size;
-     uint answ = access(B,i,&delta,n);
+     uint64_t size = nodeLength(B) - H->head; // bits before the tail
+     countOp(H,0);
+     if (i >= size) return leafAccess(H->tail,i-size);
+     i += H->head;
+     if ((B->type == tDynamic) || (B->type == tWide)) n = nodeLength(B);
+     uint answ = access(H,B,i,&delta,n);
      if (delta) recompute(B,i,delta);
      return answ;
    }
 
         // read bits [i..i+l-1], onto D[j...]
 
-static void sread (hybridBV B, uint64_t i, uint64_t l, uint64_t *D, uint64_t j,
+static void sread (hybridBV H, hybridNode B, uint64_t i, uint64_t l, uint64_t *D, uint64_t j,
 		   uint *recomp, uint64_t n)
 
-   { uint64_t lsize;
+   { uint64_t lsize,off,len;
      int64_t delta;
+     uint k;
+     if (B->type == tWide)
+        { countAccess(H,B);
+	  if (mustFlatten(H,B,n)) {
+	     delta = 0;
+	     flatten(H,B,&delta); 
+	     if (delta) *recomp = 1;
+	     }
+	  else {
+	    k = wideFind(B->bv.wide,i);
+	    while (l) {
+	       off = wideSizeBefore(B->bv.wide,k);
+	       len = min(l,B->bv.wide->csize[k]-i);
+	       sread(H,B->bv.wide->child[k],i-off,len,D,j,recomp,n);
+	       i += len; j += len; l -= len; k++;
+	       }
+	    return;
+	    }
+        }
      if (B->type == tDynamic)
-        { B->bv.dyn->accesses++;
-	  if (mustFlatten(B,n)) {
+        { countAccess(H,B);
+	  if (mustFlatten(H,B,n)) {
 	     delta = 0;
-	     flatten(B,&delta); 
+	     flatten(H,B,&delta); 
 	     if (delta) *recomp = 1;
 	     }
 	  else {
-	    lsize = hybridLength(B->bv.dyn->left);
-     	    if (i+l < lsize) sread(B->bv.dyn->left,i,l,D,j,recomp,n);
-	    else if (i>=lsize) sread(B->bv.dyn->right,i-lsize,l,D,j,recomp,n);
-	    else { sread(B->bv.dyn->left,i,lsize-i,D,j,recomp,n);
-		   sread(B->bv.dyn->right,0,l-(lsize-i),D,j+(lsize-i),recomp,n);
+	    lsize = nodeLength(B->bv.dyn->left);
+     	    if (i+l < lsize) sread(H,B->bv.dyn->left,i,l,D,j,recomp,n);
+	    else if (i>=lsize) sread(H,B->bv.dyn->right,i-lsize,l,D,j,recomp,n);
+	    else { sread(H,B->bv.dyn->left,i,lsize-i,D,j,recomp,n);
+		   sread(H,B->bv.dyn->right,0,l-(lsize-i),D,j+(lsize-i),recomp,n);
 		 }
 	    return;
 	    }
         }
      if (B->type == tLeaf) { leafRead(B->bv.leaf,i,l,D,j); return; }
+     if (B->type == tRLE) { rleRead(B->bv.rle,i,l,D,j); return; }
+     if (B->type == tArray) { arrayRead(B->bv.arr,i,l,D,j); return; }
+     if (B->type == tUniform) { fillBits(D,j,l,uniBit(B)); return; }
+     if (B->type == tRRR) { rrrRead(B->bv.rrr,i,l,D,j); return; }
+     if (B->type == tEF) { efRead(B->bv.ef,i,l,D,j); return; }
      staticRead(B->bv.stat,i,l,D,j);
    }
 
-void hybridRead (hybridBV B, uint64_t i, uint64_t l, uint64_t *D, uint64_t j)
+	// reads bits [i..i+l-1] of the tree of H, including its head
 
-   { uint recomp = 0;
+static void treeRead (hybridBV H, uint64_t i, uint64_t l, uint64_t *D, uint64_t j)
+
+   { hybridNode B = H->root;
+     uint recomp = 0;
      uint64_t n = 0;
-     if (B->type == tDynamic) n = B->bv.dyn->size;
-     sread(B,i,l,D,j,&recomp,n);
+     unbuffer(H,B,i,l); // sread does not see buffered updates
+     if ((B->type == tDynamic) || (B->type == tWide)) n = nodeLength(B);
+     sread(H,B,i,l,D,j,&recomp,n);
      if (recomp) rrecompute(B,i,l);
    }
 
+void hybridRead (hybridBV H, uint64_t i, uint64_t l, uint64_t *D, uint64_t j)
+
+   { uint64_t size,len;
+     countOp(H,0);
+     size = nodeLength(H->root) - H->head; // bits before the tail
+     len = (i < size) ? min(l,size-i) : 0;
+     if (len) treeRead(H,H->head+i,len,D,j);
+     if (len < l) leafRead(H->tail,i+len-size,l-len,D,j+len);
+   }
+
 	// computes rank_1(B,i), zero-based, assumes i is right
 
-static uint64_t rank (hybridBV B, uint64_t i, int64_t *delta, uint64_t n)
+static uint64_t rank (hybridBV H, hybridNode B, uint64_t i, int64_t *delta, uint64_t n)
 
    { uint64_t lsize;
+     int64_t ones = 0; // added by the buffered updates
+     uint k;
+     if (B->type == tWide)
+        { countAccess(H,B);
+	  if (mustFlatten(H,B,n))
+	     flatten(H,B,delta); 
+          else { 
+	     if (B->bv.wide->buf)
+		{ i = bufferRank(B->bv.wide->buf,i+1,&ones);
+		  if (i-- == 0) return ones;
+		}
+	     k = wideFind(B->bv.wide,i);
+	     return ones + wideOnesBefore(B->bv.wide,k) + 
+		    rank(H,B->bv.wide->child[k],
+			 i-wideSizeBefore(B->bv.wide,k),delta,n);
+	     }
+	}
      if (B->type == tDynamic)
-        { B->bv.dyn->accesses++;
-	  if (mustFlatten(B,n))
-	     flatten(B,delta); 
+        { countAccess(H,B);
+	  if (mustFlatten(H,B,n))
+	     flatten(H,B,delta); 
           else { 
-	     lsize = hybridLength(B->bv.dyn->left);
-             if (i < lsize) return rank(B->bv.dyn->left,i,delta,n);
-             else return hybridOnes(B->bv.dyn->left) + 
-			 rank(B->bv.dyn->right,i-lsize,delta,n);
+	     if (B->bv.dyn->buf)
+		{ i = bufferRank(B->bv.dyn->buf,i+1,&ones);
+		  if (i-- == 0) return ones;
+		}
+	     lsize = nodeLength(B->bv.dyn->left);
+             if (i < lsize) return ones + rank(H,B->bv.dyn->left,i,delta,n);
+             else return ones + nodeOnes(B->bv.dyn->left) + 
+			 rank(H,B->bv.dyn->right,i-lsize,delta,n);
 	     }
 	}
      if (B->type == tLeaf) return leafRank(B->bv.leaf,i);
+     if (B->type == tRLE) return rleRank(B->bv.rle,i);
+     if (B->type == tArray) return arrayRank(B->bv.arr,i);
+     if (B->type == tUniform) return uniBit(B) ? i+1 : 0;
+     if (B->type == tRRR) return rrrRank(B->bv.rrr,i);
+     if (B->type == tEF) return efRank(B->bv.ef,i);
      return staticRank(B->bv.stat,i);
    }
 
-uint64_t hybridRank (hybridBV B, uint64_t i)
+	// version of hybridRank that does not count the operation
+
+static uint64_t doRank (hybridBV H, uint64_t i)
 
-   { int64_t delta = 0;
+   { hybridNode B = H->root;
+     int64_t delta = 0;
      uint64_t n = 0;
-     if (B->type == tDynamic) n = B->bv.dyn->size;
-     uint64_t answ = rank(B,i,&delta,n);
+     uint64_t size = nodeLength(B) - H->head; // bits before the tail
+     if (i >= size) 
+	return nodeOnes(B) - H->headOnes + leafRank(H->tail,i-size);
+     i += H->head;
+     if ((B->type == tDynamic) || (B->type == tWide)) n = nodeLength(B);
+     uint64_t answ = rank(H,B,i,&delta,n);
      if (delta) recompute(B,i,delta);
-     return answ;
+     return answ - H->headOnes;
+   }
+
+uint64_t hybridRank (hybridBV H, uint64_t i)
+
+   { countOp(H,0);
+     return doRank(H,i);
    }
 
 	// computes rank_0(B,i), zero-based, assumes i is right
 
-uint64_t hybridRank0 (hybridBV B, uint64_t i)
+uint64_t hybridRank0 (hybridBV H, uint64_t i)
 
-   { return i + 1 - hybridRank(B,i);
+   { return i + 1 - hybridRank(H,i);
    }
 
         // computes select_1(B,j), zero-based, assumes j is right
 
-static uint64_t select1 (hybridBV B, uint64_t j, int64_t *delta, uint64_t n)
+static uint64_t select1 (hybridBV H, hybridNode B, uint64_t j, int64_t *delta, uint64_t n)
 
    { uint64_t lones;
+     uint k;
+     if (B->type == tWide)
+        { countAccess(H,B);
+	  if (mustFlatten(H,B,n))
+	     flatten(H,B,delta); 
+          else { 
+	     k = wideFindOnes(B->bv.wide,j);
+	     return wideSizeBefore(B->bv.wide,k) + select1(H,B->bv.wide->child[k],
+			 j-wideOnesBefore(B->bv.wide,k),delta,n);
+	     }
+	}
      if (B->type == tDynamic)
-        { B->bv.dyn->accesses++;
-	  if (mustFlatten(B,n))
-	     flatten(B,delta); 
+        { countAccess(H,B);
+	  if (mustFlatten(H,B,n))
+	     flatten(H,B,delta); 
           else { 
-             lones = hybridOnes(B->bv.dyn->left);
-             if (j <= lones) return select1(B->bv.dyn->left,j,delta,n);
-	     return hybridLength(B->bv.dyn->left) 
-		    + select1(B->bv.dyn->right,j-lones,delta,n);
+             lones = nodeOnes(B->bv.dyn->left);
+             if (j <= lones) return select1(H,B->bv.dyn->left,j,delta,n);
+	     return nodeLength(B->bv.dyn->left) 
+		    + select1(H,B->bv.dyn->right,j-lones,delta,n);
 	     }
 	}
      if (B->type == tLeaf) return leafSelect(B->bv.leaf,j);
+     if (B->type == tRLE) return rleSelect(B->bv.rle,j);
+     if (B->type == tArray) return arraySelect(B->bv.arr,j);
+     if (B->type == tUniform) return j-1; // must be all 1s
+     if (B->type == tRRR) return rrrSelect(B->bv.rrr,j);
+     if (B->type == tEF) return efSelect(B->bv.ef,j);
      return staticSelect(B->bv.stat,j);
    }
 
-uint64_t hybridSelect (hybridBV B, uint64_t j)
+	// version of hybridSelect that does not count the operation
+
+static uint64_t doSelect (hybridBV H, uint64_t j)
 
-   { int64_t delta = 0;
+   { hybridNode B = H->root;
+     int64_t delta = 0;
      uint64_t n = 0;
-     if (B->type == tDynamic) n = B->bv.dyn->size;
-     uint64_t answ = select1(B,j,&delta,n);
+     uint64_t ones;
+     ones = nodeOnes(B) - H->headOnes; // 1s before the tail
+     if (j > ones) 
+	return nodeLength(B) - H->head + leafSelect(H->tail,j-ones);
+     j += H->headOnes;
+     unbufferSelect(H,B,j,1); // select does not see buffered updates
+     if ((B->type == tDynamic) || (B->type == tWide)) n = nodeLength(B);
+     uint64_t answ = select1(H,B,j,&delta,n);
      if (delta) recompute(B,answ,delta);
-     return answ;
+     return answ - H->head;
+   }
+
+uint64_t hybridSelect (hybridBV H, uint64_t j)
+
+   { countOp(H,0);
+     return doSelect(H,j);
    }
 
         // computes select_0(B,j), zero-based, assumes j is right
 
-static uint64_t select0 (hybridBV B, uint64_t j, int64_t *delta, uint64_t n)
+static uint64_t select0 (hybridBV H, hybridNode B, uint64_t j, int64_t *delta, uint64_t n)
 
-   { uint64_t lzeros;
+   { uint64_t lzeros,off;
+     uint k;
+     if (B->type == tWide)
+        { countAccess(H,B);
+	  if (mustFlatten(H,B,n))
+	     flatten(H,B,delta); 
+          else { 
+	     k = wideFindZeros(B->bv.wide,j);
+	     off = wideSizeBefore(B->bv.wide,k);
+	     return off + select0(H,B->bv.wide->child[k],
+			 j-(off-wideOnesBefore(B->bv.wide,k)),delta,n);
+	     }
+	}
      if (B->type == tDynamic)
-        { B->bv.dyn->accesses++;
-	  if (mustFlatten(B,n))
-	     flatten(B,delta); 
+        { countAccess(H,B);
+	  if (mustFlatten(H,B,n))
+	     flatten(H,B,delta); 
           else { 
-             lzeros = hybridLength(B->bv.dyn->left)-hybridOnes(B->bv.dyn->left);
-             if (j <= lzeros) return select0(B->bv.dyn->left,j,delta,n);
-	     return hybridLength(B->bv.dyn->left) 
-		    + select0(B->bv.dyn->right,j-lzeros,delta,n);
+             lzeros = nodeLength(B->bv.dyn->left)-nodeOnes(B->bv.dyn->left);
+             if (j <= lzeros) return select0(H,B->bv.dyn->left,j,delta,n);
+	     return nodeLength(B->bv.dyn->left) 
+		    + select0(H,B->bv.dyn->right,j-lzeros,delta,n);
 	     }
 	}
      if (B->type == tLeaf) return leafSelect0(B->bv.leaf,j);
+     if (B->type == tRLE) return rleSelect0(B->bv.rle,j);
+     if (B->type == tArray) return arraySelect0(B->bv.arr,j);
+     if (B->type == tUniform) return j-1; // must be all 0s
+     if (B->type == tRRR) return rrrSelect0(B->bv.rrr,j);
+     if (B->type == tEF) return efSelect0(B->bv.ef,j);
      return staticSelect0(B->bv.stat,j);
    }
 
-uint64_t hybridSelect0 (hybridBV B, uint64_t j)
+	// version of hybridSelect0 that does not count the operation
+
+static uint64_t doSelect0 (hybridBV H, uint64_t j)
 
-   { int64_t delta = 0;
+   { hybridNode B = H->root;
+     int64_t delta = 0;
      uint64_t n = 0;
-     if (B->type == tDynamic) n = B->bv.dyn->size;
-     uint64_t answ = select0(B,j,&delta,n);
+     uint64_t size,zeros;
+     size = nodeLength(B) - H->head; // bits before the tail
+     zeros = size - (nodeOnes(B) - H->headOnes); // 0s before it
+     if (j > zeros) return size + leafSelect0(H->tail,j-zeros);
+     j += H->head - H->headOnes;
+     unbufferSelect(H,B,j,0); // select does not see buffered updates
+     if ((B->type == tDynamic) || (B->type == tWide)) n = nodeLength(B);
+     uint64_t answ = select0(H,B,j,&delta,n);
      if (delta) recompute(B,answ,delta);
-     return answ;
+     return answ - H->head;
+   }
+
+uint64_t hybridSelect0 (hybridBV H, uint64_t j)
+
+   { countOp(H,0);
+     return doSelect0(H,j);
+   }
+
+	// computes next_1(H,i), or next_0 if v is 0, as the select of the 
+	// rank before i, since both see or send down the buffered updates
+
+static int64_t bufferNext (hybridBV H, uint64_t i, uint v)
+
+   { uint64_t before,total;
+     if (i >= hybridLength(H)) return -1;
+     before = i ? doRank(H,i-1) : 0; // 1s before i
+     total = hybridOnes(H);
+     if (!v) { before = i - before; total = hybridLength(H) - total; }
+     if (before == total) return -1;
+     return v ? doSelect(H,before+1) : doSelect0(H,before+1);
    }
 
         // computes next_1(B,i), zero-based and including i
         // returns -1 if no answer
 
-static int64_t next1 (hybridBV B, uint64_t i, int64_t *delta, uint64_t n)
+static int64_t next1 (hybridBV H, hybridNode B, uint64_t i, int64_t *delta, uint64_t n)
 
-   { uint64_t lsize;
+   { uint64_t lsize,off;
      int64_t next;
+     uint k;
+     if (B->type == tWide)
+        { if (nodeOnes(B) == 0) return -1; // not considered an access!
+	  countAccess(H,B);
+	  if (mustFlatten(H,B,n))
+	     flatten(H,B,delta); 
+          else { 
+	     for (k=wideFind(B->bv.wide,i);k<B->bv.wide->nchildren;k++)
+		{ off = wideSizeBefore(B->bv.wide,k);
+		  if (B->bv.wide->cones[k]-wideOnesBefore(B->bv.wide,k) == 0)
+		     continue; // nothing to find there
+		  next = next1(H,B->bv.wide->child[k],i > off ? i-off : 0,delta,n);
+		  if (next != -1) return off + next;
+		}
+	     return -1;
+	     }
+	}
      if (B->type == tDynamic)
-        { if (hybridOnes(B) == 0) return -1; // not considered an access!
-	  B->bv.dyn->accesses++;
-	  if (mustFlatten(B,n))
-	     flatten(B,delta); 
+        { if (nodeOnes(B) == 0) return -1; // not considered an access!
+	  countAccess(H,B);
+	  if (mustFlatten(H,B,n))
+	     flatten(H,B,delta); 
           else { 
-	     lsize = hybridLength(B->bv.dyn->left);
+	     lsize = nodeLength(B->bv.dyn->left);
              if (i < lsize) 
-		{ next = next1(B->bv.dyn->left,i,delta,n);
+		{ next = next1(H,B->bv.dyn->left,i,delta,n);
 		  if (next != -1) return next;
 		  i = lsize;
 		}
-	     next = next1(B->bv.dyn->right,i-lsize,delta,n);
+	     next = next1(H,B->bv.dyn->right,i-lsize,delta,n);
 	     if (next == -1) return -1;
              return lsize + next;
 	     }
 	}
      if (B->type == tLeaf) return leafNext(B->bv.leaf,i);
+     if (B->type == tRLE) return rleNext(B->bv.rle,i);
+     if (B->type == tArray) return arrayNext(B->bv.arr,i);
+     if (B->type == tUniform) return uniBit(B) ? i : -1;
+     if (B->type == tRRR) return rrrNext(B->bv.rrr,i);
+     if (B->type == tEF) return efNext(B->bv.ef,i);
      return staticNext(B->bv.stat,i);
    }
 
-int64_t hybridNext (hybridBV B, uint64_t i)
+int64_t hybridNext (hybridBV H, uint64_t i)
 
-   { int64_t delta = 0;
+   { hybridNode B = H->root;
+     int64_t delta = 0;
      uint64_t n = 0;
-     if (B->type == tDynamic) n = B->bv.dyn->size;
-     int64_t answ = next1(B,i,&delta,n);
-     if (delta) recompute(B,i,delta);
-     return answ;
+     uint64_t size;
+     int64_t answ;
+     countOp(H,0);
+     if (H->pending) return bufferNext(H,i,1);
+     size = nodeLength(B) - H->head; // bits before the tail
+     if (i < size)
+	{ i += H->head;
+	  if ((B->type == tDynamic) || (B->type == tWide)) n = nodeLength(B);
+	  answ = next1(H,B,i,&delta,n);
+	// flattenings may have happened anywhere in [i..answ]
+	  if (delta) rrecompute(B,i,(answ == -1 ? nodeLength(B) : answ+1)-i);
+	  if (answ != -1) return answ - H->head;
+	  i = size; // continue on the tail
+	}
+     i -= size;
+     if (i >= tailLength(H)) return -1;
+     answ = leafNext(H->tail,i);
+     return (answ == -1) ? -1 : size + answ;
    }
 
         // computes next_0(B,i), zero-based and including i
         // returns -1 if no answer
 
-static int64_t next0 (hybridBV B, uint64_t i, int64_t *delta, uint64_t n)
+static int64_t next0 (hybridBV H, hybridNode B, uint64_t i, int64_t *delta, uint64_t n)
 
-   { uint64_t lsize;
+   { uint64_t lsize,off;
      int64_t next;
+     uint k;
+     if (B->type == tWide)
+        { if (nodeOnes(B) == nodeLength(B)) return -1; // not an access
+	  countAccess(H,B);
+	  if (mustFlatten(H,B,n))
+	     flatten(H,B,delta); 
+          else { 
+	     for (k=wideFind(B->bv.wide,i);k<B->bv.wide->nchildren;k++)
+		{ off = wideSizeBefore(B->bv.wide,k);
+		  if (B->bv.wide->cones[k]-wideOnesBefore(B->bv.wide,k) == B->bv.wide->csize[k]-off)
+		     continue; // nothing to find there
+		  next = next0(H,B->bv.wide->child[k],i > off ? i-off : 0,delta,n);
+		  if (next != -1) return off + next;
+		}
+	     return -1;
+	     }
+	}
      if (B->type == tDynamic)
-        { if (hybridOnes(B) == hybridLength(B)) return -1; // not an access
-	  B->bv.dyn->accesses++;
-	  if (mustFlatten(B,n))
-	     flatten(B,delta); 
+        { if (nodeOnes(B) == nodeLength(B)) return -1; // not an access
+	  countAccess(H,B);
+	  if (mustFlatten(H,B,n))
+	     flatten(H,B,delta); 
           else { 
-	     lsize = hybridLength(B->bv.dyn->left);
+	     lsize = nodeLength(B->bv.dyn->left);
              if (i < lsize) 
-		{ next = next0(B->bv.dyn->left,i,delta,n);
+		{ next = next0(H,B->bv.dyn->left,i,delta,n);
 		  if (next != -1) return next;
 		  i = lsize;
 		}
-	     next = next0(B->bv.dyn->right,i-lsize,delta,n);
+	     next = next0(H,B->bv.dyn->right,i-lsize,delta,n);
 	     if (next == -1) return -1;
              return lsize + next;
 	     }
 	}
      if (B->type == tLeaf) return leafNext0(B->bv.leaf,i);
+     if (B->type == tRLE) return rleNext0(B->bv.rle,i);
+     if (B->type == tArray) return arrayNext0(B->bv.arr,i);
+     if (B->type == tUniform) return uniBit(B) ? -1 : i;
+     if (B->type == tRRR) return rrrNext0(B->bv.rrr,i);
+     if (B->type == tEF) return efNext0(B->bv.ef,i);
      return staticNext0(B->bv.stat,i);
    }
 
-int64_t hybridNext0 (hybridBV B, uint64_t i)
+int64_t hybridNext0 (hybridBV H, uint64_t i)
 
-   { int64_t delta = 0;
+   { hybridNode B = H->root;
+     int64_t delta = 0;
      uint64_t n = 0;
-     if (B->type == tDynamic) n = B->bv.dyn->size;
-     int64_t answ = next0(B,i,&delta,n);
-     if (delta) recompute(B,i,delta);
-     return answ;
+     uint64_t size;
+     int64_t answ;
+     countOp(H,0);
+     if (H->pending) return bufferNext(H,i,0);
+     size = nodeLength(B) - H->head; // bits before the tail
+     if (i < size)
+	{ i += H->head;
+	  if ((B->type == tDynamic) || (B->type == tWide)) n = nodeLength(B);
+	  answ = next0(H,B,i,&delta,n);
+	// flattenings may have happened anywhere in [i..answ]
+	  if (delta) rrecompute(B,i,(answ == -1 ? nodeLength(B) : answ+1)-i);
+	  if (answ != -1) return answ - H->head;
+	  i = size; // continue on the tail
+	}
+     i -= size;
+     if (i >= tailLength(H)) return -1;
+     answ = leafNext0(H->tail,i);
+     return (answ == -1) ? -1 : size + answ;
+   }
+
+
+	// removes the first leaf-level node below internal B, rebalancing
+	// and recounting the nodes on the way as delete does
+
+static void removeFirst (hybridBV H, hybridNode B)
+
+   { hybridNode C;
+     dynamicBV D;
+     wideBV W;
+     uint64_t lsize,rsize;
+     int64_t delta;
+     if (B->type == tWide)
+	{ W = B->bv.wide;
+	  C = W->child[0];
+	  if ((C->type == tWide) || (C->type == tDynamic))
+	     { removeFirst(H,C);
+	       if ((C->type == tWide) && (W->child[1]->type == tWide) &&
+		   (C->bv.wide->nchildren < maxChildren(H) * MinWideFill) &&
+		   (C->bv.wide->nchildren + W->child[1]->bv.wide->nchildren 
+						<= maxChildren(H)))
+		  wideMergeChildren(H,W,0);
+	     }
+	  else 
+	     { nodeDestroy(H,C);
+	       wideRemoveChild(W,0);
+	     }
+	  if (W->nchildren == 1) // a single child, replaces B
+	     { C = W->child[0];
+	       *B = *C;
+	       poolFree(H->nodes,C);
+	       poolFree(H->wides,W);
+	       return;
+	     }
+	  wideRecount(W);
+	  W->accesses = 0; // reset
+	  W->updated = H->clock;
+	  return;
+	}
+     D = B->bv.dyn;
+     if ((D->left->type != tWide) && (D->left->type != tDynamic))
+	{ nodeDestroy(H,D->left); // the right child replaces B
+	  C = D->right;
+	  poolFree(H->dyns,D);
+	  *B = *C;
+	  poolFree(H->nodes,C);
+	  return;
+	}
+     removeFirst(H,D->left);
+     dynRecount(H,D);
+     lsize = nodeLength(D->left);
+     rsize = nodeLength(D->right);
+     if ((rsize > H->conf.alpha*(lsize+rsize))
+	 && (lsize+rsize >= H->conf.minLeavesToBalance*leafMaxSize()*w) 
+	 && canBalance(H,lsize+rsize,0,0)) // too biased
+	{ delta = 0;
+	  balance(H,B,0,&delta);
+	}
+   }
+
+	// first leaf-level node below B
+
+static hybridNode firstNode (hybridNode B)
+
+   { while ((B->type == tWide) || (B->type == tDynamic))
+	B = (B->type == tWide) ? B->bv.wide->child[0] : B->bv.dyn->left;
+     return B;
+   }
+
+	// removes from the tree of H the first leaf-level nodes while they
+	// hold only popped bits
+
+static void retire (hybridBV H)
+
+   { hybridNode B;
+     uint64_t len;
+     while (H->head)
+	{ unbuffer(H,H->root,0,1); // the first leaf is reached without them
+	  B = firstNode(H->root);
+	  len = nodeLength(B);
+	  if (H->head < len) return;
+	  H->clock++;
+	  H->head -= len;
+	  H->headOnes -= nodeOnes(B);
+	  if (B == H->root) // empty now
+	     { B = (hybridNode)poolAlloc(H->nodes);
+	       *B = *H->root;
+	       nodeDestroy(H,B);
+	       H->root->type = tLeaf;
+	       H->root->bv.leaf = leafCreate(H->leaves);
+	     }
+	  else removeFirst(H,H->root);
+	}
+   }
+
+	// retires the popped nodes of H and copies the next bits to pop, up
+	// to the end of the first leaf-level node, onto its front
+
+static void refill (hybridBV H)
+
+   { retire(H);
+     if (nodeLength(H->root) == H->head) flushTail(H); // only the tail left
+     unbuffer(H,H->root,0,1);
+     if (H->front == NULL)
+	H->front = (uint64_t*)myalloc((leafNewSize()+1)*sizeof(uint64_t));
+     H->frontStart = H->head;
+     H->frontEnd = min(nodeLength(firstNode(H->root)),
+		       H->head+leafNewSize()*w);
+     treeRead(H,H->frontStart,H->frontEnd-H->frontStart,H->front,0);
+   }
+
+	// removes the popped bits from the tree of H, which is a single 
+	// node, for saving it
+
+static void dropHead (hybridBV H)
+
+   { hybridNode B;
+     uint64_t *D;
+     uint64_t len;
+     if (H->head == 0) return;
+     len = nodeLength(H->root) - H->head;
+     D = (uint64_t*)myalloc(((len+w-1)/w+1)*sizeof(uint64_t));
+     treeRead(H,H->head,len,D,0);
+     B = (hybridNode)poolAlloc(H->nodes);
+     *B = *H->root;
+     nodeDestroy(H,B);
+     bitsNode(H,H->root,D,len);
+     H->head = H->headOnes = 0;
+     H->frontEnd = 0;
+   }
+
+	// appends v at the end of H. the bits are collected in a tail leaf,
+	// which is added to the tree when full
+
+void hybridAppend (hybridBV H, uint v)
+
+   { countOp(H,1);
+     if (tailLength(H) == leafNewSize()*w) flushTail(H);
+     if (H->tail == NULL) H->tail = leafCreate(H->leaves);
+     H->tail = leafResize(H->tail,leafLength(H->tail)+1,H->leaves);
+     leafInsert(H->tail,leafLength(H->tail),v != 0,H->conf.gap);
+   }
+
+	// deletes H[0] and returns it. the popped bits are skipped, not 
+	// deleted, and the first leaf of the tree is removed once they 
+	// cover it
+
+uint hybridPopFront (hybridBV H)
+
+   { uint64_t p;
+     uint v;
+     countOp(H,1);
+     if (H->head >= H->frontEnd) refill(H);
+     p = H->head - H->frontStart;
+     v = (H->front[p/w] >> (p%w)) & 1;
+     H->head++;
+     H->headOnes += v;
+     return v;
+   }
+
+	// sends an update op of H[i] with v to the root of H, which buffers
+	// it if it is internal. deletes and writes read the old bit first, 
+	// seeing the buffered updates, since rank needs it. updates on the 
+	// tail or on a root that is not internal are applied at once.
+	// returns the difference in 1s
+
+static int bufferUpdate (hybridBV H, msgType op, uint64_t i, uint v)
+
+   { uint old = 0;
+     int dif;
+     uint64_t size = nodeLength(H->root) - H->head; // bits before the tail
+     if ((op == mInsert) && (i >= size) && (tailLength(H) == leafNewSize()*w))
+	{ flushTail(H); // no room in the tail, the insert goes to the tree
+	  size = nodeLength(H->root) - H->head;
+	}
+     if ((i >= size) || 
+	 ((H->root->type != tWide) && (H->root->type != tDynamic)))
+	{ if (op == mInsert) { doInsert(H,i,v); dif = v; }
+	  else if (op == mDelete) dif = doDelete(H,i);
+	  else dif = doWrite(H,i,v);
+	  recountLeaves(H->root); // if it split, its children buffer updates
+	  return dif;
+	}
+     i += H->head;
+     if (op != mInsert) old = peek(H->root,i);
+     if ((op == mWrite) && (old == v)) return 0;
+     H->clock++;
+     if (i < H->frontEnd) H->frontEnd = 0; // the copy is no longer valid
+     dif = bufferMsg(H,H->root,op,i,v,old);
+     enforceCap(H);
+     return dif;
    }
 
+	// makes each internal node of H buffer up to size updates, 0 for none
+
+void hybridSetBuffer (hybridBV H, uint size)
+
+   { drain(H,H->root);
+     if (H->bufs) poolDestroy(H->bufs);
+     H->bufs = size ? poolCreate(sizeof(struct s_hybridBuf) + 
+				 (size-1)*sizeof(hybridMsg)) : NULL;
+     H->cbuffer = size;
+   }
@@ -29,46 +29,188 @@ Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
 	// supports hybrid bitvectors of size up to 2^64-1
 
 #include "staticBV.h"
+#include "rrrBV.h"
+#include "efBV.h"
 #include "leafBV.h"
+#include "rleBV.h"
+#include "arrayBV.h"
 
 typedef enum {
   tDynamic  = 1,
   tStatic = 2,
-  tLeaf = 3
+  tLeaf = 3,
+  tWide = 4,
+  tUniform = 5, // a run of equal bits, of which only length and bit are kept
+  tRRR = 6, // a static compressed to its entropy
+  tEF = 7, // a static with few 1s, storing their positions
+  tRLE = 8, // a leaf with few runs, storing their lengths
+  tArray = 9 // a leaf with few 1s, storing their positions
  } nodeType;
 
-typedef struct s_hybridBV *hybridBV;
+#define MaxFanout 32 // max children of a wide node
 
+typedef struct s_hybridNode *hybridNode;
+
+	// an update buffered in an internal node, not yet sent to its children
+typedef enum { mInsert, mDelete, mWrite } msgType;
+
+typedef struct s_hybridMsg
+   { uint64_t pos; // position of the update in the node when it was made
+     byte op; // a msgType
+     byte bit; // bit inserted or written
+     byte old; // bit deleted or overwritten
+   } hybridMsg;
+
+	// the updates buffered in an internal node, in order
+typedef struct s_hybridBuf
+   { uint n; // number of updates
+     int64_t length,ones; // change in length and 1s they make
+     hybridMsg msg[1]; // as many as the buffer size of the hybridBV
+   } *hybridBuf;
+
+	// size and ones count the children, not the buffered updates
 typedef struct s_dynamicBV
    { uint64_t size;
      uint64_t ones;
      uint64_t leaves;
-     uint64_t accesses; // since last update
-     hybridBV left,right; // hybridBVs
+     uint64_t accesses; // since last update, decayed if conf.decay
+     uint64_t updated; // clock of the last update below
+     uint64_t epoch; // decay period of the last access
+     hybridNode left,right; // hybridNodes
+     hybridBuf buf; // updates not yet sent to the children, NULL if none
    } *dynamicBV;
 
-typedef struct s_hybridBV
+	// B+-tree like internal node, used instead of dynamicBV if fanout > 2
+typedef struct s_wideBV
+   { uint nchildren;
+     uint64_t leaves;
+     uint64_t accesses; // since last update, decayed if conf.decay
+     uint64_t updated; // clock of the last update below
+     uint64_t epoch; // decay period of the last access
+     uint64_t csize[MaxFanout]; // cumulative sizes of the children
+     uint64_t cones[MaxFanout]; // cumulative 1s of the children
+     hybridNode child[MaxFanout]; // hybridNodes
+     hybridBuf buf; // updates not yet sent to the children, NULL if none
+   } *wideBV;
+
+typedef struct s_hybridNode
    { nodeType type;
      union
       { staticBV stat;
+        rrrBV rrr;
+        efBV ef;
         leafBV leaf;
+        rleBV rle;
+        arrayBV arr;
         dynamicBV dyn;
+        wideBV wide;
+        uint64_t uni; // 2*length+bit, if tUniform
       } bv;
+   } *hybridNode;
+
+	// tuning of a hybridBV, fixed when it is created
+typedef struct s_hybridConfig
+   { float theta; // theta * length reads => rebuild as static
+     float epsilon; // do not flatten nodes of size over epsilon * n
+     float alpha; // balance factor 3/5 < . < 1
+     uint fanout; // max children of internal nodes, 2 (binary) to 
+		  // MaxFanout. over 2 uses wideBVs
+     float trfFactor; // trfFactor * max leaf size to justify transfers
+     int minLeavesToBalance; // min number of leaves to balance the tree
+     float minFillFactor; // less than this involves rebuild, <= Gamma/2
+     uint64_t decay; // accesses lose half their weight every decay
+			// operations, 0 to count them until an update
+     uint sample; // only 1 in sample queries, at random, count accesses,
+			// so queries rarely write on the nodes. 1 counts all
+     uint gap; // dynamic leaves keep their free space as a gap at their
+		// last update, so nearby updates shift few bits. 0 for not
+   } hybridConfig;
+
+	// the tree of a hybridBV, and the pools its nodes and leaves come from
+typedef struct s_hybridBV
+   { hybridNode root;
+     pool nodes; // s_hybridNode
+     pool dyns; // s_dynamicBV
+     pool wides; // s_wideBV
+     leafPools leaves; // leaf headers and data
+     pool runs; // s_rleBV
+     arrayPools arrays; // s_arrayBV with their positions
+     uint64_t statics; // words of static and compressed data, not in the pools
+     uint64_t clock; // number of updates so far
+     uint64_t ops; // number of operations so far, if conf.decay
+     uint underflow; // the last delete left its leaf less than half full
+     uint64_t cap; // max space in words, 0 if none
+     uint64_t capFloor; // space when all static, if that was over the cap
+			// the last time it was enforced, else 0
+     hybridConfig conf; // its tuning
+     uint adaptive; // theta follows the update ratio instead of conf
+     float theta; // current theta, if adaptive
+     uint64_t queries,updates; // decayed counts, if adaptive
+     leafBV tail; // bits appended at the end, not yet in the tree, NULL
+		  // until needed
+     uint64_t head; // bits popped from the front, still in the tree
+     uint64_t headOnes; // 1s among them
+     uint64_t *front; // copy of the bits [frontStart..frontEnd-1] of the 
+     uint64_t frontStart,frontEnd; // tree, the next ones to pop,
+				   // NULL until the first pop
+     pool bufs; // s_hybridBuf of the internal nodes, NULL if not buffered
+     uint cbuffer; // updates each internal node buffers, 0 for none
+     uint64_t pending; // updates buffered in all the nodes
    } *hybridBV;
       
+	// a hybridBV being built from its bits given by chunks, which keeps
+	// only the parts already built and the last bits received
+typedef struct s_hybridBuilder
+   { hybridBV H; // the hybridBV being built
+     hybridNode *parts; // its parts so far, to be assembled at the end
+     uint64_t nparts,cparts; // number of parts and their allocated space
+     uint64_t *data; // the bits not yet in parts
+     uint64_t len; // number of bits in data
+   } *hybridBuilder;
+      
 	// to study performance
 extern uint64_t flattenAccess;
 extern uint64_t flattenBalance;
+extern uint64_t balanceRotations;
 extern uint64_t flattenFill;
+extern uint64_t flattenMemory;
+
+extern float Theta; // default reconstruction factor
 
-extern float Theta; // reconstruction factor
+	// fills C with the default configuration, whose theta is Theta
+void hybridDefaultConfig (hybridConfig *C);
 
-	// creates an empty hybridBV 
-hybridBV hybridCreate (void);
+	// creates an empty hybridBV configured by C, NULL for the default
+hybridBV hybridCreate (hybridConfig *C);
 
 	// converts a bit array into a hybridBV of n bits
-	// data is pointed to and will be freed 
-hybridBV hybridCreateFrom (uint64_t *data, uint64_t n);
+	// data is pointed to and will be freed. configured by C, NULL for
+	// the default
+hybridBV hybridCreateFrom (uint64_t *data, uint64_t n, hybridConfig *C);
+
+	// creates a hybridBV of n bits whose 1s are at the count increasing
+	// positions pos[0..count-1], without building the n bits. pos is not
+	// freed. configured by C, NULL for the default
+hybridBV hybridCreateFromPositions (uint64_t *pos, uint64_t count, 
+				    uint64_t n, hybridConfig *C);
+
+	// starts building a hybridBV whose bits will be given by chunks
+	// configured by C, NULL for the default
+hybridBuilder hybridBuilderCreate (hybridConfig *C);
+
+	// appends the n bits of data to the hybridBV being built by Bd
+	// data is not freed
+void hybridBuilderAdd (hybridBuilder Bd, uint64_t *data, uint64_t n);
+
+	// gives the hybridBV built by Bd, as a balanced tree of statics of
+	// bounded size if long, and destroys Bd
+hybridBV hybridBuilderFinish (hybridBuilder Bd);
+
+	// creates a hybridBV of n bits read from file, which must be opened
+	// for reading and hold them as the (n+w-1)/w words of the array given
+	// to hybridCreateFrom. reads them by chunks, without holding them all
+	// configured by C, NULL for the default
+hybridBV hybridCreateFromFile (FILE *file, uint64_t n, hybridConfig *C);
 
 	// destroys B, frees data 
 void hybridDestroy (hybridBV B);
@@ -77,11 +219,29 @@ void hybridDestroy (hybridBV B);
 void hybridSave (hybridBV B, FILE *file);
 
 	// loads hybridBV from file, which must be opened for reading
-hybridBV hybridLoad (FILE *file);
+	// configured by C, NULL for the default
+hybridBV hybridLoad (FILE *file, hybridConfig *C);
 
 	// gives space of hybridBV in w-bit words
 uint64_t hybridSpace (hybridBV B);
 
+	// sets the max space of B in w-bit words, 0 for no limit. when an
+	// update makes B exceed it, its least recently updated dynamic parts
+	// are flattened until it is back under the limit or B is all static
+void hybridSetMemoryCap (hybridBV B, uint64_t cap);
+
+	// if adaptive, B chooses its own theta as recommended for the 
+	// fraction of updates among its recent operations and its length, 
+	// instead of using the configured one. otherwise goes back to it
+void hybridSetAdaptiveTheta (hybridBV B, uint adaptive);
+
+	// makes each internal node of B keep up to size inserts, deletes and
+	// writes in a buffer, and send them all to its children when it
+	// fills, as in a B^epsilon-tree. 0 (the default) applies them at 
+	// once. access and rank see the buffered updates, other queries send
+	// down those on their way first
+void hybridSetBuffer (hybridBV B, uint size);
+
 	// gives bit length
 extern inline uint64_t hybridLength (hybridBV B);
 
@@ -131,4 +291,11 @@ int64_t hybridNext (hybridBV B, uint64_t i);
 
 int64_t hybridNext0 (hybridBV B, uint64_t i);
 
+	// appends v at the end of B, in amortized constant time
+void hybridAppend (hybridBV B, uint v);
+
+	// deletes B[0] in amortized constant time, assumes B is not empty
+	// returns the bit deleted
+uint hybridPopFront (hybridBV B);
+
 #endif
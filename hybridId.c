@@ -29,10 +29,14 @@ Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
 
 extern float ThetaId = 0.01; // Factor * length reads => rebuild as static
 
+	// defaults of hybridIdConfig
+
 static const float Epsilon = 0.1; // do not flatten leaves of size over Epsilon * n
 
 static const float TrfFactor = 0.125; // TrfFactor * MaxLeafSize to justify transferLeft/Right
 
+static const uint Fanout = 2; // max children of internal nodes, over 2 uses wideIds
+
 static const float Alpha = 0.65; // balance factor 3/5 < . < 1
 
 static const int MinLeavesToBalance = 5; // min number of leaves to balance the tree
@@ -40,145 +44,728 @@ static const int MinLeavesToBalance = 5; // min number of leaves to balance the
 static const float MinFillFactor = 0.3; // less than this involves rebuild.
                                 // Must be <= Gamma/2
 
-static inline mustFlatten(hybridId B, uint64_t n)
-  { return ((B->bv.dyn->size <= Epsilon * n) && 
-	    (B->bv.dyn->accesses >= ThetaId * B->bv.dyn->size));
-    // return (B->bv.dyn->accesses >= ThetaId*B->bv.dyn->size);
+static const uint64_t DecayPeriod = 0; // operations after which node access
+				// counts are halved, 0 to never decay them
+
+static const uint Sample = 1; // only 1 in Sample queries, chosen at random,
+				// count accesses, each as Sample of them
+
+static const uint LeafGap = 0; // dynamic leaves keep a gap at their last
+				// update, 0 for not
+
+#define MaxDepth 128 // deepest leaf that repairLeaf looks after
+
+static const float MinWideFill = 0.25; // wide children with less than this
+				// fraction of fanout children are merged if possible
+
+static const uint RatioWindow = 65536; // ops after which the counts that 
+				// drive the adaptive theta are halved
+
+static const float CapSlack = 0.9; // under a memory cap, flatten until 
+				// using this fraction of it
+
+static const uint64_t BuildBits = ((uint64_t)1) << 24; // long arrays built
+				// by chunks are made of statics of about 
+				// this many bits
+
+static const uint64_t ReadElems = ((uint64_t)1) << 16; // elements read at
+				// a time by hybridIdCreateFromFile
+
+static const uint FrontElems = 128; // elements copied at a time from the
+				// tree to pop them
+
+#define maxChildren(H) (min((H)->conf.fanout,MaxFanout))
+
+	// theta used by H
+
+static inline float theta (hybridId H)
+
+   { return H->adaptive ? H->theta : H->conf.theta;
+   }
+
+	// whether the current query counts accesses, and the state of the 
+	// xorshift generator that samples them, both per thread
+
+static __thread uint sampled = 1;
+static __thread uint64_t sampleSeed = 88172645463325252ull;
+
+	// decides whether the query starting on H counts accesses
+
+static inline void sampleQuery (hybridId H)
+
+   { uint64_t x;
+     if (H->conf.sample <= 1) { sampled = 1; return; }
+     x = sampleSeed;
+     x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+     sampleSeed = x;
+     sampled = (x % H->conf.sample == 0);
+   }
+
+	// counts a query on dynamic or wide B, if sampled, as conf.sample 
+	// queries. first halves its count for each period of conf.decay 
+	// operations since its last query
+
+static inline void countAccess (hybridId H, hybridIdNode B)
+
+   { uint64_t *accesses,*epoch;
+     uint64_t e;
+     if (!sampled) return;
+     if (B->type == tWide)
+	{ accesses = &B->bv.wide->accesses; epoch = &B->bv.wide->epoch; }
+     else { accesses = &B->bv.dyn->accesses; epoch = &B->bv.dyn->epoch; }
+     if (H->conf.decay)
+	{ e = H->ops / H->conf.decay;
+	  if (e != *epoch)
+	     { *accesses = (e - *epoch >= 64) ? 0 : *accesses >> (e - *epoch);
+	       *epoch = e;
+	     }
+	}
+     *accesses += max(H->conf.sample,1);
+   }
+
+static inline int mustFlatten(hybridId H, hybridIdNode B, uint64_t n)
+  { uint64_t size,accesses;
+    if (B->type == tWide)
+       { size = B->bv.wide->csize[B->bv.wide->nchildren-1];
+         accesses = B->bv.wide->accesses;
+       }
+    else
+       { size = B->bv.dyn->size;
+         accesses = B->bv.dyn->accesses;
+       }
+    return ((size <= H->conf.epsilon * n) && (accesses >= theta(H) * size));
+    // return (accesses >= H->conf.theta * size);
   }
 
-	// creates an empty hybridId 
+	// gives number of elements 
+
+static inline uint64_t nodeLength (hybridIdNode B)
+
+   { if (B->type == tLeaf) return leafIdLength(B->bv.leaf);
+     if (B->type == tStatic) return leafIdLength(B->bv.stat);
+     if (B->type == tWide) return B->bv.wide->csize[B->bv.wide->nchildren-1] +
+				 (B->bv.wide->buf ? B->bv.wide->buf->length : 0);
+     return B->bv.dyn->size + (B->bv.dyn->buf ? B->bv.dyn->buf->length : 0);
+   }
+
+	// gives the updates buffered in B, NULL if none or not internal
+
+static inline hybridIdBuf nodeBuf (hybridIdNode B)
+
+   { if (B->type == tWide) return B->bv.wide->buf;
+     if (B->type == tDynamic) return B->bv.dyn->buf;
+     return NULL;
+   }
+
+        // gives width of elements 
+
+static inline uint nodeWidth (hybridIdNode B)
+
+   { if (B->type == tStatic) return B->bv.stat->width;
+     if (B->type == tLeaf) return B->bv.leaf->width;
+     if (B->type == tWide) return B->bv.wide->width;
+     return B->bv.dyn->width;
+   }
+
+	// creates a hybridId configured by C with empty pools and an
+	// uninitialized root
+	// the root is not taken from the pools, so they can be released
+
+static hybridId create (hybridIdConfig *C)
+
+   { hybridId H = (hybridId)myalloc(sizeof(struct s_hybridId));
+     if (C) H->conf = *C; else hybridIdDefaultConfig(&H->conf);
+     H->root = (hybridIdNode)myalloc(sizeof(struct s_hybridIdNode));
+     H->nodes = poolCreate(sizeof(struct s_hybridIdNode));
+     H->dyns = poolCreate(sizeof(struct s_dynamicId));
+     H->wides = poolCreate(sizeof(struct s_wideId));
+     H->leaves = leafIdPoolsCreate();
+     H->statics = 0;
+     H->clock = 0;
+     H->ops = 0;
+     H->underflow = 0;
+     H->cap = 0;
+     H->capFloor = 0;
+     H->adaptive = 0;
+     H->tail = NULL;
+     H->head = 0;
+     H->front = NULL;
+     H->frontStart = H->frontEnd = 0;
+     H->bufs = NULL;
+     H->cbuffer = 0;
+     H->pending = 0;
+     return H;
+   }
+
+	// words of data of static LB, which are not in the pools
+
+static inline uint64_t staticWords (leafId LB)
+
+   { return (leafIdLength(LB)*(uint64_t)LB->width+w-1)/w;
+   }
+
+        // creates a static of n elements of width width from packed data, 
+	// accounting for its space in H
+
+static leafId newStatic (hybridId H, uint64_t *data, uint64_t n, uint width)
+
+   { leafId LB = leafIdCreateStaticFromPacked(data,n,width,H->leaves);
+     H->statics += staticWords(LB);
+     return LB;
+   }
+
+	// destroys static LB of H
+
+static void freeStatic (hybridId H, leafId LB)
+
+   { H->statics -= staticWords(LB);
+     leafIdDestroy(LB,H->leaves);
+   }
+
+	// fills C with the default configuration
+
+void hybridIdDefaultConfig (hybridIdConfig *C)
+
+   { C->theta = ThetaId;
+     C->epsilon = Epsilon;
+     C->alpha = Alpha;
+     C->fanout = Fanout;
+     C->trfFactor = TrfFactor;
+     C->minLeavesToBalance = MinLeavesToBalance;
+     C->minFillFactor = MinFillFactor;
+     C->decay = DecayPeriod;
+     C->sample = Sample;
+     C->gap = LeafGap;
+   }
+
+	// creates an empty hybridId configured by C, NULL for the default
 
-hybridId hybridIdCreate (uint width)
+hybridId hybridIdCreate (uint width, hybridIdConfig *C)
 
-   { hybridId B = myalloc(sizeof(struct s_hybridId));
-     B->type = tLeaf;
-     B->bv.leaf = leafIdCreate(width);
-     return B; 
+   { hybridId H = create(C);
+     H->root->type = tLeaf;
+     H->root->bv.leaf = leafIdCreate(width,H->leaves);
+     return H; 
    }
 
 	// converts an array of uint64_t into a hybridId of n elements
 	// of width width. data is pointed to and will be freed 
+	// configured by C, NULL for the default
 
-hybridId hybridIdCreateFrom64 (uint64_t *data, uint64_t n, uint width)
+hybridId hybridIdCreateFrom64 (uint64_t *data, uint64_t n, uint width,
+				hybridIdConfig *C)
 
-   { hybridId B = myalloc(sizeof(struct s_hybridId));
+   { hybridId H = create(C);
+     hybridIdNode B = H->root;
      if (n > leafIdNewSize(width))
         { B->type = tStatic;
-          B->bv.stat = leafIdCreateFrom64(data,n,width,1);
+          B->bv.stat = leafIdCreateFrom64(data,n,width,1,H->leaves);
+	  H->statics = staticWords(B->bv.stat);
         }
      else 
         { B->type = tLeaf;
-          B->bv.stat = leafIdCreateFrom64(data,n,width,0);
+          B->bv.stat = leafIdCreateFrom64(data,n,width,0,H->leaves);
         } 
-     return B;
+     return H;
    }
 
 	// converts an array of uint32_t into a hybridId of n elements
 	// of width width. data is pointed to and will be freed 
+	// configured by C, NULL for the default
 
-hybridId hybridIdCreateFrom32 (uint32_t *data, uint64_t n, uint width)
+hybridId hybridIdCreateFrom32 (uint32_t *data, uint64_t n, uint width,
+				hybridIdConfig *C)
 
-   { hybridId B = myalloc(sizeof(struct s_hybridId));
+   { hybridId H = create(C);
+     hybridIdNode B = H->root;
      if (n > leafIdNewSize(width))
         { B->type = tStatic;
-          B->bv.stat = leafIdCreateFrom32(data,n,width,1);
+          B->bv.stat = leafIdCreateFrom32(data,n,width,1,H->leaves);
+	  H->statics = staticWords(B->bv.stat);
         }
      else 
         { B->type = tLeaf;
-          B->bv.stat = leafIdCreateFrom32(data,n,width,0);
+          B->bv.stat = leafIdCreateFrom32(data,n,width,0,H->leaves);
         } 
-     return B;
+     return H;
+   }
+
+	// frees the static data below B, the rest goes with the pools
+
+static void destroyStatics (hybridId H, hybridIdNode B)
+
+   { uint k;
+     if (B->type == tStatic) leafIdDestroy(B->bv.stat,H->leaves);
+     else if (B->type == tWide)
+          { for (k=0;k<B->bv.wide->nchildren;k++)
+                destroyStatics(H,B->bv.wide->child[k]);
+          }
+     else if (B->type == tDynamic)
+          { destroyStatics(H,B->bv.dyn->left);
+            destroyStatics(H,B->bv.dyn->right);
+          }
+   }
+
+	// destroys H, frees data. nodes and leaves are released in bulk
+
+void hybridIdDestroy (hybridId H)
+
+   { destroyStatics(H,H->root);
+     myfree(H->root);
+     poolDestroy(H->nodes);
+     poolDestroy(H->dyns);
+     poolDestroy(H->wides);
+     leafIdPoolsDestroy(H->leaves);
+     myfree(H->front);
+     if (H->bufs) poolDestroy(H->bufs);
+     myfree(H);
+   }
+
+	// returns the buffer *F of an internal node to the pool of H
+
+static void bufDestroy (hybridId H, hybridIdBuf *F)
+
+   { if (*F == NULL) return;
+     H->pending -= (*F)->n;
+     poolFree(H->bufs,*F);
+     *F = NULL;
    }
 
-	// destroys B, frees data 
+	// destroys B, returns its nodes and leaves to the pools of H
 
-void hybridIdDestroy (hybridId B)
+static void nodeDestroy (hybridId H, hybridIdNode B)
 
-   { if (B->type == tLeaf) leafIdDestroy(B->bv.leaf);
-     else if (B->type == tStatic) leafIdDestroy(B->bv.stat);
-     else { hybridIdDestroy(B->bv.dyn->left);
-            hybridIdDestroy(B->bv.dyn->right);
-            myfree(B->bv.dyn);
+   { uint k;
+     if (B->type == tLeaf) leafIdDestroy(B->bv.leaf,H->leaves);
+     else if (B->type == tStatic) freeStatic(H,B->bv.stat);
+     else if (B->type == tWide)
+          { for (k=0;k<B->bv.wide->nchildren;k++)
+                nodeDestroy(H,B->bv.wide->child[k]);
+            bufDestroy(H,&B->bv.wide->buf);
+            poolFree(H->wides,B->bv.wide);
           }
-     myfree(B);
+     else { nodeDestroy(H,B->bv.dyn->left);
+            nodeDestroy(H,B->bv.dyn->right);
+            bufDestroy(H,&B->bv.dyn->buf);
+            poolFree(H->dyns,B->bv.dyn);
+          }
+     poolFree(H->nodes,B);
+   }
+
+	// child of W holding position i (the last one if i = size)
+	// branchless count over the cumulative sizes, so it vectorizes
+
+static inline uint wideFind (wideId W, uint64_t i)
+
+   { uint k,c = 0;
+     for (k=0;k<W->nchildren;k++) c += (W->csize[k] <= i);
+     return c < W->nchildren ? c : W->nchildren-1;
+   }
+
+	// elements in the children of W before the kth
+
+static inline uint64_t wideSizeBefore (wideId W, uint k)
+
+   { return k ? W->csize[k-1] : 0;
    }
 
         // creates a static version of B, rewriting it but not its address
 
         // reads B into D[j..] without unpacking 
 
-static void packedRead (hybridId B, uint64_t *D, uint64_t j)
+static void packedRead (hybridIdNode B, uint64_t *D, uint64_t j)
 
    { uint64_t lsize;
-     uint width;
+     uint width,k;
+     if (B->type == tWide)
+        { for (k=0;k<B->bv.wide->nchildren;k++)
+              packedRead(B->bv.wide->child[k],D,
+			 j+wideSizeBefore(B->bv.wide,k));
+	  return;
+        }
      if (B->type == tDynamic)
-        { lsize = hybridIdLength(B->bv.dyn->left);
+        { lsize = nodeLength(B->bv.dyn->left);
           packedRead(B->bv.dyn->left,D,j);
           packedRead(B->bv.dyn->right,D,j+lsize);
 	  return;
         }
-     width = hybridIdWidth(B);
+     width = nodeWidth(B);
      if (B->type == tStatic)
-          copyBits(D,j*width,B->bv.stat->data,0,hybridIdLength(B)*width);
-     else copyBits(D,j*width,B->bv.leaf->data,0,hybridIdLength(B)*width);
+          copyBits(D,j*width,B->bv.stat->data,0,nodeLength(B)*width);
+     else { leafIdCloseGap(B->bv.leaf);
+	    copyBits(D,j*width,B->bv.leaf->data,0,nodeLength(B)*width);
+	  }
    }
 
         // collects all the descending elements into an array, destroys bv.dyn
+	// or bv.wide
 
-static uint64_t* collect (hybridId B, uint64_t len, uint width)
+static uint64_t* collect (hybridId H, hybridIdNode B, uint64_t len, uint width)
 
    { uint64_t *D;
+     uint k;
      D = (uint64_t*)myalloc(((len*width+w-1)/w)*sizeof(uint64_t));
      packedRead (B,D,0);
-     hybridIdDestroy(B->bv.dyn->left);
-     hybridIdDestroy(B->bv.dyn->right);
-     myfree(B->bv.dyn);
+     if (B->type == tWide)
+        { for (k=0;k<B->bv.wide->nchildren;k++)
+              nodeDestroy(H,B->bv.wide->child[k]);
+          bufDestroy(H,&B->bv.wide->buf);
+          poolFree(H->wides,B->bv.wide);
+          return D;
+        }
+     nodeDestroy(H,B->bv.dyn->left);
+     nodeDestroy(H,B->bv.dyn->right);
+     bufDestroy(H,&B->bv.dyn->buf);
+     poolFree(H->dyns,B->bv.dyn);
      return D;
    }
 
         // gives number of leaves
 
-static inline uint64_t hybridIdLeaves (hybridId B)
+static inline uint64_t nodeLeaves (hybridIdNode B)
 
    { uint num;
      if (B->type == tLeaf) return 1;
      if (B->type == tDynamic) return B->bv.dyn->leaves;
+     if (B->type == tWide) return B->bv.wide->leaves;
      num = leafIdNewSize(B->bv.stat->width);
      return (leafIdLength(B->bv.stat)+num-1)/num;
    }
 
+	// in write-optimized mode (H->cbuffer > 0) the updates that reach an
+	// internal node are kept in its buffer, and the whole buffer is sent
+	// to the children when it fills, as in a B^epsilon-tree. the sizes
+	// of a node do not include its own buffer, nodeLength does
+
+static void insert (hybridId H, hybridIdNode B, uint64_t i, uint64_t v, uint *recalc);
+static void delete (hybridId H, hybridIdNode B, uint64_t i, uint *recalc);
+static void nodeWrite (hybridId H, hybridIdNode B, uint64_t i, uint64_t v);
+static void flushNode (hybridId H, hybridIdNode B);
+
+	// recounts the leaves of B from its children, if it is internal
+
+static void recountLeaves (hybridIdNode B)
+
+   { uint k;
+     if (B->type == tWide)
+	{ B->bv.wide->leaves = 0;
+	  for (k=0;k<B->bv.wide->nchildren;k++)
+	      B->bv.wide->leaves += nodeLeaves(B->bv.wide->child[k]);
+	}
+     else if (B->type == tDynamic)
+	B->bv.dyn->leaves = nodeLeaves(B->bv.dyn->left) +
+			    nodeLeaves(B->bv.dyn->right);
+   }
+
+	// adds an update op of B[i] with value v to the buffer of internal
+	// B, and sends the buffer down if it fills
+
+static void bufferMsg (hybridId H, hybridIdNode B, msgType op, uint64_t i, 
+		       uint64_t v)
+
+   { hybridIdBuf *F = (B->type == tWide) ? &B->bv.wide->buf : &B->bv.dyn->buf;
+     hybridIdMsg *M;
+     if (*F == NULL)
+	{ *F = (hybridIdBuf)poolAlloc(H->bufs);
+	  (*F)->n = 0;
+	  (*F)->length = 0;
+	}
+     M = (*F)->msg + (*F)->n++;
+     M->pos = i; M->op = op; M->val = v;
+     H->pending++;
+     if (op == mInsert) (*F)->length++;
+     else if (op == mDelete) (*F)->length--;
+     if (B->type == tWide) 
+	{ B->bv.wide->accesses = 0; // reset
+	  B->bv.wide->updated = H->clock;
+	}
+     else
+	{ B->bv.dyn->accesses = 0; // reset
+	  B->bv.dyn->updated = H->clock;
+	}
+     if ((*F)->n == H->cbuffer) flushNode(H,B);
+   }
+
+	// sends an update op of B[i] with value v to the child B, which 
+	// buffers it if it is internal and H buffers updates, or applies it
+	// otherwise
+
+static inline void send (hybridId H, hybridIdNode B, msgType op, uint64_t i,
+			 uint64_t v, uint *recalc)
+
+   { if (H->cbuffer && ((B->type == tWide) || (B->type == tDynamic)))
+	bufferMsg(H,B,op,i,v);
+     else if (op == mInsert) insert(H,B,i,v,recalc);
+     else if (op == mDelete) delete(H,B,i,recalc);
+     else nodeWrite(H,B,i,v);
+   }
+
+	// sends down the updates buffered in B, in order. they are applied
+	// on B, which changes as inserts and deletes make it, and so go on
+	// to the buffers of its internal children or to its other children.
+	// if B becomes one of its children, its buffer is sent down too
+
+static void flushNode (hybridId H, hybridIdNode B)
+
+   { hybridIdBuf F;
+     hybridIdMsg *M;
+     uint k,recalc;
+     while ((F = nodeBuf(B)) != NULL)
+	{ if (B->type == tWide) B->bv.wide->buf = NULL;
+	  else B->bv.dyn->buf = NULL;
+	  H->pending -= F->n;
+	  for (k=0;k<F->n;k++)
+	      { M = F->msg + k;
+		if (nodeBuf(B)) // B became a child with its own buffer
+		   bufferMsg(H,B,M->op,M->pos,M->val);
+		else if (M->op == mInsert) insert(H,B,M->pos,M->val,&recalc);
+		else if (M->op == mDelete) delete(H,B,M->pos,&recalc);
+		else nodeWrite(H,B,M->pos,M->val);
+		recountLeaves(B); // they may have changed below
+	      }
+	  poolFree(H->bufs,F);
+	}
+   }
+
+	// sends down all the updates buffered in B and below it
+
+static void drain (hybridId H, hybridIdNode B)
+
+   { uint k;
+     if (H->pending == 0) return;
+     flushNode(H,B);
+     if (B->type == tWide)
+	{ for (k=0;k<B->bv.wide->nchildren;k++) 
+	      drain(H,B->bv.wide->child[k]);
+	}
+     else if (B->type == tDynamic)
+	{ drain(H,B->bv.dyn->left);
+	  drain(H,B->bv.dyn->right);
+	}
+     recountLeaves(B);
+   }
+
+	// sends down the updates buffered in the nodes of B that hold 
+	// elements [i..i+l-1], l > 0, so that none remains on the way to them
+
+static void unbuffer (hybridId H, hybridIdNode B, uint64_t i, uint64_t l)
+
+   { uint64_t lsize,off,len;
+     uint k;
+     if (H->pending == 0) return;
+     flushNode(H,B);
+     if (B->type == tWide)
+        { k = wideFind(B->bv.wide,i);
+          while (l)
+	     { off = wideSizeBefore(B->bv.wide,k);
+	       len = min(l,B->bv.wide->csize[k]-i);
+	       unbuffer(H,B->bv.wide->child[k],i-off,len);
+	       i += len; l -= len; k++;
+	     }
+	}
+     else if (B->type == tDynamic)
+        { lsize = nodeLength(B->bv.dyn->left);
+     	  if (i+l <= lsize) unbuffer(H,B->bv.dyn->left,i,l);
+	  else if (i >= lsize) unbuffer(H,B->bv.dyn->right,i-lsize,l);
+	  else { unbuffer(H,B->bv.dyn->left,i,lsize-i);
+		 unbuffer(H,B->bv.dyn->right,0,l-(lsize-i));
+	       }
+	}
+     recountLeaves(B);
+   }
+
+	// translates position *i of a node to the position it had before
+	// the updates buffered in F. returns 1 and the value in *v instead
+	// if the element at *i was inserted or written by them
+
+static uint bufferFind (hybridIdBuf F, uint64_t *i, uint64_t *v)
+
+   { hybridIdMsg *M;
+     uint k = F->n;
+     while (k--)
+	{ M = F->msg + k;
+	  if (M->op == mInsert)
+	     { if (*i == M->pos) { *v = M->val; return 1; }
+	       if (*i > M->pos) (*i)--;
+	     }
+	  else if (M->op == mDelete) 
+	     { if (*i >= M->pos) (*i)++;
+	     }
+	  else if (*i == M->pos) { *v = M->val; return 1; }
+	}
+     return 0;
+   }
+
         // converts into a leaf if it's short or into a static otherwise
 	// delta gives the difference in leaves (new - old)
 
-static void flatten (hybridId B, int64_t *delta)
+static void flatten (hybridId H, hybridIdNode B, int64_t *delta)
 
    { uint64_t len;
      uint64_t *D;
      uint width;
      
-     if (B->type != tDynamic) return;
-     width = hybridIdWidth(B);
-     len = hybridIdLength(B);
-    *delta = - hybridIdLeaves(B);
-     D = collect(B,len,width);
+     if ((B->type != tDynamic) && (B->type != tWide)) return;
+    *delta = - nodeLeaves(B);
+     drain(H,B); // the buffered updates below are applied first
+     if ((B->type != tDynamic) && (B->type != tWide))
+	{ *delta += nodeLeaves(B);
+	  return;
+	}
+     width = nodeWidth(B);
+     len = nodeLength(B);
+     D = collect(H,B,len,width);
      if (len > leafIdNewSize(width)) // creates a static
         { B->type = tStatic;
-          B->bv.stat = leafIdCreateStaticFromPacked(D,len,width);
+          B->bv.stat = newStatic(H,D,len,width);
         }
      else // a leaf
         { B->type = tLeaf;
-          B->bv.leaf = leafIdCreateFromPacked(D,0,len,width);
+          B->bv.leaf = leafIdCreateFromPacked(D,0,len,width,H->leaves);
 	  myfree(D);
         }
-     *delta += hybridIdLeaves(B);
+     poolTrim(H->nodes); // gives back the slabs the flattening emptied
+     poolTrim(H->dyns);
+     poolTrim(H->wides);
+     leafIdPoolsTrim(H->leaves);
+     if (H->bufs) poolTrim(H->bufs);
+     *delta += nodeLeaves(B);
+   }
+
+	// recomputes the cumulative counters of W from its children
+
+static void wideRecount (wideId W)
+
+   { uint k;
+     uint64_t size,leaves;
+     size = leaves = 0;
+     for (k=0;k<W->nchildren;k++)
+        { size += nodeLength(W->child[k]);
+          leaves += nodeLeaves(W->child[k]);
+          W->csize[k] = size;
+        }
+     W->leaves = leaves;
+   }
+
+	// creates a wide node without children
+
+static wideId wideCreate (hybridId H, uint width)
+
+   { wideId W = (wideId)poolAlloc(H->wides);
+     W->nchildren = 0;
+     W->width = width;
+     W->leaves = 0;
+     W->accesses = 0;
+     W->updated = H->clock;
+     W->epoch = 0;
+     W->buf = NULL;
+     return W;
+   }
+
+	// inserts HB as the kth child of W, does not recount
+
+static void wideAddChild (wideId W, uint k, hybridIdNode HB)
+
+   { memmove(W->child+k+1,W->child+k,(W->nchildren-k)*sizeof(hybridIdNode));
+     W->child[k] = HB;
+     W->nchildren++;
+   }
+
+	// removes the kth child of W, does not destroy it nor recount
+
+static void wideRemoveChild (wideId W, uint k)
+
+   { W->nchildren--;
+     memmove(W->child+k,W->child+k+1,(W->nchildren-k)*sizeof(hybridIdNode));
+   }
+
+	// moves the second half of the children of W to a new wide hybridIdNode
+
+static hybridIdNode wideSplit (hybridId H, wideId W)
+
+   { hybridIdNode HB;
+     uint half = W->nchildren/2;
+     HB = (hybridIdNode)poolAlloc(H->nodes);
+     HB->type = tWide;
+     HB->bv.wide = wideCreate(H,W->width);
+     memcpy(HB->bv.wide->child,W->child+half,
+	    (W->nchildren-half)*sizeof(hybridIdNode));
+     HB->bv.wide->nchildren = W->nchildren-half;
+     W->nchildren = half;
+     wideRecount(W);
+     wideRecount(HB->bv.wide);
+     return HB;
+   }
+
+	// B is a full wide node with no parent to absorb a split, so it
+	// becomes a wide node with the two halves as children
+
+static void wideGrow (hybridId H, hybridIdNode B)
+
+   { hybridIdNode HB;
+     wideId W = wideCreate(H,B->bv.wide->width);
+     HB = (hybridIdNode)poolAlloc(H->nodes);
+     HB->type = tWide;
+     HB->bv.wide = B->bv.wide;
+     W->child[1] = wideSplit(H,HB->bv.wide);
+     W->child[0] = HB;
+     W->nchildren = 2;
+     wideRecount(W);
+     W->buf = HB->bv.wide->buf; // B keeps its buffered updates
+     HB->bv.wide->buf = NULL;
+     B->bv.wide = W;
+   }
+
+static void halveLeaf (hybridId H, leafId B, hybridIdNode *HB1, hybridIdNode *HB2);
+
+	// splits the full leaf child k of W into two children
+
+static void wideSplitLeaf (hybridId H, wideId W, uint k)
+
+   { hybridIdNode HB = W->child[k];
+     hybridIdNode HB1,HB2;
+     halveLeaf(H,HB->bv.leaf,&HB1,&HB2);
+     poolFree(H->nodes,HB);
+     W->child[k] = HB1;
+     wideAddChild(W,k+1,HB2);
+     wideRecount(W);
+   }
+
+	// moves the children of the wide child k+1 of W to the wide child k.
+	// their buffered updates go down first, and they are not merged if
+	// they no longer fit together after that
+
+static void wideMergeChildren (hybridId H, wideId W, uint k)
+
+   { wideId W1,W2;
+     flushNode(H,W->child[k]);
+     flushNode(H,W->child[k+1]);
+     if ((W->child[k]->type != tWide) || (W->child[k+1]->type != tWide) ||
+	 (W->child[k]->bv.wide->nchildren + W->child[k+1]->bv.wide->nchildren
+						> maxChildren(H)))
+	{ wideRecount(W);
+	  return;
+	}
+     W1 = W->child[k]->bv.wide;
+     W2 = W->child[k+1]->bv.wide;
+     memcpy(W1->child+W1->nchildren,W2->child,W2->nchildren*sizeof(hybridIdNode));
+     W1->nchildren += W2->nchildren;
+     W1->accesses = 0;
+     W1->updated = H->clock;
+     W1->epoch = 0;
+     poolFree(H->wides,W2);
+     poolFree(H->nodes,W->child[k+1]);
+     wideRemoveChild(W,k+1);
+     wideRecount(W1);
+     wideRecount(W);
    }
 
        // halves a static array into leaves, leaving a leaf covering i
         // returns a dynamicId and destroys B
 
-static dynamicId splitFrom (uint64_t *data, uint64_t n, uint width, uint64_t i)
+static dynamicId splitFrom (hybridId H, uint64_t *data, uint64_t n, uint width, uint64_t i)
 
-   { hybridId HB;
+   { hybridIdNode HB;
      dynamicId DB,finalDB;
      uint bnum; // size in elements of blocks to create
      uint bsize; // bit size of blocks to create
@@ -193,7 +780,7 @@ static dynamicId splitFrom (uint64_t *data, uint64_t n, uint width, uint64_t i)
      start = 0;
      end = n;
      while (nblock >= 2) {
-        DB = (dynamicId)myalloc(sizeof(struct s_dynamicId));
+        DB = (dynamicId)poolAlloc(H->dyns);
         if (HB == NULL) finalDB = DB;
         else {
            HB->type = tDynamic;
@@ -203,468 +790,1438 @@ static dynamicId splitFrom (uint64_t *data, uint64_t n, uint width, uint64_t i)
 	DB->width = width;
 	DB->leaves = nblock;
         DB->accesses = 0;
+        DB->updated = H->clock;
+        DB->epoch = 0;
+        DB->buf = NULL;
         mid = start+(nblock/2)*bnum;
         if (i/bnum < nblock/2) { // split the left half
                 // create right half
-           DB->right = HB = (hybridId)myalloc(sizeof(struct s_hybridId));
+           DB->right = HB = (hybridIdNode)poolAlloc(H->nodes);
            if (n - (nblock/2)*bnum > leafIdNewSize(width)) { // create a static
               segment = (uint64_t*)myalloc((((end-mid)*width+w-1)/w)
 					   * sizeof(uint64_t));
               copyBits(segment,0,data,mid*width,(end-mid)*width);
               HB->type = tStatic;
               HB->bv.stat = 
-		  leafIdCreateStaticFromPacked(segment,n-(nblock/2)*bnum,width);
+		  newStatic(H,segment,n-(nblock/2)*bnum,width);
               }
            else { // create a leaf
               HB->type = tLeaf;
               HB->bv.leaf =
-		  leafIdCreateFromPacked(data,mid,n-(nblock/2)*bnum,width);
+		  leafIdCreateFromPacked(data,mid,n-(nblock/2)*bnum,width,H->leaves);
               }
                 // continue for left half
            end = mid;
            nblock = nblock/2;
            n = nblock * bnum;
-           DB->left = HB = (hybridId)myalloc(sizeof(struct s_hybridId));
+           DB->left = HB = (hybridIdNode)poolAlloc(H->nodes);
            }
         else { // split the right half
                 // create left half
-           DB->left = HB = (hybridId)myalloc(sizeof(struct s_hybridId));
+           DB->left = HB = (hybridIdNode)poolAlloc(H->nodes);
            if ((nblock/2)*bnum > leafIdNewSize(width)) { // create a static
               segment = (uint64_t*)myalloc((((mid-start)*width+w-1)/w)
 					   * sizeof(uint64_t));
               copyBits(segment,0,data,start*width,(mid-start)*width);
               HB->type = tStatic;
 	      HB->bv.stat = 
-		  leafIdCreateStaticFromPacked(segment,(nblock/2)*bnum,width);
+		  newStatic(H,segment,(nblock/2)*bnum,width);
               }
            else { // create a leaf
               HB->type = tLeaf;
               HB->bv.leaf =
-		  leafIdCreateFromPacked(data,start,(nblock/2)*bnum,width);
+		  leafIdCreateFromPacked(data,start,(nblock/2)*bnum,width,H->leaves);
               }
                 // continue for right half
            start = mid;
            n = n-(nblock/2)*bnum;
 	   i = i-(nblock/2)*bnum;
            nblock = nblock - nblock/2;
-           DB->right = HB = (hybridId)myalloc(sizeof(struct s_hybridId));
+           DB->right = HB = (hybridIdNode)poolAlloc(H->nodes);
            }
         }
         // finally, the leaf where i lies
      HB->type = tLeaf;
-     HB->bv.leaf = leafIdCreateFromPacked(data,start,n,width);
+     HB->bv.leaf = leafIdCreateFromPacked(data,start,n,width,H->leaves);
      return finalDB;
    }
 
-static dynamicId split (leafId B, uint64_t i)
+	// distributes a static array of n elements from data[start..] into a
+	// wide node, leaving a leaf covering i. returns a wideId and does
+	// not free data
 
-   { dynamicId DB;
-     DB = splitFrom(B->data,leafIdLength(B),B->width,i);
-     leafIdDestroy(B);
-     return DB;
+static wideId wideSplitFrom (hybridId H, uint64_t *data, uint64_t start, uint64_t n, 
+			     uint width, uint64_t i)
+
+   { wideId W;
+     hybridIdNode HB;
+     uint bnum; // size in elements of blocks to create
+     uint64_t nblock,parts,p,from,to,len;
+     uint64_t *segment;
+
+     W = wideCreate(H,width);
+     bnum = leafIdNewSize(width);
+     nblock = (n+bnum-1)/bnum; // total blocks
+     parts = min(nblock,max(2,maxChildren(H)/2)); // leave room to grow
+     for (p=0;p<parts;p++)
+        { from = (nblock*p/parts)*bnum;
+          to = min(n,(nblock*(p+1)/parts)*bnum);
+          len = to-from;
+          HB = (hybridIdNode)poolAlloc(H->nodes);
+          if ((i >= from) && ((i < to) || (p == parts-1)) && (len > bnum))
+             { HB->type = tWide; // continue on the part holding i
+               HB->bv.wide = wideSplitFrom(H,data,start+from,len,width,i-from);
+             }
+          else if (len > leafIdNewSize(width)) // create a static
+             { segment = (uint64_t*)myalloc(((len*width+w-1)/w)
+					    * sizeof(uint64_t));
+               copyBits(segment,0,data,(start+from)*width,len*width);
+               HB->type = tStatic;
+               HB->bv.stat = newStatic(H,segment,len,width);
+             }
+          else // create a leaf
+             { HB->type = tLeaf;
+               HB->bv.leaf = leafIdCreateFromPacked(data,start+from,len,width,H->leaves);
+             }
+          W->child[p] = HB;
+        }
+     W->nchildren = parts;
+     wideRecount(W);
+     return W;
+   }
+
+	// turns static B into a dynamic subtree, leaving a leaf covering i
+	// does not change #leaves!
+
+static void split (hybridId H, hybridIdNode B, uint64_t i)
+
+   { leafId LB = B->bv.stat;
+     if (H->conf.fanout > 2)
+        { B->type = tWide;
+          B->bv.wide = wideSplitFrom(H,LB->data,0,leafIdLength(LB),LB->width,i);
+        }
+     else
+        { B->type = tDynamic;
+          B->bv.dyn = splitFrom(H,LB->data,leafIdLength(LB),LB->width,i);
+        }
+     freeStatic(H,LB);
    }
 
        // balance by rebuilding: flattening + splitting
         // assumes B is dynamic
 
-static inline int canBalance (uint64_t n, uint width, int dleft, int dright)
+static inline int canBalance (hybridId H, uint64_t n, uint width, int dleft, int dright)
 
    { uint b = leafIdNewSize(width); // size of leaves to create in split
      uint64_t left = (((n+b-1)/b)/2)*b; // size of left part
      uint64_t right = n-left; // size of right part
-     if (left+dleft > Alpha*(n+dleft+dright)) return 0;
-     if (right+dright > Alpha*(n+dleft+dright)) return 0;
+     if (left+dleft > H->conf.alpha*(n+dleft+dright)) return 0;
+     if (right+dright > H->conf.alpha*(n+dleft+dright)) return 0;
      return 1;
    }
 
-static void balance (hybridId B, uint64_t i, int64_t *delta)
+	// whether sizes a and b of two siblings are within the balance 
+	// factor even after deleting or inserting one element, or too
+	// small to matter
+
+static inline int balanced (hybridId H, uint64_t a, uint64_t b, uint width)
+
+   { if (a+b < H->conf.minLeavesToBalance*leafIdMaxSize(width)) return 1;
+     return (max(a,b)+1 <= H->conf.alpha*(a+b-1));
+   }
+
+	// recomputes the counters of dynamic D from its children
+
+static inline void dynRecount (hybridId H, dynamicId D)
 
-   { uint64_t len = hybridIdLength(B);
-     uint width = hybridIdWidth(B);
+   { D->size = nodeLength(D->left) + nodeLength(D->right);
+     D->leaves = nodeLeaves(D->left) + nodeLeaves(D->right);
+     D->accesses = 0;
+     D->updated = H->clock;
+   }
+
+	// child of D on side s (0 = left, 1 = right)
+
+static inline hybridIdNode *side (dynamicId D, uint s)
+
+   { return s ? &D->right : &D->left;
+   }
+
+	// rebalances dynamic B with a single or a double rotation towards 
+	// its lighter side, if that leaves it balanced. returns whether it 
+	// did. the leaves and the size of B do not change
+
+static int rotate (hybridId H, hybridIdNode B)
+
+   { dynamicId D = B->bv.dyn;
+     uint h = (nodeLength(D->left) < nodeLength(D->right)); // heavy side
+     uint o = 1-h;
+     hybridIdNode X = *side(D,h);
+     hybridIdNode O = *side(D,o);
+     hybridIdNode Xh,Xo,Y,Yh,Yo;
+     dynamicId DX,DY;
+     if (X->type != tDynamic) return 0;
+     if (nodeBuf(X)) // X changes, its buffered updates go down first
+	{ flushNode(H,X);
+	  recountLeaves(B);
+	  if (X->type != tDynamic) return 0;
+	}
+     DX = X->bv.dyn;
+     Xh = *side(DX,h); Xo = *side(DX,o);
+	// single: X goes to side o, with Xo and O as its children
+     if (balanced(H,nodeLength(Xh),nodeLength(Xo)+nodeLength(O),DX->width) &&
+	 balanced(H,nodeLength(Xo),nodeLength(O),DX->width))
+	{ *side(DX,h) = Xo; *side(DX,o) = O;
+	  dynRecount(H,DX);
+	  *side(D,h) = Xh; *side(D,o) = X;
+	  return 1;
+	}
+	// double: Xo = (Yh,Yo) is split between X = (Xh,Yh) and Y = (Yo,O)
+     if (Xo->type != tDynamic) return 0;
+     Y = Xo;
+     if (nodeBuf(Y)) // so does Y
+	{ flushNode(H,Y);
+	  recountLeaves(X);
+	  recountLeaves(B);
+	  if (Y->type != tDynamic) return 0;
+	}
+     DY = Y->bv.dyn;
+     Yh = *side(DY,h); Yo = *side(DY,o);
+     if (!(balanced(H,nodeLength(Xh)+nodeLength(Yh),
+		      nodeLength(Yo)+nodeLength(O),DX->width) &&
+	   balanced(H,nodeLength(Xh),nodeLength(Yh),DX->width) &&
+	   balanced(H,nodeLength(Yo),nodeLength(O),DX->width))) return 0;
+     *side(DX,o) = Yh;
+     dynRecount(H,DX);
+     *side(DY,h) = Yo; *side(DY,o) = O;
+     dynRecount(H,DY);
+     *side(D,o) = Y;
+     return 1;
+   }
+
+	// rebuilds B unless a rotation suffices
+
+static void balance (hybridId H, hybridIdNode B, uint64_t i, int64_t *delta)
+
+   { uint64_t len = nodeLength(B);
+     uint width = nodeWidth(B);
      uint64_t *D;
-     *delta = - hybridIdLeaves(B);
-     D = collect(B,len,width);
-     B->bv.dyn = splitFrom(D,len,width,i);
-     *delta += hybridIdLeaves(B);
+     if (rotate(H,B)) return;
+     *delta = - nodeLeaves(B);
+     drain(H,B); // the buffered updates below are applied first
+     if (B->type != tDynamic)
+	{ *delta += nodeLeaves(B);
+	  return;
+	}
+     D = collect(H,B,len,width);
+     B->bv.dyn = splitFrom(H,D,len,width,i);
+     *delta += nodeLeaves(B);
      myfree(D);
    }
 
-        // splits a full leaf into two
-        // returns a hybridId and destroys B
+        // splits a full leaf into two hybridIdNode leaves, destroys B
 
-static dynamicId splitLeaf (leafId B)
+static void halveLeaf (hybridId H, leafId B, hybridIdNode *HB1, hybridIdNode *HB2)
 
-   { hybridId HB,HB1,HB2;
-     dynamicId DB;
-     leafId LB;
-     uint bnum;
-     uint64_t *segment;
+   { uint bnum;
 
+     leafIdCloseGap(B);
      bnum = leafIdMaxSize(B->width) / 2; // elements in new leaves
-     LB = leafIdCreateFromPacked(B->data,0,bnum,B->width);
-     HB1 = (hybridId)myalloc(sizeof(struct s_hybridId));
-     HB1->type = tLeaf;
-     HB1->bv.leaf = LB;
-     LB = leafIdCreateFromPacked(B->data,bnum,bnum,B->width);
-     HB2 = (hybridId)myalloc(sizeof(struct s_hybridId));
-     HB2->type = tLeaf;
-     HB2->bv.leaf = LB;
-     DB = (dynamicId)myalloc(sizeof(struct s_dynamicId));
+     *HB1 = (hybridIdNode)poolAlloc(H->nodes);
+     (*HB1)->type = tLeaf;
+     (*HB1)->bv.leaf = leafIdCreateFromPacked(B->data,0,bnum,B->width,H->leaves);
+     *HB2 = (hybridIdNode)poolAlloc(H->nodes);
+     (*HB2)->type = tLeaf;
+     (*HB2)->bv.leaf = leafIdCreateFromPacked(B->data,bnum,bnum,B->width,H->leaves);
+     leafIdDestroy(B,H->leaves);
+   }
+
+        // splits a full leaf into two
+        // returns a dynamicId and destroys B
+
+static dynamicId splitLeaf (hybridId H, leafId B)
+
+   { dynamicId DB;
+
+     DB = (dynamicId)poolAlloc(H->dyns);
      DB->size = B->size;
      DB->width = B->width;
      DB->accesses = 0;
+     DB->updated = H->clock;
+     DB->epoch = 0;
      DB->leaves = 2;
-     DB->left = HB1;
-     DB->right = HB2;
-     leafIdDestroy(B);
+     DB->buf = NULL;
+     halveLeaf(H,B,&DB->left,&DB->right);
      return DB;
    }
 
-        // merge the two leaf children of B into a leaf
-        // returns a leafId and destroys B
+        // appends the leaf of B2 to the leaf of B1, destroys the leaf of B2
 
-static leafId mergeLeaves (dynamicId B)
+static void mergeLeaves (hybridId H, hybridIdNode B1, hybridIdNode B2)
 
    { leafId LB1,LB2;
+     LB2 = B2->bv.leaf;
+     LB1 = B1->bv.leaf = leafIdResize(B1->bv.leaf,B1->bv.leaf->size+LB2->size,
+				      H->leaves);
+     leafIdCloseGap(LB1);
+     leafIdCloseGap(LB2);
+     copyBits(LB1->data,LB1->size*LB1->width,
+	      LB2->data,0,LB2->size*LB1->width);
+     LB1->size += LB2->size;
+     leafIdDestroy(LB2,H->leaves);
+   }
 
+        // merge the two leaf children of B into a leaf
+        // returns a leafId and destroys B
+
+static leafId mergeChildren (hybridId H, dynamicId B)
+
+   { leafId LB1;
+     mergeLeaves(H,B->left,B->right);
      LB1 = B->left->bv.leaf;
-     LB2 = B->right->bv.leaf;
-     copyBits(LB1->data,LB1->size*B->width,LB2->data,0,LB2->size*B->width);
-     LB1->size += LB2->size;
-     leafIdDestroy(LB2);
-     myfree(B);
+     poolFree(H->nodes,B->left); poolFree(H->nodes,B->right);
+     poolFree(H->dyns,B);
      return LB1;
    }
 
-        // transfers elements from the right to the left leaves children of B
-	// tells if it transferred something
+        // merges the leaf children k and k+1 of W
 
-static int transferLeft (dynamicId B)
+static void wideMergeLeaves (hybridId H, wideId W, uint k)
 
-   { leafId LB1,LB2;
-     uint i,trf;
+   { mergeLeaves(H,W->child[k],W->child[k+1]);
+     poolFree(H->nodes,W->child[k+1]);
+     wideRemoveChild(W,k+1);
+     wideRecount(W);
+   }
+
+        // transfers elements from the right leaf of B2 to the left leaf
+	// of B1. tells if it transferred something
+
+static int transferLeft (hybridId H, hybridIdNode B1, hybridIdNode B2)
+
+   { uint i,trf,width;
      uint64_t *segment;
+     leafId LB1 = B1->bv.leaf;
+     leafId LB2 = B2->bv.leaf;
 
-     LB1 = B->left->bv.leaf;
-     LB2 = B->right->bv.leaf;
+     width = LB1->width;
      trf = (LB2->size-LB1->size+1)/2;
-     if (trf < leafIdMaxSize(B->width) * TrfFactor) return 0;
-     copyBits(LB1->data,LB1->size*B->width,LB2->data,0,trf*B->width);
+     if (trf < leafIdMaxSize(width) * H->conf.trfFactor) return 0;
+     LB1 = B1->bv.leaf = leafIdResize(LB1,LB1->size+trf,H->leaves);
+     leafIdCloseGap(LB1);
+     leafIdCloseGap(LB2);
+     copyBits(LB1->data,LB1->size*width,LB2->data,0,trf*width);
      LB1->size += trf;
      LB2->size -= trf;
-     segment = (uint64_t*)myalloc(((leafIdMaxSize(B->width)*B->width+w-1)/w)
+     segment = (uint64_t*)myalloc(((leafIdMaxSize(width)*width+w-1)/w)
 				  * sizeof(uint64_t));
-     copyBits(segment,0,LB2->data,trf*B->width,LB2->size*B->width);
-     memcpy(LB2->data,segment,(LB2->size*B->width+7)/8);
+     copyBits(segment,0,LB2->data,trf*width,LB2->size*width);
+     memcpy(LB2->data,segment,(LB2->size*width+7)/8);
      myfree(segment);
+     B2->bv.leaf = leafIdResize(LB2,LB2->size,H->leaves);
      return 1;
    }
 
-        // transfers elems from the left to the right leaves children of B
-	// tells if it transferred something
+        // transfers elems from the left leaf of B1 to the right leaf
+	// of B2. tells if it transferred something
 
-static int transferRight (dynamicId B)
+static int transferRight (hybridId H, hybridIdNode B1, hybridIdNode B2)
 
-   { leafId LB1,LB2;
-     uint i,trf;
+   { uint i,trf,width;
      uint64_t *segment;
+     leafId LB1 = B1->bv.leaf;
+     leafId LB2 = B2->bv.leaf;
 
-     LB1 = B->left->bv.leaf;
-     LB2 = B->right->bv.leaf;
+     width = LB1->width;
      trf = (LB1->size-LB2->size+1)/2;
-     if (trf < leafIdMaxSize(B->width) * TrfFactor) return 0;
-     segment = (uint64_t*)myalloc(((leafIdMaxSize(B->width)*B->width+w-1)/w)
+     if (trf < leafIdMaxSize(width) * H->conf.trfFactor) return 0;
+     LB2 = B2->bv.leaf = leafIdResize(LB2,LB2->size+trf,H->leaves);
+     leafIdCloseGap(LB1);
+     leafIdCloseGap(LB2);
+     segment = (uint64_t*)myalloc(((leafIdMaxSize(width)*width+w-1)/w)
 				  *sizeof(uint64_t));
-     memcpy(segment,LB2->data,(LB2->size*B->width+7)/8);
-     copyBits(LB2->data,0,LB1->data,(LB1->size-trf)*B->width,trf*B->width);
-     copyBits(LB2->data,trf*B->width,segment,0,LB2->size*B->width);
+     memcpy(segment,LB2->data,(LB2->size*width+7)/8);
+     copyBits(LB2->data,0,LB1->data,(LB1->size-trf)*width,trf*width);
+     copyBits(LB2->data,trf*width,segment,0,LB2->size*width);
      LB1->size -= trf;
      LB2->size += trf;
      myfree(segment);
+     B1->bv.leaf = leafIdResize(LB1,LB1->size,H->leaves);
      return 1;
    }
 
-	// writes B to file, which must be opened for writing
+	// makes B a balanced tree, binary or wide as the fanout of H says,
+	// whose leaves are the k >= 2 nodes parts[0..k-1] of width width
+
+static void assemble (hybridId H, hybridIdNode B, hybridIdNode *parts, 
+		      uint64_t k, uint width)
+
+   { hybridIdNode HB;
+     dynamicId D;
+     wideId W;
+     uint64_t c,from,to,nch;
+     if (H->conf.fanout > 2)
+	{ W = wideCreate(H,width);
+	  nch = min(k,max(2,maxChildren(H)/2)); // leave room to grow
+	  for (c=0;c<nch;c++)
+	      { from = k*c/nch; to = k*(c+1)/nch;
+		if (to-from == 1) HB = parts[from];
+		else 
+		   { HB = (hybridIdNode)poolAlloc(H->nodes);
+		     assemble(H,HB,parts+from,to-from,width);
+		   }
+		W->child[c] = HB;
+	      }
+	  W->nchildren = nch;
+	  wideRecount(W);
+	  B->type = tWide;
+	  B->bv.wide = W;
+	}
+     else
+	{ D = (dynamicId)poolAlloc(H->dyns);
+	  D->width = width;
+	  if (k/2 == 1) D->left = parts[0];
+	  else 
+	     { D->left = (hybridIdNode)poolAlloc(H->nodes);
+	       assemble(H,D->left,parts,k/2,width);
+	     }
+	  if (k-k/2 == 1) D->right = parts[k/2];
+	  else 
+	     { D->right = (hybridIdNode)poolAlloc(H->nodes);
+	       assemble(H,D->right,parts+k/2,k-k/2,width);
+	     }
+	  dynRecount(H,D);
+	  D->epoch = 0;
+	  D->buf = NULL;
+	  B->type = tDynamic;
+	  B->bv.dyn = D;
+	}
+   }
+
+	// makes B a static, if long, or else a leaf with the n packed
+	// elements of data. data is pointed to and will be freed
+
+static void packedNode (hybridId H, hybridIdNode B, uint64_t *data, 
+			uint64_t n, uint width)
+
+   { if (n > leafIdNewSize(width))
+        { B->type = tStatic;
+          B->bv.stat = newStatic(H,data,n,width);
+        }
+     else 
+        { B->type = tLeaf;
+          B->bv.leaf = leafIdCreateFromPacked(data,0,n,width,H->leaves);
+	  myfree(data);
+        } 
+   }
+
+	// starts building a hybridId of width width configured by C, NULL
+	// for the default, whose elements will be given by chunks
+
+hybridIdBuilder hybridIdBuilderCreate (uint width, hybridIdConfig *C)
+
+   { hybridIdBuilder Bd = 
+	  (hybridIdBuilder)myalloc(sizeof(struct s_hybridIdBuilder));
+     Bd->H = create(C);
+     Bd->width = width;
+     Bd->part = ((BuildBits/width)/w)*w; // so parts are w-aligned
+     Bd->cparts = 16;
+     Bd->parts = (hybridIdNode*)myalloc(Bd->cparts*sizeof(hybridIdNode));
+     Bd->nparts = 0;
+     Bd->data = (uint64_t*)mycalloc(2*Bd->part*width/w+1,sizeof(uint64_t));
+     Bd->len = 0;
+     return Bd;
+   }
+
+	// adds to Bd a part with the len elements of its buffer from the 
+	// position from, whose bits are w-aligned
+
+static void builderPart (hybridIdBuilder Bd, uint64_t from, uint64_t len)
+
+   { uint64_t *data;
+     uint64_t words;
+     hybridIdNode HB;
+     words = (len*Bd->width+w-1)/w;
+     data = (uint64_t*)myalloc((words+1)*sizeof(uint64_t));
+     memcpy(data,Bd->data+from*Bd->width/w,words*sizeof(uint64_t));
+     HB = (hybridIdNode)poolAlloc(Bd->H->nodes);
+     packedNode(Bd->H,HB,data,len,Bd->width);
+     if (Bd->nparts == Bd->cparts)
+	{ Bd->cparts *= 2;
+	  Bd->parts = (hybridIdNode*)myrealloc(Bd->parts,
+					     Bd->cparts*sizeof(hybridIdNode));
+	}
+     Bd->parts[Bd->nparts++] = HB;
+   }
+
+	// appends element v to the hybridId being built. the buffer keeps up
+	// to 2*part elements, and the first part elements become a part when
+	// it fills, so the last parts are not too short
+
+static void builderPush (hybridIdBuilder Bd, uint64_t v)
+
+   { uint64_t p,half;
+     p = Bd->len*Bd->width;
+     Bd->data[p/w] |= v << (p%w);
+     if ((p%w)+Bd->width > w) Bd->data[p/w+1] |= v >> (w-(p%w));
+     if (++Bd->len == 2*Bd->part)
+	{ builderPart(Bd,0,Bd->part);
+	  half = Bd->part*Bd->width/w;
+	  memcpy(Bd->data,Bd->data+half,half*sizeof(uint64_t));
+	  memset(Bd->data+half,0,(half+1)*sizeof(uint64_t));
+	  Bd->len = Bd->part;
+	}
+   }
+
+	// appends the n uint64_t of data to the hybridId being built
+
+void hybridIdBuilderAdd64 (hybridIdBuilder Bd, uint64_t *data, uint64_t n)
+
+   { uint64_t i;
+     for (i=0;i<n;i++) builderPush(Bd,data[i]);
+   }
+
+	// appends the n uint32_t of data to the hybridId being built
+
+void hybridIdBuilderAdd32 (hybridIdBuilder Bd, uint32_t *data, uint64_t n)
+
+   { uint64_t i;
+     for (i=0;i<n;i++) builderPush(Bd,data[i]);
+   }
+
+	// finishes the hybridId being built as a balanced tree of its parts,
+	// the buffer making one or two more, and destroys Bd
+
+hybridId hybridIdBuilderFinish (hybridIdBuilder Bd)
+
+   { hybridId H = Bd->H;
+     uint64_t half;
+     if (Bd->nparts == 0) // a single node
+	{ Bd->data = (uint64_t*)myrealloc(Bd->data,
+			((Bd->len*Bd->width+w-1)/w+1)*sizeof(uint64_t));
+	  packedNode(H,H->root,Bd->data,Bd->len,Bd->width);
+	}
+     else 
+	{ if (Bd->len > Bd->part)
+	     { half = (Bd->len/w/2)*w;
+	       builderPart(Bd,0,half);
+	       builderPart(Bd,half,Bd->len-half);
+	     }
+	  else builderPart(Bd,0,Bd->len);
+	  myfree(Bd->data);
+	  assemble(H,H->root,Bd->parts,Bd->nparts,Bd->width);
+	}
+     myfree(Bd->parts);
+     myfree(Bd);
+     return H;
+   }
+
+	// creates a hybridId of n elements of width width read from file, 
+	// opened for reading, as the array of n uint64_t given to 
+	// hybridIdCreateFrom64. reads ReadElems elements at a time. 
+	// configured by C, NULL for the default
+
+hybridId hybridIdCreateFromFile (FILE *file, uint64_t n, uint width,
+				 hybridIdConfig *C)
+
+   { hybridIdBuilder Bd = hybridIdBuilderCreate(width,C);
+     uint64_t *chunk;
+     uint64_t done,len;
+     chunk = (uint64_t*)myalloc(ReadElems*sizeof(uint64_t));
+     for (done=0;done<n;done+=len)
+	{ len = min(n-done,ReadElems);
+	  myfread(chunk,sizeof(uint64_t),len,file);
+	  hybridIdBuilderAdd64(Bd,chunk,len);
+	}
+     myfree(chunk);
+     return hybridIdBuilderFinish(Bd);
+   }
+
+	// writes H to file, which must be opened for writing
+
+static void flushTail (hybridId H);
+static void dropHead (hybridId H);
+static void bufferUpdate (hybridId H, msgType op, uint64_t i, uint64_t v);
 
-void hybridIdSave (hybridId B, FILE *file)
+void hybridIdSave (hybridId H, FILE *file)
 
    { int64_t delta;
-     flatten(B,&delta);
+     hybridIdNode B = H->root;
+     flushTail(H);
+     flatten(H,B,&delta);
+     dropHead(H);
 	// not as elegant as I thought :-)
      if (B->type == tStatic) leafIdSave(B->bv.stat,file);
      else leafIdSave(B->bv.leaf,file);
    }
 
 	// loads hybridId from file, which must be opened for reading
+	// configured by C, NULL for the default
 
-hybridId hybridIdLoad (FILE *file)
+hybridId hybridIdLoad (FILE *file, hybridIdConfig *C)
 
    { leafId LB;
-     hybridId B = myalloc(sizeof(struct s_hybridId));
-     LB = leafIdLoad(file);
+     hybridId H = create(C);
+     hybridIdNode B = H->root;
+     LB = leafIdLoad(file,H->leaves);
 	// not as elegant as I thought :-)
      if (LB->isStat)
         { B->type = tStatic;
           B->bv.stat = LB;
+	  H->statics = staticWords(LB);
         }
      else
         { B->type = tLeaf;
           B->bv.leaf = LB;
         }
-     return B;
+     return H;
    }
 
-	// gives space of hybridId in w-bit words
+	// gives space of the nodes and leaves of B in w-bit words
 
-uint64_t hybridIdSpace (hybridId B)
+static uint64_t nodeSpace (hybridIdNode B)
 
    { uint64_t s;
-     s = (sizeof(struct s_hybridId)*8+w-1)/w;
+     uint k;
+     s = (sizeof(struct s_hybridIdNode)*8+w-1)/w;
      if (B->type == tLeaf) return s+leafIdSpace(B->bv.leaf);
      else if (B->type == tStatic) return s+leafIdSpace(B->bv.stat);
+     else if (B->type == tWide)
+        { s += (sizeof(struct s_wideId)*8+w-1)/w;
+          for (k=0;k<B->bv.wide->nchildren;k++)
+              s += nodeSpace(B->bv.wide->child[k]);
+          return s;
+        }
      return s+(sizeof(struct s_dynamicId)*8+w-1)/w+
-            hybridIdSpace(B->bv.dyn->left)+hybridIdSpace(B->bv.dyn->right);
+            nodeSpace(B->bv.dyn->left)+nodeSpace(B->bv.dyn->right);
+   }
+
+	// gives space of hybridId in w-bit words, including the space the
+	// pools hold but is not in use
+
+uint64_t hybridIdSpace (hybridId H)
+
+   { return (sizeof(struct s_hybridId)*8+w-1)/w + nodeSpace(H->root) +
+            poolOverhead(H->nodes) + poolOverhead(H->dyns) + 
+            poolOverhead(H->wides) + leafIdPoolsOverhead(H->leaves) +
+	    (H->tail ? leafIdSpace(H->tail) : 0) + (H->front ? FrontElems : 0) +
+	    (H->bufs ? poolSpace(H->bufs) : 0);
+   }
+
+	// gives the same as hybridIdSpace in O(1) time, from what the pools
+	// and the statics of H hold
+
+static uint64_t curSpace (hybridId H)
+
+   { return (sizeof(struct s_hybridId)*8+w-1)/w + 
+	    (sizeof(struct s_hybridIdNode)*8+w-1)/w + H->statics +
+	    poolSpace(H->nodes) + poolSpace(H->dyns) + poolSpace(H->wides) +
+	    leafIdPoolsSpace(H->leaves) + (H->front ? FrontElems : 0) +
+	    (H->bufs ? poolSpace(H->bufs) : 0);
+   }
+
+	// flattens the maximal dynamic subtrees below B last updated at
+	// time <= old, and recounts the leaves above them
+
+static void flattenCold (hybridId H, hybridIdNode B, uint64_t old)
+
+   { int64_t delta;
+     uint k;
+     if (B->type == tWide)
+	{ if (B->bv.wide->updated <= old) 
+	     { flatten(H,B,&delta);
+	       return;
+	     }
+	  B->bv.wide->leaves = 0;
+	  for (k=0;k<B->bv.wide->nchildren;k++)
+	      { flattenCold(H,B->bv.wide->child[k],old);
+	        B->bv.wide->leaves += nodeLeaves(B->bv.wide->child[k]);
+	      }
+	}
+     else if (B->type == tDynamic)
+	{ if (B->bv.dyn->updated <= old) 
+	     { flatten(H,B,&delta);
+	       return;
+	     }
+	  flattenCold(H,B->bv.dyn->left,old);
+	  flattenCold(H,B->bv.dyn->right,old);
+	  B->bv.dyn->leaves = nodeLeaves(B->bv.dyn->left) +
+			      nodeLeaves(B->bv.dyn->right);
+	}
+   }
+
+	// gives the oldest update time of a dynamic node below B
+
+static uint64_t oldestUpdate (hybridIdNode B)
+
+   { uint64_t old,t;
+     uint k;
+     if (B->type == tWide)
+	{ old = B->bv.wide->updated;
+	  for (k=0;k<B->bv.wide->nchildren;k++)
+	      { t = oldestUpdate(B->bv.wide->child[k]);
+		if (t < old) old = t;
+	      }
+	  return old;
+	}
+     if (B->type == tDynamic)
+	{ old = B->bv.dyn->updated;
+	  t = oldestUpdate(B->bv.dyn->left);
+	  if (t < old) old = t;
+	  t = oldestUpdate(B->bv.dyn->right);
+	  if (t < old) old = t;
+	  return old;
+	}
+     return ~(uint64_t)0;
+   }
+
+	// if H exceeds its cap, flattens the subtrees not updated since 
+	// the oldest update, then doubling that period each time, until 
+	// it uses at most CapSlack times its cap or it is all static. in 
+	// the latter case the cap is too close to the static size, and
+	// later calls wait until the space exceeds that floor by the slack
+	// of the cap, (1-CapSlack) times it, and then flatten only until
+	// half of that slack is recovered, instead of everything each time.
+	// flattening part of the views of a shared static buffer copies
+	// them without freeing it, so a step that does not reduce the space
+	// is followed by flattening everything
+
+static void enforceCap (hybridId H)
+
+   { uint64_t old,period,slack,target,space;
+     if (H->cap == 0) return;
+     slack = H->cap * (1-CapSlack);
+     target = H->cap - slack;
+     if (H->capFloor)
+	{ if (curSpace(H) <= max(H->cap,H->capFloor+slack)) return;
+	  target = max(target,H->capFloor+slack/2);
+	}
+     else if (curSpace(H) <= H->cap) return;
+     old = oldestUpdate(H->root);
+     period = 1;
+     space = curSpace(H);
+     while (old <= H->clock)
+	{ flattenCold(H,H->root,old);
+	  poolCompact(H->nodes);
+	  poolCompact(H->dyns);
+	  poolCompact(H->wides);
+	  leafIdPoolsCompact(H->leaves);
+	  if (curSpace(H) <= target) return;
+	  if (old == H->clock) break;
+	  if (curSpace(H) >= space) old = H->clock; // no gain, flatten all
+	  else { space = curSpace(H);
+		 old = min(H->clock,old+period);
+		 period *= 2;
+	       }
+	}
+     H->capFloor = curSpace(H); // all static now
+   }
+
+	// chooses theta for the fraction of updates q1 among the recent
+	// operations on H and its length n, as recommended in the README
+
+static void retune (hybridId H)
+
+   { float q1 = H->updates / (float)(H->updates + H->queries);
+     if (q1 >= 0.1) H->theta = 0.1;
+     else if (q1 <= 0.0001) H->theta = 0.01;
+     else if (nodeLength(H->root) <= (((uint64_t)1) << 22)) H->theta = 0.01;
+     else H->theta = 0.001;
+   }
+
+	// counts an update (upd) or query on H. if adaptive, retunes its
+	// theta and halves the counts once per window so old operations fade out
+
+static inline void countOp (hybridId H, uint upd)
+
+   { if (H->conf.decay) H->ops++;
+     if (!upd) sampleQuery(H);
+     if (!H->adaptive) return;
+     if (upd) H->updates++; else H->queries++;
+     if (H->updates + H->queries >= RatioWindow)
+	{ retune(H);
+	  H->updates /= 2; H->queries /= 2;
+	}
    }
 
+	// makes H choose its own theta, or use the configured one
+
+void hybridIdSetAdaptiveTheta (hybridId H, uint adaptive)
+
+   { H->adaptive = adaptive;
+     H->theta = H->conf.theta;
+     H->updates = H->queries = 0;
+   }
+
+	// sets the max space of H in w-bit words, 0 for no limit
+
+void hybridIdSetMemoryCap (hybridId H, uint64_t cap)
+
+   { H->cap = cap;
+     H->capFloor = 0;
+     enforceCap(H);
+   }
+
+	// appends leaf HB after the last leaf of B, merging them if they fit
+	// in a new leaf. full wide nodes are split on the way down and 
+	// dynamic ones rebalanced on the way up, as insert does
+
+static void appendNode (hybridId H, hybridIdNode B, hybridIdNode HB)
+
+   { hybridIdNode C;
+     dynamicId D;
+     wideId W;
+     uint64_t lsize,rsize;
+     int64_t delta;
+     uint width = nodeWidth(HB);
+     if (B->type == tWide)
+	{ if (B->bv.wide->nchildren >= maxChildren(H)) wideGrow(H,B); // no room
+	  W = B->bv.wide;
+	  C = W->child[W->nchildren-1];
+	  if ((C->type == tWide) && (C->bv.wide->nchildren >= maxChildren(H)))
+	     flushNode(H,C); // C splits, its buffered updates go down first
+	  if ((C->type == tWide) && (C->bv.wide->nchildren >= maxChildren(H)))
+	     { wideAddChild(W,W->nchildren,wideSplit(H,C->bv.wide));
+	       C = W->child[W->nchildren-1];
+	     }
+	  if ((C->type == tWide) || (C->type == tDynamic) || 
+	      ((C->type == tLeaf) && 
+	       (nodeLength(C)+nodeLength(HB) <= leafIdNewSize(width))))
+	     appendNode(H,C,HB);
+	  else wideAddChild(W,W->nchildren,HB);
+	  wideRecount(W);
+	  W->accesses = 0; // reset
+	  W->updated = H->clock;
+	}
+     else if (B->type == tDynamic)
+	{ D = B->bv.dyn;
+	  appendNode(H,D->right,HB);
+	  dynRecount(H,D);
+	  lsize = nodeLength(D->left);
+	  rsize = nodeLength(D->right);
+	  if ((rsize > H->conf.alpha*(lsize+rsize))
+	      && (lsize+rsize >= H->conf.minLeavesToBalance*leafIdMaxSize(width)) 
+	      && canBalance(H,lsize+rsize,width,0,0)) // too biased
+	     { delta = 0;
+	       balance(H,B,lsize+rsize-1,&delta);
+	     }
+	}
+     else if (nodeLength(B) == 0) // an empty root
+	{ C = (hybridIdNode)poolAlloc(H->nodes);
+	  *C = *B;
+	  nodeDestroy(H,C);
+	  *B = *HB;
+	  poolFree(H->nodes,HB);
+	}
+     else if ((B->type == tLeaf) && 
+	      (nodeLength(B)+nodeLength(HB) <= leafIdNewSize(width)))
+	{ mergeLeaves(H,B,HB);
+	  poolFree(H->nodes,HB);
+	}
+     else // B becomes the parent of its old contents and HB
+	{ C = (hybridIdNode)poolAlloc(H->nodes);
+	  *C = *B;
+	  if (H->conf.fanout > 2)
+	     { W = wideCreate(H,width);
+	       W->child[0] = C;
+	       W->child[1] = HB;
+	       W->nchildren = 2;
+	       wideRecount(W);
+	       B->type = tWide;
+	       B->bv.wide = W;
+	     }
+	  else
+	     { D = (dynamicId)poolAlloc(H->dyns);
+	       D->width = width;
+	       D->left = C;
+	       D->right = HB;
+	       dynRecount(H,D);
+	       D->epoch = 0;
+	       D->buf = NULL;
+	       B->type = tDynamic;
+	       B->bv.dyn = D;
+	     }
+	}
+   }
+
+	// number of elements appended to H and not yet in the tree
+
+static inline uint64_t tailLength (hybridId H)
+
+   { return H->tail ? leafIdLength(H->tail) : 0;
+   }
+
+	// moves the elements appended to H from its tail to the end of the 
+	// tree, the tail becoming a leaf
+
+static void flushTail (hybridId H)
+
+   { hybridIdNode HB;
+     if (tailLength(H) == 0) return;
+     H->clock++;
+     HB = (hybridIdNode)poolAlloc(H->nodes);
+     HB->type = tLeaf;
+     HB->bv.leaf = H->tail;
+     H->tail = NULL;
+     appendNode(H,H->root,HB);
+     enforceCap(H);
+   }
 
 	// gives number of elements 
 
-extern inline uint64_t hybridIdLength (hybridId B)
+extern inline uint64_t hybridIdLength (hybridId H)
 
-   { if (B->type == tLeaf) return leafIdLength(B->bv.leaf);
-     if (B->type == tStatic) return leafIdLength(B->bv.stat);
-     return B->bv.dyn->size;
+   { return nodeLength(H->root) - H->head + tailLength(H);
    }
 
         // gives width of elements 
 
-extern inline uint hybridIdWidth (hybridId B)
+extern inline uint hybridIdWidth (hybridId H)
 
-   { if (B->type == tStatic) return B->bv.stat->width;
-     if (B->type == tLeaf) return B->bv.leaf->width;
-     return B->bv.dyn->width;
+   { return nodeWidth(H->root);
    }
 
+
         // checks balance of B, assumed to be dynamic, and rotates once if needs
 
 	// sets value for B[i] = v, assumes i is right and v fits in width
 
-void hybridIdWrite (hybridId B, uint64_t i, uint64_t v)
+static void nodeWrite (hybridId H, hybridIdNode B, uint64_t i, uint64_t v)
 
    { uint64_t lsize;
+     uint k;
      if (B->type == tStatic) {
-        B->type = tDynamic;
-        B->bv.dyn = split(B->bv.stat,i);
+        split(H,B,i);
         }
      if (B->type == tLeaf)
         { leafIdWrite(B->bv.leaf,i,v);
 	  return;
 	}
+     if (B->type == tWide)
+        { B->bv.wide->accesses = 0; // reset
+          B->bv.wide->updated = H->clock;
+          k = wideFind(B->bv.wide,i);
+          send(H,B->bv.wide->child[k],mWrite,i-wideSizeBefore(B->bv.wide,k),v,
+	       NULL);
+          return;
+        }
      B->bv.dyn->accesses = 0; // reset
-     lsize = hybridIdLength(B->bv.dyn->left);
-     if (i < lsize) hybridIdWrite(B->bv.dyn->left,i,v);
-     else hybridIdWrite(B->bv.dyn->right,i-lsize,v);
+     B->bv.dyn->updated = H->clock;
+     lsize = nodeLength(B->bv.dyn->left);
+     if (i < lsize) send(H,B->bv.dyn->left,mWrite,i,v,NULL);
+     else send(H,B->bv.dyn->right,mWrite,i-lsize,v,NULL);
+   }
+
+static void doWrite (hybridId H, uint64_t i, uint64_t v)
+
+   { uint64_t size = nodeLength(H->root) - H->head; // before the tail
+     H->clock++;
+     if (i >= size) { leafIdWrite(H->tail,i-size,v); return; }
+     i += H->head;
+     if (i < H->frontEnd) H->frontEnd = 0; // the copy is no longer valid
+     nodeWrite(H,H->root,i,v);
+     enforceCap(H);
+   }
+
+void hybridIdWrite (hybridId H, uint64_t i, uint64_t v)
+
+   { countOp(H,1);
+     if (H->cbuffer) bufferUpdate(H,mWrite,i,v);
+     else doWrite(H,i,v);
    }
 
         // changing leaves is uncommon and only then we need to recompute
         // leaves. we do our best to avoid this overhead in typical operations
 
-static void irecompute (hybridId B, uint64_t i)
+static void irecompute (hybridIdNode B, uint64_t i)
 
    { uint64_t lsize;
+     uint k;
+     if (B->type == tWide) {
+        k = wideFind(B->bv.wide,i);
+        irecompute(B->bv.wide->child[k],i-wideSizeBefore(B->bv.wide,k));
+        B->bv.wide->leaves = 0;
+        for (k=0;k<B->bv.wide->nchildren;k++)
+            B->bv.wide->leaves += nodeLeaves(B->bv.wide->child[k]);
+        }
      if (B->type == tDynamic) {
-        lsize = hybridIdLength(B->bv.dyn->left);
+        lsize = nodeLength(B->bv.dyn->left);
         if (i < lsize) irecompute(B->bv.dyn->left,i);
         else irecompute(B->bv.dyn->right,i-lsize);
-        B->bv.dyn->leaves = hybridIdLeaves(B->bv.dyn->left) +
-                            hybridIdLeaves(B->bv.dyn->right);
+        B->bv.dyn->leaves = nodeLeaves(B->bv.dyn->left) +
+                            nodeLeaves(B->bv.dyn->right);
         }
    }
 
-static void rrecompute (hybridId B, uint64_t i, uint64_t l)
-
-   { uint64_t lsize;
+static void rrecompute (hybridIdNode B, uint64_t i, uint64_t l)
+
+   { uint64_t lsize,off,len;
+     uint k;
+     if (B->type == tWide) {
+        k = wideFind(B->bv.wide,i);
+        while (l) {
+           off = wideSizeBefore(B->bv.wide,k);
+           len = min(l,B->bv.wide->csize[k]-i);
+           rrecompute(B->bv.wide->child[k],i-off,len);
+           i += len; l -= len; k++;
+           }
+        B->bv.wide->leaves = 0;
+        for (k=0;k<B->bv.wide->nchildren;k++)
+            B->bv.wide->leaves += nodeLeaves(B->bv.wide->child[k]);
+        }
      if (B->type == tDynamic) {
-        lsize = hybridIdLength(B->bv.dyn->left);
+        lsize = nodeLength(B->bv.dyn->left);
         if (i+l < lsize) rrecompute(B->bv.dyn->left,i,l);
         else if (i >= lsize) rrecompute(B->bv.dyn->right,i-lsize,l);
         else { rrecompute(B->bv.dyn->left,i,lsize-i);
                rrecompute(B->bv.dyn->right,0,l-(lsize-i));
              }
-        B->bv.dyn->leaves = hybridIdLeaves(B->bv.dyn->left) +
-                            hybridIdLeaves(B->bv.dyn->right);
+        B->bv.dyn->leaves = nodeLeaves(B->bv.dyn->left) +
+                            nodeLeaves(B->bv.dyn->right);
         }
    }
 
+	// inserts v at B[i] for a wide B, as in a B+-tree: full children are
+	// split before descending, so there is always room for them in B
+
+static void wideInsert (hybridId H, hybridIdNode B, uint64_t i, uint64_t v, uint *recalc)
+
+   { wideId W;
+     hybridIdNode C;
+     uint k;
+     if (B->bv.wide->nchildren >= maxChildren(H)) wideGrow(H,B); // no room
+     W = B->bv.wide;
+     W->accesses = 0; // reset
+     W->updated = H->clock;
+     k = wideFind(W,i);
+     C = W->child[k];
+     if ((C->type == tWide) && (C->bv.wide->nchildren >= maxChildren(H)))
+	flushNode(H,C); // C splits, its buffered updates go down first
+     if ((C->type == tWide) && (C->bv.wide->nchildren >= maxChildren(H)))
+        { wideAddChild(W,k+1,wideSplit(H,C->bv.wide));
+          wideRecount(W);
+          k = wideFind(W,i);
+        }
+     else if ((C->type == tLeaf) && 
+	      (leafIdLength(C->bv.leaf) == leafIdMaxSize(W->width)))
+        { if (!(((k+1 < W->nchildren) && (W->child[k+1]->type == tLeaf)
+                && transferRight(H,C,W->child[k+1]))
+               || ((k > 0) && (W->child[k-1]->type == tLeaf)
+                && transferLeft(H,W->child[k-1],C))))
+             { wideSplitLeaf(H,W,k); // could not avoid it
+               *recalc = 1; // leaf added
+             }
+          else wideRecount(W);
+          k = wideFind(W,i);
+        }
+     send(H,W->child[k],mInsert,i-wideSizeBefore(W,k),v,recalc);
+     for (;k<W->nchildren;k++) W->csize[k]++;
+   }
+
 	// inserts v at B[i], assumes i is right and v fits in width
 
-void insert (hybridId B, uint64_t i, uint64_t v, uint *recalc)
+static void insert (hybridId H, hybridIdNode B, uint64_t i, uint64_t v, uint *recalc)
 
    { uint64_t lsize,rsize;
      int64_t delta;
      uint width;
+     hybridIdNode HB1,HB2;
      if (B->type == tStatic) {
-        B->type = tDynamic;
-        B->bv.dyn = split(B->bv.stat,i); // does not change #leaves!
+        split(H,B,i); // does not change #leaves!
         }
      if (B->type == tLeaf) {
         if (leafIdLength(B->bv.leaf) == leafIdMaxSize(B->bv.leaf->width))//split
-           { B->type = tDynamic;
-             B->bv.dyn = splitLeaf(B->bv.leaf);
+           { if (H->conf.fanout > 2)
+                { width = B->bv.leaf->width;
+                  halveLeaf(H,B->bv.leaf,&HB1,&HB2);
+                  B->type = tWide;
+                  B->bv.wide = wideCreate(H,width);
+                  B->bv.wide->child[0] = HB1;
+                  B->bv.wide->child[1] = HB2;
+                  B->bv.wide->nchildren = 2;
+                  wideRecount(B->bv.wide);
+                }
+             else
+                { B->type = tDynamic;
+                  B->bv.dyn = splitLeaf(H,B->bv.leaf);
+                }
 	     *recalc = 1; // leaf added
            }
         else
-           { leafIdInsert(B->bv.leaf,i,v);
+           { B->bv.leaf = leafIdResize(B->bv.leaf,leafIdLength(B->bv.leaf)+1,
+				       H->leaves);
+	     leafIdInsert(B->bv.leaf,i,v,H->conf.gap);
              return;
            }
         }
+     if (B->type == tWide) {
+        wideInsert(H,B,i,v,recalc);
+        return;
+        }
      B->bv.dyn->accesses = 0; // reset
+     B->bv.dyn->updated = H->clock;
      width = B->bv.dyn->width;
-     lsize = hybridIdLength(B->bv.dyn->left);
-     rsize = hybridIdLength(B->bv.dyn->right);
+     lsize = nodeLength(B->bv.dyn->left);
+     rsize = nodeLength(B->bv.dyn->right);
      if (i < lsize) {
         if ((lsize == leafIdMaxSize(width))      // will overflow if leaf
              && (rsize < leafIdMaxSize(width))   // can avoid if leaf
              && (B->bv.dyn->left->type == tLeaf) // both are leaves
              && (B->bv.dyn->right->type == tLeaf)
-             && transferRight(B->bv.dyn)) { // avoided, transferred to the right
-	   insert(B,i,v,recalc);
+             && transferRight(H,B->bv.dyn->left,B->bv.dyn->right)) {
+				// avoided, transferred to the right
+	   insert(H,B,i,v,recalc);
 	   return;
 	   }
-        if ((lsize+1 > Alpha*(lsize+rsize+1))
-             && (lsize+rsize >= MinLeavesToBalance*leafIdMaxSize(width)) 
-	     && canBalance(lsize+rsize,width,1,0)) { // too biased
+        if ((lsize+1 > H->conf.alpha*(lsize+rsize+1))
+             && (lsize+rsize >= H->conf.minLeavesToBalance*leafIdMaxSize(width)) 
+	     && canBalance(H,lsize+rsize,width,1,0)) { // too biased
 	   delta = 0;
-           balance(B,i,&delta);
+           balance(H,B,i,&delta);
 	   if (delta) *recalc = 1;
-           insert(B,i,v,recalc);
+           insert(H,B,i,v,recalc);
            return;
            }
-        insert(B->bv.dyn->left,i,v,recalc);
+        send(H,B->bv.dyn->left,mInsert,i,v,recalc);
         }
      else {
         if ((rsize == leafIdMaxSize(width))       // will overflow if leaf
              && (lsize < leafIdMaxSize(width))    // can avoid if leaf
 	     && (B->bv.dyn->right->type == tLeaf) // both are leaves
              && (B->bv.dyn->left->type == tLeaf) 
-             && transferLeft(B->bv.dyn)) { // avoided, transferred to the left
-	   insert(B,i,v,recalc);
+             && transferLeft(H,B->bv.dyn->left,B->bv.dyn->right)) {
+				// avoided, transferred to the left
+	   insert(H,B,i,v,recalc);
 	   return;
 	   }
-        if ((rsize+1 > Alpha*(lsize+rsize+1)) 
-             && (lsize+rsize >= MinLeavesToBalance*leafIdMaxSize(width)) 
-	     && canBalance(lsize+rsize,width,0,1))    { // too biased
+        if ((rsize+1 > H->conf.alpha*(lsize+rsize+1)) 
+             && (lsize+rsize >= H->conf.minLeavesToBalance*leafIdMaxSize(width)) 
+	     && canBalance(H,lsize+rsize,width,0,1))    { // too biased
 	   delta = 0;
-           balance(B,i,&delta);
+           balance(H,B,i,&delta);
 	   if (delta) *recalc = 1;
-           insert(B,i,v,recalc);
+           insert(H,B,i,v,recalc);
            return;
            }
-        insert(B->bv.dyn->right,i-lsize,v,recalc);
+        send(H,B->bv.dyn->right,mInsert,i-lsize,v,recalc);
         }
      B->bv.dyn->size++;
    }
 
-void hybridIdInsert (hybridId B, uint64_t i, uint64_t v)
+static void doInsert (hybridId H, uint64_t i, uint64_t v)
 
-   { uint recalc = 0;
-     insert(B,i,v,&recalc);
+   { hybridIdNode B = H->root;
+     uint recalc = 0;
+     uint64_t size = nodeLength(B) - H->head; // before the tail
+     uint width = nodeWidth(B);
+     H->clock++;
+     if ((i >= size) && (tailLength(H) == leafIdNewSize(width)))
+	{ flushTail(H); // no room in the tail
+	  size = nodeLength(B) - H->head;
+	}
+     if (i >= size)
+	{ if (H->tail == NULL) H->tail = leafIdCreate(width,H->leaves);
+	  H->tail = leafIdResize(H->tail,leafIdLength(H->tail)+1,H->leaves);
+	  leafIdInsert(H->tail,i-size,v,H->conf.gap);
+	  return;
+	}
+     i += H->head;
+     if (i < H->frontEnd) H->frontEnd = 0; // the copy is no longer valid
+     insert(H,B,i,v,&recalc);
      if (recalc) irecompute(B,i); // we went to the leaf now holding i
+     enforceCap(H);
+   }
+
+void hybridIdInsert (hybridId H, uint64_t i, uint64_t v)
+
+   { countOp(H,1);
+     if (H->cbuffer) bufferUpdate(H,mInsert,i,v);
+     else doInsert(H,i,v);
+   }
+
+	// deletes B[i] for a wide B. underfull children are merged with
+	// a neighbor as in a B+-tree, while flattening works as usual
+
+static void wideDelete (hybridId H, hybridIdNode B, uint64_t i, uint *recalc)
+
+   { wideId W = B->bv.wide;
+     hybridIdNode C;
+     uint k,j;
+     int64_t delta;
+     uint64_t size;
+     W->accesses = 0; // reset
+     W->updated = H->clock;
+     k = wideFind(W,i);
+     send(H,W->child[k],mDelete,i-wideSizeBefore(W,k),0,recalc);
+     for (j=k;j<W->nchildren;j++) W->csize[j]--;
+     C = W->child[k];
+     if (nodeLength(C) == 0) // empty child, remove
+        { nodeDestroy(H,C);
+          wideRemoveChild(W,k);
+          wideRecount(W);
+          *recalc = 1;
+        }
+     else if (C->type == tLeaf)
+        { if ((k+1 < W->nchildren) && (W->child[k+1]->type == tLeaf) &&
+              (nodeLength(C)+nodeLength(W->child[k+1]) 
+						<= leafIdNewSize(W->width)))
+             { wideMergeLeaves(H,W,k);
+               *recalc = 1;
+             }
+          else if ((k > 0) && (W->child[k-1]->type == tLeaf) &&
+              (nodeLength(C)+nodeLength(W->child[k-1]) 
+						<= leafIdNewSize(W->width)))
+             { wideMergeLeaves(H,W,k-1);
+               *recalc = 1;
+             }
+        }
+     else if ((C->type == tWide) &&
+              (C->bv.wide->nchildren < maxChildren(H) * MinWideFill))
+        { if ((k+1 < W->nchildren) && (W->child[k+1]->type == tWide) &&
+              (C->bv.wide->nchildren + W->child[k+1]->bv.wide->nchildren
+                                                <= maxChildren(H)))
+             wideMergeChildren(H,W,k);
+          else if ((k > 0) && (W->child[k-1]->type == tWide) &&
+              (C->bv.wide->nchildren + W->child[k-1]->bv.wide->nchildren
+                                                <= maxChildren(H)))
+             wideMergeChildren(H,W,k-1);
+        }
+     if (W->nchildren == 1) // a single child, replaces B
+        { C = W->child[0];
+          *B = *C;
+          poolFree(H->nodes,C);
+          poolFree(H->wides,W);
+          *recalc = 1;
+          return;
+        }
+     size = W->csize[W->nchildren-1];
+     if (size <= leafIdNewSize(W->width)) { // becomes a leaf
+        delta = 0;
+        flatten(H,B,&delta);
+        *recalc = 1;
+        }
+     else if (size < W->leaves * leafIdNewSize(W->width) * H->conf.minFillFactor) {
+        delta = 0;
+        flatten(H,B,&delta);
+        if (delta) *recalc = 1;
+        }
    }
 
 	// deletes B[i], assumes i is right
 
-static void delete (hybridId B, uint64_t i, uint *recalc)
+static void delete (hybridId H, hybridIdNode B, uint64_t i, uint *recalc)
 
    { uint64_t lsize,rsize;
-     hybridId B2;
+     hybridIdNode B2;
      int64_t delta;
      uint width;
      if (B->type == tStatic) {
-        B->type = tDynamic;
-        B->bv.dyn = split(B->bv.stat,i);
+        split(H,B,i);
         }
      if (B->type == tLeaf) {
-        leafIdDelete(B->bv.leaf,i);
+        leafIdDelete(B->bv.leaf,i,H->conf.gap);
+	B->bv.leaf = leafIdResize(B->bv.leaf,leafIdLength(B->bv.leaf),H->leaves);
+	H->underflow = (leafIdLength(B->bv.leaf) < leafIdNewSize(B->bv.leaf->width)/2);
 	return;
 	}
+     if (B->type == tWide) {
+        wideDelete(H,B,i,recalc);
+        return;
+        }
      B->bv.dyn->accesses = 0; // reset
+     B->bv.dyn->updated = H->clock;
      width = B->bv.dyn->width;
-     lsize = hybridIdLength(B->bv.dyn->left);
-     rsize = hybridIdLength(B->bv.dyn->right);
+     lsize = nodeLength(B->bv.dyn->left);
+     rsize = nodeLength(B->bv.dyn->right);
      if (i < lsize) {  
-        if ((rsize > Alpha*(lsize+rsize-1)) 
-             && (lsize+rsize >= MinLeavesToBalance*leafIdMaxSize(width)) 
-	     && canBalance(lsize+rsize,width,-1,0))   { // too biased
+        if ((rsize > H->conf.alpha*(lsize+rsize-1)) 
+             && (lsize+rsize >= H->conf.minLeavesToBalance*leafIdMaxSize(width)) 
+	     && canBalance(H,lsize+rsize,width,-1,0))   { // too biased
 	   delta = 0;
-           balance(B,i,&delta);
+           balance(H,B,i,&delta);
 	   if (delta) *recalc = 1;
-           delete(B,i,recalc);
+           delete(H,B,i,recalc);
 	   return;
            }
-        delete(B->bv.dyn->left,i,recalc);
+        send(H,B->bv.dyn->left,mDelete,i,0,recalc);
         if (lsize == 1) { // left child is now of size zero, remove
-           hybridIdDestroy(B->bv.dyn->left);
+           nodeDestroy(H,B->bv.dyn->left);
            B2 = B->bv.dyn->right;
-           myfree(B->bv.dyn);
+           poolFree(H->dyns,B->bv.dyn);
            *B = *B2;
+           poolFree(H->nodes,B2);
 	   *recalc = 1;
            return;
            }
         }
      else { 
-        if ((lsize > Alpha*(lsize+rsize-1)) 
-             && (lsize+rsize >= MinLeavesToBalance*leafIdMaxSize(width)) 
-	     && canBalance(lsize+rsize,width,0,-1))   { // too biased
+        if ((lsize > H->conf.alpha*(lsize+rsize-1)) 
+             && (lsize+rsize >= H->conf.minLeavesToBalance*leafIdMaxSize(width)) 
+	     && canBalance(H,lsize+rsize,width,0,-1))   { // too biased
 	   delta = 0;
-           balance(B,i,&delta);
+           balance(H,B,i,&delta);
 	   if (delta) *recalc = 1;
-           delete(B,i,recalc);
+           delete(H,B,i,recalc);
 	   return;
            }
-        delete(B->bv.dyn->right,i-lsize,recalc);
+        send(H,B->bv.dyn->right,mDelete,i-lsize,0,recalc);
         if (rsize == 1) { // right child is now of size zero, remove
-           hybridIdDestroy(B->bv.dyn->right);
+           nodeDestroy(H,B->bv.dyn->right);
            B2 = B->bv.dyn->left;
-           myfree(B->bv.dyn);
+           poolFree(H->dyns,B->bv.dyn);
            *B = *B2;
+           poolFree(H->nodes,B2);
 	   *recalc = 1;
            return;
            }
         }
      B->bv.dyn->size--;
-     if (B->bv.dyn->size <= leafIdNewSize(B->bv.dyn->width)){ // merge leaves
-        B->bv.leaf = mergeLeaves(B->bv.dyn);
+     if ((B->bv.dyn->size <= leafIdNewSize(B->bv.dyn->width)) && // merge
+	 (B->bv.dyn->left->type == tLeaf) && (B->bv.dyn->right->type == tLeaf)){
+        B->bv.leaf = mergeChildren(H,B->bv.dyn);
         B->type = tLeaf;
 	*recalc = 1;
         }
+     else if (B->bv.dyn->size <= leafIdNewSize(B->bv.dyn->width)) {
+        delta = 0; // a child is internal, with buffered updates
+        flatten(H,B,&delta);
+        *recalc = 1;
+        }
      else if (B->bv.dyn->size <
-              B->bv.dyn->leaves * leafIdNewSize(B->bv.dyn->width) * MinFillFactor) {
+              B->bv.dyn->leaves * leafIdNewSize(B->bv.dyn->width) * H->conf.minFillFactor) {
         delta = 0;
-        flatten(B,&delta);
+        flatten(H,B,&delta);
         if (delta) *recalc = 1;
         }
    }
 
-void hybridIdDelete (hybridId B, uint64_t i)
+	// collects in P[0..] the nodes from the root of H down to the leaf
+	// holding position i, and in *start the position where the leaf 
+	// starts. returns the depth of the leaf, or -1 if the path goes 
+	// through wide or static nodes or is deeper than MaxDepth
+
+static int leafPath (hybridId H, uint64_t i, hybridIdNode *P, uint64_t *start)
+
+   { hybridIdNode B = H->root;
+     uint64_t lsize;
+     int d = 0;
+     *start = 0;
+     while (B->type == tDynamic)
+	{ if (d == MaxDepth-1) return -1;
+	  P[d++] = B;
+	  lsize = nodeLength(B->bv.dyn->left);
+	  if (i < lsize) B = B->bv.dyn->left;
+	  else { B = B->bv.dyn->right; i -= lsize; *start += lsize; }
+	}
+     if (B->type != tLeaf) return -1;
+     P[d] = B;
+     return d;
+   }
+
+	// recomputes the counters of the dynamic nodes P[0..d-1], bottom-up
+
+static void pathRecount (hybridId H, hybridIdNode *P, int d)
+
+   { while (d--) dynRecount(H,P[d]->bv.dyn);
+   }
+
+	// if the leaf holding position i is less than half full, merges it
+	// with the next (or previous) leaf or borrows from it, even if they
+	// hang from different nodes. it gives up on wide and static nodes
+
+static void repairLeaf (hybridId H, uint64_t i)
+
+   { hybridIdNode P1[MaxDepth],P2[MaxDepth];
+     hybridIdNode *PL,*PR; // paths to the left and the right leaf
+     int d1,d2,dl,dr,k;
+     uint64_t s1,s2,len;
+     hybridIdNode Par,Sib;
+     dynamicId D;
+     d1 = leafPath(H,i,P1,&s1);
+     if (d1 <= 0) return; // also if the root is a leaf
+     len = leafIdLength(P1[d1]->bv.leaf);
+     if (len >= leafIdNewSize(P1[d1]->bv.leaf->width)/2) return;
+     if (s1+len < nodeLength(H->root))
+	{ d2 = leafPath(H,s1+len,P2,&s2);
+	  PL = P1; dl = d1; PR = P2; dr = d2;
+	}
+     else
+	{ d2 = leafPath(H,s1-1,P2,&s2);
+	  PL = P2; dl = d2; PR = P1; dr = d1;
+	}
+     if (d2 < 0) return;
+     if (len + leafIdLength(P2[d2]->bv.leaf) <= leafIdNewSize(P1[d1]->bv.leaf->width))
+	{ mergeLeaves(H,PL[dl],PR[dr]);
+		// the parent of the right leaf is replaced by its sibling
+	  Par = PR[dr-1]; D = Par->bv.dyn;
+	  Sib = (D->left == PR[dr]) ? D->right : D->left;
+	  *Par = *Sib;
+	  poolFree(H->nodes,Sib); poolFree(H->nodes,PR[dr]);
+	  poolFree(H->dyns,D);
+	  if ((dl >= dr) && (PL[dr-1] == Par)) // Sib was on the left path
+	     { for (k=dr;k<dl;k++) PL[k] = PL[k+1];
+	       dl--;
+	     }
+	  dr--; // the right path now ends at the ancestors of Par
+	}
+     else if (PL == P1) 
+	{ if (!transferLeft(H,PL[dl],PR[dr])) return;
+	}
+     else if (!transferRight(H,PL[dl],PR[dr])) return;
+     pathRecount(H,PL,dl);
+     pathRecount(H,PR,dr);
+   }
+
+static void doDelete (hybridId H, uint64_t i)
 
-   { uint recalc = 0;
-     delete(B,i,&recalc);
+   { hybridIdNode B = H->root;
+     uint recalc = 0;
+     uint64_t size = nodeLength(B) - H->head; // before the tail
+     H->clock++;
+     if (i >= size)
+	{ leafIdDelete(H->tail,i-size,H->conf.gap);
+	  H->tail = leafIdResize(H->tail,leafIdLength(H->tail),H->leaves);
+	  return;
+	}
+     i += H->head;
+     if (i < H->frontEnd) H->frontEnd = 0; // the copy is no longer valid
+     delete(H,B,i,&recalc);
      if (recalc) { // the node is now at i-1 or at i, hard to know
         irecompute(B,i-1);
         irecompute(B,i);
         }
+     if (H->underflow && !H->pending) // it moves elements below buffers
+	{ if (i > 0) repairLeaf(H,i-1);
+	  if (i < nodeLength(H->root)) repairLeaf(H,i);
+	}
+     enforceCap(H);
    }
 
-        // flattening is uncommon and only then we need to recompute
-        // leaves. we do our best to avoid this overhead in typical queries
+void hybridIdDelete (hybridId H, uint64_t i)
 
-static void recompute (hybridId B, uint64_t i, int64_t delta)
+   { countOp(H,1);
+     if (H->cbuffer) bufferUpdate(H,mDelete,i,0);
+     else doDelete(H,i);
+   }
 
-   { uint64_t lsize;
-     if (B->type == tDynamic) {
-        B->bv.dyn->leaves += delta;
-        lsize = hybridIdLength(B->bv.dyn->left);
+        // flattening is uncommon and only then we need to recompute
+        // leaves. we do our best to avoid this overhead in typical queries.
+	// i goes through the buffered updates as access did
+
+static void recompute (hybridIdNode B, uint64_t i, int64_t delta)
+
+   { uint64_t lsize,v;
+     uint k;
+     if ((B->type != tWide) && (B->type != tDynamic)) return;
+     if (B->type == tWide) B->bv.wide->leaves += delta;
+     else B->bv.dyn->leaves += delta;
+     if (nodeBuf(B) && bufferFind(nodeBuf(B),&i,&v)) return; // not below
+     if (B->type == tWide) {
+        k = wideFind(B->bv.wide,i);
+        recompute(B->bv.wide->child[k],i-wideSizeBefore(B->bv.wide,k),delta);
+        }
+     else {
+        lsize = nodeLength(B->bv.dyn->left);
         if (i < lsize) recompute(B->bv.dyn->left,i,delta);
         else recompute(B->bv.dyn->right,i-lsize,delta);
         }
@@ -672,53 +2229,92 @@ static void recompute (hybridId B, uint64_t i, int64_t delta)
 
 	// access B[i], assumes i is right
 
-uint64_t access (hybridId B, uint64_t i, int64_t *delta, uint64_t n)
+static uint64_t access (hybridId H, hybridIdNode B, uint64_t i, int64_t *delta, uint64_t n)
 
-   { uint64_t lsize;
+   { uint64_t lsize,v;
+     uint k;
+     if (B->type == tWide)
+        { countAccess(H,B);
+          if (mustFlatten(H,B,n))
+               flatten(H,B,delta);
+          else
+             { if (B->bv.wide->buf && bufferFind(B->bv.wide->buf,&i,&v)) 
+		  return v;
+	       k = wideFind(B->bv.wide,i);
+               return access(H,B->bv.wide->child[k],
+			     i-wideSizeBefore(B->bv.wide,k),delta,n);
+             }
+        }
      if (B->type == tDynamic)
-        { B->bv.dyn->accesses++;
-	  if (mustFlatten(B,n))
-               flatten(B,delta);
+        { countAccess(H,B);
+	  if (mustFlatten(H,B,n))
+               flatten(H,B,delta);
           else
-             { lsize = hybridIdLength(B->bv.dyn->left);
-               if (i < lsize) return access(B->bv.dyn->left,i,delta,n);
-               return access(B->bv.dyn->right,i-lsize,delta,n);
+             { if (B->bv.dyn->buf && bufferFind(B->bv.dyn->buf,&i,&v)) 
+		  return v;
+	       lsize = nodeLength(B->bv.dyn->left);
+               if (i < lsize) return access(H,B->bv.dyn->left,i,delta,n);
+               return access(H,B->bv.dyn->right,i-lsize,delta,n);
              }
         }
      if (B->type == tLeaf) return leafIdAccess(B->bv.leaf,i);
      return leafIdAccess(B->bv.stat,i);
    }
 
-uint64_t hybridIdAccess (hybridId B, uint64_t i)
+uint64_t hybridIdAccess (hybridId H, uint64_t i)
 
-   { int64_t delta = 0;
+   { hybridIdNode B = H->root;
+     int64_t delta = 0;
      uint64_t n = 0;
-     if (B->type == tDynamic) n = B->bv.dyn->size;
-     uint64_t answ = access(B,i,&delta,n);
+     uint64_t size = nodeLength(B) - H->head; // before the tail
+     countOp(H,0);
+     if (i >= size) return leafIdAccess(H->tail,i-size);
+     i += H->head;
+     if ((B->type == tDynamic) || (B->type == tWide)) n = nodeLength(B);
+     uint64_t answ = access(H,B,i,&delta,n);
      if (delta) recompute(B,i,delta);
      return answ;
    }
 
         // read values [i..i+l-1], onto D[0...], of uint64_t
 
-static void sread64 (hybridId B, uint64_t i, uint64_t l, uint64_t *D, 
+static void sread64 (hybridId H, hybridIdNode B, uint64_t i, uint64_t l, uint64_t *D, 
 		     uint *recomp, uint64_t n)
 
-   { uint64_t lsize;
+   { uint64_t lsize,off,len;
      int64_t delta;
+     uint k;
+     if (B->type == tWide)
+        { countAccess(H,B);
+          if (mustFlatten(H,B,n)) {
+             delta = 0;
+             flatten(H,B,&delta);
+             if (delta) *recomp = 1;
+             }
+          else {
+            k = wideFind(B->bv.wide,i);
+            while (l) {
+               off = wideSizeBefore(B->bv.wide,k);
+               len = min(l,B->bv.wide->csize[k]-i);
+               sread64(H,B->bv.wide->child[k],i-off,len,D,recomp,n);
+               i += len; D += len; l -= len; k++;
+               }
+            return;
+            }
+        }
      if (B->type == tDynamic)
-        { B->bv.dyn->accesses++;
-	  if (mustFlatten(B,n)) {
+        { countAccess(H,B);
+	  if (mustFlatten(H,B,n)) {
              delta = 0;
-	     flatten(B,&delta);
+	     flatten(H,B,&delta);
 	     if (delta) *recomp = 1;
 	     }
           else {
-            lsize = hybridIdLength(B->bv.dyn->left);
-            if (i+l < lsize) sread64(B->bv.dyn->left,i,l,D,recomp,n);
-            else if (i >= lsize) sread64(B->bv.dyn->right,i-lsize,l,D,recomp,n);
-            else { sread64(B->bv.dyn->left,i,lsize-i,D,recomp,n);
-                   sread64(B->bv.dyn->right,0,l-(lsize-i),D+(lsize-i),recomp,n);
+            lsize = nodeLength(B->bv.dyn->left);
+            if (i+l < lsize) sread64(H,B->bv.dyn->left,i,l,D,recomp,n);
+            else if (i >= lsize) sread64(H,B->bv.dyn->right,i-lsize,l,D,recomp,n);
+            else { sread64(H,B->bv.dyn->left,i,lsize-i,D,recomp,n);
+                   sread64(H,B->bv.dyn->right,0,l-(lsize-i),D+(lsize-i),recomp,n);
                  }
             return;
             }
@@ -727,35 +2323,69 @@ static void sread64 (hybridId B, uint64_t i, uint64_t l, uint64_t *D,
      else leafIdRead64(B->bv.stat,i,l,D);
    }
 
-void hybridRead64 (hybridId B, uint64_t i, uint64_t l, uint64_t *D)
+	// reads elements [i..i+l-1] of the tree of H, including its head
+
+static void treeRead64 (hybridId H, uint64_t i, uint64_t l, uint64_t *D)
 
-   { uint recomp = 0; 
+   { hybridIdNode B = H->root;
+     uint recomp = 0; 
      uint64_t n = 0;
-     if (B->type == tDynamic) n = B->bv.dyn->size;
-     sread64(B,i,l,D,&recomp,n);
+     countOp(H,0);
+     unbuffer(H,B,i,l); // sread does not see buffered updates
+     if ((B->type == tDynamic) || (B->type == tWide)) n = nodeLength(B);
+     sread64(H,B,i,l,D,&recomp,n);
      if (recomp) rrecompute(B,i,l);
    }
 
+void hybridIdRead64 (hybridId H, uint64_t i, uint64_t l, uint64_t *D)
+
+   { uint64_t size,len;
+     size = nodeLength(H->root) - H->head; // before the tail
+     len = (i < size) ? min(l,size-i) : 0;
+     if (len) treeRead64(H,H->head+i,len,D);
+     else countOp(H,0);
+     if (len < l) leafIdRead64(H->tail,i+len-size,l-len,D+len);
+   }
+
         // read values [i..i+l-1], onto D[0...], of uint32_t
 
-static void sread32 (hybridId B, uint64_t i, uint64_t l, uint32_t *D, 
+static void sread32 (hybridId H, hybridIdNode B, uint64_t i, uint64_t l, uint32_t *D, 
 		     uint *recomp, uint64_t n)
 
-   { uint64_t lsize;
+   { uint64_t lsize,off,len;
      int64_t delta;
+     uint k;
+     if (B->type == tWide)
+        { countAccess(H,B);
+          if (mustFlatten(H,B,n)) {
+             delta = 0;
+             flatten(H,B,&delta);
+             if (delta) *recomp = 1;
+             }
+          else {
+            k = wideFind(B->bv.wide,i);
+            while (l) {
+               off = wideSizeBefore(B->bv.wide,k);
+               len = min(l,B->bv.wide->csize[k]-i);
+               sread32(H,B->bv.wide->child[k],i-off,len,D,recomp,n);
+               i += len; D += len; l -= len; k++;
+               }
+            return;
+            }
+        }
      if (B->type == tDynamic)
-        { B->bv.dyn->accesses++;
-	  if (mustFlatten(B,n)) {
+        { countAccess(H,B);
+	  if (mustFlatten(H,B,n)) {
              delta = 0;
-             flatten(B,&delta);
+             flatten(H,B,&delta);
              if (delta) *recomp = 1;
              }
           else {
-            lsize = hybridIdLength(B->bv.dyn->left);
-            if (i+l < lsize) sread32(B->bv.dyn->left,i,l,D,recomp,n);
-            else if (i >= lsize) sread32(B->bv.dyn->right,i-lsize,l,D,recomp,n);
-            else { sread32(B->bv.dyn->left,i,lsize-i,D,recomp,n);
-                   sread32(B->bv.dyn->right,0,l-(lsize-i),D+(lsize-i),recomp,n);
+            lsize = nodeLength(B->bv.dyn->left);
+            if (i+l < lsize) sread32(H,B->bv.dyn->left,i,l,D,recomp,n);
+            else if (i >= lsize) sread32(H,B->bv.dyn->right,i-lsize,l,D,recomp,n);
+            else { sread32(H,B->bv.dyn->left,i,lsize-i,D,recomp,n);
+                   sread32(H,B->bv.dyn->right,0,l-(lsize-i),D+(lsize-i),recomp,n);
                  }
             return;
             }
@@ -764,12 +2394,231 @@ static void sread32 (hybridId B, uint64_t i, uint64_t l, uint32_t *D,
      else leafIdRead32(B->bv.stat,i,l,D);
    }
 
-void hybridRead32 (hybridId B, uint64_t i, uint64_t l, uint32_t *D)
+	// reads elements [i..i+l-1] of the tree of H, including its head
+
+static void treeRead32 (hybridId H, uint64_t i, uint64_t l, uint32_t *D)
 
-   { uint recomp = 0;
+   { hybridIdNode B = H->root;
+     uint recomp = 0;
      uint64_t n = 0;
-     if (B->type == tDynamic) n = B->bv.dyn->size;
-     sread32(B,i,l,D,&recomp,n);
+     countOp(H,0);
+     unbuffer(H,B,i,l); // sread does not see buffered updates
+     if ((B->type == tDynamic) || (B->type == tWide)) n = nodeLength(B);
+     sread32(H,B,i,l,D,&recomp,n);
      if (recomp) rrecompute(B,i,l);
    }
 
+void hybridIdRead32 (hybridId H, uint64_t i, uint64_t l, uint32_t *D)
+
+   { uint64_t size,len;
+     size = nodeLength(H->root) - H->head; // before the tail
+     len = (i < size) ? min(l,size-i) : 0;
+     if (len) treeRead32(H,H->head+i,len,D);
+     else countOp(H,0);
+     if (len < l) leafIdRead32(H->tail,i+len-size,l-len,D+len);
+   }
+
+
+	// removes the first leaf-level node below internal B, rebalancing
+	// and recounting the nodes on the way as delete does
+
+static void removeFirst (hybridId H, hybridIdNode B)
+
+   { hybridIdNode C;
+     dynamicId D;
+     wideId W;
+     uint64_t lsize,rsize;
+     int64_t delta;
+     uint width;
+     if (B->type == tWide)
+	{ W = B->bv.wide;
+	  C = W->child[0];
+	  if ((C->type == tWide) || (C->type == tDynamic))
+	     { removeFirst(H,C);
+	       if ((C->type == tWide) && (W->child[1]->type == tWide) &&
+		   (C->bv.wide->nchildren < maxChildren(H) * MinWideFill) &&
+		   (C->bv.wide->nchildren + W->child[1]->bv.wide->nchildren 
+						<= maxChildren(H)))
+		  wideMergeChildren(H,W,0);
+	     }
+	  else 
+	     { nodeDestroy(H,C);
+	       wideRemoveChild(W,0);
+	     }
+	  if (W->nchildren == 1) // a single child, replaces B
+	     { C = W->child[0];
+	       *B = *C;
+	       poolFree(H->nodes,C);
+	       poolFree(H->wides,W);
+	       return;
+	     }
+	  wideRecount(W);
+	  W->accesses = 0; // reset
+	  W->updated = H->clock;
+	  return;
+	}
+     D = B->bv.dyn;
+     if ((D->left->type != tWide) && (D->left->type != tDynamic))
+	{ nodeDestroy(H,D->left); // the right child replaces B
+	  C = D->right;
+	  poolFree(H->dyns,D);
+	  *B = *C;
+	  poolFree(H->nodes,C);
+	  return;
+	}
+     removeFirst(H,D->left);
+     dynRecount(H,D);
+     lsize = nodeLength(D->left);
+     rsize = nodeLength(D->right);
+     width = D->width;
+     if ((rsize > H->conf.alpha*(lsize+rsize))
+	 && (lsize+rsize >= H->conf.minLeavesToBalance*leafIdMaxSize(width)) 
+	 && canBalance(H,lsize+rsize,width,0,0)) // too biased
+	{ delta = 0;
+	  balance(H,B,0,&delta);
+	}
+   }
+
+	// first leaf-level node below B
+
+static hybridIdNode firstNode (hybridIdNode B)
+
+   { while ((B->type == tWide) || (B->type == tDynamic))
+	B = (B->type == tWide) ? B->bv.wide->child[0] : B->bv.dyn->left;
+     return B;
+   }
+
+	// removes from the tree of H the first leaf-level nodes while they
+	// hold only popped elements
+
+static void retire (hybridId H)
+
+   { hybridIdNode B;
+     uint64_t len;
+     uint width;
+     while (H->head)
+	{ unbuffer(H,H->root,0,1); // the first leaf is reached without them
+	  B = firstNode(H->root);
+	  len = nodeLength(B);
+	  if (H->head < len) return;
+	  H->clock++;
+	  H->head -= len;
+	  if (B == H->root) // empty now
+	     { width = nodeWidth(B);
+	       B = (hybridIdNode)poolAlloc(H->nodes);
+	       *B = *H->root;
+	       nodeDestroy(H,B);
+	       H->root->type = tLeaf;
+	       H->root->bv.leaf = leafIdCreate(width,H->leaves);
+	     }
+	  else removeFirst(H,H->root);
+	}
+   }
+
+	// retires the popped nodes of H and copies the next elements to pop,
+	// up to the end of the first leaf-level node, onto its front
+
+static void refill (hybridId H)
+
+   { retire(H);
+     if (nodeLength(H->root) == H->head) flushTail(H); // only the tail left
+     unbuffer(H,H->root,0,1);
+     if (H->front == NULL)
+	H->front = (uint64_t*)myalloc(FrontElems*sizeof(uint64_t));
+     H->frontStart = H->head;
+     H->frontEnd = min(nodeLength(firstNode(H->root)),H->head+FrontElems);
+     treeRead64(H,H->frontStart,H->frontEnd-H->frontStart,H->front);
+   }
+
+	// removes the popped elements from the tree of H, which is a single
+	// node, for saving it
+
+static void dropHead (hybridId H)
+
+   { hybridIdNode B = H->root;
+     uint64_t *D;
+     uint64_t len;
+     uint width;
+     if (H->head == 0) return;
+     len = nodeLength(B) - H->head;
+     width = nodeWidth(B);
+     D = (uint64_t*)myalloc((len+1)*sizeof(uint64_t));
+     treeRead64(H,H->head,len,D);
+     B = (hybridIdNode)poolAlloc(H->nodes);
+     *B = *H->root;
+     nodeDestroy(H,B);
+     B = H->root;
+     if (len > leafIdNewSize(width))
+        { B->type = tStatic;
+          B->bv.stat = leafIdCreateFrom64(D,len,width,1,H->leaves);
+	  H->statics += staticWords(B->bv.stat);
+        }
+     else 
+        { B->type = tLeaf;
+          B->bv.leaf = leafIdCreateFrom64(D,len,width,0,H->leaves);
+        } 
+     H->head = 0;
+     H->frontEnd = 0;
+   }
+
+	// appends v at the end of H. the elements are collected in a tail 
+	// leaf, which becomes a leaf of the tree when full
+
+void hybridIdAppend (hybridId H, uint64_t v)
+
+   { uint width = nodeWidth(H->root);
+     countOp(H,1);
+     if (tailLength(H) == leafIdNewSize(width)) flushTail(H);
+     if (H->tail == NULL) H->tail = leafIdCreate(width,H->leaves);
+     H->tail = leafIdResize(H->tail,leafIdLength(H->tail)+1,H->leaves);
+     leafIdInsert(H->tail,leafIdLength(H->tail),v,H->conf.gap);
+   }
+
+	// deletes H[0] and returns it. the popped elements are skipped, not
+	// deleted, and the first leaf of the tree is removed once they 
+	// cover it
+
+uint64_t hybridIdPopFront (hybridId H)
+
+   { countOp(H,1);
+     if (H->head >= H->frontEnd) refill(H);
+     return H->front[H->head++ - H->frontStart];
+   }
+
+	// sends an update op of H[i] with v to the root of H, which buffers
+	// it if it is internal. updates on the tail or on a root that is not
+	// internal are applied at once
+
+static void bufferUpdate (hybridId H, msgType op, uint64_t i, uint64_t v)
+
+   { uint64_t size = nodeLength(H->root) - H->head; // before the tail
+     if ((op == mInsert) && (i >= size) && 
+	 (tailLength(H) == leafIdNewSize(nodeWidth(H->root))))
+	{ flushTail(H); // no room in the tail, the insert goes to the tree
+	  size = nodeLength(H->root) - H->head;
+	}
+     if ((i >= size) || 
+	 ((H->root->type != tWide) && (H->root->type != tDynamic)))
+	{ if (op == mInsert) doInsert(H,i,v);
+	  else if (op == mDelete) doDelete(H,i);
+	  else doWrite(H,i,v);
+	  recountLeaves(H->root); // if it split, its children buffer updates
+	  return;
+	}
+     i += H->head;
+     H->clock++;
+     if (i < H->frontEnd) H->frontEnd = 0; // the copy is no longer valid
+     bufferMsg(H,H->root,op,i,v);
+     enforceCap(H);
+   }
+
+	// makes each internal node of H buffer up to size updates, 0 for none
+
+void hybridIdSetBuffer (hybridId H, uint size)
+
+   { drain(H,H->root);
+     if (H->bufs) poolDestroy(H->bufs);
+     H->bufs = size ? poolCreate(sizeof(struct s_hybridIdBuf) + 
+				 (size-1)*sizeof(hybridIdMsg)) : NULL;
+     H->cbuffer = size;
+   }
@@ -31,37 +31,159 @@ Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
 #include "leafId.h"
 #include "hybridBV.h" // to include nodeType
 
-typedef struct s_hybridId *hybridId;
-
+typedef struct s_hybridIdNode *hybridIdNode;
+
+	// an update buffered in an internal node, not yet sent to its children
+typedef struct s_hybridIdMsg
+   { uint64_t pos; // position of the update in the node when it was made
+     uint64_t val; // value inserted or written
+     byte op; // a msgType
+   } hybridIdMsg;
+
+	// the updates buffered in an internal node, in order
+typedef struct s_hybridIdBuf
+   { uint n; // number of updates
+     int64_t length; // change in length they make
+     hybridIdMsg msg[1]; // as many as the buffer size of the hybridId
+   } *hybridIdBuf;
+
+	// size counts the children, not the buffered updates
 typedef struct s_dynamicId
    { uint64_t size;
      byte width; // up to w
      uint64_t leaves; // leaves below node
-     uint64_t accesses; // since last update
-     hybridId left,right; // hybridIds
+     uint64_t accesses; // since last update, decayed if conf.decay
+     uint64_t updated; // clock of the last update below
+     uint64_t epoch; // decay period of the last access
+     hybridIdNode left,right; // hybridIdNodes
+     hybridIdBuf buf; // updates not yet sent to the children, NULL if none
    } *dynamicId;
 
-typedef struct s_hybridId
+	// B+-tree like internal node, used instead of dynamicId if fanout > 2
+typedef struct s_wideId
+   { uint nchildren;
+     byte width; // up to w
+     uint64_t leaves; // leaves below node
+     uint64_t accesses; // since last update, decayed if conf.decay
+     uint64_t updated; // clock of the last update below
+     uint64_t epoch; // decay period of the last access
+     uint64_t csize[MaxFanout]; // cumulative sizes of the children
+     hybridIdNode child[MaxFanout]; // hybridIdNodes
+     hybridIdBuf buf; // updates not yet sent to the children, NULL if none
+   } *wideId;
+
+typedef struct s_hybridIdNode
    { nodeType type;
      union
       { leafId stat;
         leafId leaf;
         dynamicId dyn;
+        wideId wide;
       } bv;
+   } *hybridIdNode;
+
+	// tuning of a hybridId, fixed when it is created
+typedef struct s_hybridIdConfig
+   { float theta; // theta * length reads => rebuild as static
+     float epsilon; // do not flatten nodes of size over epsilon * n
+     float alpha; // balance factor 3/5 < . < 1
+     uint fanout; // max children of internal nodes, 2 (binary) to 
+		  // MaxFanout. over 2 uses wideIds
+     float trfFactor; // trfFactor * max leaf size to justify transfers
+     int minLeavesToBalance; // min number of leaves to balance the tree
+     float minFillFactor; // less than this involves rebuild, <= Gamma/2
+     uint64_t decay; // accesses lose half their weight every decay
+			// operations, 0 to count them until an update
+     uint sample; // only 1 in sample queries, at random, count accesses,
+			// so queries rarely write on the nodes. 1 counts all
+     uint gap; // dynamic leaves keep their free space as a gap at their
+		// last update, so nearby updates shift few elements. 0 for not
+   } hybridIdConfig;
+
+	// the tree of a hybridId, and the pools its nodes and leaves come from
+typedef struct s_hybridId
+   { hybridIdNode root;
+     pool nodes; // s_hybridIdNode
+     pool dyns; // s_dynamicId
+     pool wides; // s_wideId
+     leafIdPools leaves; // leaf headers and data
+     uint64_t statics; // words of static data, not in the pools
+     uint64_t clock; // number of updates so far
+     uint64_t ops; // number of operations so far, if conf.decay
+     uint underflow; // the last delete left its leaf less than half full
+     uint64_t cap; // max space in words, 0 if none
+     uint64_t capFloor; // space when all static, if that was over the cap
+			// the last time it was enforced, else 0
+     hybridIdConfig conf; // its tuning
+     uint adaptive; // theta follows the update ratio instead of conf
+     float theta; // current theta, if adaptive
+     uint64_t queries,updates; // decayed counts, if adaptive
+     leafId tail; // elements appended at the end, not yet in the tree,
+		  // NULL until needed
+     uint64_t head; // elements popped from the front, still in the tree
+     uint64_t *front; // copy of the elements [frontStart..frontEnd-1] of
+     uint64_t frontStart,frontEnd; // the tree, the next ones to pop,
+				   // NULL until the first pop
+     pool bufs; // s_hybridIdBuf of the internal nodes, NULL if not buffered
+     uint cbuffer; // updates each internal node buffers, 0 for none
+     uint64_t pending; // updates buffered in all the nodes
    } *hybridId;
       
-extern float ThetaId; // reconstruction factor
+	// a hybridId being built from its elements given by chunks, which
+	// keeps only the parts already built and the last elements received
+typedef struct s_hybridIdBuilder
+   { hybridId H; // the hybridId being built
+     uint width; // width of its elements
+     uint64_t part; // elements per part
+     hybridIdNode *parts; // its parts so far, to be assembled at the end
+     uint64_t nparts,cparts; // number of parts and their allocated space
+     uint64_t *data; // the elements not yet in parts, packed
+     uint64_t len; // number of elements in data
+   } *hybridIdBuilder;
+      
+extern float ThetaId; // default reconstruction factor
+
+	// fills C with the default configuration, whose theta is ThetaId
+void hybridIdDefaultConfig (hybridIdConfig *C);
 
-	// creates an empty hybridId, of width width
-hybridId hybridIdCreate (uint width);
+	// creates an empty hybridId, of width width, configured by C, 
+	// NULL for the default
+hybridId hybridIdCreate (uint width, hybridIdConfig *C);
 
 	// converts an array of uint64_t into a hybridId of n elements
 	// of width width. data is pointed to and will be freed 
-hybridId hybridIdCreateFrom64 (uint64_t *data, uint64_t n, uint width);
+	// configured by C, NULL for the default
+hybridId hybridIdCreateFrom64 (uint64_t *data, uint64_t n, uint width,
+			       hybridIdConfig *C);
 
 	// converts an array of uint32_t into a hybridId of n elements
 	// of width width. data is pointed to and will be freed 
-hybridId hybridIdCreateFrom32 (uint32_t *data, uint64_t n, uint width);
+	// configured by C, NULL for the default
+hybridId hybridIdCreateFrom32 (uint32_t *data, uint64_t n, uint width,
+			       hybridIdConfig *C);
+
+	// starts building a hybridId of width width whose elements will be
+	// given by chunks. configured by C, NULL for the default
+hybridIdBuilder hybridIdBuilderCreate (uint width, hybridIdConfig *C);
+
+	// appends the n uint64_t of data to the hybridId being built by Bd
+	// data is not freed
+void hybridIdBuilderAdd64 (hybridIdBuilder Bd, uint64_t *data, uint64_t n);
+
+	// appends the n uint32_t of data to the hybridId being built by Bd
+	// data is not freed
+void hybridIdBuilderAdd32 (hybridIdBuilder Bd, uint32_t *data, uint64_t n);
+
+	// gives the hybridId built by Bd, as a balanced tree of statics of
+	// bounded size if long, and destroys Bd
+hybridId hybridIdBuilderFinish (hybridIdBuilder Bd);
+
+	// creates a hybridId of n elements of width width read from file, 
+	// which must be opened for reading and hold them as n uint64_t. 
+	// reads them by chunks, without holding them all
+	// configured by C, NULL for the default
+hybridId hybridIdCreateFromFile (FILE *file, uint64_t n, uint width,
+				 hybridIdConfig *C);
 
 	// destroys B, frees data 
 void hybridIdDestroy (hybridId B);
@@ -70,11 +192,29 @@ void hybridIdDestroy (hybridId B);
 void hybridIdSave (hybridId B, FILE *file);
 
 	// loads hybridId from file, which must be opened for reading
-hybridId hybridIdLoad (FILE *file);
+	// configured by C, NULL for the default
+hybridId hybridIdLoad (FILE *file, hybridIdConfig *C);
 
 	// gives space of hybridId in w-bit words
 uint64_t hybridIdSpace (hybridId B);
 
+	// sets the max space of B in w-bit words, 0 for no limit. when an
+	// update makes B exceed it, its least recently updated dynamic parts
+	// are flattened until it is back under the limit or B is all static
+void hybridIdSetMemoryCap (hybridId B, uint64_t cap);
+
+	// if adaptive, B chooses its own theta as recommended for the 
+	// fraction of updates among its recent operations and its length, 
+	// instead of using the configured one. otherwise goes back to it
+void hybridIdSetAdaptiveTheta (hybridId B, uint adaptive);
+
+	// makes each internal node of B keep up to size inserts, deletes and
+	// writes in a buffer, and send them all to its children when it
+	// fills, as in a B^epsilon-tree. 0 (the default) applies them at 
+	// once. access sees the buffered updates, reads send down those on
+	// their way first
+void hybridIdSetBuffer (hybridId B, uint size);
+
 	// gives number of elements length
 extern inline uint64_t hybridIdLength (hybridId B);
 
@@ -99,4 +239,12 @@ void hybridIdRead64 (hybridId B, uint64_t i, uint64_t l, uint64_t *D);
         // read values [i..i+l-1], onto D[0...], of uint32_t
 void hybridIdRead32 (hybridId B, uint64_t i, uint64_t l, uint32_t *D);
 
+	// appends v at the end of B in amortized constant time, assumes v
+	// fits in width
+void hybridIdAppend (hybridId B, uint64_t v);
+
+	// deletes B[0] in amortized constant time, assumes B is not empty
+	// returns the value deleted
+uint64_t hybridIdPopFront (hybridId B);
+
 #endif
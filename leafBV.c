@@ -29,6 +29,12 @@ Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
 
 const int MaxBlockWords = 128; // b value in words: maximum leaf size
 const float Gamma = 0.75; // new blocks try to be this fraction full
+static const uint CacheLine = 8; // leaves are aligned to this many bytes,
+				 // 64 to start them at cache lines
+static const uint ClassLine = 64; // capacities grow by this many bytes
+static const float ClassGrowth = 1.25; // capacity ratio of consecutive classes
+static const float ShrinkFill = 0.75; // shrink when fits in this fraction 
+				      // of the previous class
 
        // size that a newly created leaf should have
 
@@ -44,28 +50,124 @@ extern inline uint leafMaxSize(void)
    { return MaxBlockWords;
    }
 
-	// creates an empty leafBV 
+	// creates empty pools for leaves
+
+leafPools leafPoolsCreate (void)
+
+   { leafPools P = (leafPools)myalloc(sizeof(struct s_leafPools));
+     uint lines,next,cap;
+     P->nclasses = 0;
+     lines = 1;
+     do { cap = (lines*ClassLine - sizeof(struct s_leafBV)) / sizeof(uint64_t);
+	  if ((cap >= MaxBlockWords) || (P->nclasses == MaxLeafClasses-1))
+	     cap = MaxBlockWords;
+	  P->cap[P->nclasses] = cap;
+	  P->blocks[P->nclasses] = NULL; // created on its first leaf
+	  P->nclasses++;
+	  next = lines * ClassGrowth;
+	  lines = max(lines+1,next);
+	}
+     while (cap < MaxBlockWords);
+     return P;
+   }
+
+	// destroys P, releasing at once all the leaves taken from it
+
+void leafPoolsDestroy (leafPools P)
+
+   { uint c;
+     for (c=0;c<P->nclasses;c++) 
+	if (P->blocks[c] != NULL) poolDestroy(P->blocks[c]);
+     myfree(P);
+   }
+
+	// releases the slabs of P that became free, as poolTrim
+
+void leafPoolsTrim (leafPools P)
+
+   { uint c;
+     for (c=0;c<P->nclasses;c++) 
+	if (P->blocks[c] != NULL) poolTrim(P->blocks[c]);
+   }
+
+	// releases the slabs of P that hold no leaf in use
+
+void leafPoolsCompact (leafPools P)
+
+   { uint c;
+     for (c=0;c<P->nclasses;c++) 
+	if (P->blocks[c] != NULL) poolCompact(P->blocks[c]);
+   }
+
+	// gives space allocated by P, in w-bit words
 
-leafBV leafCreate (void)
+uint64_t leafPoolsSpace (leafPools P)
 
-   { leafBV B = (leafBV)myalloc(sizeof(struct s_leafBV));
+   { uint64_t s = (sizeof(struct s_leafPools)*8+w-1)/w;
+     uint c;
+     for (c=0;c<P->nclasses;c++) 
+	if (P->blocks[c] != NULL) s += poolSpace(P->blocks[c]);
+     return s;
+   }
+
+	// gives space allocated by P and not in use, in w-bit words
+
+uint64_t leafPoolsOverhead (leafPools P)
+
+   { uint64_t s = (sizeof(struct s_leafPools)*8+w-1)/w;
+     uint c;
+     for (c=0;c<P->nclasses;c++) 
+	if (P->blocks[c] != NULL) s += poolOverhead(P->blocks[c]);
+     return s;
+   }
+
+	// takes from P a leaf of class c
+
+static leafBV newLeaf (leafPools P, uint c)
+
+   { leafBV B;
+     if (P->blocks[c] == NULL)
+	P->blocks[c] = poolCreateAligned(sizeof(struct s_leafBV) + 
+				    P->cap[c] * sizeof(uint64_t),CacheLine);
+     B = (leafBV)poolAlloc(P->blocks[c]);
+     B->cap = P->cap[c];
+     B->cls = c;
+     B->right = 0;
+     return B;
+   }
+
+	// smallest class of P where n bits fit
+
+static uint fitClass (leafPools P, uint n)
+
+   { uint c = 0;
+     while (n > P->cap[c]*w) c++;
+     return c;
+   }
+
+	// creates an empty leafBV taken from P
+
+leafBV leafCreate (leafPools P)
+
+   { leafBV B = newLeaf(P,0);
      B->size = 0;
      B->ones = 0;
-     B->data = (uint64_t*)myalloc(MaxBlockWords * sizeof(uint64_t));
      return B;
    }
 
-	// converts a bit array into a leafBV of n bits
+	// converts a bit array into a leafBV of n bits, taken from P
 	// data is copied but freed only if freeit
 
-leafBV leafCreateFrom (uint64_t *data, uint n, int freeit)
+leafBV leafCreateFrom (uint64_t *data, uint n, int freeit, leafPools P)
 
    { uint i,nb;
      leafBV B;
-     if (n == 0) return leafCreate();
-     B = (leafBV)myalloc(sizeof(struct s_leafBV));
+     if (n == 0) 
+        { if (freeit) myfree(data);
+          return leafCreate(P);
+        }
+     B = newLeaf(P,fitClass(P,n));
      B->size = n;
-     B->data = (uint64_t*)myalloc(MaxBlockWords * sizeof(uint64_t));
      nb = (n+7)/8;
      memcpy(B->data,data,nb);
      nb = (n+w-1)/w;
@@ -76,38 +178,111 @@ leafBV leafCreateFrom (uint64_t *data, uint n, int freeit)
      return B;
    }
 
-	// destroys B, frees data 
+	// destroys B, returning it to P
 
-void leafDestroy (leafBV B)
+void leafDestroy (leafBV B, leafPools P)
 
-   { myfree(B->data);
-     myfree(B);
+   { poolFree(P->blocks[B->cls],B);
+   }
+
+	// gives a leaf with the content of B and a capacity for n bits,
+	// leafLength(B) <= n <= leafMaxSize()*w. B is moved to a larger
+	// class if n does not fit, or to a smaller one if n uses little of
+	// its class. B should not be used anymore, only the returned leaf
+
+leafBV leafResize (leafBV B, uint n, leafPools P)
+
+   { leafBV NB;
+     uint c;
+     if (n > B->cap*w) c = fitClass(P,n);
+     else if ((B->cls > 0) && (n <= P->cap[B->cls-1]*w*ShrinkFill))
+	c = fitClass(P,n);
+     else return B;
+     leafCloseGap(B);
+     NB = newLeaf(P,c);
+     NB->size = B->size;
+     NB->ones = B->ones;
+     memcpy(NB->data,B->data,((B->size+w-1)/w)*sizeof(uint64_t));
+     poolFree(P->blocks[B->cls],B);
+     return NB;
    }
 
 	// saves leaf data to file, which must be opened for writing
 
 void leafSave (leafBV B, FILE *file)
 
-   { if (B->size != 0)
+   { leafCloseGap(B);
+     if (B->size != 0)
         myfwrite (B->data,sizeof(uint64_t),(B->size+w-1)/w,file);
    }
 
         // loads leaf data from file, which must be opened for reading
         // size is the number of bits
 
-leafBV leafLoad (FILE *file, uint size)
+leafBV leafLoad (FILE *file, uint size, leafPools P)
 
     { uint64_t *data = (uint64_t*)myalloc(((size+w-1)/w)*sizeof(uint64_t));
       myfread (data,sizeof(uint64_t),(size+w-1)/w,file);
-      return leafCreateFrom(data,size,1);
+      return leafCreateFrom(data,size,1,P);
     }
 
 	// gives (allocated) space of B in w-bit words
 
 uint leafSpace (leafBV B)
 
-   { return (sizeof(struct s_leafBV)+sizeof(uint64_t)-1)/sizeof(uint64_t) 
-	    + MaxBlockWords;
+   { return ((sizeof(struct s_leafBV) + B->cap*sizeof(uint64_t)
+	      + CacheLine-1) / CacheLine) * (CacheLine/sizeof(uint64_t));
+   }
+
+	// reads l <= w bits of D from position i
+
+static inline uint64_t getBits (uint64_t *D, uint i, uint l)
+
+   { uint64_t word = D[i/w] >> (i%w);
+     if ((i%w)+l > w) word |= D[i/w+1] << (w-(i%w));
+     if (l == w) return word;
+     return word & ((((uint64_t)1) << l) - 1);
+   }
+
+	// writes the l <= w bits of v onto D from position i
+
+static inline void setBits (uint64_t *D, uint i, uint l, uint64_t v)
+
+   { uint64_t mask = (l == w) ? ~(uint64_t)0 : (((uint64_t)1) << l) - 1;
+     D[i/w] = (D[i/w] & ~(mask << (i%w))) | (v << (i%w));
+     if ((i%w)+l > w)
+	D[i/w+1] = (D[i/w+1] & ~(mask >> (w-(i%w)))) | (v >> (w-(i%w)));
+   }
+
+	// moves the gap of B to position i, so that B[i] is the first bit
+	// after it. the bits in between move from one side to the other,
+	// a word at a time
+
+static void moveGap (leafBV B, uint i)
+
+   { uint g = B->size - B->right; // where the gap starts
+     uint glen = B->cap*w - B->size;
+     uint l;
+     if (glen) 
+	{ while (i < g)
+	     { l = min(w,g-i);
+	       g -= l;
+	       setBits(B->data,g+glen,l,getBits(B->data,g,l));
+	     }
+	  while (i > g)
+	     { l = min(w,i-g);
+	       setBits(B->data,g,l,getBits(B->data,g+glen,l));
+	       g += l;
+	     }
+	}
+     B->right = B->size - i;
+   }
+
+	// moves the bits after the gap of B, if any, to follow the others
+
+void leafCloseGap (leafBV B)
+
+   { if (B->right) moveGap(B,B->size);
    }
 
 	// gives bit length
@@ -124,12 +299,39 @@ extern inline uint leafOnes (leafBV B)
    { return B->ones;
    }
 
+	// gives the number of runs of B, or a number over max if there are
+	// more than max. the bits are read by words, up to the gap and from
+	// its end
+
+uint leafRuns (leafBV B, uint max)
+
+   { uint g = B->size - B->right; // where the gap starts
+     uint glen = B->cap*w - B->size;
+     uint p,l;
+     uint64_t x,dif,prev;
+     uint runs;
+     if (B->size == 0) return 0;
+     runs = 1;
+     prev = leafAccess(B,0); // so the first bit is no change
+     for (p=0; (p<B->size) && (runs <= max); p+=l)
+	{ l = (p < g) ? min(w,g-p) : min(w,B->size-p);
+	  x = getBits(B->data,(p < g) ? p : p+glen,l);
+	  dif = x ^ ((x << 1) | prev); // 1s where a bit differs from the last
+	  if (l < w) dif &= (((uint64_t)1) << l) - 1;
+	  runs += popcount(dif);
+	  prev = (x >> (l-1)) & 1;
+	}
+     return runs;
+   }
+
        // sets value for B[i]= (v != 0), assumes i is right
         // returns difference in 1s
 
 int leafWrite (leafBV B, uint i, uint v)
 
-   { uint64_t one = ((uint64_t)1) << (i%w);
+   { uint64_t one;
+     if (i >= B->size - B->right) i += B->cap*w - B->size; // after the gap
+     one = ((uint64_t)1) << (i%w);
      if (v) {
 	if (!(B->data[i/w] & one)) {
 	   B->data[i/w] |= one;
@@ -148,12 +350,22 @@ int leafWrite (leafBV B, uint i, uint v)
    }
 
         // inserts v at B[i], assumes i is right and that insertion is possible
+	// if gap, the gap of B moves to i, else B is kept without gap
 
-void leafInsert (leafBV B, uint i, uint v)
+void leafInsert (leafBV B, uint i, uint v, uint gap)
 
-   { uint nb = ++B->size/w;
-     uint ib = i/w;
+   { uint nb,ib;
      int b;
+     if (gap) // the gap moves to i and v takes its first bit
+	{ moveGap(B,i);
+	  setBits(B->data,i,1,v);
+	  B->size++;
+	  B->ones += v;
+	  return;
+	}
+     leafCloseGap(B);
+     nb = B->size++/w; // last word used after inserting
+     ib = i/w;
 
      for (b=nb;b>ib;b--)
 	 B->data[b] = (B->data[b] << 1) | (B->data[b-1] >> (w-1));
@@ -168,13 +380,23 @@ void leafInsert (leafBV B, uint i, uint v)
 
         // deletes B[i], assumes i is right
         // returns difference in 1s
-
-int leafDelete (leafBV B, uint i)
-
-   { uint nb = B->size--/w;
-     uint ib = i/w;
-     int b;
-     int v = (B->data[ib] >> (i%w)) & 1;
+	// if gap, the gap of B moves to i, else B is kept without gap
+
+int leafDelete (leafBV B, uint i, uint gap)
+
+   { uint nb,ib;
+     int b,v;
+     if (gap) // the gap moves after i and takes it
+	{ moveGap(B,i+1);
+	  v = (B->data[i/w] >> (i%w)) & 1;
+	  B->size--;
+	  B->ones -= v;
+	  return -v;
+	}
+     leafCloseGap(B);
+     nb = --B->size/w; // last word used before deleting
+     ib = i/w;
+     v = (B->data[ib] >> (i%w)) & 1;
 
      B->data[ib] = (B->data[ib] & ((((uint64_t)1) << (i%w)) - 1)) |
 		   ((B->data[ib] >> 1) & (~((uint64_t)0) << (i%w)));
@@ -190,14 +412,22 @@ int leafDelete (leafBV B, uint i)
 
 extern inline uint leafAccess (leafBV B, uint i)
 
-   { return (B->data[i/w] >> (i%w)) & 1;
+   { if (i >= B->size - B->right) i += B->cap*w - B->size; // after the gap
+     return (B->data[i/w] >> (i%w)) & 1;
    }
 
         // read bits [i..i+l-1], onto D[j...]
 
 void leafRead (leafBV B, uint i, uint l, uint64_t *D, uint64_t j)
 
-   { copyBits(D,j,B->data,i,l);
+   { uint g = B->size - B->right; // where the gap starts
+     uint len;
+     if (i < g) // before the gap
+	{ len = min(l,g-i);
+	  copyBits(D,j,B->data,i,len);
+	  i += len; j += len; l -= len;
+	}
+     if (l) copyBits(D,j,B->data,i+B->cap*w-B->size,l);
    }
 
 	// computes rank(B,i), zero-based, assumes i is right
@@ -206,26 +436,33 @@ uint leafRank (leafBV B, uint i)
 
    { int p,ib;
      uint ones = 0;
+     if (i >= B->size - B->right) // counts the 1s after i instead
+	{ i += B->cap*w - B->size + 1;
+	  for (p=(i+w-1)/w;p<B->cap;p++) ones += popcount(B->data[p]);
+	  if (i%w) ones += popcount(B->data[i/w] >> (i%w));
+	  return B->ones - ones;
+	}
      ib = ++i/w;
      for (p=0;p<ib;p++) ones += popcount(B->data[p]);
      if (i%w) ones += popcount(B->data[p] & ((((uint64_t)1)<<(i%w))-1));
      return ones;
    }
 
-        // computes select_1(B,j), zero-based, assumes j is right
+	// position of the j-th 1 of D, or 0 if flip is all 1s, counting
+	// from position i
 
-uint leafSelect (leafBV B, uint j)
+static uint scanSelect (uint64_t *D, uint i, uint j, uint64_t flip)
 
-   { uint p,i,pc;
+   { uint p,pc;
      uint64_t word;
      uint ones = 0;
-     p = 0;
+     p = i/w;
+     word = (D[p] ^ flip) & ((~(uint64_t)0) << (i%w));
      while (1)
-	{ word = B->data[p];
-	  pc = popcount(word);
+	{ pc = popcount(word);
 	  if (ones+pc >= j) break;
 	  ones += pc; 
-	  p++;
+	  word = D[++p] ^ flip;
 	}
      i = p*w;
 /* this was actually slower
@@ -241,7 +478,6 @@ uint leafSelect (leafBV B, uint j)
 	}
      return i;
 */
-     i = p*w;
      while (1)
 	{ ones += word & 1; 
 	  if (ones == j) return i;
@@ -250,32 +486,42 @@ uint leafSelect (leafBV B, uint j)
 	}
    }
 
-        // computes select_1(B,j), zero-based, assumes j is right
+	// number of 1s in the first n bits of D
 
-uint leafSelect0 (leafBV B, uint j)
+static uint prefixOnes (uint64_t *D, uint n)
 
-   { uint p,i,pc;
-     uint64_t word;
+   { uint p;
      uint ones = 0;
-     p = 0;
-     while (1)
-	{ word = ~B->data[p];
-	  pc = popcount(word);
-	  if (ones+pc >= j) break;
-	  ones += pc; 
-	  p++;
-	}
-     i = p*w;
-     while (1)
-	{ ones += word & 1; 
-	  if (ones == j) return i;
-	  word >>= 1; 
-	  i++; 
-	}
+     for (p=0;p<n/w;p++) ones += popcount(D[p]);
+     if (n%w) ones += popcount(D[p] & ((((uint64_t)1) << (n%w)) - 1));
+     return ones;
    }
 
-        // computes next_1(B,i), zero-based and including i
-	// returns -1 if no answer
+        // computes select_1(B,j), zero-based, assumes j is right
+
+uint leafSelect (leafBV B, uint j)
+
+   { uint g,glen,ones;
+     if (B->right == 0) return scanSelect(B->data,0,j,0);
+     g = B->size - B->right; // where the gap starts
+     glen = B->cap*w - B->size;
+     ones = prefixOnes(B->data,g);
+     if (j <= ones) return scanSelect(B->data,0,j,0);
+     return scanSelect(B->data,g+glen,j-ones,0) - glen;
+   }
+
+        // computes select_0(B,j), zero-based, assumes j is right
+
+uint leafSelect0 (leafBV B, uint j)
+
+   { uint g,glen,zeros;
+     if (B->right == 0) return scanSelect(B->data,0,j,~(uint64_t)0);
+     g = B->size - B->right; // where the gap starts
+     glen = B->cap*w - B->size;
+     zeros = g - prefixOnes(B->data,g);
+     if (j <= zeros) return scanSelect(B->data,0,j,~(uint64_t)0);
+     return scanSelect(B->data,g+glen,j-zeros,~(uint64_t)0) - glen;
+   }
 
 	// trick for lowest 1 in a 64-bit word
 static int decode[64] = {
@@ -284,18 +530,44 @@ static int decode[64] = {
       63,55,48,27,60,41,37,16,46,35,44,21,52,32,23,11,
       54,26,40,15,34,20,31,10,25,14,19, 9,13, 8, 7, 6 };
 
-int leafNext (leafBV B, uint i)
+	// first 1 of D, or 0 if flip is all 1s, in [i..n-1], -1 if none
 
-   { uint p;
+static int scanNext (uint64_t *D, uint i, uint n, uint64_t flip)
+
+   { uint p,e;
      uint64_t word;
+     if (i >= n) return -1;
      p = i/w;
-     word = B->data[p] & ((~(uint64_t)0)<<(i%w));
-     while ((++p*w <= B->size) && !word)
-	word = B->data[p];
-     if (p*w > B->size)
-	word &= (((uint64_t)1) << (B->size % w)) - 1;
+     e = (n-1)/w; // last word
+     word = (D[p] ^ flip) & ((~(uint64_t)0) << (i%w));
+     while (!word && (p < e)) word = D[++p] ^ flip;
+     if ((p == e) && (n%w)) word &= (((uint64_t)1) << (n%w)) - 1;
      if (!word) return -1;
-     return (p-1)*w + decode[(0x03f79d71b4ca8b09 * (word & -word))>>58];
+     return p*w + decode[(0x03f79d71b4ca8b09 * (word & -word))>>58];
+   }
+
+	// next 1 of B, or 0 if flip is all 1s, from i, skipping the gap
+
+static int leafScan (leafBV B, uint i, uint64_t flip)
+
+   { uint g = B->size - B->right; // where the gap starts
+     uint glen = B->cap*w - B->size;
+     int p;
+     if (i < g)
+	{ p = scanNext(B->data,i,g,flip);
+	  if (p >= 0) return p;
+	  i = g;
+	}
+     p = scanNext(B->data,i+glen,B->size+glen,flip);
+     return (p < 0) ? -1 : p - glen;
+   }
+
+        // computes next_1(B,i), zero-based and including i
+	// returns -1 if no answer
+
+int leafNext (leafBV B, uint i)
+
+   { return leafScan(B,i,0);
    }
 
         // computes next_0(B,i), zero-based and including i
@@ -303,14 +575,5 @@ int leafNext (leafBV B, uint i)
 
 int leafNext0 (leafBV B, uint i)
 
-   { uint p;
-     uint64_t word;
-     p = i/w;
-     word = (~B->data[p]) & ((~(uint64_t)0)<<(i%w));
-     while ((++p*w <= B->size) && word)
-	word = ~B->data[p];
-     if (p*w > B->size)
-	word &= (((uint64_t)1) << (B->size % w)) - 1;
-     if (!word) return -1;
-     return (p-1)*w + decode[(0x03f79d71b4ca8b09 * (word & -word))>>58];
+   { return leafScan(B,i,~(uint64_t)0);
    }
@@ -29,54 +29,107 @@ Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
 	// supports leaf bitvectors of size up to 2^32-1
 
 #include "basics.h"
+#include "pool.h"
 
+#define MaxLeafClasses 32 // max number of leaf capacities
+
+	// the counters and the bits share a single block, so reaching a
+	// leaf costs one miss less. the capacity of the block is one of a
+	// few size classes, growing geometrically up to leafMaxSize()
+	// words. if updated with gap, the free bits of the block form a
+	// gap after the last bit updated, and the bits after the gap are 
+	// kept at the end of the block, so nearby updates shift few bits
 typedef struct s_leafBV
    { uint size; // bits represented
      uint ones; // # 1s
-     uint64_t *data; 
+     uint cap; // words of data
+     uint cls; // size class
+     uint right; // bits after the gap, 0 if none
+     uint64_t data[]; // cap words
    } *leafBV;
 
+	// pools the leaves of a structure are taken from, one per size class
+typedef struct s_leafPools
+   { uint nclasses; 
+     uint cap[MaxLeafClasses]; // data words of each class, increasing
+     pool blocks[MaxLeafClasses]; // s_leafBV with their data, NULL until used
+   } *leafPools;
+
 	// size that a newly created leaf should have, and max leaf size
 	// multiples of w
 extern inline uint leafNewSize(void);
 extern inline uint leafMaxSize(void);
 
-	// creates an empty leafBV 
-leafBV leafCreate (void);
+	// creates empty pools for leaves
+leafPools leafPoolsCreate (void);
+
+	// destroys P, releasing at once all the leaves taken from it
+void leafPoolsDestroy (leafPools P);
+
+	// releases the slabs of P that became free, as poolTrim
+void leafPoolsTrim (leafPools P);
+
+	// releases the slabs of P that hold no leaf in use
+void leafPoolsCompact (leafPools P);
+
+	// gives space allocated by P, in w-bit words
+uint64_t leafPoolsSpace (leafPools P);
 
-	// converts a bit array into a leafBV of n bits
+	// gives space allocated by P and not in use, in w-bit words
+uint64_t leafPoolsOverhead (leafPools P);
+
+	// creates an empty leafBV taken from P
+leafBV leafCreate (leafPools P);
+
+	// converts a bit array into a leafBV of n bits, taken from P
 	// data is copied but freed only if freeit
-leafBV leafCreateFrom (uint64_t *data, uint n, int freeit);
+leafBV leafCreateFrom (uint64_t *data, uint n, int freeit, leafPools P);
+
+	// destroys B, returning it to P
+void leafDestroy (leafBV B, leafPools P);
 
-	// destroys B, frees data 
-void leafDestroy (leafBV B);
+	// gives a leaf with the content of B and a capacity for n bits,
+	// leafLength(B) <= n <= leafMaxSize()*w. B is moved to a larger
+	// class if n does not fit, or to a smaller one if n uses little of
+	// its class. B should not be used anymore, only the returned leaf
+leafBV leafResize (leafBV B, uint n, leafPools P);
 
 	// saves leaf data to file, which must be opened for writing
 void leafSave (leafBV B, FILE *file);
 
         // loads leaf data from file, which must be opened for reading
         // size is the number of bits
-leafBV leafLoad (FILE *file, uint size);
+leafBV leafLoad (FILE *file, uint size, leafPools P);
 
 	// gives (allocated) space of B in w-bit words
 uint leafSpace (leafBV B);
 
+	// moves the bits after the gap of B, if any, to follow the others,
+	// so that they are all at the beginning of B->data
+void leafCloseGap (leafBV B);
+
 	// gives bit length
 extern inline uint leafLength (leafBV B);
 
 	// gives number of 1s
 extern inline uint leafOnes (leafBV B);
 
+	// gives the number of runs of B, or a number over max if there are
+	// more than max
+uint leafRuns (leafBV B, uint max);
+
        // sets value for B[i]= (v != 0), assumes i is right
         // returns difference in 1s
 int leafWrite (leafBV B, uint i, uint v);
 
         // inserts v at B[i], assumes i is right and that insertion is possible
-void leafInsert (leafBV B, uint i, uint v);
+	// if gap, the gap of B moves to i, else B is kept without gap
+void leafInsert (leafBV B, uint i, uint v, uint gap);
 
         // deletes B[i], assumes i is right
         // returns difference in 1s
-int leafDelete (leafBV B, uint i);
+	// if gap, the gap of B moves to i, else B is kept without gap
+int leafDelete (leafBV B, uint i, uint gap);
 
 	// access B[i], assumes i is right
 extern inline uint leafAccess (leafBV B, uint i);
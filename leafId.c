@@ -29,6 +29,11 @@ Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
 
 #define MaxBlockWords 128 // measured in uint64_t's
 #define Gamma 0.75 // new blocks try to be this fraction full
+#define CacheLine 8 // dynamic leaves are aligned to this many bytes, 64 to
+			// start them at cache lines
+#define ClassLine 64 // capacities grow by this many bytes
+#define ClassGrowth 1.25 // capacity ratio of consecutive classes
+#define ShrinkFill 0.75 // shrink when fits in this fraction of previous class
 
        // size that a newly created leaf should have measured in elements
 
@@ -44,28 +49,132 @@ extern inline uint leafIdMaxSize(uint width)
    { return (MaxBlockWords*w/width / 2) * 2; // make it even
    }
 
-	// creates an empty leafId of elements of width width
+	// creates empty pools for leaves
+
+leafIdPools leafIdPoolsCreate (void)
+
+   { leafIdPools P = (leafIdPools)myalloc(sizeof(struct s_leafIdPools));
+     uint lines,next,cap;
+     P->headers = poolCreate(sizeof(struct s_leafId));
+     P->nclasses = 0;
+     lines = 1;
+     do { cap = (lines*ClassLine - sizeof(struct s_leafId)) / sizeof(uint64_t);
+	  if ((cap >= MaxBlockWords) || (P->nclasses == MaxLeafIdClasses-1))
+	     cap = MaxBlockWords;
+	  P->cap[P->nclasses] = cap;
+	  P->blocks[P->nclasses] = NULL; // created on its first leaf
+	  P->nclasses++;
+	  next = lines * ClassGrowth;
+	  lines = max(lines+1,next);
+	}
+     while (cap < MaxBlockWords);
+     return P;
+   }
+
+	// destroys P, releasing at once all the leaves taken from it
+
+void leafIdPoolsDestroy (leafIdPools P)
+
+   { uint c;
+     poolDestroy(P->headers);
+     for (c=0;c<P->nclasses;c++) 
+	if (P->blocks[c] != NULL) poolDestroy(P->blocks[c]);
+     myfree(P);
+   }
+
+	// releases the slabs of P that became free, as poolTrim
 
-leafId leafIdCreate (uint width)
+void leafIdPoolsTrim (leafIdPools P)
+
+   { uint c;
+     poolTrim(P->headers);
+     for (c=0;c<P->nclasses;c++) 
+	if (P->blocks[c] != NULL) poolTrim(P->blocks[c]);
+   }
+
+	// releases the slabs of P that hold no leaf in use
+
+void leafIdPoolsCompact (leafIdPools P)
+
+   { uint c;
+     poolCompact(P->headers);
+     for (c=0;c<P->nclasses;c++) 
+	if (P->blocks[c] != NULL) poolCompact(P->blocks[c]);
+   }
 
-   { leafId B = (leafId)myalloc(sizeof(struct s_leafId));
+	// gives space allocated by P, in w-bit words. the data of static
+	// leaves is not included
+
+uint64_t leafIdPoolsSpace (leafIdPools P)
+
+   { uint64_t s = (sizeof(struct s_leafIdPools)*8+w-1)/w + 
+		  poolSpace(P->headers);
+     uint c;
+     for (c=0;c<P->nclasses;c++) 
+	if (P->blocks[c] != NULL) s += poolSpace(P->blocks[c]);
+     return s;
+   }
+
+	// gives space allocated by P and not in use, in w-bit words
+
+uint64_t leafIdPoolsOverhead (leafIdPools P)
+
+   { uint64_t s = (sizeof(struct s_leafIdPools)*8+w-1)/w + 
+		  poolOverhead(P->headers);
+     uint c;
+     for (c=0;c<P->nclasses;c++) 
+	if (P->blocks[c] != NULL) s += poolOverhead(P->blocks[c]);
+     return s;
+   }
+
+	// takes from P a dynamic leaf of class c with its data block
+
+static leafId newDynamic (leafIdPools P, uint c)
+
+   { leafId B;
+     if (P->blocks[c] == NULL)
+	P->blocks[c] = poolCreateAligned(sizeof(struct s_leafId) + 
+				    P->cap[c] * sizeof(uint64_t),CacheLine);
+     B = (leafId)poolAlloc(P->blocks[c]);
+     B->isStat = 0;
+     B->cls = c;
+     B->cap = P->cap[c];
+     B->right = 0;
+     B->data = (uint64_t*)(B+1);
+     return B;
+   }
+
+	// smallest class of P where n bits fit
+
+static uint fitClass (leafIdPools P, uint64_t n)
+
+   { uint c = 0;
+     while (n > P->cap[c]*w) c++;
+     return c;
+   }
+
+	// creates an empty leafId of elements of width width, taken from P
+
+leafId leafIdCreate (uint width, leafIdPools P)
+
+   { leafId B = newDynamic(P,0);
      B->size = 0;
      B->width = width;
-     B->isStat = 0;
-     B->data = (uint64_t*)myalloc(MaxBlockWords * sizeof(uint64_t));
      return B;
    }
 
         // creates a static leafId of n elements of width width
         // from data in an already packed array, which is simply pointed
 
-leafId leafIdCreateStaticFromPacked (uint64_t *data, uint n, uint width)
+leafId leafIdCreateStaticFromPacked (uint64_t *data, uint n, uint width,
+				     leafIdPools P)
 
    { leafId B;
-     B = (leafId)myalloc(sizeof(struct s_leafId));
+     B = (leafId)poolAlloc(P->headers);
      B->size = n;
      B->width = width;
      B->isStat = 1;
+     B->right = 0;
      B->data = data;
      return B;
    }
@@ -73,15 +182,14 @@ leafId leafIdCreateStaticFromPacked (uint64_t *data, uint n, uint width)
         // creates a dynamic leafId of n elements of width width
         // from data[i..] in an already packed array, which is not destroyed
 
-leafId leafIdCreateFromPacked (uint64_t *data, uint64_t i, uint n, uint width)
+leafId leafIdCreateFromPacked (uint64_t *data, uint64_t i, uint n, uint width,
+			       leafIdPools P)
 
    { leafId B;
-     if (n == 0) return leafIdCreate(width);
-     B = (leafId)myalloc(sizeof(struct s_leafId));
+     if (n == 0) return leafIdCreate(width,P);
+     B = newDynamic(P,fitClass(P,(uint64_t)n*width));
      B->size = n;
      B->width = width;
-     B->isStat = 0;
-     B->data = (uint64_t*)myalloc(MaxBlockWords * sizeof(uint64_t));
      if (i == 0) memcpy(B->data,data,(n*width+7)/8);
      else copyBits(B->data,0,data,i*width,n*width);
      return B;
@@ -90,21 +198,29 @@ leafId leafIdCreateFromPacked (uint64_t *data, uint64_t i, uint n, uint width)
 	// converts an array of n uint64_t into a leafId of n elements
 	// of width width. data is pointed to and will be freed 
 
-leafId leafIdCreateFrom64 (uint64_t *data, uint n, uint width, uint isStat)
+leafId leafIdCreateFrom64 (uint64_t *data, uint n, uint width, uint isStat,
+			   leafIdPools P)
 
    { uint i,p;
      leafId B;
      uint64_t word;
-     if (n == 0) return leafIdCreate(width); // does not accept empty static
-     B = (leafId)myalloc(sizeof(struct s_leafId));
+     if (n == 0) // does not accept empty static
+	{ free(data);
+	  return leafIdCreate(width,P);
+	}
+     if (isStat)
+	{ B = (leafId)poolAlloc(P->headers);
+	  B->isStat = 1;
+	}
+     else B = newDynamic(P,fitClass(P,(uint64_t)n*width));
      B->size = n;
      B->width = width;
-     B->isStat = isStat;
+     B->right = 0;
      if (isStat)
 	{ if (B->width == w) { B->data = data; return B; }
 	  B->data = (uint64_t*)mycalloc(((n*width+w-1)/w),sizeof(uint64_t));
 	}
-     else B->data = (uint64_t*)mycalloc(MaxBlockWords,sizeof(uint64_t));
+     else memset(B->data,0,B->cap*sizeof(uint64_t));
      p = 0;
      for (i=0;i<n;i++)
 	 { word = data[i];
@@ -119,19 +235,27 @@ leafId leafIdCreateFrom64 (uint64_t *data, uint n, uint width, uint isStat)
 	// converts an array of n uint32_t into a leafId of n elements
 	// of width width. data is pointed to and will be freed 
 
-leafId leafIdCreateFrom32 (uint32_t *data, uint n, uint width, uint isStat)
+leafId leafIdCreateFrom32 (uint32_t *data, uint n, uint width, uint isStat,
+			   leafIdPools P)
 
    { uint i,p;
      leafId B;
-     uint32_t word;
-     if (n == 0) return leafIdCreate(width); // does not allow empty static
-     B = (leafId)myalloc(sizeof(struct s_leafId));
+     uint64_t word;
+     if (n == 0) // does not allow empty static
+	{ free(data);
+	  return leafIdCreate(width,P);
+	}
+     if (isStat)
+	{ B = (leafId)poolAlloc(P->headers);
+	  B->isStat = 1;
+	}
+     else B = newDynamic(P,fitClass(P,(uint64_t)n*width));
      B->size = n;
      B->width = width;
-     B->isStat = isStat;
+     B->right = 0;
      if (isStat)
 	  B->data = (uint64_t*)mycalloc(((n*width+w-1)/w),sizeof(uint64_t));
-     else B->data = (uint64_t*)mycalloc(MaxBlockWords,sizeof(uint64_t));
+     else memset(B->data,0,B->cap*sizeof(uint64_t));
      p = 0;
      for (i=0;i<n;i++)
 	 { word = data[i];
@@ -143,19 +267,47 @@ leafId leafIdCreateFrom32 (uint32_t *data, uint n, uint width, uint isStat)
      return B;
    }
 
-	// destroys B, frees data 
+	// destroys B, returning it to P. the data of statics is freed
 
-void leafIdDestroy (leafId B)
+void leafIdDestroy (leafId B, leafIdPools P)
 
-   { myfree(B->data);
-     myfree(B);
+   { if (B->isStat) 
+	{ myfree(B->data);
+	  poolFree(P->headers,B);
+	}
+     else poolFree(P->blocks[B->cls],B);
+   }
+
+	// gives a dynamic leaf with the content of B and a capacity for n 
+	// elements, leafIdLength(B) <= n <= leafIdMaxSize(width). B is moved
+	// to a larger class if n does not fit, or to a smaller one if n uses 
+	// little of its class. B should not be used anymore, only the
+	// returned leaf
+
+leafId leafIdResize (leafId B, uint n, leafIdPools P)
+
+   { leafId NB;
+     uint c;
+     uint64_t bits = (uint64_t)n * B->width;
+     if (bits > (uint64_t)B->cap*w) c = fitClass(P,bits);
+     else if ((B->cls > 0) && (bits <= P->cap[B->cls-1]*w*ShrinkFill))
+	c = fitClass(P,bits);
+     else return B;
+     leafIdCloseGap(B);
+     NB = newDynamic(P,c);
+     NB->size = B->size;
+     NB->width = B->width;
+     memcpy(NB->data,B->data,((B->size*B->width+w-1)/w)*sizeof(uint64_t));
+     poolFree(P->blocks[B->cls],B);
+     return NB;
    }
 
 	// saves leaf data to file, which must be opened for writing
 
 void leafIdSave (leafId B, FILE *file)
 
-   { myfwrite(&B->size,sizeof(uint64_t),1,file);
+   { leafIdCloseGap(B);
+     myfwrite(&B->size,sizeof(uint64_t),1,file);
      myfwrite(&B->width,sizeof(byte),1,file);
      myfwrite(&B->isStat,sizeof(byte),1,file);
      if (B->size != 0)
@@ -165,7 +317,7 @@ void leafIdSave (leafId B, FILE *file)
         // loads leaf data from file, which must be opened for reading
         // size is the number of elements
 
-leafId leafIdLoad (FILE *file)
+leafId leafIdLoad (FILE *file, leafIdPools P)
 
     { leafId B;
       uint64_t *data;
@@ -176,8 +328,8 @@ leafId leafIdLoad (FILE *file)
       myfread(&isStat,sizeof(byte),1,file);
       data = (uint64_t*)myalloc(((size*width+w-1)/w)*sizeof(uint64_t));
       myfread (data,sizeof(uint64_t),(size*width+w-1)/w,file);
-      if (isStat) B = leafIdCreateStaticFromPacked(data,size,width);
-      else { B = leafIdCreateFromPacked(data,0,size,width);
+      if (isStat) B = leafIdCreateStaticFromPacked(data,size,width,P);
+      else { B = leafIdCreateFromPacked(data,0,size,width,P);
              myfree(data);
 	   }
       return B;
@@ -187,8 +339,70 @@ leafId leafIdLoad (FILE *file)
 
 uint leafIdSpace (leafId B)
 
-   { return (sizeof(struct s_leafId)+sizeof(uint64_t)-1)/sizeof(uint64_t) 
-	    + (B->isStat ? ((B->size*B->width+w-1)/w) : MaxBlockWords);
+   { if (B->isStat)
+	return (sizeof(struct s_leafId)+sizeof(uint64_t)-1)/sizeof(uint64_t) 
+	       + (B->size*B->width+w-1)/w;
+     return ((sizeof(struct s_leafId) + B->cap*sizeof(uint64_t)
+	      + CacheLine-1) / CacheLine) * (CacheLine/sizeof(uint64_t));
+   }
+
+	// elements that fit in the gap of dynamic leaf B
+
+static inline uint gapLength (leafId B)
+
+   { return B->cap*w/B->width - B->size;
+   }
+
+	// reads l <= w bits of D from position i
+
+static inline uint64_t getBits (uint64_t *D, uint i, uint l)
+
+   { uint64_t word = D[i/w] >> (i%w);
+     if ((i%w)+l > w) word |= D[i/w+1] << (w-(i%w));
+     if (l == w) return word;
+     return word & ((((uint64_t)1) << l) - 1);
+   }
+
+	// writes the l <= w bits of v onto D from position i
+
+static inline void setBits (uint64_t *D, uint i, uint l, uint64_t v)
+
+   { uint64_t mask = (l == w) ? ~(uint64_t)0 : (((uint64_t)1) << l) - 1;
+     D[i/w] = (D[i/w] & ~(mask << (i%w))) | (v << (i%w));
+     if ((i%w)+l > w)
+	D[i/w+1] = (D[i/w+1] & ~(mask >> (w-(i%w)))) | (v >> (w-(i%w)));
+   }
+
+	// moves the gap of B to element i, so that B[i] is the first one
+	// after it. the elements in between move from one side to the
+	// other, w bits at a time
+
+static void moveGap (leafId B, uint i)
+
+   { uint g = (B->size - B->right) * B->width; // bit where the gap starts
+     uint glen = gapLength(B) * B->width;
+     uint t = i * B->width;
+     uint l;
+     if (glen) 
+	{ while (t < g)
+	     { l = min(w,g-t);
+	       g -= l;
+	       setBits(B->data,g+glen,l,getBits(B->data,g,l));
+	     }
+	  while (t > g)
+	     { l = min(w,t-g);
+	       setBits(B->data,g,l,getBits(B->data,g+glen,l));
+	       g += l;
+	     }
+	}
+     B->right = B->size - i;
+   }
+
+	// moves the elements after the gap of B, if any, to follow the others
+
+void leafIdCloseGap (leafId B)
+
+   { if (B->right) moveGap(B,B->size);
    }
 
 	// gives array length
@@ -205,6 +419,7 @@ void leafIdWrite (leafId B, uint i, uint64_t v)
 
    { uint64_t word;
      uint iq,ir;
+     if (i >= B->size - B->right) i += gapLength(B); // after the gap
      if (B->width == w) { B->data[i] = v; return; }
      word = (((uint64_t)1) << B->width) - 1;
      iq = i*B->width/w;
@@ -219,13 +434,22 @@ void leafIdWrite (leafId B, uint i, uint64_t v)
 
         // inserts v at B[i], assumes that insertion is possible
 	// assumes not static, i is right, and value fits in width
+	// if gap, the gap of B moves to i, else B is kept without gap
 
-void leafIdInsert (leafId B, uint i, uint64_t v)
+void leafIdInsert (leafId B, uint i, uint64_t v, uint gap)
 
-   { uint nb = ++B->size*B->width/w;
-     uint ib = i*B->width/w;
-     uint ir = (i*B->width)%w;
+   { uint nb,ib,ir;
      int b;
+     if (gap) // the gap moves to i and v takes its first element
+	{ moveGap(B,i);
+	  setBits(B->data,i*B->width,B->width,v);
+	  B->size++;
+	  return;
+	}
+     leafIdCloseGap(B);
+     nb = (B->size++*B->width+B->width-1)/w; // last word used after
+     ib = i*B->width/w;
+     ir = (i*B->width)%w;
 
      if (B->width == w)
 	{ for (b=nb;b>ib;b--) B->data[b] = B->data[b-1];
@@ -241,33 +465,40 @@ void leafIdInsert (leafId B, uint i, uint64_t v)
 		       ((~(uint64_t)0) << (ir+B->width)));
      else {
 	B->data[ib] = (B->data[ib] & ((((uint64_t)1) << ir) - 1)) | (v << ir);
-	B->data[ib+1] = (B->data[ib+1] & ((~(uint64_t)0) << (ir+B->width-w))) |
-			(v >> (w-ir));
+	if (ir+B->width > w) // ib+1 may be out of the block otherwise
+	   B->data[ib+1] = (B->data[ib+1] & ((~(uint64_t)0) << (ir+B->width-w)))
+			   | (v >> (w-ir));
         }
    }
 
         // deletes B[i]
 	// assumes not static, i is right, and value fits in width
+	// if gap, the gap of B moves to i, else B is kept without gap
 
-void leafIdDelete (leafId B, uint i)
+void leafIdDelete (leafId B, uint i, uint gap)
 
-   { uint nb = B->size--*B->width/w;
-     uint ib = i*B->width/w;
-     uint ir = (i*B->width)%w;
+   { uint nb,ib,ir;
      int b;
+     if (gap) // the gap moves after i and takes it
+	{ moveGap(B,i+1);
+	  B->size--;
+	  return;
+	}
+     leafIdCloseGap(B);
+     nb = (B->size--*B->width-1)/w; // last word used before
+     ib = i*B->width/w;
+     ir = (i*B->width)%w;
 
      if (B->width == w)
-	{ for (b=ib+1;b<nb;b++) B->data[b-1] = B->data[b];
+	{ for (b=ib+1;b<=nb;b++) B->data[b-1] = B->data[b];
 	  return;
 	}
      if (ir+B->width <= w)
         B->data[ib] = (B->data[ib] & ((((uint64_t)1) << ir) - 1)) |
 		      ((B->data[ib] >> B->width) & (~((uint64_t)0) << ir));
      else {
-	B->data[ib+1] = (B->data[ib+1] & (~(uint64_t)0) << (ir+B->width-w)) |
-			((B->data[ib] >> (w-B->width)) & 
-			 ((((uint64_t)1) << (ir+B->width-1)) - 1));
-	B->data[ib] &= (~(uint64_t)0) << (w-B->width);
+	B->data[ib] &= (((uint64_t)1) << ir) - 1;
+	B->data[ib+1] &= (~(uint64_t)0) << (ir+B->width-w);
         }
      for (b=ib+1;b<=nb;b++) {
 	 B->data[b-1] |= B->data[b] << (w-B->width);
@@ -280,6 +511,7 @@ void leafIdDelete (leafId B, uint i)
 extern inline uint64_t leafIdAccess (leafId B, uint i)
 
    { uint64_t word;
+     if (i >= B->size - B->right) i += gapLength(B); // after the gap
      if (B->width == w) return B->data[i];
      uint iq = i*B->width/w;
      uint ir = (i*B->width)%w;
@@ -288,9 +520,10 @@ extern inline uint64_t leafIdAccess (leafId B, uint i)
      return word & ((((uint64_t)1) << B->width) - 1);
    }
 
-        // read bits [i..i+l-1], onto D[0...] of 64 bits
+	// reads the elements stored at [i..i+l-1] of B->data, onto D[0...]
+	// of 64 bits
 
-void leafIdRead64 (leafId B, uint i, uint l, uint64_t *D)
+static void readData64 (leafId B, uint i, uint l, uint64_t *D)
 
    { uint j,width,iq,ir;
      width = B->width;
@@ -302,19 +535,31 @@ void leafIdRead64 (leafId B, uint i, uint l, uint64_t *D)
      ir = (i*B->width)%w;
      for (j=0;j<l;j++)
 	{ D[j] = B->data[iq] >> ir;
-	  if (ir+width >= w) 
-	     { iq++;
-	       D[j] |= B->data[iq] << (w-ir);
-	       ir += width-w;
-	     }
-	  else ir += width; 
+	  if (ir+width > w) D[j] |= B->data[iq+1] << (w-ir);
+	  ir += width;
+	  if (ir >= w) { iq++; ir -= w; }
 	  D[j] &= ((((uint64_t)1) << width) - 1);
 	}
    }
 
-        // read bits [i..i+l-1], onto D[0...] of 32 bits
+        // read bits [i..i+l-1], onto D[0...] of 64 bits
 
-void leafIdRead32 (leafId B, uint i, uint l, uint32_t *D)
+void leafIdRead64 (leafId B, uint i, uint l, uint64_t *D)
+
+   { uint g = B->size - B->right; // where the gap starts
+     uint len;
+     if (i < g) // before the gap
+	{ len = min(l,g-i);
+	  readData64(B,i,len,D);
+	  i += len; D += len; l -= len;
+	}
+     if (l) readData64(B,i+gapLength(B),l,D);
+   }
+
+	// reads the elements stored at [i..i+l-1] of B->data, onto D[0...]
+	// of 32 bits
+
+static void readData32 (leafId B, uint i, uint l, uint32_t *D)
 
    { uint j,width,iq,ir;
      width = B->width;
@@ -322,62 +567,47 @@ void leafIdRead32 (leafId B, uint i, uint l, uint32_t *D)
      ir = (i*B->width)%w;
      for (j=0;j<l;j++)
 	{ D[j] = B->data[iq] >> ir;
-	  if (ir+width >= w) 
-	     { iq++;
-	       D[j] |= B->data[iq] << (w-ir);
-	       ir += width-w;
-	     }
-	  else ir += width; 
+	  if (ir+width > w) D[j] |= B->data[iq+1] << (w-ir);
+	  ir += width;
+	  if (ir >= w) { iq++; ir -= w; }
 	  D[j] &= ((((uint64_t)1) << width) - 1);
 	}
    }
 
+        // read bits [i..i+l-1], onto D[0...] of 32 bits
+
+void leafIdRead32 (leafId B, uint i, uint l, uint32_t *D)
+
+   { uint g = B->size - B->right; // where the gap starts
+     uint len;
+     if (i < g) // before the gap
+	{ len = min(l,g-i);
+	  readData32(B,i,len,D);
+	  i += len; D += len; l -= len;
+	}
+     if (l) readData32(B,i+gapLength(B),l,D);
+   }
+
         // finds first value >= c in [i..j], which must be increasing
         // returns j+1 if not found
 
 uint leafIdNext (leafId B, uint i, uint j, uint64_t c)
 
-   { uint width,iq,ir,d,m;
-     uint64_t v;
-     width = B->width;
+   { uint d,m;
 	// answer is i
-     iq = i*B->width/w;
-     ir = (i*B->width)%w;
-     v = B->data[iq] >> ir;
-     if (ir+width >= w) 
-	v |= B->data[iq+1] << (w-ir);
-     v &= ((((uint64_t)1) << width) - 1);
-     if (v >= c) return i;
+     if (leafIdAccess(B,i) >= c) return i;
 	// answer is j+1
-     iq = j*B->width/w;
-     ir = (j*B->width)%w;
-     v = B->data[iq] >> ir;
-     if (ir+width >= w) 
-	v |= B->data[iq+1] << (w-ir);
-     v &= ((((uint64_t)1) << width) - 1);
-     if (v < c) return j+1;
+     if (leafIdAccess(B,j) < c) return j+1;
 	// invariant data[i] < c and data[j] >= c
      d = 1;
      while (i+d <= j)
-        { iq = (i+d)*B->width/w;
-          ir = ((i+d)*B->width)%w;
-	  v = B->data[iq] >> ir;
-	  if (ir+width >= w) 
-	     v |= B->data[iq+1] << (w-ir);
-	  v &= ((((uint64_t)1) << width) - 1);
-	  if (v >= c) break;
+        { if (leafIdAccess(B,i+d) >= c) break;
           i += d; d <<= 1; 
 	}
      d = min(j,i+d); // data[d] >= j
      while (i+1<d)
         { m = (i+d)>>1;
-          iq = m*B->width/w;
-          ir = (m*B->width)%w;
-	  v = B->data[iq] >> ir;
-	  if (ir+width >= w) 
-	     v |= B->data[iq+1] << (w-ir);
-	  v &= ((((uint64_t)1) << width) - 1);
-          if (v < c) i = m; else d = m;
+          if (leafIdAccess(B,m) < c) i = m; else d = m;
         }
      return d;
    }
@@ -29,50 +29,107 @@ Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
 	// supports leaf arrays of size up to 2^32-1
 
 #include "basics.h"
+#include "pool.h"
 
+#define MaxLeafIdClasses 32 // max number of leaf capacities
+
+	// the data of a dynamic leaf follows its header in a single block,
+	// so data points right after it, usually in the same cache line.
+	// the capacity of the block is one of a few size classes, growing
+	// geometrically. static leaves point to a separate array. if
+	// updated with gap, the free elements of a dynamic leaf form a gap after
+	// the last one updated, and the elements after the gap are kept at
+	// the end of the block, so nearby updates shift few elements
 typedef struct s_leafId
    { uint64_t size; // elements represented
      byte width; // bits used per element, up to w
      byte isStat; // does not accept indels
+     byte cls; // size class, if dynamic
+     uint cap; // words of data, if dynamic
+     uint right; // elements after the gap, 0 if none
      uint64_t *data; 
    } *leafId;
 
+	// pools the leaves of a structure are taken from, one per size class.
+	// the data of static leaves is not pooled
+typedef struct s_leafIdPools
+   { pool headers; // s_leafId of static leaves
+     uint nclasses;
+     uint cap[MaxLeafIdClasses]; // data words of each class, increasing
+     pool blocks[MaxLeafIdClasses]; // s_leafId of dynamic leaves + data,
+				    // NULL until used
+   } *leafIdPools;
+
 	// size that a newly created leaf should have, and max leaf size
 	// measured in elements
 extern inline uint leafIdNewSize(uint width);
 extern inline uint leafIdMaxSize(uint width);
 
-	// creates an empty leafId with elements of width width
-leafId leafIdCreate (uint width);
+	// creates empty pools for leaves
+leafIdPools leafIdPoolsCreate (void);
+
+	// destroys P, releasing at once all the leaves taken from it
+void leafIdPoolsDestroy (leafIdPools P);
+
+	// releases the slabs of P that became free, as poolTrim
+void leafIdPoolsTrim (leafIdPools P);
+
+	// releases the slabs of P that hold no leaf in use
+void leafIdPoolsCompact (leafIdPools P);
+
+	// gives space allocated by P, in w-bit words. the data of static
+	// leaves is not included
+uint64_t leafIdPoolsSpace (leafIdPools P);
+
+	// gives space allocated by P and not in use, in w-bit words
+uint64_t leafIdPoolsOverhead (leafIdPools P);
+
+	// creates an empty leafId with elements of width width, taken from P
+leafId leafIdCreate (uint width, leafIdPools P);
 
         // creates a static leafId of n elements of width width
         // from data in an already packed array, which is simply pointed
-leafId leafIdCreateStaticFromPacked (uint64_t *data, uint n, uint width);
+leafId leafIdCreateStaticFromPacked (uint64_t *data, uint n, uint width,
+				     leafIdPools P);
 
         // creates a dynamic leafId of n elements of width width
         // from data[i..] in an already packed array, which is not destroyed
-leafId leafIdCreateFromPacked (uint64_t *data, uint64_t i, uint n, uint width);
+leafId leafIdCreateFromPacked (uint64_t *data, uint64_t i, uint n, uint width,
+			       leafIdPools P);
 
 	// converts an array of n uint64_t into a leafId of n elements
 	// of width width. data is pointed to and will be freed 
-leafId leafIdCreateFrom64 (uint64_t *data, uint n, uint width, uint isStat);
+leafId leafIdCreateFrom64 (uint64_t *data, uint n, uint width, uint isStat,
+			   leafIdPools P);
 
 	// converts an array of n uint32_t into a leafId of n elements
 	// of width width. data is pointed to and will be freed 
-leafId leafIdCreateFrom32 (uint32_t *data, uint n, uint width, uint isStat);
+leafId leafIdCreateFrom32 (uint32_t *data, uint n, uint width, uint isStat,
+			   leafIdPools P);
 
-	// destroys B, frees data 
-void leafIdDestroy (leafId B);
+	// destroys B, returning it to P
+void leafIdDestroy (leafId B, leafIdPools P);
+
+	// gives a dynamic leaf with the content of B and a capacity for n 
+	// elements, leafIdLength(B) <= n <= leafIdMaxSize(width). B is moved
+	// to a larger class if n does not fit, or to a smaller one if n uses 
+	// little of its class. B should not be used anymore, only the
+	// returned leaf
+leafId leafIdResize (leafId B, uint n, leafIdPools P);
 
 	// saves leaf data to file, which must be opened for writing
 void leafIdSave (leafId B, FILE *file);
 
         // loads leaf data from file, which must be opened for reading
-leafId leafIdLoad (FILE *file);
+leafId leafIdLoad (FILE *file, leafIdPools P);
 
 	// gives (allocated) space of B in w-bit words
 uint leafIdSpace (leafId B);
 
+	// moves the elements after the gap of B, if any, to follow the 
+	// others, so that they are all at the beginning of B->data
+void leafIdCloseGap (leafId B);
+
 	// gives array length
 extern inline uint leafIdLength (leafId B);
 
@@ -82,11 +139,13 @@ void leafIdWrite (leafId B, uint i, uint64_t v);
 
         // inserts v at B[i], assumes that insertion is possible
 	// assumes not static, i is right, and value fits in width
-void leafIdInsert (leafId B, uint i, uint64_t v);
+	// if gap, the gap of B moves to i, else B is kept without gap
+void leafIdInsert (leafId B, uint i, uint64_t v, uint gap);
 
         // deletes B[i], assumes i is right
 	// assumes not static, i is right, and value fits in width
-void leafIdDelete (leafId B, uint i);
+	// if gap, the gap of B moves to i, else B is kept without gap
+void leafIdDelete (leafId B, uint i, uint gap);
 
 	// access B[i], assumes i is right
 extern inline uint64_t leafIdAccess (leafId B, uint i);
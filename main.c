@@ -1,6 +1,7 @@
 
 #include "hybridBV.h"
 #include "hybridId.h"
+#include "multiBV.h"
 #include <time.h>
 #include <sys/times.h>
 #include <unistd.h>
@@ -12,6 +13,16 @@
 // #define ADVID
 // #define ADVID2
 // #define WORSTCASE
+// #define MULTI
+// #define RRR
+// #define EF
+// #define RLE
+// #define ARRAY
+// #define POSITIONS
+// #define BUILDER
+// #define APPEND
+// #define GAP
+// #define FANOUT
 #define NEXT
 
 uint64_t rnd (uint64_t m)
@@ -22,6 +33,138 @@ uint64_t rnd (uint64_t m)
 
 #define alphaUpd 1.0
 
+	// packs the n bits of bits, one per byte, into a bit array
+
+uint64_t *pack (unsigned char *bits, uint64_t n)
+
+   { uint64_t *data;
+     uint64_t i;
+     data = (uint64_t*)calloc((n+w-1)/w+1,sizeof(uint64_t));
+     for (i=0;i<n;i++)
+         if (bits[i]) data[i/w] |= ((uint64_t)1) << (i%w);
+     return data;
+   }
+
+	// compares all the queries on B with those on the n bits of bits,
+	// one per byte, and prints Mal! on each difference
+
+void check (hybridBV B, unsigned char *bits, uint64_t n)
+
+   { uint64_t i,o;
+     int64_t j,k;
+     if (hybridLength(B) != n) printf("Mal!\n");
+     o = 0;
+     for (i=0;i<n;i++)
+         { o += bits[i];
+           if (hybridAccess(B,i) != bits[i]) printf("Mal!\n");
+           if (hybridRank(B,i) != o) printf("Mal!\n");
+           if (hybridRank0(B,i) != i+1-o) printf("Mal!\n");
+           if (bits[i] && (hybridSelect(B,o) != i)) printf("Mal!\n");
+           if (!bits[i] && (hybridSelect0(B,i+1-o) != i)) printf("Mal!\n");
+         }
+     if (hybridOnes(B) != o) printf("Mal!\n");
+     j = k = -1;
+     for (i=n;i-->0;)
+         { if (bits[i]) j = i; else k = i;
+           if (hybridNext(B,i) != j) printf("Mal!\n");
+           if (hybridNext0(B,i) != k) printf("Mal!\n");
+         }
+   }
+
+	// applies m random inserts, deletes, and writes on B and on the n
+	// bits of bits, which must have space for n+m, and returns the new
+	// length. the new bits are 1 with probability p, or copy the 
+	// previous one if p < 0
+
+uint64_t update (hybridBV B, unsigned char *bits, uint64_t n, uint64_t m,
+		 double p)
+
+   { uint64_t i,o;
+     uint v;
+     for (i=0;i<m;i++)
+         { o = rnd(n+1);
+           if (p >= 0) v = (rand() < p*RAND_MAX);
+           else v = o ? bits[o-1] : bits[0];
+           switch (rnd(3))
+              { case 0: hybridInsert(B,o,v);
+                        memmove(bits+o+1,bits+o,n-o);
+                        bits[o] = v; n++;
+                        break;
+                case 1: if (o == n) break;
+                        if (hybridDelete(B,o) != -(int)bits[o]) 
+                           printf("Mal!\n");
+                        memmove(bits+o,bits+o+1,n-o-1);
+                        n--;
+                        break;
+                case 2: if (o == n) break;
+                        if (hybridWrite(B,o,v) != (int)v-(int)bits[o])
+                           printf("Mal!\n");
+                        bits[o] = v;
+                        break;
+              }
+         }
+     return n;
+   }
+
+	// compares B with the n values of vals, accessing each and reading
+	// them by chunks of random lengths, also as 32-bit values if they
+	// fit, and prints Mal! on each difference
+
+void checkId (hybridId B, uint64_t *vals, uint64_t n)
+
+   { uint64_t i,k,l;
+     uint64_t *D;
+     uint32_t *D32;
+     if (hybridIdLength(B) != n) printf("Mal!\n");
+     for (i=0;i<n;i++)
+         if (hybridIdAccess(B,i) != vals[i]) printf("Mal!\n");
+     D = (uint64_t*)malloc(1000*sizeof(uint64_t));
+     D32 = (uint32_t*)malloc(1000*sizeof(uint32_t));
+     for (i=0;i<n;i+=l)
+         { l = 1+rnd(1000);
+           if (l > n-i) l = n-i;
+           hybridIdRead64(B,i,l,D);
+           for (k=0;k<l;k++)
+               if (D[k] != vals[i+k]) printf("Mal!\n");
+           if (hybridIdWidth(B) > 32) continue;
+           hybridIdRead32(B,i,l,D32);
+           for (k=0;k<l;k++)
+               if (D32[k] != vals[i+k]) printf("Mal!\n");
+         }
+     free(D32);
+     free(D);
+   }
+
+	// applies m random inserts, deletes, and writes on B and on the n
+	// values of vals, which must have space for n+m, and returns the new
+	// length. the new values are random of width bits, width < 32
+
+uint64_t updateId (hybridId B, uint64_t *vals, uint64_t n, uint64_t m,
+		   uint width)
+
+   { uint64_t i,o,v;
+     for (i=0;i<m;i++)
+         { o = rnd(n+1);
+           v = rnd(((uint64_t)1) << width);
+           switch (rnd(3))
+              { case 0: hybridIdInsert(B,o,v);
+                        memmove(vals+o+1,vals+o,(n-o)*sizeof(uint64_t));
+                        vals[o] = v; n++;
+                        break;
+                case 1: if (o == n) break;
+                        hybridIdDelete(B,o);
+                        memmove(vals+o,vals+o+1,(n-o-1)*sizeof(uint64_t));
+                        n--;
+                        break;
+                case 2: if (o == n) break;
+                        hybridIdWrite(B,o,v);
+                        vals[o] = v;
+                        break;
+              }
+         }
+     return n;
+   }
+
 void main (void)
 
    { hybridBV B;
@@ -31,6 +174,16 @@ void main (void)
      staticBV S;
      struct tms t1,t2;
      int64_t j,k;
+     multiBV M;
+     uint64_t r,c,*rows,*pos;
+     unsigned char *bits;
+     uint32_t *data32;
+     FILE *file;
+     hybridBuilder Bd;
+     hybridIdBuilder IBd;
+     uint64_t *vals;
+     hybridConfig C;
+     hybridIdConfig IC;
 
      srand(time(NULL)); 
 
@@ -46,7 +199,7 @@ void main (void)
 	 }
      // for 0: for (i=0;i<n/w;i++) data[i] = ~data[i];
 
-     B = hybridCreateFrom(data,n);
+     B = hybridCreateFrom(data,n,NULL);
 
      times(&t1);
      
@@ -77,7 +230,7 @@ void main (void)
 
      times(&t1);
 
-     I = hybridIdCreateFrom64(data,n,25);
+     I = hybridIdCreateFrom64(data,n,25,NULL);
 
      for (i=0;i<n;i++)
          hybridIdAccess(I,i);
@@ -103,7 +256,7 @@ void main (void)
 
      times(&t1);
 
-     I = hybridIdCreateFrom64(data,n,25);
+     I = hybridIdCreateFrom64(data,n,25,NULL);
 
      for (i=0;i<m;i++)
 	{ if (rnd(1000000000) < alphaUpd * 1000000000)
@@ -132,7 +285,7 @@ void main (void)
 
      times(&t1);
 
-     I = hybridIdCreateFrom64(data,n,25);
+     I = hybridIdCreateFrom64(data,n,25,NULL);
 
      for (i=0;i<m;i++)
 	{ if (rnd(1000000000) < alphaUpd * 1000000000)
@@ -161,7 +314,7 @@ void main (void)
 
      times(&t1);
 
-     B = hybridCreateFrom(data,n);
+     B = hybridCreateFrom(data,n,NULL);
 
      for (i=0;i<m;i++)
 	{ if (rnd(1000000000) < alphaUpd * 1000000000)
@@ -192,7 +345,7 @@ void main (void)
 
      times(&t1);
 
-     B = hybridCreateFrom(data,n);
+     B = hybridCreateFrom(data,n,NULL);
 
      for (i=0;i<m;i++)
 	{ if (rnd(1000000000) < alphaUpd * 1000000000)
@@ -215,9 +368,542 @@ void main (void)
 
 #endif
 
+#ifdef MULTI
+
+	// 6 columns of different densities against plain rows, the bit of
+	// column c of row i is (rows[i] >> c) & 1
+
+     m = 100000;
+     M = multiCreate(6);
+     rows = (uint64_t*)malloc((m+1)*sizeof(uint64_t));
+     n = 0;
+
+     printf("Inserting %li rows\n",m);
+     for (i=0;i<m;i++)
+         { r = 0;
+           for (c=0;c<6;c++)
+               if (rnd(7) <= c) r |= ((uint64_t)1) << c;
+           o = rnd(n+1);
+           multiInsert(M,o,&r);
+           memmove(rows+o+1,rows+o,(n-o)*sizeof(uint64_t));
+           rows[o] = r; n++;
+         }
+
+     printf("Deleting %li rows and writing %li bits\n",m/2,m/2);
+     for (i=0;i<m/2;i++)
+         { o = rnd(n);
+           multiDelete(M,o,&r);
+           if (r != rows[o]) printf("Mal!\n");
+           memmove(rows+o,rows+o+1,(n-o-1)*sizeof(uint64_t));
+           n--;
+           o = rnd(n); c = rnd(6); u = rnd(2);
+           if (multiWrite(M,c,o,u) != (int)u - (int)((rows[o] >> c) & 1))
+              printf("Mal!\n");
+           rows[o] = (rows[o] & ~(((uint64_t)1) << c)) | (u << c);
+         }
+     if (multiLength(M) != n) printf("Mal!\n");
+
+     printf("Checking access, rank, select, and next on each column\n");
+     for (c=0;c<6;c++)
+         { o = 0; j = -1; k = -1;
+           for (i=n;i-->0;)
+               { if ((rows[i] >> c) & 1) j = i; else k = i;
+                 if (multiNext(M,c,i) != j) printf("Mal!\n");
+                 if (multiNext0(M,c,i) != k) printf("Mal!\n");
+               }
+           for (i=0;i<n;i++)
+               { u = (rows[i] >> c) & 1;
+                 if (multiAccess(M,c,i) != u) printf("Mal!\n");
+                 o += u;
+                 if (multiRank(M,c,i) != o) printf("Mal!\n");
+                 if (multiRank0(M,c,i) != i+1-o) printf("Mal!\n");
+                 if (u && (multiSelect(M,c,o) != i)) printf("Mal!\n");
+                 if (!u && (multiSelect0(M,c,i+1-o) != i)) printf("Mal!\n");
+               }
+           if (multiOnes(M,c) != o) printf("Mal!\n");
+           printf("Column %li: %li ones out of %li\n",c,o,n);
+         }
+
+     free(rows);
+     multiDestroy(M);
+
+#endif
+
+#ifdef RRR
+
+	// bits 97% dense are built as RRR statics, queried, and updated,
+	// which decompresses parts of them and compresses them again
+
+     n = 1024*1024*2;
+     m = 10000;
+     bits = (unsigned char*)malloc(n+m);
+     for (i=0;i<n;i++)
+         bits[i] = (rnd(100) < 97);
+
+     B = hybridCreateFrom(pack(bits,n),n,NULL);
+     printf("RRR: %.2f bits per bit\n",hybridSpace(B)*w/(float)n);
+     check(B,bits,n);
+     n = update(B,bits,n,m,0.97);
+     printf("After %li updates: %.2f bits per bit\n",m,hybridSpace(B)*w/(float)n);
+     check(B,bits,n);
+
+     free(bits);
+     hybridDestroy(B);
+
+#endif
+
+#ifdef EF
+
+	// bits 1% dense are built as Elias-Fano statics, queried, and
+	// updated, which decompresses parts of them and compresses them again
+
+     n = 1024*1024*2;
+     m = 10000;
+     bits = (unsigned char*)malloc(n+m);
+     for (i=0;i<n;i++)
+         bits[i] = (rnd(100) < 1);
+
+     B = hybridCreateFrom(pack(bits,n),n,NULL);
+     printf("Elias-Fano: %.2f bits per bit\n",hybridSpace(B)*w/(float)n);
+     check(B,bits,n);
+     n = update(B,bits,n,m,0.01);
+     printf("After %li updates: %.2f bits per bit\n",m,hybridSpace(B)*w/(float)n);
+     check(B,bits,n);
+
+     free(bits);
+     hybridDestroy(B);
+
+#endif
+
+#ifdef RLE
+
+	// runs of about 2000 equal bits are inserted, so the leaves are split
+	// into run-length leaves, and then updated keeping most runs
+
+     n = 1024*1024*2;
+     m = 10000;
+     bits = (unsigned char*)malloc(n+m);
+     B = hybridCreate(NULL);
+     u = 0;
+     for (i=0;i<n;i++)
+         { if (rnd(2000) == 0) u = !u;
+           bits[i] = u;
+           hybridInsert(B,i,u);
+         }
+     printf("Run-length: %.2f bits per bit\n",hybridSpace(B)*w/(float)n);
+     check(B,bits,n);
+     n = update(B,bits,n,m,-1);
+     printf("After %li updates: %.2f bits per bit\n",m,hybridSpace(B)*w/(float)n);
+     check(B,bits,n);
+
+     free(bits);
+     hybridDestroy(B);
+
+#endif
+
+#ifdef ARRAY
+
+	// bits 1% dense are inserted, so the leaves are split into arrays of
+	// positions, and then updated, some of them until they become plain
+
+     n = 1024*1024*2;
+     m = 100000;
+     bits = (unsigned char*)malloc(n+m+4096);
+     B = hybridCreate(NULL);
+     for (i=0;i<n;i++)
+         { bits[i] = (rnd(100) < 1);
+           hybridInsert(B,i,bits[i]);
+         }
+     printf("Arrays: %.2f bits per bit\n",hybridSpace(B)*w/(float)n);
+     for (i=0;i<4096;i++) // inserts, writes, and deletes of 0s make a few
+         { o = rnd(16384); // leaves dense enough to become plain
+           hybridInsert(B,o,1);
+           memmove(bits+o+1,bits+o,n-o);
+           bits[o] = 1; n++;
+           o = 32768 + rnd(16384);
+           if (hybridWrite(B,o,1) != 1-bits[o]) printf("Mal!\n");
+           bits[o] = 1;
+           o = 65536 + rnd(1024);
+           if (bits[o]) continue;
+           if (hybridDelete(B,o) != 0) printf("Mal!\n");
+           memmove(bits+o,bits+o+1,n-o-1);
+           n--;
+         }
+     check(B,bits,n);
+     n = update(B,bits,n,m,0.01);
+     printf("After %li updates: %.2f bits per bit\n",m,hybridSpace(B)*w/(float)n);
+     check(B,bits,n);
+
+     free(bits);
+     hybridDestroy(B);
+
+#endif
+
+#ifdef POSITIONS
+
+	// builds from the positions of its 1s a bitvector of two static
+	// parts, whose regions are sparse, all 0s, dense, random, and all 1s,
+	// and then updates it
+
+     n = 1024*1024*16 + 777;
+     m = 10000;
+     bits = (unsigned char*)malloc(n+m);
+     for (i=0;i<n;i++)
+         switch (5*i/n)
+            { case 0: bits[i] = (rnd(1000) == 0); break;
+              case 1: bits[i] = 0; break;
+              case 2: bits[i] = (rnd(100) < 97); break;
+              case 3: bits[i] = rnd(2); break;
+              case 4: bits[i] = 1; break;
+            }
+     pos = (uint64_t*)malloc(n*sizeof(uint64_t));
+     for (i=o=0;i<n;i++)
+         if (bits[i]) pos[o++] = i;
+
+     B = hybridCreateFromPositions(pos,o,n,NULL);
+     printf("From %li positions: %.2f bits per bit\n",o,hybridSpace(B)*w/(float)n);
+     check(B,bits,n);
+     n = update(B,bits,n,m,0.5);
+     check(B,bits,n);
+     hybridDestroy(B);
+
+     B = hybridCreateFromPositions(pos,0,n,NULL); // no 1s
+     memset(bits,0,n);
+     check(B,bits,n);
+     hybridDestroy(B);
+
+     free(pos);
+     free(bits);
+
+#endif
+
+#ifdef BUILDER
+
+	// builds a bitvector of two static parts and an array of several
+	// ones by chunks of random sizes, and from a file
+
+     n = 1024*1024*16 + 777;
+     m = 10000;
+     bits = (unsigned char*)malloc(n+m);
+     for (i=0;i<n;i++)
+         bits[i] = (i < n/2) ? (rnd(100) < 3) : rnd(2);
+     Bd = hybridBuilderCreate(NULL);
+     for (i=0;i<n;i+=u)
+         { u = rnd(100000) + 1;
+           if (u > n-i) u = n-i;
+           data = pack(bits+i,u);
+           hybridBuilderAdd(Bd,data,u);
+           free(data);
+         }
+     B = hybridBuilderFinish(Bd);
+     printf("Built by chunks: %.2f bits per bit\n",hybridSpace(B)*w/(float)n);
+     check(B,bits,n);
+     hybridDestroy(B);
+
+     file = tmpfile();
+     data = pack(bits,n);
+     fwrite(data,sizeof(uint64_t),(n+w-1)/w,file);
+     free(data);
+     rewind(file);
+     B = hybridCreateFromFile(file,n,NULL);
+     fclose(file);
+     for (i=o=0;i<n;i++)
+         { o += bits[i];
+           if (hybridAccess(B,i) != bits[i]) printf("Mal!\n");
+           if ((i % 1000 == 0) && (hybridRank(B,i) != o)) printf("Mal!\n");
+         }
+     n = update(B,bits,n,m,0.5);
+     check(B,bits,n);
+     hybridDestroy(B);
+     free(bits);
+
+     n = 1024*1024*3 + 55;
+     data = (uint64_t*)malloc(n*sizeof(uint64_t));
+     data32 = (uint32_t*)malloc(n*sizeof(uint32_t));
+     for (i=0;i<n;i++)
+         data32[i] = data[i] = rnd(((uint64_t)1) << 20);
+     IBd = hybridIdBuilderCreate(20,NULL);
+     for (i=0;i<n;i+=u)
+         { u = rnd(100000) + 1;
+           if (u > n-i) u = n-i;
+           if (rnd(2)) hybridIdBuilderAdd64(IBd,data+i,u);
+           else hybridIdBuilderAdd32(IBd,data32+i,u);
+         }
+     I = hybridIdBuilderFinish(IBd);
+     if (hybridIdLength(I) != n) printf("Mal!\n");
+     for (i=0;i<n;i++)
+         if (hybridIdAccess(I,i) != data[i]) printf("Mal!\n");
+     hybridIdDestroy(I);
+
+     file = tmpfile();
+     fwrite(data,sizeof(uint64_t),n,file);
+     rewind(file);
+     I = hybridIdCreateFromFile(file,n,20,NULL);
+     fclose(file);
+     if (hybridIdLength(I) != n) printf("Mal!\n");
+     for (i=0;i<n;i++)
+         if (hybridIdAccess(I,i) != data[i]) printf("Mal!\n");
+     printf("Arrays built by chunks and from a file\n");
+     hybridIdDestroy(I);
+     free(data32);
+     free(data);
+
+#endif
+
+#ifdef APPEND
+
+	// sliding windows over a hybridBV and a hybridId, whose values are 
+	// appended at the end and popped from the front, mixed with updates
+	// elsewhere. they are saved and loaded in every other round, and all
+	// popped in the fifth
+
+     m = 1024*512;
+     bits = (unsigned char*)malloc(8*m);
+     for (i=0;i<m;i++) 
+         bits[i] = rnd(2);
+     B = hybridCreateFrom(pack(bits,m),m,NULL);
+     o = 0; n = m; // the window is bits[o..o+n-1]
+     for (r=0;r<8;r++)
+         { for (u=rnd(m/2);u>0;u--)
+               { bits[o+n] = rnd(2);
+                 hybridAppend(B,bits[o+n++]);
+               }
+           for (u=(r==4)?n:rnd(1+min(n,m/2));u>0;u--)
+               { if (hybridPopFront(B) != bits[o]) printf("Mal!\n");
+                 o++; n--;
+               }
+           for (u=rnd(m/4);u>0;u--)
+               { bits[o+n] = rnd(2);
+                 hybridAppend(B,bits[o+n++]);
+               }
+           n = update(B,bits+o,n,1000,0.5);
+           if (r % 2)
+              { file = tmpfile();
+                hybridSave(B,file);
+                hybridDestroy(B);
+                rewind(file);
+                B = hybridLoad(file,NULL);
+                fclose(file);
+              }
+           check(B,bits+o,n);
+           printf("Bitvector window of %li bits after %li popped\n",n,o);
+         }
+     hybridDestroy(B);
+     free(bits);
+
+     vals = (uint64_t*)malloc(8*m*sizeof(uint64_t));
+     for (i=0;i<m;i++) 
+         vals[i] = rnd(1 << 13);
+     data = (uint64_t*)malloc(m*sizeof(uint64_t));
+     memcpy(data,vals,m*sizeof(uint64_t));
+     I = hybridIdCreateFrom64(data,m,13,NULL);
+     o = 0; n = m; // the window is vals[o..o+n-1]
+     for (r=0;r<8;r++)
+         { for (u=rnd(m/2);u>0;u--)
+               { vals[o+n] = rnd(1 << 13);
+                 hybridIdAppend(I,vals[o+n++]);
+               }
+           for (u=(r==4)?n:rnd(1+min(n,m/2));u>0;u--)
+               { if (hybridIdPopFront(I) != vals[o]) printf("Mal!\n");
+                 o++; n--;
+               }
+           for (u=rnd(m/4);u>0;u--)
+               { vals[o+n] = rnd(1 << 13);
+                 hybridIdAppend(I,vals[o+n++]);
+               }
+           n = updateId(I,vals+o,n,1000,13);
+           if (r % 2)
+              { file = tmpfile();
+                hybridIdSave(I,file);
+                hybridIdDestroy(I);
+                rewind(file);
+                I = hybridIdLoad(file,NULL);
+                fclose(file);
+              }
+           checkId(I,vals+o,n);
+           printf("Array window of %li values after %li popped\n",n,o);
+         }
+     hybridIdDestroy(I);
+     free(vals);
+
+#endif
+
+#ifdef GAP
+
+	// a hybridBV and a hybridId whose leaves keep their free space as a
+	// gap at their last update, receive random updates and then runs of
+	// inserts and deletes at nearby positions
+
+     hybridDefaultConfig(&C);
+     C.gap = 1;
+     n = 1024*256;
+     m = 20000;
+     bits = (unsigned char*)malloc(n+2*m);
+     B = hybridCreate(&C);
+     for (i=0;i<n;i++)
+         { bits[i] = rnd(2);
+           hybridInsert(B,i,bits[i]);
+         }
+     n = update(B,bits,n,m,0.5);
+     check(B,bits,n);
+     for (i=0;i<m;i++)
+         { if (i % 1000 == 0) o = rnd(n-64); // a new run
+           u = o + rnd(64);
+           if (rnd(2))
+              { hybridInsert(B,u,1);
+                memmove(bits+u+1,bits+u,n-u);
+                bits[u] = 1; n++;
+              }
+           else
+              { if (hybridDelete(B,u) != -(int)bits[u]) printf("Mal!\n");
+                memmove(bits+u,bits+u+1,n-u-1);
+                n--;
+              }
+         }
+     check(B,bits,n);
+     printf("Bitvector with gaps of %li bits\n",n);
+     hybridDestroy(B);
+     free(bits);
+
+     hybridIdDefaultConfig(&IC);
+     IC.gap = 1;
+     n = 1024*256;
+     vals = (uint64_t*)malloc((n+2*m)*sizeof(uint64_t));
+     I = hybridIdCreate(20,&IC);
+     for (i=0;i<n;i++)
+         { vals[i] = rnd(1 << 20);
+           hybridIdInsert(I,i,vals[i]);
+         }
+     n = updateId(I,vals,n,m,20);
+     checkId(I,vals,n);
+     for (i=0;i<m;i++)
+         { if (i % 1000 == 0) o = rnd(n-64); // a new run
+           u = o + rnd(64);
+           if (rnd(2))
+              { hybridIdInsert(I,u,i);
+                memmove(vals+u+1,vals+u,(n-u)*sizeof(uint64_t));
+                vals[u] = i; n++;
+              }
+           else
+              { hybridIdDelete(I,u);
+                memmove(vals+u,vals+u+1,(n-u-1)*sizeof(uint64_t));
+                n--;
+              }
+         }
+     checkId(I,vals,n);
+     printf("Array with gaps of %li values\n",n);
+     hybridIdDestroy(I);
+     free(vals);
+
+#endif
+
+#ifdef FANOUT
+
+	// hybridBVs and hybridIds whose internal nodes have up to 16 
+	// children, built by inserts, from statics, from positions or by 
+	// chunks in parts that are assembled, and by appends, and then 
+	// updated at random
+
+     hybridDefaultConfig(&C);
+     C.fanout = 16;
+     n = 1024*512;
+     m = 20000;
+     bits = (unsigned char*)malloc(1024*1024*17+m);
+     B = hybridCreate(&C);
+     for (i=0;i<n;i++)
+         { bits[i] = rnd(2);
+           hybridInsert(B,i,bits[i]);
+         }
+     n = update(B,bits,n,m,0.5);
+     check(B,bits,n);
+     for (i=0;i<m;i++) // the tail joins the tree when full
+         { bits[n] = rnd(2);
+           hybridAppend(B,bits[n++]);
+         }
+     n = update(B,bits,n,m,0.5);
+     o = rnd(n); // a burst fills leaves at one place, and then empties them
+     memmove(bits+o+m,bits+o,n-o);
+     for (i=0;i<m;i++)
+         { bits[o+i] = rnd(2);
+           hybridInsert(B,o+i,bits[o+i]);
+         }
+     n += m;
+     check(B,bits,n);
+     for (i=0;i<m;i++) hybridDelete(B,o);
+     memmove(bits+o,bits+o+m,n-o-m);
+     n -= m;
+     check(B,bits,n);
+     printf("Bitvector of %li bits built by inserts\n",n);
+     hybridDestroy(B);
+
+     B = hybridCreateFrom(pack(bits,n),n,&C);
+     n = update(B,bits,n,m,0.5);
+     check(B,bits,n);
+     printf("Bitvector of %li bits split from statics\n",n);
+     hybridDestroy(B);
+
+     n = 1024*1024*16 + 1000;
+     pos = (uint64_t*)malloc(n/50*sizeof(uint64_t));
+     for (i=o=0;i<n;i++)
+         { bits[i] = (rnd(100) == 0);
+           if (bits[i]) pos[o++] = i;
+         }
+     B = hybridCreateFromPositions(pos,o,n,&C);
+     n = update(B,bits,n,m,0.01);
+     check(B,bits,n);
+     printf("Bitvector of %li bits assembled from positions\n",n);
+     hybridDestroy(B);
+     free(pos);
+     free(bits);
+
+     hybridIdDefaultConfig(&IC);
+     IC.fanout = 16;
+     n = 1024*512;
+     vals = (uint64_t*)malloc((1024*1024*4+m)*sizeof(uint64_t));
+     I = hybridIdCreate(20,&IC);
+     for (i=0;i<n;i++)
+         { vals[i] = rnd(1 << 20);
+           hybridIdInsert(I,i,vals[i]);
+         }
+     n = updateId(I,vals,n,m,20);
+     checkId(I,vals,n);
+     for (i=0;i<m;i++) // the tail joins the tree when full
+         { vals[n] = rnd(1 << 20);
+           hybridIdAppend(I,vals[n++]);
+         }
+     n = updateId(I,vals,n,m,20);
+     o = rnd(n);
+     memmove(vals+o+m,vals+o,(n-o)*sizeof(uint64_t));
+     for (i=0;i<m;i++)
+         { vals[o+i] = rnd(1 << 20);
+           hybridIdInsert(I,o+i,vals[o+i]);
+         }
+     n += m;
+     checkId(I,vals,n);
+     for (i=0;i<m;i++) hybridIdDelete(I,o);
+     memmove(vals+o,vals+o+m,(n-o-m)*sizeof(uint64_t));
+     n -= m;
+     checkId(I,vals,n);
+     printf("Array of %li values built by inserts\n",n);
+     hybridIdDestroy(I);
+
+     n = 1024*1024*4; // in more parts than fit in a node
+     for (i=0;i<n;i++)
+         vals[i] = (rnd(1 << 20) << 20) + rnd(1 << 20);
+     IBd = hybridIdBuilderCreate(40,&IC);
+     hybridIdBuilderAdd64(IBd,vals,n);
+     I = hybridIdBuilderFinish(IBd);
+     n = updateId(I,vals,n,m,40);
+     checkId(I,vals,n);
+     printf("Array of %li values assembled by chunks\n",n);
+     hybridIdDestroy(I);
+     free(vals);
+
+#endif
+
 #ifdef BASIC
 
-     B = hybridCreate();
+     B = hybridCreate(NULL);
 
      printf("Inserting %li 10s\n",leafMaxSize()*w);
      for (i=0;i<leafMaxSize()*w;i++)
@@ -272,7 +958,7 @@ void main (void)
 
 #ifdef BASICID
 
-     I = hybridIdCreate(10);
+     I = hybridIdCreate(10,NULL);
 
      printf("Inserting 1 to 1000\n");
      for (i=0;i<1000;i++)
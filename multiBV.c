@@ -0,0 +1,644 @@
+
+/*
+
+HybridBV -- an implementation of adaptive dynamic bitvectors. 
+Copyright (C) 2024-current_year Gonzalo Navarro
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+Author's contact: Gonzalo Navarro, Dept. of Computer Science, University of
+Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
+
+*/
+
+	// supports families of k dynamic bitvectors of the same length up to
+	// 2^64-1, the columns, whose rows are inserted and deleted together
+
+#include "multiBV.h"
+
+	// a node is merged with a neighbor when it falls below 1/UnderFill
+	// of its max size, if both fit in Gamma of it
+
+static const uint UnderFill = 4;
+static const float Gamma = 0.75;
+
+	// leaves keep a gap at their last update, 0 for not (see leafInsert)
+static const uint MultiGap = 0;
+
+	// bit of column c in row
+
+static inline uint rowBit (uint64_t *row, uint c)
+
+   { return (row[c/w] >> (c%w)) & 1;
+   }
+
+	// takes from M an internal node with no children
+
+static multiNode newNode (multiBV M, uint isLeaf)
+
+   { multiNode N = (multiNode)poolAlloc(M->nodes);
+     N->nchildren = 0;
+     N->isLeaf = isLeaf;
+     return N;
+   }
+
+	// length and 1s of each column of N, onto *size and ones[0..k-1]
+
+static void nodeCounts (multiBV M, multiNode N, uint64_t *size, uint64_t *ones)
+
+   { uint j,c;
+     *size = 0;
+     for (c=0;c<M->k;c++) ones[c] = 0;
+     for (j=0;j<N->nchildren;j++)
+	{ *size += N->size[j];
+	  for (c=0;c<M->k;c++) ones[c] += N->ones[j*M->k+c];
+	}
+   }
+
+	// makes child the j-th child of N, computing its counts
+
+static void setChild (multiBV M, multiNode N, uint j, void *child)
+
+   { leafBV *L;
+     uint c;
+     N->child[j] = child;
+     if (N->isLeaf)
+	{ L = (leafBV*)child;
+	  N->size[j] = leafLength(L[0]);
+	  for (c=0;c<M->k;c++) N->ones[j*M->k+c] = leafOnes(L[c]);
+	}
+     else nodeCounts(M,(multiNode)child,&N->size[j],N->ones+j*M->k);
+   }
+
+	// opens room for a child at position j of N, which must not be full
+
+static void openChild (multiBV M, multiNode N, uint j)
+
+   { memmove(N->size+j+1,N->size+j,(N->nchildren-j)*sizeof(uint64_t));
+     memmove(N->child+j+1,N->child+j,(N->nchildren-j)*sizeof(void*));
+     memmove(N->ones+(j+1)*M->k,N->ones+j*M->k,
+	     (N->nchildren-j)*M->k*sizeof(uint64_t));
+     N->nchildren++;
+   }
+
+	// removes the j-th child from N, without freeing it
+
+static void closeChild (multiBV M, multiNode N, uint j)
+
+   { N->nchildren--;
+     memmove(N->size+j,N->size+j+1,(N->nchildren-j)*sizeof(uint64_t));
+     memmove(N->child+j,N->child+j+1,(N->nchildren-j)*sizeof(void*));
+     memmove(N->ones+j*M->k,N->ones+(j+1)*M->k,
+	     (N->nchildren-j)*M->k*sizeof(uint64_t));
+   }
+
+	// splits the full j-th child of N, which must not be full, into the 
+	// j-th and (j+1)-th
+
+static void splitChild (multiBV M, multiNode N, uint j)
+
+   { leafBV *L,*L1,*L2;
+     multiNode C,C2;
+     uint c,half;
+     openChild(M,N,j+1);
+     if (N->isLeaf) // halves the leaves of all the columns
+	{ L = (leafBV*)N->child[j];
+	  L1 = (leafBV*)poolAlloc(M->leaves);
+	  L2 = (leafBV*)poolAlloc(M->leaves);
+	  half = leafMaxSize() / 2; // words of the new leaves
+	  for (c=0;c<M->k;c++)
+	      { leafCloseGap(L[c]);
+		L1[c] = leafCreateFrom(L[c]->data,half*w,0,M->cols);
+		L2[c] = leafCreateFrom(L[c]->data+half,leafLength(L[c])-half*w,
+				       0,M->cols);
+		leafDestroy(L[c],M->cols);
+	      }
+	  poolFree(M->leaves,L);
+	  M->nleaves++;
+	  M->reshapes++;
+	  setChild(M,N,j,L1);
+	  setChild(M,N,j+1,L2);
+	}
+     else // moves the second half of the children to a new node
+	{ C = (multiNode)N->child[j];
+	  C2 = newNode(M,C->isLeaf);
+	  half = C->nchildren / 2;
+	  C2->nchildren = C->nchildren - half;
+	  memcpy(C2->size,C->size+half,C2->nchildren*sizeof(uint64_t));
+	  memcpy(C2->child,C->child+half,C2->nchildren*sizeof(void*));
+	  memcpy(C2->ones,C->ones+half*M->k,
+		 C2->nchildren*M->k*sizeof(uint64_t));
+	  C->nchildren = half;
+	  setChild(M,N,j,C);
+	  setChild(M,N,j+1,C2);
+	}
+   }
+
+	// appends the (j+1)-th child of N to the j-th one, and removes it
+
+static void mergeChildren (multiBV M, multiNode N, uint j)
+
+   { leafBV *L1,*L2;
+     multiNode C1,C2;
+     uint c;
+     if (N->isLeaf)
+	{ L1 = (leafBV*)N->child[j];
+	  L2 = (leafBV*)N->child[j+1];
+	  for (c=0;c<M->k;c++)
+	      { L1[c] = leafResize(L1[c],leafLength(L1[c])+leafLength(L2[c]),
+				   M->cols);
+		leafCloseGap(L1[c]);
+		leafCloseGap(L2[c]);
+		copyBits(L1[c]->data,L1[c]->size,L2[c]->data,0,L2[c]->size);
+		L1[c]->size += L2[c]->size;
+		L1[c]->ones += L2[c]->ones;
+		leafDestroy(L2[c],M->cols);
+	      }
+	  poolFree(M->leaves,L2);
+	  M->nleaves--;
+	  M->reshapes++;
+	}
+     else
+	{ C1 = (multiNode)N->child[j];
+	  C2 = (multiNode)N->child[j+1];
+	  memcpy(C1->size+C1->nchildren,C2->size,C2->nchildren*sizeof(uint64_t));
+	  memcpy(C1->child+C1->nchildren,C2->child,C2->nchildren*sizeof(void*));
+	  memcpy(C1->ones+C1->nchildren*M->k,C2->ones,
+		 C2->nchildren*M->k*sizeof(uint64_t));
+	  C1->nchildren += C2->nchildren;
+	  poolFree(M->nodes,C2);
+	}
+     N->size[j] += N->size[j+1];
+     for (c=0;c<M->k;c++) N->ones[j*M->k+c] += N->ones[(j+1)*M->k+c];
+     closeChild(M,N,j+1);
+   }
+
+	// merges the j-th child of N with a neighbor if it is too small
+	// and both fit in one
+
+static void fixUnderflow (multiBV M, multiNode N, uint j)
+
+   { multiNode C;
+     leafBV *L;
+     uint c;
+     if (N->nchildren == 1) return;
+     if (N->isLeaf && (N->size[j] == 0)) // just removes it
+	{ L = (leafBV*)N->child[j];
+	  for (c=0;c<M->k;c++) leafDestroy(L[c],M->cols);
+	  poolFree(M->leaves,L);
+	  M->nleaves--;
+	  M->reshapes++;
+	  closeChild(M,N,j);
+	  return;
+	}
+     if (j == N->nchildren-1) j--; // merges j with j+1
+     if (N->isLeaf)
+	{ if ((N->size[j] >= leafMaxSize()*w/UnderFill) &&
+	      (N->size[j+1] >= leafMaxSize()*w/UnderFill)) return;
+	  if (N->size[j]+N->size[j+1] > leafMaxSize()*w*Gamma) return;
+	}
+     else
+	{ C = (multiNode)N->child[j];
+	  if ((C->nchildren >= MultiFanout/UnderFill) &&
+	      (((multiNode)N->child[j+1])->nchildren >= MultiFanout/UnderFill))
+	     return;
+	  if (C->nchildren + ((multiNode)N->child[j+1])->nchildren > 
+	      MultiFanout*Gamma) return;
+	}
+     mergeChildren(M,N,j);
+   }
+
+	// leaves that move to other size classes as they grow and shrink
+	// free their blocks in the pools. they are compacted after as many
+	// leaf splits and merges as there are leaves
+
+static void compact (multiBV M)
+
+   { if (M->reshapes*8 <= M->nleaves) return;
+     poolCompact(M->nodes);
+     poolCompact(M->leaves);
+     leafPoolsCompact(M->cols);
+     M->reshapes = 0;
+   }
+
+	// creates an empty multiBV of k columns, with no root
+
+static multiBV create (uint k)
+
+   { multiBV M = (multiBV)myalloc(sizeof(struct s_multiBV));
+     M->k = k;
+     M->size = 0;
+     M->ones = (uint64_t*)mycalloc(k,sizeof(uint64_t));
+     M->root = NULL;
+     M->nleaves = 0;
+     M->reshapes = 0;
+     M->nodes = poolCreate(sizeof(struct s_multiNode) +
+			   k*MultiFanout*sizeof(uint64_t));
+     M->leaves = poolCreate(k*sizeof(leafBV));
+     M->cols = leafPoolsCreate();
+     M->row = (uint64_t*)myalloc(((k+w-1)/w)*sizeof(uint64_t));
+     return M;
+   }
+
+	// creates an empty multiBV of k columns
+
+multiBV multiCreate (uint k)
+
+   { multiBV M = create(k);
+     leafBV *L = (leafBV*)poolAlloc(M->leaves);
+     uint c;
+     for (c=0;c<k;c++) L[c] = leafCreate(M->cols);
+     M->nleaves = 1;
+     M->root = newNode(M,1);
+     M->root->nchildren = 1;
+     setChild(M,M->root,0,L);
+     return M;
+   }
+
+	// destroys M, releasing at once its nodes and leaves
+
+void multiDestroy (multiBV M)
+
+   { poolDestroy(M->nodes);
+     poolDestroy(M->leaves);
+     leafPoolsDestroy(M->cols);
+     myfree(M->ones);
+     myfree(M->row);
+     myfree(M);
+   }
+
+	// number of leaves below N
+
+static uint64_t nodeLeaves (multiNode N)
+
+   { uint64_t leaves;
+     uint j;
+     if (N->isLeaf) return N->nchildren;
+     leaves = 0;
+     for (j=0;j<N->nchildren;j++) leaves += nodeLeaves((multiNode)N->child[j]);
+     return leaves;
+   }
+
+	// writes the leaves below N to file, each as its length and the
+	// bits of its columns
+
+static void nodeSave (multiBV M, multiNode N, FILE *file)
+
+   { leafBV *L;
+     uint j,c,size;
+     for (j=0;j<N->nchildren;j++)
+	{ if (!N->isLeaf) { nodeSave(M,(multiNode)N->child[j],file); continue; }
+	  L = (leafBV*)N->child[j];
+	  size = leafLength(L[0]);
+	  myfwrite(&size,sizeof(uint),1,file);
+	  for (c=0;c<M->k;c++) leafSave(L[c],file);
+	}
+   }
+
+	// writes M to file, which must be opened for writing
+
+void multiSave (multiBV M, FILE *file)
+
+   { uint64_t leaves = nodeLeaves(M->root);
+     myfwrite(&M->k,sizeof(uint),1,file);
+     myfwrite(&M->size,sizeof(uint64_t),1,file);
+     myfwrite(&leaves,sizeof(uint64_t),1,file);
+     nodeSave(M,M->root,file);
+   }
+
+	// loads multiBV from file, which must be opened for reading
+	// its leaves are grouped by levels into a balanced tree
+
+multiBV multiLoad (FILE *file)
+
+   { multiBV M;
+     multiNode N;
+     void **child,**nodes;
+     uint64_t n,m,t,j;
+     uint k,c,size,isLeaf;
+     leafBV *L;
+     myfread(&k,sizeof(uint),1,file);
+     M = create(k);
+     myfread(&M->size,sizeof(uint64_t),1,file);
+     myfread(&n,sizeof(uint64_t),1,file);
+     M->nleaves = n;
+     child = (void**)myalloc(n*sizeof(void*));
+     for (j=0;j<n;j++)
+	{ myfread(&size,sizeof(uint),1,file);
+	  L = (leafBV*)poolAlloc(M->leaves);
+	  for (c=0;c<k;c++) 
+	      { L[c] = leafLoad(file,size,M->cols);
+		M->ones[c] += leafOnes(L[c]);
+	      }
+	  child[j] = L;
+	}
+     nodes = (void**)myalloc(((n+MultiFanout-1)/MultiFanout)*sizeof(void*));
+     isLeaf = 1;
+     while (1)
+	{ m = (n+MultiFanout-1)/MultiFanout; // nodes of the level
+	  for (t=0;t<m;t++)
+	      { N = newNode(M,isLeaf);
+		for (j=t*n/m;j<(t+1)*n/m;j++) 
+		    { N->nchildren++;
+		      setChild(M,N,N->nchildren-1,child[j]);
+		    }
+		nodes[t] = N;
+	      }
+	  if (m == 1) break;
+	  memcpy(child,nodes,m*sizeof(void*));
+	  n = m;
+	  isLeaf = 0;
+	}
+     M->root = N;
+     myfree(nodes);
+     myfree(child);
+     return M;
+   }
+
+	// gives space of M in w-bit words
+
+uint64_t multiSpace (multiBV M)
+
+   { return (sizeof(struct s_multiBV)*8+w-1)/w + M->k + (M->k+w-1)/w +
+	    poolSpace(M->nodes) + poolSpace(M->leaves) + 
+	    leafPoolsSpace(M->cols);
+   }
+
+	// gives the number of columns
+
+inline uint multiColumns (multiBV M)
+
+   { return M->k;
+   }
+
+	// gives the length of the columns
+
+inline uint64_t multiLength (multiBV M)
+
+   { return M->size;
+   }
+
+	// gives the number of 1s of column c
+
+inline uint64_t multiOnes (multiBV M, uint c)
+
+   { return M->ones[c];
+   }
+
+	// inserts row at position i of all the columns, assumes i is right
+	// full nodes are split on the way down, so there is room for the
+	// new child of a split
+
+void multiInsert (multiBV M, uint64_t i, uint64_t *row)
+
+   { multiNode N;
+     leafBV *L;
+     uint j,c;
+     if (M->root->nchildren == MultiFanout) // the tree grows
+	{ N = newNode(M,0);
+	  N->nchildren = 1;
+	  setChild(M,N,0,M->root);
+	  splitChild(M,N,0);
+	  M->root = N;
+	}
+     M->size++;
+     for (c=0;c<M->k;c++) M->ones[c] += rowBit(row,c);
+     N = M->root;
+     while (1)
+	{ j = 0;
+	  while ((j < N->nchildren-1) && (i > N->size[j])) i -= N->size[j++];
+	  if (N->isLeaf ? (N->size[j] == leafMaxSize()*w)
+			: (((multiNode)N->child[j])->nchildren == MultiFanout))
+	     { splitChild(M,N,j);
+	       if (i > N->size[j]) i -= N->size[j++];
+	     }
+	  N->size[j]++;
+	  for (c=0;c<M->k;c++) N->ones[j*M->k+c] += rowBit(row,c);
+	  if (N->isLeaf) break;
+	  N = (multiNode)N->child[j];
+	}
+     L = (leafBV*)N->child[j];
+     for (c=0;c<M->k;c++)
+	 { L[c] = leafResize(L[c],leafLength(L[c])+1,M->cols);
+	   leafInsert(L[c],i,rowBit(row,c),MultiGap);
+	 }
+     compact(M);
+   }
+
+	// deletes the i-th row below N, writing it onto row, and merges 
+	// the child it was in if it gets too small
+
+static void deleteRow (multiBV M, multiNode N, uint64_t i, uint64_t *row)
+
+   { leafBV *L;
+     uint j,c;
+     j = 0;
+     while (i >= N->size[j]) i -= N->size[j++];
+     if (N->isLeaf)
+	{ L = (leafBV*)N->child[j];
+	  memset(row,0,((M->k+w-1)/w)*sizeof(uint64_t));
+	  for (c=0;c<M->k;c++)
+	      { if (leafDelete(L[c],i,MultiGap)) row[c/w] |= ((uint64_t)1) << (c%w);
+		L[c] = leafResize(L[c],leafLength(L[c]),M->cols);
+	      }
+	}
+     else deleteRow(M,(multiNode)N->child[j],i,row);
+     N->size[j]--;
+     for (c=0;c<M->k;c++) N->ones[j*M->k+c] -= rowBit(row,c);
+     fixUnderflow(M,N,j);
+   }
+
+	// deletes the i-th row of all the columns, assumes i is right
+	// writes it onto row, unless row is NULL
+
+void multiDelete (multiBV M, uint64_t i, uint64_t *row)
+
+   { multiNode N;
+     uint c;
+     if (row == NULL) row = M->row;
+     deleteRow(M,M->root,i,row);
+     M->size--;
+     for (c=0;c<M->k;c++) M->ones[c] -= rowBit(row,c);
+     if (!M->root->isLeaf && (M->root->nchildren == 1)) // the tree shrinks
+	{ N = M->root;
+	  M->root = (multiNode)N->child[0];
+	  poolFree(M->nodes,N);
+	}
+     compact(M);
+   }
+
+	// sets value for column c at i below N, returns difference in 1s
+
+static int writeBit (multiBV M, multiNode N, uint c, uint64_t i, uint v)
+
+   { uint j = 0;
+     int dif;
+     while (i >= N->size[j]) i -= N->size[j++];
+     if (N->isLeaf) dif = leafWrite(((leafBV*)N->child[j])[c],i,v);
+     else dif = writeBit(M,(multiNode)N->child[j],c,i,v);
+     N->ones[j*M->k+c] += dif;
+     return dif;
+   }
+
+	// sets value for column c at i = (v != 0), assumes c and i are right
+	// returns difference in 1s
+
+int multiWrite (multiBV M, uint c, uint64_t i, uint v)
+
+   { int dif = writeBit(M,M->root,c,i,v != 0);
+     M->ones[c] += dif;
+     return dif;
+   }
+
+	// gives the leaf of M holding row i, and the row within it
+
+static leafBV *findLeaf (multiBV M, uint64_t *i)
+
+   { multiNode N = M->root;
+     uint j;
+     while (1)
+	{ j = 0;
+	  while (*i >= N->size[j]) *i -= N->size[j++];
+	  if (N->isLeaf) return (leafBV*)N->child[j];
+	  N = (multiNode)N->child[j];
+	}
+   }
+
+	// access column c at i, assumes c and i are right
+
+uint multiAccess (multiBV M, uint c, uint64_t i)
+
+   { leafBV *L = findLeaf(M,&i);
+     return leafAccess(L[c],i);
+   }
+
+	// reads the i-th row of all the columns onto row, assumes i is right
+
+void multiAccessRow (multiBV M, uint64_t i, uint64_t *row)
+
+   { leafBV *L = findLeaf(M,&i);
+     uint c;
+     memset(row,0,((M->k+w-1)/w)*sizeof(uint64_t));
+     for (c=0;c<M->k;c++)
+	 row[c/w] |= ((uint64_t)leafAccess(L[c],i)) << (c%w);
+   }
+
+	// computes rank_1 of column c at i, zero-based, assumes c and i are
+	// right
+
+uint64_t multiRank (multiBV M, uint c, uint64_t i)
+
+   { multiNode N = M->root;
+     uint64_t ones = 0;
+     uint j;
+     while (1)
+	{ j = 0;
+	  while (i >= N->size[j]) 
+	     { ones += N->ones[j*M->k+c];
+	       i -= N->size[j++];
+	     }
+	  if (N->isLeaf) return ones + leafRank(((leafBV*)N->child[j])[c],i);
+	  N = (multiNode)N->child[j];
+	}
+   }
+
+	// computes rank_0 of column c at i, zero-based, assumes c and i are
+	// right
+
+uint64_t multiRank0 (multiBV M, uint c, uint64_t i)
+
+   { return i+1 - multiRank(M,c,i);
+   }
+
+	// computes select_1 of column c for j, zero-based, assumes c and j
+	// are right
+
+uint64_t multiSelect (multiBV M, uint c, uint64_t j)
+
+   { multiNode N = M->root;
+     uint64_t pos = 0;
+     uint t;
+     while (1)
+	{ t = 0;
+	  while (j > N->ones[t*M->k+c]) 
+	     { j -= N->ones[t*M->k+c];
+	       pos += N->size[t++];
+	     }
+	  if (N->isLeaf) return pos + leafSelect(((leafBV*)N->child[t])[c],j);
+	  N = (multiNode)N->child[t];
+	}
+   }
+
+	// computes select_0 of column c for j, zero-based, assumes c and j
+	// are right
+
+uint64_t multiSelect0 (multiBV M, uint c, uint64_t j)
+
+   { multiNode N = M->root;
+     uint64_t pos = 0;
+     uint t;
+     while (1)
+	{ t = 0;
+	  while (j > N->size[t] - N->ones[t*M->k+c]) 
+	     { j -= N->size[t] - N->ones[t*M->k+c];
+	       pos += N->size[t++];
+	     }
+	  if (N->isLeaf) return pos + leafSelect0(((leafBV*)N->child[t])[c],j);
+	  N = (multiNode)N->child[t];
+	}
+   }
+
+	// computes next_1 (next_0 if flip) of column c from i below N
+	// skips the children with no 1s (0s) in column c
+
+static int64_t next (multiBV M, multiNode N, uint c, uint64_t i, uint flip)
+
+   { uint64_t pos = 0;
+     uint64_t ones;
+     int64_t ans;
+     uint j = 0;
+     while (i >= N->size[j]) 
+	{ i -= N->size[j];
+	  pos += N->size[j++];
+	}
+     for (;j<N->nchildren;j++)
+	{ ones = N->ones[j*M->k+c];
+	  if (flip ? (ones < N->size[j]) : (ones > 0))
+	     { if (!N->isLeaf) ans = next(M,(multiNode)N->child[j],c,i,flip);
+	       else if (flip) ans = leafNext0(((leafBV*)N->child[j])[c],i);
+	       else ans = leafNext(((leafBV*)N->child[j])[c],i);
+	       if (ans != -1) return pos + ans;
+	     }
+	  pos += N->size[j];
+	  i = 0;
+	}
+     return -1;
+   }
+
+        // computes next_1 of column c from i, zero-based and including i
+        // returns -1 if no answer
+
+int64_t multiNext (multiBV M, uint c, uint64_t i)
+
+   { return next(M,M->root,c,i,0);
+   }
+
+        // computes next_0 of column c from i, zero-based and including i
+        // returns -1 if no answer
+
+int64_t multiNext0 (multiBV M, uint c, uint64_t i)
+
+   { return next(M,M->root,c,i,1);
+   }
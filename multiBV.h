@@ -0,0 +1,135 @@
+
+/*
+
+HybridBV -- an implementation of adaptive dynamic bitvectors. 
+Copyright (C) 2024-current_year Gonzalo Navarro
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+Author's contact: Gonzalo Navarro, Dept. of Computer Science, University of
+Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
+
+*/
+
+#ifndef INCLUDEDmultiBV
+#define INCLUDEDmultiBV
+
+	// supports families of k dynamic bitvectors of the same length up to
+	// 2^64-1, the columns, whose rows are inserted and deleted together
+
+#include "leafBV.h"
+#include "pool.h"
+
+#define MultiFanout 16 // max children of an internal node
+
+	// the columns share a single B+-tree of lengths. each node keeps the
+	// length of each child, the same for all the columns, and the 1s of
+	// each column in each child. each leaf is an array of k leafBVs of
+	// the same length, one per column
+typedef struct s_multiNode *multiNode;
+
+typedef struct s_multiNode
+   { uint nchildren;
+     uint isLeaf; // its children are leaves
+     uint64_t size[MultiFanout]; // length of the children
+     void *child[MultiFanout]; // multiNodes, or leaves if isLeaf
+     uint64_t ones[]; // 1s of column c in child j at ones[j*k+c]
+   } *multiNode;
+
+typedef struct s_multiBV
+   { uint k; // number of columns
+     uint64_t size; // length of the columns
+     uint64_t *ones; // 1s of each column
+     multiNode root;
+     pool nodes; // s_multiNode with their k*MultiFanout counters
+     pool leaves; // arrays of k leafBVs
+     leafPools cols; // leafBVs of the columns
+     uint64_t nleaves; // number of leaves
+     uint64_t reshapes; // leaf splits and merges since the pools were
+			// last compacted
+     uint64_t *row; // room for a row of k bits
+   } *multiBV;
+
+	// rows are given and returned as arrays of (k+w-1)/w words, where
+	// the bit of column c is (row[c/w] >> (c%w)) & 1
+
+	// creates an empty multiBV of k columns
+multiBV multiCreate (uint k);
+
+	// destroys M
+void multiDestroy (multiBV M);
+
+	// writes M to file, which must be opened for writing
+void multiSave (multiBV M, FILE *file);
+
+	// loads multiBV from file, which must be opened for reading
+multiBV multiLoad (FILE *file);
+
+	// gives space of M in w-bit words
+uint64_t multiSpace (multiBV M);
+
+	// gives the number of columns
+extern inline uint multiColumns (multiBV M);
+
+	// gives the length of the columns
+extern inline uint64_t multiLength (multiBV M);
+
+	// gives the number of 1s of column c
+extern inline uint64_t multiOnes (multiBV M, uint c);
+
+	// inserts row at position i of all the columns, assumes i is right
+void multiInsert (multiBV M, uint64_t i, uint64_t *row);
+
+	// deletes the i-th row of all the columns, assumes i is right
+	// writes it onto row, unless row is NULL
+void multiDelete (multiBV M, uint64_t i, uint64_t *row);
+
+	// sets value for column c at i = (v != 0), assumes c and i are right
+	// returns difference in 1s
+int multiWrite (multiBV M, uint c, uint64_t i, uint v);
+
+	// access column c at i, assumes c and i are right
+uint multiAccess (multiBV M, uint c, uint64_t i);
+
+	// reads the i-th row of all the columns onto row, assumes i is right
+void multiAccessRow (multiBV M, uint64_t i, uint64_t *row);
+
+	// computes rank_1 of column c at i, zero-based, assumes c and i are
+	// right
+uint64_t multiRank (multiBV M, uint c, uint64_t i);
+
+	// computes rank_0 of column c at i, zero-based, assumes c and i are
+	// right
+uint64_t multiRank0 (multiBV M, uint c, uint64_t i);
+
+	// computes select_1 of column c for j, zero-based, assumes c and j
+	// are right
+uint64_t multiSelect (multiBV M, uint c, uint64_t j);
+
+	// computes select_0 of column c for j, zero-based, assumes c and j
+	// are right
+uint64_t multiSelect0 (multiBV M, uint c, uint64_t j);
+
+        // computes next_1 of column c from i, zero-based and including i
+        // returns -1 if no answer
+
+int64_t multiNext (multiBV M, uint c, uint64_t i);
+
+        // computes next_0 of column c from i, zero-based and including i
+        // returns -1 if no answer
+
+int64_t multiNext0 (multiBV M, uint c, uint64_t i);
+
+#endif
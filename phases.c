@@ -0,0 +1,76 @@
+
+#include "hybridBV.h"
+#include <time.h>
+#include <sys/times.h>
+#include <unistd.h>
+
+uint64_t rnd (uint64_t m)
+
+   { uint64_t r = rand();
+     return r % m;
+   }
+
+	// fractions of updates of the successive phases
+static float Phases[] = { 0.3, 0.00001, 0.05, 0.001, 0.3 };
+#define NPhases (sizeof(Phases)/sizeof(float))
+
+void main (int argc, char **argv)
+
+   { hybridBV B;
+     uint64_t n,m,i;
+     uint64_t *data;
+     struct tms t1,t2;
+     float alphaUpd,total;
+     int p,adaptive;
+
+     if (argc < 3)
+        { fprintf(stderr,"Usage: %s <log_2 n> <alpha> [<factor>|a]\n"
+          "Creates a bitvector of length n and applies alpha*n ops on it in\n"
+          "each of several phases, where a fraction 1/q of them, different\n"
+          "in each phase, are indels (50/50 in probability) and the others\n"
+          "are accesses, all at random positions.\n"
+          "Nodes containing t bits are flattened after receiving factor*t queries.\n"
+          "With \"a\" instead of factor, the bitvector chooses factor by itself\n"
+          "from the 1/q it observes.\n",
+                  argv[0]);
+          exit(1);
+        }
+
+     srand(time(NULL));
+
+     n = (((uint64_t)1) << atoi(argv[1]));
+     m = n * atoi(argv[2]);
+     adaptive = (argc > 3) && !strcmp(argv[3],"a");
+     if ((argc > 3) && !adaptive) Theta = atof(argv[3]);
+
+     data = (uint64_t*)myalloc(n/8);
+     for (i=0;i<n/w;i++)
+         data[i] = rand() | (((uint64_t)rand()) << 32);
+
+     B = hybridCreateFrom(data,n,NULL);
+     if (adaptive) hybridSetAdaptiveTheta(B,1);
+
+     total = 0;
+     for (p=0;p<NPhases;p++)
+        { alphaUpd = Phases[p];
+          times(&t1);
+          for (i=0;i<m;i++)
+	     { if (rnd(1000000000) < alphaUpd * 1000000000)
+                  { if (rnd(2)==0) hybridInsert(B,rnd(++n),rnd(2));
+                    else hybridDelete(B,rnd(n--));
+                  }
+               else hybridAccess(B,rnd(n));
+             }
+          times(&t2);
+          total += (t2.tms_utime-t1.tms_utime)/(float)sysconf(_SC_CLK_TCK);
+          printf("Phase %i, 1/q = %f: %f microseconds per operation",p+1,alphaUpd,
+	     (t2.tms_utime-t1.tms_utime)/(float)sysconf(_SC_CLK_TCK)*1000000/(float)m);
+          if (adaptive) printf(", theta = %f",B->theta);
+          printf("\n");
+        }
+     printf("Time per operation in microseconds: %f\n",
+	     total*1000000/(float)(m*NPhases));
+
+     hybridDestroy(B);
+     exit(0);
+   }
@@ -0,0 +1,234 @@
+
+/*
+
+HybridBV -- an implementation of adaptive dynamic bitvectors. 
+Copyright (C) 2024-current_year Gonzalo Navarro
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+Author's contact: Gonzalo Navarro, Dept. of Computer Science, University of
+Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
+
+*/
+
+#include "pool.h"
+
+static const uint SlabBytes = 16384; // target size of the largest slabs
+
+	// bytes of a slab used for its link, its number of objects, and for
+	// aligning its objects, as malloc gives at least 8-aligned memory
+
+static inline uint slabExtra (pool P)
+
+   { return sizeof(void*) + sizeof(uint64_t) + P->align - sizeof(uint64_t);
+   }
+
+	// number of objects in a slab
+
+static inline uint64_t *slabCount (byte *slab)
+
+   { return (uint64_t*)(slab + sizeof(void*));
+   }
+
+	// creates an empty pool of objects of size bytes, aligned to align
+	// bytes, a power of 2 that is at least 8
+
+pool poolCreateAligned (uint size, uint align)
+
+   { pool P = (pool)myalloc(sizeof(struct s_pool));
+     P->align = align;
+     P->size = ((size+align-1)/align)*align;
+     P->perSlab = max(1,(SlabBytes-slabExtra(P))/P->size);
+     P->free = NULL;
+     P->slabs = NULL;
+     P->nslabs = 0;
+     P->nobjs = 0;
+     P->used = 0;
+     P->kept = 0;
+     P->freed = 0;
+     return P;
+   }
+
+	// creates an empty pool of objects of size bytes
+
+pool poolCreate (uint size)
+
+   { return poolCreateAligned(size,sizeof(uint64_t));
+   }
+
+	// frees all the slabs of P
+
+static void freeSlabs (pool P)
+
+   { void *slab,*next;
+     slab = P->slabs;
+     while (slab != NULL)
+	{ next = *(void**)slab;
+	  myfree(slab);
+	  slab = next;
+	}
+     P->slabs = NULL;
+     P->free = NULL;
+     P->nslabs = 0;
+     P->nobjs = 0;
+     P->kept = 0;
+     P->freed = 0;
+   }
+
+	// destroys P, releasing at once all the objects taken from it
+
+void poolDestroy (pool P)
+
+   { freeSlabs(P);
+     myfree(P);
+   }
+
+	// first object of a slab
+
+static inline byte *slabObjects (pool P, byte *slab)
+
+   { byte *o = slab + sizeof(void*) + sizeof(uint64_t);
+     return o + ((P->align - ((uintptr_t)o & (P->align-1))) & (P->align-1));
+   }
+
+	// allocates a new slab and puts its objects in the free list. it holds
+	// a quarter of the objects allocated so far, at least 1 and at most 
+	// perSlab
+
+static void newSlab (pool P)
+
+   { byte *slab,*o;
+     uint k,n;
+     n = min(P->perSlab,max(1,P->nobjs/4));
+     slab = (byte*)myalloc(slabExtra(P)+n*P->size);
+     *(void**)slab = P->slabs;
+     *slabCount(slab) = n;
+     P->slabs = slab;
+     P->nslabs++;
+     P->nobjs += n;
+     o = slabObjects(P,slab) + n*P->size;
+     for (k=0;k<n;k++)
+	{ o -= P->size;
+	  *(void**)o = P->free;
+	  P->free = o;
+	}
+   }
+
+	// gets an object from P
+
+void *poolAlloc (pool P)
+
+   { void *o;
+     if (P->free == NULL) newSlab(P);
+     o = P->free;
+     P->free = *(void**)o;
+     P->used++;
+     return o;
+   }
+
+	// returns object o to P
+
+void poolFree (pool P, void *o)
+
+   { *(void**)o = P->free;
+     P->free = o;
+     P->used--;
+     P->freed++;
+   }
+
+
+	// compares two addresses, for qsort
+
+static int addrCmp (const void *a, const void *b)
+
+   { uintptr_t x = (uintptr_t)*(void**)a;
+     uintptr_t y = (uintptr_t)*(void**)b;
+     return (x > y) - (x < y);
+   }
+
+	// releases the slabs of P where all the objects are free. this takes
+	// time O(f log f) for f free objects, so it is for occasional use
+
+void poolCompact (pool P)
+
+   { void **objs,**slabs,*o;
+     uint64_t nfree,nslabs,i,j,k,s,n;
+     byte *end;
+     nfree = P->nobjs - P->used;
+     P->freed = 0;
+     if (nfree == 0) { P->kept = 0; return; } // no slab can be all free
+     if (P->used == 0) { freeSlabs(P); return; }
+     objs = (void**)myalloc(nfree*sizeof(void*));
+     i = 0;
+     for (o=P->free;o!=NULL;o=*(void**)o) objs[i++] = o;
+     qsort(objs,nfree,sizeof(void*),addrCmp);
+     nslabs = P->nslabs;
+     slabs = (void**)myalloc(nslabs*sizeof(void*));
+     i = 0;
+     for (o=P->slabs;o!=NULL;o=*(void**)o) slabs[i++] = o;
+     qsort(slabs,nslabs,sizeof(void*),addrCmp);
+     P->free = NULL;
+     P->slabs = NULL;
+     j = 0;
+     for (s=0;s<nslabs;s++)
+	{ n = *slabCount((byte*)slabs[s]);
+	  end = slabObjects(P,(byte*)slabs[s]) + n*P->size;
+	  k = j; // free objects k..j-1 are those of this slab
+	  while ((j < nfree) && ((byte*)objs[j] < end)) j++;
+	  if (j-k == n) 
+	     { myfree(slabs[s]);
+	       P->nslabs--;
+	       P->nobjs -= n;
+	     }
+	  else 
+	     { *(void**)slabs[s] = P->slabs;
+	       P->slabs = slabs[s];
+	       for (i=k;i<j;i++)
+		  { *(void**)objs[i] = P->free;
+		    P->free = objs[i];
+		  }
+	     }
+	}
+     myfree(objs);
+     myfree(slabs);
+     P->kept = P->nobjs - P->used;
+   }
+
+	// releases the slabs of P where all the objects are free, once as
+	// many objects as a slab and as those left free by the last compaction
+	// have been returned, so the compaction time is amortized on them.
+	// all the slabs go at once if none is in use
+
+void poolTrim (pool P)
+
+   { if (P->used == 0) { freeSlabs(P); return; }
+     if (P->freed < max(P->kept,P->perSlab)) return;
+     poolCompact(P);
+   }
+
+	// gives space allocated by P in w-bit words
+
+uint64_t poolSpace (pool P)
+
+   { return (sizeof(struct s_pool)*8+w-1)/w + 
+	    ((P->nslabs*slabExtra(P)+P->nobjs*P->size)*8+w-1)/w;
+   }
+
+	// gives space allocated by P and not in use, in w-bit words
+
+uint64_t poolOverhead (pool P)
+
+   { return poolSpace(P) - (P->used*P->size*8+w-1)/w;
+   }
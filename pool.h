@@ -0,0 +1,83 @@
+
+/*
+
+HybridBV -- an implementation of adaptive dynamic bitvectors. 
+Copyright (C) 2024-current_year Gonzalo Navarro
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+Author's contact: Gonzalo Navarro, Dept. of Computer Science, University of
+Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
+
+*/
+
+#ifndef INCLUDEDpool
+#define INCLUDEDpool
+
+	// slab allocator of fixed-size objects. objects are carved from slabs
+	// and recycled through a free list, so creating and destroying
+	// nodes and leaves does not call malloc/free nor fragments the heap.
+	// the first slab holds a single object and each new one holds a
+	// quarter of the objects allocated so far, up to about SlabBytes, so
+	// small structures do not pay for large slabs nor for many unused objects
+
+#include "basics.h"
+
+typedef struct s_pool
+   { uint size; // bytes per object, multiple of align
+     uint align; // objects start at multiples of align bytes
+     uint perSlab; // max objects per slab
+     void *free; // free objects, linked through their first word
+     void *slabs; // slabs, linked through their first word
+     uint64_t nslabs; // slabs allocated
+     uint64_t nobjs; // objects in all the slabs
+     uint64_t used; // objects given and not returned
+     uint64_t kept; // free objects left in used slabs by the last compaction
+     uint64_t freed; // objects returned since the last compaction
+   } *pool;
+
+	// creates an empty pool of objects of size bytes
+pool poolCreate (uint size);
+
+	// same, with objects aligned to align bytes, a power of 2 that is
+	// at least 8 (eg 64 to start them at cache lines)
+pool poolCreateAligned (uint size, uint align);
+
+	// destroys P, releasing at once all the objects taken from it
+void poolDestroy (pool P);
+
+	// gets an object from P
+void *poolAlloc (pool P);
+
+	// returns object o to P
+void poolFree (pool P, void *o);
+
+	// releases the slabs of P where all the objects are free, once as
+	// many objects as a slab and as those left free by the last compaction
+	// have been returned, so it takes amortized O(log f) time per object
+	// returned. all the slabs are released at once if none is in use
+void poolTrim (pool P);
+
+	// releases the slabs of P where all the objects are free. this takes
+	// time O(f log f) for f free objects, so it is for occasional use
+void poolCompact (pool P);
+
+	// gives space allocated by P in w-bit words
+uint64_t poolSpace (pool P);
+
+	// gives space allocated by P and not in use, in w-bit words
+uint64_t poolOverhead (pool P);
+
+#endif
@@ -43,7 +43,7 @@ void main (int argc, char **argv)
 
      times(&t1);
 
-     B = hybridCreateFrom(data,n);
+     B = hybridCreateFrom(data,n,NULL);
 
      for (i=0;i<m;i++)
 	{ if (rnd(1000000000) < alphaUpd * 1000000000)
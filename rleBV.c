@@ -0,0 +1,321 @@
+
+/*
+
+HybridBV -- an implementation of adaptive dynamic bitvectors. 
+Copyright (C) 2024-current_year Gonzalo Navarro
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+Author's contact: Gonzalo Navarro, Dept. of Computer Science, University of
+Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
+
+*/
+
+#include "rleBV.h"
+
+        // trick for lowest 1 in a 64-bit word, as in staticBV.c
+static int decodeLow[64] = {
+       0, 1,56, 2,57,49,28, 3,61,58,42,50,38,29,17, 4,
+      62,47,59,36,45,43,51,22,53,39,33,30,24,18,12, 5,
+      63,55,48,27,60,41,37,16,46,35,44,21,52,32,23,11,
+      54,26,40,15,34,20,31,10,25,14,19, 9,13, 8, 7, 6 };
+
+static inline uint lowest (uint64_t x)
+
+   { return decodeLow[(0x03f79d71b4ca8b09 * (x & -x))>>58];
+   }
+
+	// bit of the kth run of B
+
+static inline uint runBit (rleBV B, uint k)
+
+   { return B->first ^ (k & 1);
+   }
+
+	// finds the run of B holding position i, i < size, giving its 
+	// start in *s
+
+static inline uint findRun (rleBV B, uint i, uint *s)
+
+   { uint k = 0;
+     *s = 0;
+     while (*s + B->run[k] <= i) *s += B->run[k++];
+     return k;
+   }
+
+	// first position from p, p < n, where the n bits of data are not b,
+	// n if none
+
+static uint nextChange (uint64_t *data, uint n, uint p, uint b)
+
+   { uint64_t x;
+     uint k = p/w;
+     x = (b ? ~data[k] : data[k]) & ((~(uint64_t)0) << (p%w));
+     while (!x) 
+	{ if (++k >= (n+w-1)/w) return n;
+	  x = b ? ~data[k] : data[k];
+	}
+     return min(n,k*w + lowest(x));
+   }
+
+	// gives the number of runs of the n bits of data, or a number over
+	// max if there are more than max
+
+uint rleCountRuns (uint64_t *data, uint n, uint max)
+
+   { uint p = 0;
+     uint runs = 0;
+     while ((p < n) && (runs <= max))
+	{ p = nextChange(data,n,p,(data[p/w] >> (p%w)) & 1);
+	  runs++;
+	}
+     return runs;
+   }
+
+	// converts a bit array of at most MaxRuns runs into a rleBV of n
+	// bits, taken from P. data is not freed
+
+rleBV rleCreateFrom (uint64_t *data, uint n, pool P)
+
+   { rleBV B = (rleBV)poolAlloc(P);
+     uint p,q,b;
+     B->size = n;
+     B->ones = 0;
+     B->nruns = 0;
+     B->first = n ? data[0] & 1 : 0;
+     p = 0;
+     while (p < n)
+	{ b = (data[p/w] >> (p%w)) & 1;
+	  q = nextChange(data,n,p,b);
+	  B->run[B->nruns++] = q-p;
+	  if (b) B->ones += q-p;
+	  p = q;
+	}
+     return B;
+   }
+
+	// destroys B, returning it to P
+
+void rleDestroy (rleBV B, pool P)
+
+   { poolFree(P,B);
+   }
+
+	// gives space of B in w-bit words
+
+uint rleSpace (rleBV B)
+
+   { return (sizeof(struct s_rleBV)+sizeof(uint64_t)-1) / sizeof(uint64_t);
+   }
+
+	// gives bit length
+
+extern inline uint rleLength (rleBV B)
+
+   { return B->size;
+   }
+
+	// gives number of 1s
+
+extern inline uint rleOnes (rleBV B)
+
+   { return B->ones;
+   }
+
+	// gives number of runs
+
+extern inline uint rleRuns (rleBV B)
+
+   { return B->nruns;
+   }
+
+	// opens room for c runs at position k of B
+
+static inline void openRuns (rleBV B, uint k, uint c)
+
+   { memmove(B->run+k+c,B->run+k,(B->nruns-k)*sizeof(uint));
+     B->nruns += c;
+   }
+
+	// removes run k of B, which is empty, merging its neighbors
+
+static void closeRun (rleBV B, uint k)
+
+   { if ((k > 0) && (k+1 < B->nruns)) // merge k-1 and k+1
+	{ B->run[k-1] += B->run[k+1];
+	  memmove(B->run+k,B->run+k+2,(B->nruns-k-2)*sizeof(uint));
+	  B->nruns -= 2;
+	  return;
+	}
+     if (k == 0) B->first ^= 1; // the second run becomes the first
+     memmove(B->run+k,B->run+k+1,(B->nruns-k-1)*sizeof(uint));
+     B->nruns--;
+   }
+
+       // sets value for B[i]= (v != 0), assumes i is right and that B 
+	// has at most MaxRuns runs. returns difference in 1s
+
+int rleWrite (rleBV B, uint i, uint v)
+
+   { v = (v != 0);
+     if (rleAccess(B,i) == v) return 0;
+     rleDelete(B,i);
+     rleInsert(B,i,v);
+     return v ? 1 : -1;
+   }
+
+        // inserts v at B[i], assumes i is right and that B has at most
+	// MaxRuns runs
+
+void rleInsert (rleBV B, uint i, uint v)
+
+   { uint k,s;
+     v = (v != 0);
+     B->size++;
+     B->ones += v;
+     if (B->nruns == 0) 
+	{ B->first = v;
+	  B->run[B->nruns++] = 1;
+	  return;
+	}
+     if (i == B->size-1) // append after the last run
+	{ k = B->nruns-1;
+	  if (runBit(B,k) == v) B->run[k]++;
+	  else { B->run[B->nruns++] = 1; }
+	  return;
+	}
+     k = findRun(B,i,&s);
+     if (runBit(B,k) == v) B->run[k]++;
+     else if ((i == s) && (k > 0)) B->run[k-1]++; // run k-1 has bit v
+     else if (i == s) // new first run
+	{ openRuns(B,0,1);
+	  B->run[0] = 1;
+	  B->first = v;
+	}
+     else // cut run k in two around the new bit
+	{ openRuns(B,k+1,2);
+	  B->run[k+2] = B->run[k] - (i-s);
+	  B->run[k+1] = 1;
+	  B->run[k] = i-s;
+	}
+   }
+
+        // deletes B[i], assumes i is right
+        // returns difference in 1s
+
+int rleDelete (rleBV B, uint i)
+
+   { uint k,s,v;
+     k = findRun(B,i,&s);
+     v = runBit(B,k);
+     B->size--;
+     B->ones -= v;
+     if (--B->run[k] == 0) closeRun(B,k);
+     return - (int)v;
+   }
+
+	// access B[i], assumes i is right
+
+uint rleAccess (rleBV B, uint i)
+
+   { uint s;
+     return runBit(B,findRun(B,i,&s));
+   }
+
+        // read bits [i..i+l-1], onto D[j...]
+
+void rleRead (rleBV B, uint i, uint l, uint64_t *D, uint64_t j)
+
+   { uint64_t fill[2][16];
+     uint k,s,len,chunk;
+     if (l == 0) return;
+     memset(fill[0],0,sizeof(fill[0]));
+     memset(fill[1],0xff,sizeof(fill[1]));
+     k = findRun(B,i,&s);
+     while (l)
+	{ len = min(l,s+B->run[k]-i); // what remains of run k
+	  l -= len; i += len;
+	  while (len)
+	     { chunk = min(len,16*w);
+	       copyBits(D,j,fill[runBit(B,k)],0,chunk);
+	       j += chunk; len -= chunk;
+	     }
+	  s += B->run[k++];
+	}
+   }
+
+	// computes rank(B,i), zero-based, assumes i is right
+
+uint rleRank (rleBV B, uint i)
+
+   { uint k,s,ones;
+     k = s = ones = 0;
+     while (s + B->run[k] <= i) 
+	{ if (runBit(B,k)) ones += B->run[k];
+	  s += B->run[k++];
+	}
+     if (runBit(B,k)) ones += i-s+1;
+     return ones;
+   }
+
+        // computes select_1(B,j), zero-based, assumes j is right
+
+uint rleSelect (rleBV B, uint j)
+
+   { uint k,s;
+     k = s = 0;
+     while (!runBit(B,k) || (B->run[k] < j))
+	{ if (runBit(B,k)) j -= B->run[k];
+	  s += B->run[k++];
+	}
+     return s+j-1;
+   }
+
+        // computes select_0(B,j), zero-based, assumes j is right
+
+uint rleSelect0 (rleBV B, uint j)
+
+   { uint k,s;
+     k = s = 0;
+     while (runBit(B,k) || (B->run[k] < j))
+	{ if (!runBit(B,k)) j -= B->run[k];
+	  s += B->run[k++];
+	}
+     return s+j-1;
+   }
+
+        // computes next_1(B,i), zero-based and including i
+        // returns -1 if no answer
+
+int rleNext (rleBV B, uint i)
+
+   { uint k,s;
+     k = findRun(B,i,&s);
+     if (runBit(B,k)) return i;
+     if (k+1 < B->nruns) return s+B->run[k];
+     return -1;
+   }
+
+        // computes next_0(B,i), zero-based and including i
+        // returns -1 if no answer
+
+int rleNext0 (rleBV B, uint i)
+
+   { uint k,s;
+     k = findRun(B,i,&s);
+     if (!runBit(B,k)) return i;
+     if (k+1 < B->nruns) return s+B->run[k];
+     return -1;
+   }
@@ -0,0 +1,107 @@
+
+/*
+
+HybridBV -- an implementation of adaptive dynamic bitvectors. 
+Copyright (C) 2024-current_year Gonzalo Navarro
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+Author's contact: Gonzalo Navarro, Dept. of Computer Science, University of
+Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
+
+*/
+
+#ifndef INCLUDEDrleBV
+#define INCLUDEDrleBV
+
+	// supports leaf bitvectors of size up to 2^32-1 made of a few runs 
+	// of equal bits, stored as the lengths of the runs
+
+#include "basics.h"
+#include "pool.h"
+
+#define MaxRuns 24 // max runs of a leaf, more must be stored as plain bits
+
+	// the runs alternate 0s and 1s, so only the bit of the first is 
+	// kept. an update adds at most 2 runs, so there is room for them
+typedef struct s_rleBV
+   { uint size; // bits represented
+     uint ones; // # 1s
+     uint nruns; // number of runs, 0 if size is 0
+     uint first; // bit of the first run
+     uint run[MaxRuns+2]; // lengths of the runs
+   } *rleBV;
+
+	// gives the number of runs of the n bits of data, or a number over
+	// max if there are more than max
+uint rleCountRuns (uint64_t *data, uint n, uint max);
+
+	// converts a bit array of at most MaxRuns runs into a rleBV of n
+	// bits, taken from P. data is not freed
+rleBV rleCreateFrom (uint64_t *data, uint n, pool P);
+
+	// destroys B, returning it to P
+void rleDestroy (rleBV B, pool P);
+
+	// gives space of B in w-bit words
+uint rleSpace (rleBV B);
+
+	// gives bit length
+extern inline uint rleLength (rleBV B);
+
+	// gives number of 1s
+extern inline uint rleOnes (rleBV B);
+
+	// gives number of runs, the updates can leave more than MaxRuns
+extern inline uint rleRuns (rleBV B);
+
+       // sets value for B[i]= (v != 0), assumes i is right and that B 
+	// has at most MaxRuns runs. returns difference in 1s
+int rleWrite (rleBV B, uint i, uint v);
+
+        // inserts v at B[i], assumes i is right and that B has at most
+	// MaxRuns runs
+void rleInsert (rleBV B, uint i, uint v);
+
+        // deletes B[i], assumes i is right
+        // returns difference in 1s
+int rleDelete (rleBV B, uint i);
+
+	// access B[i], assumes i is right
+uint rleAccess (rleBV B, uint i);
+
+        // read bits [i..i+l-1], onto D[j...]
+void rleRead (rleBV B, uint i, uint l, uint64_t *D, uint64_t j);
+
+	// computes rank_1(B,i), zero-based, assumes i is right
+uint rleRank (rleBV B, uint i);
+
+	// computes select_1(B,j), zero-based, assumes j is right
+uint rleSelect (rleBV B, uint j);
+
+	// computes select_0(B,j), zero-based, assumes j is right
+uint rleSelect0 (rleBV B, uint j);
+
+        // computes next_1(B,i), zero-based and including i
+        // returns -1 if no answer
+
+int rleNext (rleBV B, uint i);
+
+        // computes next_0(B,i), zero-based and including i
+        // returns -1 if no answer
+
+int rleNext0 (rleBV B, uint i);
+
+#endif
@@ -0,0 +1,352 @@
+
+/*
+
+HybridBV -- an implementation of adaptive dynamic bitvectors. 
+Copyright (C) 2024-current_year Gonzalo Navarro
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+Author's contact: Gonzalo Navarro, Dept. of Computer Science, University of
+Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
+
+*/
+
+#include "rrrBV.h"
+
+#define T 63 // bits per block
+
+#define SR 32 // blocks per sample
+
+	// binomial coefficients, and bits of the offsets of each class
+
+static uint64_t Binom[T+1][T+1];
+static uint Blen[T+1];
+static int Init = 0;
+
+static void initTables (void)
+
+    { uint i,k;
+      if (Init) return;
+      for (i=0;i<=T;i++)
+	  { Binom[i][0] = 1;
+	    for (k=1;k<=i;k++) 
+		Binom[i][k] = Binom[i-1][k-1] + (k < i ? Binom[i-1][k] : 0);
+	  }
+      for (k=0;k<=T;k++)
+	  { Blen[k] = 0;
+	    while ((Blen[k] < T) && ((((uint64_t)1) << Blen[k]) < Binom[T][k])) 
+		Blen[k]++;
+	  }
+      Init = 1;
+    }
+
+        // trick for lowest 1 in a 64-bit word, as in staticBV.c
+static int decodeLow[64] = {
+       0, 1,56, 2,57,49,28, 3,61,58,42,50,38,29,17, 4,
+      62,47,59,36,45,43,51,22,53,39,33,30,24,18,12, 5,
+      63,55,48,27,60,41,37,16,46,35,44,21,52,32,23,11,
+      54,26,40,15,34,20,31,10,25,14,19, 9,13, 8, 7, 6 };
+
+static inline uint lowest (uint64_t x)
+
+    { return decodeLow[(0x03f79d71b4ca8b09 * (x & -x))>>58];
+    }
+
+	// reads l <= w bits of A from position p
+
+static inline uint64_t getBits (uint64_t *A, uint64_t p, uint l)
+
+    { uint64_t x;
+      if (l == 0) return 0;
+      x = A[p/w] >> (p%w);
+      if ((p%w)+l > w) x |= A[p/w+1] << (w-(p%w));
+      return l == w ? x : x & ((((uint64_t)1) << l) - 1);
+    }
+
+	// writes the l <= w bits of x onto A from position p, which are 0s
+
+static inline void putBits (uint64_t *A, uint64_t p, uint l, uint64_t x)
+
+    { if (l == 0) return;
+      A[p/w] |= x << (p%w);
+      if ((p%w)+l > w) A[p/w+1] |= x >> (w-(p%w));
+    }
+
+	// offset of block x among those with the same number of 1s, the
+	// sum of binom(p,k) for its kth 1 at position p
+
+static uint64_t encode (uint64_t x)
+
+    { uint64_t off = 0;
+      uint k = 0;
+      while (x)
+	 { k++;
+	   off += Binom[lowest(x)][k];
+	   x &= x-1;
+	 }
+      return off;
+    }
+
+	// block with c 1s and offset off
+
+static uint64_t decode (uint c, uint64_t off)
+
+    { uint64_t x = 0;
+      int p = T-1;
+      if (c == T) return (((uint64_t)1) << T) - 1;
+      for (;c>0;c--)
+	 { while (Binom[p][c] > off) p--;
+	   x |= ((uint64_t)1) << p;
+	   off -= Binom[p][c];
+	   p--;
+	 }
+      return x;
+    }
+
+	// bits in block b of B
+
+static inline uint blockLength (rrrBV B, uint64_t b)
+
+    { return b < B->nblocks-1 ? T : B->size - b*T;
+    }
+
+	// finds block b of B, giving its position in the offsets and the 
+	// 1s before it
+
+static inline void findBlock (rrrBV B, uint64_t b, uint64_t *pos, uint64_t *ones)
+
+    { uint64_t k = (b/SR)*SR;
+      *pos = B->spos[b/SR];
+      *ones = B->sones[b/SR];
+      for (;k<b;k++) 
+	  { *pos += Blen[B->classes[k]];
+	    *ones += B->classes[k];
+	  }
+    }
+
+	// bits of block b of B, at position pos of the offsets
+
+static inline uint64_t getBlock (rrrBV B, uint64_t b, uint64_t pos)
+
+    { uint c = B->classes[b];
+      return decode(c,getBits(B->offsets,pos,Blen[c]));
+    }
+
+	// converts a bit array into a compressed bitvector of n bits
+	// data is not freed
+
+rrrBV rrrCreateFrom (uint64_t *data, uint64_t n)
+
+    { rrrBV B;
+      uint64_t b,x,pos,ones;
+      uint c;
+      initTables();
+      B = (rrrBV)myalloc(sizeof(struct s_rrrBV));
+      B->size = n;
+      B->nblocks = (n+T-1)/T;
+      B->classes = (byte*)myalloc(B->nblocks);
+      B->sones = (uint64_t*)myalloc((B->nblocks/SR+1)*sizeof(uint64_t));
+      B->spos = (uint64_t*)myalloc((B->nblocks/SR+1)*sizeof(uint64_t));
+      pos = 0;
+      for (b=0;b<B->nblocks;b++)
+	  { B->classes[b] = popcount(getBits(data,b*T,blockLength(B,b)));
+	    pos += Blen[B->classes[b]];
+	  }
+      B->offsets = (uint64_t*)mycalloc(pos/w+2,sizeof(uint64_t));
+      pos = ones = 0;
+      for (b=0;b<B->nblocks;b++)
+	  { if (b % SR == 0) 
+	       { B->spos[b/SR] = pos;
+		 B->sones[b/SR] = ones;
+	       }
+	    c = B->classes[b];
+	    x = getBits(data,b*T,blockLength(B,b));
+	    putBits(B->offsets,pos,Blen[c],encode(x));
+	    pos += Blen[c];
+	    ones += c;
+	  }
+      B->ones = ones;
+      return B;
+    }
+
+	// gives the space in w-bit words that a compressed bitvector of n 
+	// bits with the given ones would use if they were evenly spread. 
+	// clustered 1s take less
+
+uint64_t rrrEstimate (uint64_t n, uint64_t ones)
+
+    { uint64_t nb = (n+T-1)/T;
+      initTables();
+      if (n == 0) return sizeof(struct s_rrrBV)*8/w;
+      return sizeof(struct s_rrrBV)*8/w + (nb+w/8-1)/(w/8) + 2*(nb/SR+1) +
+	     (nb*Blen[(ones*T+n/2)/n]+w-1)/w;
+    }
+
+	// destroys B
+
+void rrrDestroy (rrrBV B)
+
+    { if (B != NULL) 
+         { myfree(B->classes); myfree(B->offsets);
+	   myfree(B->sones); myfree(B->spos);
+      	   myfree(B);
+	 }
+    }
+
+	// rrrBV size in w-bit words
+
+uint64_t rrrSpace (rrrBV B)
+
+    { uint64_t space = sizeof(struct s_rrrBV)*8/w;
+      uint64_t pos,ones;
+      if (B == NULL) return 0;
+      if (B->nblocks == 0) return space;
+      findBlock(B,B->nblocks-1,&pos,&ones);
+      pos += Blen[B->classes[B->nblocks-1]];
+      return space + (B->nblocks+w/8-1)/(w/8) + 2*(B->nblocks/SR+1) + 
+	     pos/w+2;
+    }
+
+        // gives bit length
+
+extern inline uint64_t rrrLength (rrrBV B)
+
+    { return B->size;
+    }
+
+        // gives number of ones
+
+extern inline uint64_t rrrOnes (rrrBV B)
+
+    { return B->ones;
+    }
+
+	// access B[i], assumes i is right
+
+uint rrrAccess (rrrBV B, uint64_t i)
+
+    { uint64_t pos,ones;
+      findBlock(B,i/T,&pos,&ones);
+      return (getBlock(B,i/T,pos) >> (i%T)) & 1;
+    }
+
+        // read bits [i..i+l-1] onto D[j..], assumes it is right
+        
+void rrrRead (rrrBV B, uint64_t i, uint64_t l, uint64_t *D, uint64_t j)
+
+    { uint64_t b,pos,ones,len;
+      uint64_t x[2];
+      if (l == 0) return;
+      b = i/T;
+      findBlock(B,b,&pos,&ones);
+      x[1] = 0;
+      while (l)
+	 { x[0] = getBlock(B,b,pos);
+	   len = min(l,T-i%T);
+	   copyBits(D,j,x,i%T,len);
+	   pos += Blen[B->classes[b]];
+	   b++; i += len; j += len; l -= len;
+	 }
+    }
+
+	// computes rank(B,i), zero-based, assumes i is right
+
+uint64_t rrrRank (rrrBV B, uint64_t i)
+
+    { uint64_t pos,ones;
+      findBlock(B,i/T,&pos,&ones);
+      return ones + popcount(getBlock(B,i/T,pos) & 
+			     (((uint64_t)~0) >> (w-1-(i%T))));
+    }
+
+	// position of the jth 1 of x, j >= 1
+
+static inline uint selectWord (uint64_t x, uint j)
+
+    { while (--j) x &= x-1;
+      return lowest(x);
+    }
+
+        // computes select_1(B,j), zero-based, assumes j is right
+
+uint64_t rrrSelect (rrrBV B, uint64_t j)
+
+    { uint64_t s,d,m,b,pos,ones;
+	// binary search on the samples for the last one with < j 1s before
+      s = 0; d = (B->nblocks-1)/SR+1;
+      while (s+1 < d)
+	 { m = (s+d)/2;
+	   if (B->sones[m] < j) s = m; else d = m;
+	 }
+      b = s*SR; pos = B->spos[s]; ones = B->sones[s];
+      while (ones + B->classes[b] < j)
+	 { ones += B->classes[b];
+	   pos += Blen[B->classes[b]];
+	   b++;
+	 }
+      return b*T + selectWord(getBlock(B,b,pos),j-ones);
+    }
+
+        // computes select_0(B,j), zero-based, assumes j is right
+
+uint64_t rrrSelect0 (rrrBV B, uint64_t j)
+
+    { uint64_t s,d,m,b,pos,zeros;
+	// binary search on the samples for the last one with < j 0s before
+      s = 0; d = (B->nblocks-1)/SR+1;
+      while (s+1 < d)
+	 { m = (s+d)/2;
+	   if (m*SR*T - B->sones[m] < j) s = m; else d = m;
+	 }
+      b = s*SR; pos = B->spos[s]; zeros = b*T - B->sones[s];
+      while (zeros + blockLength(B,b) - B->classes[b] < j)
+	 { zeros += blockLength(B,b) - B->classes[b];
+	   pos += Blen[B->classes[b]];
+	   b++;
+	 }
+      return b*T + selectWord(~getBlock(B,b,pos),j-zeros);
+    }
+
+        // computes next_1(B,i), zero-based and including i
+        // returns -1 if no answer
+
+int64_t rrrNext (rrrBV B, uint64_t i)
+
+    { uint64_t b,pos,ones,x;
+      b = i/T;
+      findBlock(B,b,&pos,&ones);
+      x = getBlock(B,b,pos) & ((~(uint64_t)0) << (i%T));
+      if (x) return b*T + lowest(x);
+      ones += B->classes[b]; // 1s up to the end of the block
+      if (ones == B->ones) return -1;
+      return rrrSelect(B,ones+1);
+    }
+
+        // computes next_0(B,i), zero-based and including i
+        // returns -1 if no answer
+
+int64_t rrrNext0 (rrrBV B, uint64_t i)
+
+    { uint64_t b,pos,ones,x;
+      b = i/T;
+      findBlock(B,b,&pos,&ones);
+      x = ~getBlock(B,b,pos) & ((~(uint64_t)0) << (i%T)) & 
+	  ((((uint64_t)1) << blockLength(B,b)) - 1);
+      if (x) return b*T + lowest(x);
+      ones += B->classes[b]; // 0s up to the end of the block
+      if ((b+1)*T >= B->size) return -1;
+      if ((b+1)*T - ones == B->size - B->ones) return -1;
+      return rrrSelect0(B,(b+1)*T-ones+1);
+    }
@@ -0,0 +1,88 @@
+
+/*
+
+HybridBV -- an implementation of adaptive dynamic bitvectors. 
+Copyright (C) 2024-current_year Gonzalo Navarro
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+Author's contact: Gonzalo Navarro, Dept. of Computer Science, University of
+Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
+
+*/
+
+#ifndef INCLUDEDrrrBV
+#define INCLUDEDrrrBV
+
+	// supports static bitvectors of size up to 2^64-1 compressed to
+	// their zero-order entropy: the bits are cut in blocks of 63, each
+	// stored as its number of 1s (class) and its index among the blocks 
+	// of that class (offset)
+
+#include "basics.h"
+
+typedef struct s_rrrBV {
+    uint64_t size; // number of bits
+    uint64_t ones; // number of 1s
+    uint64_t nblocks; // number of blocks
+    byte *classes; // class of each block
+    uint64_t *offsets; // offsets of the blocks, using the bits their class needs
+    uint64_t *sones; // 1s before each sampled block
+    uint64_t *spos; // position in offsets of each sampled block
+    } *rrrBV;
+
+	// converts a bit array into a compressed bitvector of n bits
+	// data is not freed
+rrrBV rrrCreateFrom (uint64_t *data, uint64_t n);
+
+	// gives the space in w-bit words that a compressed bitvector of n 
+	// bits with the given ones would use if they were evenly spread. 
+	// clustered 1s take less
+uint64_t rrrEstimate (uint64_t n, uint64_t ones);
+
+	// destroys B
+void rrrDestroy (rrrBV B);
+
+	// gives space of bitvector in w-bit words
+uint64_t rrrSpace (rrrBV B);
+
+	// gives bit length
+extern inline uint64_t rrrLength (rrrBV B);
+
+	// gives number of ones
+extern inline uint64_t rrrOnes (rrrBV B);
+
+	// access B[i], assumes i is right
+uint rrrAccess (rrrBV B, uint64_t i);
+
+        // read bits [i..i+l-1], writes onto D[j..]
+void rrrRead (rrrBV B, uint64_t i, uint64_t l, uint64_t *D, uint64_t j);
+
+	// computes rank_1(B,i), zero-based, assumes i is right
+uint64_t rrrRank (rrrBV B, uint64_t i);
+
+	// computes select_1(B,j), zero-based, assumes j is right
+uint64_t rrrSelect (rrrBV B, uint64_t j);
+
+	// computes select_0(B,j), zero-based, assumes j is right
+uint64_t rrrSelect0 (rrrBV B, uint64_t j);
+
+	// computes next_1(B,i), zero-based, assumes i is right
+int64_t rrrNext (rrrBV B, uint64_t i);
+
+	// computes next_0(B,i), zero-based, assumes i is right
+int64_t rrrNext0 (rrrBV B, uint64_t i);
+
+#endif
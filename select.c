@@ -42,13 +42,13 @@ void main (int argc, char **argv)
          data[i] = rand() | (((uint64_t)rand()) << 32);
 
 /*
-     B = hybridCreate();
+     B = hybridCreate(NULL);
      for (i=0;i<n;i++) hybridInsert(B,i,rnd(2));
 */     
 
      times(&t1);
 
-     B = hybridCreateFrom(data,n);
+     B = hybridCreateFrom(data,n,NULL);
 
      for (i=0;i<m;i++)
 	{ if (rnd(1000000000) < alphaUpd * 1000000000)
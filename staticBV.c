@@ -29,34 +29,73 @@ Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
 
 #define w16 (8*sizeof(uint16_t)) // superblock length is 2^w16
 
-	// preprocesses for rank, with parameter K
+#define Unknown (~(uint64_t)0) // ones not counted yet
 
-static void staticPreprocess (staticBV B)
+static const float MinShared = 0.875; // a shared buffer whose staticBVs use
+			// less of its bits is copied to them and freed
 
-    { uint64_t i,n;
-      uint64_t sacc,acc;
-      uint64_t last,word;
+	// ones in P[0..p-1], for p a multiple of K*w up to its size
+
+static inline uint64_t rankBefore (staticBV P, uint64_t p)
+
+    { if (p == P->size) return P->ones;
+      return P->S[(P->off+p) >> w16] + P->B[p/(K*w)] - P->before;
+    }
+
+	// preprocesses for rank, with parameter K. the blocks that fall 
+	// inside the nparts static bitvectors parts[k], whose bits are at
+	// offs[k] of B (increasing and multiple of K*w), take their counts 
+	// from them instead of recounting their bits, if they have them
+
+static void staticPreprocess (staticBV B, staticBV *parts, uint64_t *offs,
+			      uint nparts)
+
+    { uint64_t i,j,n,nw;
+      uint64_t tot,start;
+      uint k;
       n = B->size;
       if (n == 0) return;
+      nw = (n+w-1)/w;
       B->B = (uint16_t*)myalloc(((n+K*w-1)/(K*w))*sizeof(uint16_t));
       B->S = (uint64_t*)myalloc(((n+(1<<w16)-1)/(1<<w16))*sizeof(uint64_t));
-      sacc = acc = 0;
-      i = 0;
-      while (i<(n+w-1)/w)
-          { uint64_t top = min((n+w-1)/w,i+(1<<w16)/w);
-            sacc += acc; acc = 0;
-            B->S[(i*w) >> w16] = sacc;
-            while (i<top)
-                { if (i%K == 0) B->B[i/K] = acc;
-                  acc += popcount(B->data[i]);
-                  i++;
-                }
+      tot = start = 0; // ones before word i, and before part k
+      k = 0;
+      for (i=0;i<nw;i+=K)
+          { if (((i*w) & ((1<<w16)-1)) == 0) B->S[(i*w) >> w16] = tot;
+	    B->B[i/K] = tot - B->S[(i*w) >> w16];
+	    while ((k < nparts) && (offs[k]+parts[k]->size <= i*w)) k++;
+	    if ((k < nparts) && (offs[k] <= i*w) && (offs[k] % (K*w) == 0)
+		&& ((i+K)*w <= offs[k]+parts[k]->size) && (parts[k]->B != NULL))
+	       { if (offs[k] == i*w) start = tot;
+	         tot = start + rankBefore(parts[k],(i+K)*w-offs[k]);
+	       }
+	    else for (j=i;j<min(nw,i+K);j++) tot += popcount(B->data[j]);
           }
       B->ones = staticRank(B,n-1);
     } 
 
+	// builds the counts of B if it does not have them yet
+
+static inline void staticDirs (staticBV B)
+
+    { if (B->B == NULL) staticPreprocess(B,NULL,NULL,0);
+    }
+
+	// counts the 1s of B, without using its counts
+
+static uint64_t countOnes (staticBV B)
+
+    { uint64_t i,ones;
+      ones = 0;
+      for (i=0;i<B->size/w;i++) ones += popcount(B->data[i]);
+      if (B->size % w) 
+	 ones += popcount(B->data[i] & ((((uint64_t)1) << (B->size % w)) - 1));
+      return ones;
+    }
+
 	// converts a bit array into a bitvector of n bits
-        // data is pointed to and will be freed 
+        // data is pointed to and will be freed. its 1s and counts are
+	// computed on the first operation that needs them
 
 staticBV staticCreateFrom (uint64_t *data, uint64_t n)
 
@@ -67,27 +106,170 @@ staticBV staticCreateFrom (uint64_t *data, uint64_t n)
       else B->data = data;
       B->S = NULL;
       B->B = NULL;
-      staticPreprocess(B);
+      B->off = B->before = 0;
+      B->shared = NULL;
+      B->ones = Unknown;
+      return B;
+    }
+
+	// converts a bit array into a bitvector of n bits, reusing the
+	// counts of the nparts static bitvectors parts[k] whose bits are 
+	// copied at offs[k] of data, in increasing order. data is pointed 
+	// to and will be freed. if no part has counts, they are computed 
+	// on the first operation that needs them
+
+staticBV staticCreateFromParts (uint64_t *data, uint64_t n, staticBV *parts,
+				uint64_t *offs, uint nparts)
+
+    { staticBV B;
+      uint k;
+      B = (staticBV)myalloc(sizeof(struct s_staticBV));
+      B->size = n;
+      if (n == 0) B->data = NULL;
+      else B->data = data;
+      B->S = NULL;
+      B->B = NULL;
+      B->off = B->before = 0;
+      B->shared = NULL;
+      for (k=0;k<nparts;k++) if (parts[k]->B != NULL) break;
+      if (k < nparts) staticPreprocess(B,parts,offs,nparts);
+      else B->ones = Unknown;
       return B;
     }
 
-	// destroys B, frees data
+	// creates a bitvector with bits [off..off+n-1] of B, n > 0, sharing
+	// them and their counts with B if off is a multiple of K*w, and 
+	// copying them otherwise. B can be destroyed before it. builds the
+	// counts of B if it does not have them
+
+staticBV staticView (staticBV B, uint64_t off, uint64_t n)
+
+    { staticBV V;
+      uint64_t *data;
+      uint64_t space;
+      if (off % (K*w))
+	 { data = (uint64_t*)myalloc(((n+w-1)/w)*sizeof(uint64_t));
+	   copyBits(data,0,B->data,off,n);
+	   if (n % w) data[n/w] &= (((uint64_t)1) << (n % w)) - 1;
+	   return staticCreateFrom(data,n);
+	 }
+      staticDirs(B);
+      if (B->shared == NULL)
+	 { space = staticSpace(B) - sizeof(struct s_staticBV)*8/w;
+	   B->shared = (staticShared)myalloc(sizeof(struct s_staticShared));
+	   B->shared->refs = 1;
+	   B->shared->space = space;
+	   B->shared->bits = B->shared->live = B->size;
+	   B->shared->users = (staticBV*)myalloc(sizeof(staticBV));
+	   B->shared->users[0] = B;
+	 }
+      V = (staticBV)myalloc(sizeof(struct s_staticBV));
+      B->shared->users = (staticBV*)myrealloc(B->shared->users,
+				(B->shared->refs+1)*sizeof(staticBV));
+      B->shared->users[B->shared->refs++] = V;
+      B->shared->live += n;
+      V->size = n;
+      V->before = B->before + rankBefore(B,off);
+      V->ones = staticRank(B,off+n-1) - (V->before - B->before);
+      V->off = B->off + off;
+      V->data = B->data + off/w;
+      V->S = B->S;
+      V->B = B->B + off/(K*w);
+      V->shared = B->shared;
+      return V;
+    }
+
+	// frees the bits and counts of B, of the whole buffer if shared
+
+static void freeData (staticBV B)
+
+    { if (B->data != NULL) myfree(B->data - B->off/w);
+      myfree(B->S); 
+      if (B->B != NULL) myfree(B->B - B->off/(K*w));
+    }
+
+	// removes B from the staticBVs that use its shared buffer, and 
+	// gives the number left
+
+static uint64_t unshare (staticBV B)
+
+    { staticShared Sh = B->shared;
+      uint64_t k;
+      for (k=0;Sh->users[k]!=B;k++);
+      Sh->users[k] = Sh->users[--Sh->refs];
+      Sh->live -= B->size;
+      return Sh->refs;
+    }
+
+	// destroys B, frees data once no other bitvector shares it
 
 void staticDestroy (staticBV B)
 
     { if (B != NULL) 
-         { myfree(B->data);
-           myfree(B->S); myfree(B->B);
+         { if (B->shared != NULL)
+	      { if (unshare(B)) { myfree(B); return; }
+		myfree(B->shared->users);
+		myfree(B->shared);
+	      }
+	   freeData(B);
       	   myfree(B);
 	 }
     }
 
+	// destroys B as staticDestroy. if the bitvectors that still share
+	// its buffer use less than MinShared of its bits, they get their own
+	// copies, whose counts are built again when needed, and the buffer
+	// is freed. returns the words they use now minus those they used
+
+int64_t staticRelease (staticBV B)
+
+    { staticShared Sh;
+      staticBV U;
+      uint64_t *data,*S;
+      uint16_t *Bl;
+      uint64_t k,nw;
+      int64_t dif;
+      if ((B == NULL) || (B->shared == NULL) || (B->shared->refs == 1)) 
+	 { staticDestroy(B); return 0; }
+      Sh = B->shared;
+      unshare(B);
+      myfree(B);
+      if (Sh->live >= MinShared * Sh->bits) return 0;
+      U = Sh->users[0]; // the buffer, to free after the copies
+      data = U->data - U->off/w;
+      S = U->S;
+      Bl = U->B - U->off/(K*w);
+      dif = - (int64_t)Sh->space;
+      for (k=0;k<Sh->refs;k++)
+	  { U = Sh->users[k];
+	    nw = (U->size+w-1)/w;
+	    U->data = (uint64_t*)memcpy(myalloc(nw*sizeof(uint64_t)),
+					U->data,nw*sizeof(uint64_t));
+	    if (U->size % w) 
+	       U->data[nw-1] &= (((uint64_t)1) << (U->size % w)) - 1;
+	    U->S = NULL;
+	    U->B = NULL;
+	    U->off = U->before = 0;
+	    U->shared = NULL;
+	    dif += staticSpace(U) - sizeof(struct s_staticBV)*8/w;
+	  }
+      myfree(data); myfree(S); myfree(Bl);
+      myfree(Sh->users);
+      myfree(Sh);
+      return dif;
+    }
+
         // writes B's data to file, which must be opened for writing 
 
 void staticSave (staticBV B, FILE *file)
 
-   { if (B->size != 0)
-        fwrite (B->data,sizeof(uint64_t),(B->size+w-1)/w,file);
+   { uint64_t last;
+     if (B->size == 0) return;
+     fwrite (B->data,sizeof(uint64_t),B->size/w,file);
+     if (B->size % w) // a shared buffer can have more bits after it
+	{ last = B->data[B->size/w] & ((((uint64_t)1) << (B->size % w)) - 1);
+	  fwrite (&last,sizeof(uint64_t),1,file);
+	}
    }
 
         // loads staticBV's data from file, which must be opened for reading
@@ -104,7 +286,9 @@ staticBV staticLoad (FILE *file, uint64_t size)
 	   }
       B->S = NULL;
       B->B = NULL;
-      staticPreprocess(B);
+      B->off = B->before = 0;
+      B->shared = NULL;
+      B->ones = Unknown;
       return B;
     }
 
@@ -115,15 +299,21 @@ extern inline uint64_t *staticBits (staticBV B)
     { return B->data;
     }
 
-	// staticBV size in w-bit words
+	// staticBV size in w-bit words, with its counts even if they are not
+	// built yet. a shared buffer is counted only in the last bitvector 
+	// that uses it
 
 uint64_t staticSpace (staticBV B)
 
     { uint64_t space = sizeof(struct s_staticBV)*8/w;
       if (B == NULL) return 0;
+      if (B->shared != NULL)
+	 return space + (B->shared->refs == 1 ? B->shared->space : 0);
       if (B->data != NULL) space += (B->size+w-1)/w;
-      if (B->B != NULL) space += ((B->size+K*w-1)/(K*w))/(w/w16);
-      if (B->S != NULL) space += (B->size+(1<<w16)-1)/(1<<w16);
+      if (B->size != 0)
+	 { space += ((B->size+K*w-1)/(K*w))/(w/w16);
+	   space += (B->size+(1<<w16)-1)/(1<<w16);
+	 }
       return space;
     }
 
@@ -138,7 +328,8 @@ extern inline uint64_t staticLength (staticBV B)
 
 extern inline uint64_t staticOnes (staticBV B)
 
-    { return B->ones;
+    { if (B->ones == Unknown) B->ones = countOnes(B);
+      return B->ones;
     }
 
 	// access B[i], assumes i is right
@@ -162,8 +353,9 @@ extern inline uint64_t staticRank (staticBV B, uint64_t i)
 
     { uint64_t b,sb;
       uint64_t rank;
+      staticDirs(B);
       sb = i/(K*w);
-      rank = B->S[i>>w16] + B->B[sb];
+      rank = B->S[(B->off+i)>>w16] + B->B[sb] - B->before;
       sb *= K;
       for (b=sb;b<i/w;b++) rank += popcount(B->data[b]);
       return rank + popcount(B->data[b] & (((uint64_t)~0) >> (w-1-(i%w))));
@@ -177,17 +369,26 @@ extern inline uint64_t staticRank0 (staticBV B, uint64_t i)
     }
 
         // computes select_1(B,j), zero-based, assumes j is right
+	// works on the whole buffer B shares, if any, over the superblocks
+	// and blocks that overlap B
 
 extern uint64_t staticSelect (staticBV B, uint64_t j)
 
-    { int64_t i,d,b;
+    { int64_t i,d,b,bl,s0;
       uint p;
       uint64_t word,s,m,n;
-      n = B->size;
+      uint64_t *data;
+      uint16_t *BB;
+      staticDirs(B);
+      data = B->data - B->off/w; // the whole buffer
+      BB = B->B - B->off/(w*K);
+      n = B->off + B->size; // end of B in the buffer
+      s0 = B->off >> w16;
       s = (n+(1<<w16)-1)/(1<<w16);
 	// interpolation: guess + exponential search
-      i = ((uint64_t)(j * (n / (float)B->ones))) >> w16;
+      i = (B->off + (uint64_t)(j * (B->size / (float)B->ones))) >> w16;
       if (i == s) i--;
+      j += B->before;
       if (B->S[i] < j)
 	 { d = 1;
 	   while ((i+d < s) && (B->S[i+d] < j))
@@ -200,9 +401,9 @@ extern uint64_t staticSelect (staticBV B, uint64_t j)
 	 }
       else
 	 { d = 1;
-	   while ((i-d >= 0) && (B->S[i-d] >= j))
+	   while ((i-d >= s0) && (B->S[i-d] >= j))
 	      { i -= d; d <<= 1; }
-	   d = max(0,i-d); // now d is the bottom of the range
+	   d = max(s0,i-d); // now d is the bottom of the range
 	   while (d+1<i)
 	      { m = (i+d)>>1;
 	        if (B->S[m] < j) d = m; else i = m;
@@ -211,42 +412,44 @@ extern uint64_t staticSelect (staticBV B, uint64_t j)
 	 }
 	// now the same inside the superblock
       j -= B->S[i]; // what remains to be found inside the superblock
-      p = i < s-1 ? B->S[i+1]-B->S[i] : B->ones-B->S[i];
+      p = i < s-1 ? B->S[i+1]-B->S[i] : B->before+B->ones-B->S[i];
       b = (i << w16) / (w*K);
+      bl = max(b,B->off/(w*K)); // first block of the superblock inside B
       s = min(b+(1<<w16)/(w*K),(n+w*K-1)/(w*K));
       i = b + ((j * (s-b)*(w*K) / (float)p)) / (w*K);
       if (i == s) i--;
-      if (B->B[i] < j)
+      if (i < bl) i = bl;
+      if (BB[i] < j)
 	 { d = 1;
-	   while ((i+d < s) && (B->B[i+d] < j))
+	   while ((i+d < s) && (BB[i+d] < j))
 	      { i += d; d <<= 1; }
 	   d = min(s,i+d); // now d is the top of the range
 	   while (i+1<d)
 	      { m = (i+d)>>1;
-	        if (B->B[m] < j) i = m; else d = m;
+	        if (BB[m] < j) i = m; else d = m;
 	      }
 	 }
       else
 	 { d = 1;
-	   while ((i-d >= b) && (B->B[i-d] >= j))
+	   while ((i-d >= bl) && (BB[i-d] >= j))
 	      { i -= d; d <<= 1; }
-	   d = max(b,i-d); // now d is the bottom of the range
+	   d = max(bl,i-d); // now d is the bottom of the range
 	   while (d+1<i)
 	      { m = (i+d)>>1;
-	        if (B->B[m] < j) d = m; else i = m;
+	        if (BB[m] < j) d = m; else i = m;
 	      }
 	   i--;
 	 }
 	// now it's confined to K blocks
-      j -= B->B[i];
+      j -= BB[i];
       i *= K;
       while ((i+1)*w < n)
-	{ p = popcount(B->data[i]);
+	{ p = popcount(data[i]);
 	  if (p >= j) break;
 	  j -= p;
 	  i++;
 	}
-      word = B->data[i];
+      word = data[i];
       i *= w;
 /* this was actually slower
      uint len = (8*sizeof(word)) >> 1;
@@ -263,24 +466,33 @@ extern uint64_t staticSelect (staticBV B, uint64_t j)
 */
       while (1)
 	{ j -= word & 1;
-	  if (j == 0) return i;
+	  if (j == 0) return i - B->off;
 	  word >>= 1;
 	  i++;
 	}
     }
 
         // computes select_0(B,j), zero-based, assumes j is right
+	// works on the whole buffer B shares, as staticSelect
 
 extern uint64_t staticSelect0 (staticBV B, uint64_t j)
 
-    { int64_t i,d,b;
+    { int64_t i,d,b,bl,s0;
       uint p;
-      uint64_t word,s,m,n,sb;
-      n = B->size;
+      uint64_t word,s,m,n;
+      uint64_t *data;
+      uint16_t *BB;
+      staticDirs(B);
+      data = B->data - B->off/w; // the whole buffer
+      BB = B->B - B->off/(w*K);
+      n = B->off + B->size; // end of B in the buffer
+      s0 = B->off >> w16;
       s = (n+(1<<w16)-1)/(1<<w16);
 	// interpolation: guess + exponential search
-      i = ((uint64_t)(j * (n / (float)(n-B->ones)))) >> w16;
+      i = (B->off + (uint64_t)(j * (B->size / (float)(B->size-B->ones)))) 
+	  >> w16;
       if (i == s) i--;
+      j += B->off - B->before;
       if (i*(1 << w16) - B->S[i] < j)
 	 { d = 1;
 	   while ((i+d < s) && ((i+d)*(1 << w16) - B->S[i+d] < j))
@@ -293,9 +505,9 @@ extern uint64_t staticSelect0 (staticBV B, uint64_t j)
 	 }
       else
 	 { d = 1;
-	   while ((i-d >= 0) && ((i-d)*(1 << w16) - B->S[i-d] >= j))
+	   while ((i-d >= s0) && ((i-d)*(1 << w16) - B->S[i-d] >= j))
 	      { i -= d; d <<= 1; }
-	   d = max(0,i-d); // now d is the bottom of the range
+	   d = max(s0,i-d); // now d is the bottom of the range
 	   while (d+1<i)
 	      { m = (i+d)>>1;
 	        if (m*(1 << w16) - B->S[m] < j) d = m; else i = m;
@@ -305,46 +517,48 @@ extern uint64_t staticSelect0 (staticBV B, uint64_t j)
 	// now the same inside the superblock
       j -= i*(1 << w16) - B->S[i]; // what remains to be found inside superblock
       p = i < s-1 ? (1<<w16)-(B->S[i+1]-B->S[i]) : 
-		    (B->size-i*(1<<w16))-(B->ones-B->S[i]);
+		    (n-i*(1<<w16))-(B->before+B->ones-B->S[i]);
       b = (i << w16) / (w*K);
+      bl = max(b,B->off/(w*K)); // first block of the superblock inside B
       s = min(b+(1<<w16)/(w*K),(n+w*K-1)/(w*K));
       i = b + ((j * (s-b)*(w*K) / (float)p)) / (w*K);
       if (i == s) i--;
-      if ((i-b)*w*K - B->B[i] < j)
+      if (i < bl) i = bl;
+      if ((i-b)*w*K - BB[i] < j)
 	 { d = 1;
-	   while ((i+d < s) && (((i-b)+d)*w*K - B->B[i+d] < j))
+	   while ((i+d < s) && (((i-b)+d)*w*K - BB[i+d] < j))
 	      { i += d; d <<= 1; }
 	   d = min(s,i+d); // now d is the top of the range
 	   while (i+1<d)
 	      { m = (i+d)>>1;
-	        if ((m-b)*w*K - B->B[m] < j) i = m; else d = m;
+	        if ((m-b)*w*K - BB[m] < j) i = m; else d = m;
 	      }
 	 }
       else
 	 { d = 1;
-	   while ((i-d >= b) && (((i-b)-d)*w*K - B->B[i-d] >= j))
+	   while ((i-d >= bl) && (((i-b)-d)*w*K - BB[i-d] >= j))
 	      { i -= d; d <<= 1; }
-	   d = max(b,i-d); // now d is the bottom of the range
+	   d = max(bl,i-d); // now d is the bottom of the range
 	   while (d+1<i)
 	      { m = (i+d)>>1;
-	        if ((m-b)*w*K - B->B[m] < j) d = m; else i = m;
+	        if ((m-b)*w*K - BB[m] < j) d = m; else i = m;
 	      }
 	   i--;
 	 }
 	// now it's confined to K blocks
-      j -= (i-b)*w*K - B->B[i];
+      j -= (i-b)*w*K - BB[i];
       i *= K;
       while ((i+1)*w < n)
-	{ p = popcount(~B->data[i]);
+	{ p = popcount(~data[i]);
 	  if (p >= j) break;
 	  j -= p;
 	  i++;
 	}
-      word = ~B->data[i];
+      word = ~data[i];
       i *= w;
       while (1)
 	{ j -= word & 1;
-	  if (j == 0) return i;
+	  if (j == 0) return i - B->off;
 	  word >>= 1;
 	  i++;
 	}
@@ -386,8 +600,9 @@ int64_t staticNext (staticBV B, uint64_t i)
 	 }
       else if (p == 1+(B->size-1)/w) return -1; // end of bitvector
 	// reduce to select
+      staticDirs(B);
       sb = p/K-1;
-      rank = B->S[(sb*K*w)>>w16] + B->B[sb];
+      rank = rankBefore(B,sb*K*w);
       if (rank == B->ones) return -1;
       return staticSelect(B,rank+1);
     }
@@ -403,7 +618,9 @@ int64_t staticNext0 (staticBV B, uint64_t i)
       p = i/w;
       word = ~B->data[p] & ((~(uint64_t)0)<<(i%w));
       if (word) // a likely case, solve faster
-         return p*w + decode[(0x03f79d71b4ca8b09 * (word & -word))>>58];
+         { b = p*w + decode[(0x03f79d71b4ca8b09 * (word & -word))>>58];
+	   return b < B->size ? b : -1; // could be a 0 beyond the end
+	 }
 	// search within block
       b = min((p/K+2)*K,1+(B->size-1)/w); // scan at least 2 blocks (a full one)
       p++;
@@ -419,8 +636,9 @@ int64_t staticNext0 (staticBV B, uint64_t i)
 	 }
       else if (p == 1+(B->size-1)/w) return -1; // end of bitvector
 	// reduce to select
+      staticDirs(B);
       sb = p/K-1;
-      rank = sb*K*w - (B->S[(sb*K*w)>>w16] + B->B[sb]);
+      rank = sb*K*w - rankBefore(B,sb*K*w);
       if (rank == B->size - B->ones) return -1;
       return staticSelect0(B,rank+1);
     }
@@ -30,21 +30,57 @@ Chile. Beauchef 851, Santiago, Chile. gnavarro@dcc.uchile.cl
 
 #include "basics.h"
 
-typedef struct s_staticBV {
+typedef struct s_staticBV *staticBV;
+
+	// a buffer of bits and counts shared by several staticBVs
+typedef struct s_staticShared {
+    uint64_t refs; // number of staticBVs using it
+    uint64_t space; // words of bits and counts
+    uint64_t bits; // bits in the buffer
+    uint64_t live; // bits of the staticBVs using it
+    staticBV *users; // the staticBVs using it, refs of them
+    } *staticShared;
+
+struct s_staticBV {
     uint64_t size; // number of bits
     uint64_t ones; // number of 1s
     uint64_t* data; // the bits
-    uint64_t *S; // superblocks
+    uint64_t *S; // superblocks, of the whole shared buffer
     uint16_t *B; // blocks
-    } *staticBV;
+    uint64_t off; // bits before data in the shared buffer, multiple of K*w
+    uint64_t before; // 1s before data in the shared buffer
+    staticShared shared; // NULL if data is not shared
+    };
 
 	// converts a bit array into a bitvector of n bits
-	// data is pointed to and will be freed 
+	// data is pointed to and will be freed. its 1s and counts are
+	// computed on the first operation that needs them
 staticBV staticCreateFrom (uint64_t *data, uint64_t n);
 
-	// destroys B, frees data 
+	// converts a bit array into a bitvector of n bits, reusing the
+	// counts of the nparts static bitvectors parts[k] whose bits are 
+	// copied at offs[k] of data, in increasing order. data is pointed 
+	// to and will be freed. if no part has counts, they are computed 
+	// on the first operation that needs them
+staticBV staticCreateFromParts (uint64_t *data, uint64_t n, staticBV *parts,
+				uint64_t *offs, uint nparts);
+
+	// creates a bitvector with bits [off..off+n-1] of B, n > 0, sharing
+	// them and their counts with B if off is a multiple of K*w, and 
+	// copying them otherwise. B can be destroyed before it. builds the
+	// counts of B if it does not have them
+staticBV staticView (staticBV B, uint64_t off, uint64_t n);
+
+	// destroys B, frees data once no other bitvector shares it
 void staticDestroy (staticBV B);
 
+	// destroys B as staticDestroy. if the bitvectors that still share
+	// its buffer use less than MinShared (in staticBV.c) of its bits, 
+	// they get their own copies, whose counts are built again when 
+	// needed, and the buffer is freed. returns the words they use now
+	// minus those they used
+int64_t staticRelease (staticBV B);
+
 	// writes B's data to file, which must be opened for writing
 void staticSave (staticBV B, FILE *file);
 
@@ -52,7 +88,9 @@ void staticSave (staticBV B, FILE *file);
 	// size is the number of bits
 staticBV staticLoad (FILE *file, uint64_t size);
 
-	// gives space of bitvector in w-bit words
+	// gives space of bitvector in w-bit words, with its counts even if
+	// they are not built yet. a shared buffer is counted only in the 
+	// last bitvector that uses it
 uint64_t staticSpace (staticBV B);
 
         // data of staticBV